@@ -322,16 +322,16 @@ inline void AABB_minmax::grow(float x, float y, float z)
 {
  // do not assume a[i] is less than b[i]
  if(x < a[0]) a[0] = x; if(b[0] < x) b[0] = x;
- if(y < a[1]) a[1] = y; if(b[1] < y) b[0] = y;
- if(z < a[2]) a[2] = z; if(b[2] < z) b[0] = z;
+ if(y < a[1]) a[1] = y; if(b[1] < y) b[1] = y;
+ if(z < a[2]) a[2] = z; if(b[2] < z) b[2] = z;
 }
 
 inline void AABB_minmax::grow(const float* v)
 {
  // do not assume a[i] is less than b[i]
  if(v[0] < a[0]) a[0] = v[0]; if(b[0] < v[0]) b[0] = v[0];
- if(v[1] < a[1]) a[1] = v[1]; if(b[1] < v[1]) b[0] = v[1];
- if(v[2] < a[2]) a[2] = v[2]; if(b[2] < v[2]) b[0] = v[2];
+ if(v[1] < a[1]) a[1] = v[1]; if(b[1] < v[1]) b[1] = v[1];
+ if(v[2] < a[2]) a[2] = v[2]; if(b[2] < v[2]) b[2] = v[2];
 }
 
 inline void AABB_minmax::grow(const AABB_minmax& other)
@@ -383,6 +383,45 @@ inline float surface_area(const AABB_minmax& aabb)
  return 2.0f*(dx*dy + dx*dz + dy*dz);
 }
 
+// slab tests are made conservative in two ways, so that segments which graze an edge or corner of
+// a box are never rejected when the triangle test would report a hit:
+// exit distances are scaled up to cover rounding in (b - O)*inv_V (a few ulps of the distance)
+// boxes are padded by a few ulps of the largest coordinate of the segment and the box, since the
+// triangle test accepts hits that far outside a triangle (where a segment component is small,
+// this is far more than a few ulps of the distance)
+const float AABB_SLAB_ROBUST = 1.0f + 2.0f*3.0f*std::numeric_limits<float>::epsilon();
+const float AABB_SLAB_PADDING = 16.0f*std::numeric_limits<float>::epsilon();
+
+// padding of slab tests of a segment against boxes within bounds (see segment_AABB_test)
+inline float segment_AABB_padding(const AABB_minmax& bounds, const float* O, const float* V)
+{
+ float m = 0.0f;
+ for(int i = 0; i < 3; i++) {
+     m = std::max(m, std::max(std::abs(bounds.a[i]), std::abs(bounds.b[i])));
+     m = std::max(m, std::max(std::abs(O[i]), std::abs(O[i] + V[i])));
+    }
+ return AABB_SLAB_PADDING*m;
+}
+
+// segment-AABB slab test
+// O is the segment start, inv_V is the reciprocal of the segment vector, and the segment is
+// tested over [0, t_max] so that boxes beyond the closest hit found so far are rejected
+// pad is from segment_AABB_padding
+inline bool segment_AABB_test(const AABB_minmax& aabb, const float* O, const float* inv_V, float t_max, float pad)
+{
+ float t_min = 0.0f;
+ for(int i = 0; i < 3; i++) {
+     float t1 = (aabb.a[i] - pad - O[i])*inv_V[i];
+     float t2 = (aabb.b[i] + pad - O[i])*inv_V[i];
+     if(t2 < t1) std::swap(t1, t2);
+     if(t_min < t1) t_min = t1;
+     t2 *= AABB_SLAB_ROBUST;
+     if(t2 < t_max) t_max = t2;
+     if(t_max < t_min) return false;
+    }
+ return true;
+}
+
 inline float volume(const AABB_minmax& aabb)
 {
  float dx = aabb.dx();
@@ -0,0 +1,325 @@
+#ifndef __CS489_AFFINE3_H
+#define __CS489_AFFINE3_H
+
+#include "math.h"
+#include "vector3.h"
+#include "matrix4.h"
+
+// affine transform stored as the top three rows of a row-major matrix4D (translation in m[3],
+// m[7], m[11]); the bottom row is always 0, 0, 0, 1, so it is not stored (48 bytes instead of 64),
+// products skip the terms that multiply it, and the inverse only needs the upper 3x3
+
+#pragma region AFFINE3D_CLASS_DEFINITIONS
+
+typedef struct _c_saffine3D { real32 m[12]; } c_saffine3D;
+class affine3D : public c_saffine3D {
+ public :
+  typedef real32 value_type;
+  typedef real32 array_type[12];
+ public :
+  affine3D();
+  explicit affine3D(const real32* m);
+  explicit affine3D(const matrix4D& other);
+  affine3D(const affine3D& other);
+ public :
+  real32* data(void) { return &(this->m[0]); }
+  const real32* data(void)const { return &(this->m[0]); }
+  array_type& get(void) { return this->m; }
+  const array_type& get(void)const { return this->m; }
+ public :
+  real32 determinant(void)const;
+  real32 invert(void);
+ public :
+  void load(const real32* m);
+  void load_identity(void);
+  void load_scaling(real32 x, real32 y, real32 z);
+  void load_translation(real32 x, real32 y, real32 z);
+  void load_quaternion(const real32* q);
+  void load_transform(const real32* S, const real32* Q, const real32* T);
+ public :
+  explicit operator matrix4D(void)const;
+ public :
+  const real32& operator [](size_t index)const;
+  real32& operator [](size_t index);
+ public :
+  affine3D& operator =(const affine3D& other);
+  affine3D& operator *=(const affine3D& other);
+};
+
+#pragma endregion AFFINE3D_CLASS_DEFINITIONS
+
+#pragma region AFFINE3D_ARRAY_FUNCTIONS
+
+inline void affine3D_copy(real32* X, const real32* A)
+{
+ X[0x0] = A[0x0]; X[0x1] = A[0x1]; X[0x2] = A[0x2]; X[0x3] = A[0x3];
+ X[0x4] = A[0x4]; X[0x5] = A[0x5]; X[0x6] = A[0x6]; X[0x7] = A[0x7];
+ X[0x8] = A[0x8]; X[0x9] = A[0x9]; X[0xA] = A[0xA]; X[0xB] = A[0xB];
+}
+
+inline void affine3D_lerp(real32* X, const real32* A, const real32* B, real32 t)
+{
+ // X = A + t*(B - A) (safe to call lerp(X, X, B, t))
+ __m128 s = _mm_set1_ps(t);
+ __m128 a0 = _mm_loadu_ps(&A[0x0]);
+ __m128 a1 = _mm_loadu_ps(&A[0x4]);
+ __m128 a2 = _mm_loadu_ps(&A[0x8]);
+ _mm_storeu_ps(&X[0x0], _mm_add_ps(a0, _mm_mul_ps(s, _mm_sub_ps(_mm_loadu_ps(&B[0x0]), a0))));
+ _mm_storeu_ps(&X[0x4], _mm_add_ps(a1, _mm_mul_ps(s, _mm_sub_ps(_mm_loadu_ps(&B[0x4]), a1))));
+ _mm_storeu_ps(&X[0x8], _mm_add_ps(a2, _mm_mul_ps(s, _mm_sub_ps(_mm_loadu_ps(&B[0x8]), a2))));
+}
+
+inline void affine3D_mul(real32* X, const real32* A, const real32* B)
+{
+ // row i of X = A[i][0]*B[0] + A[i][1]*B[1] + A[i][2]*B[2] + (0, 0, 0, A[i][3]), the same sums as
+ // matrix4D_mul without the terms of the bottom row (safe to call mul(X, X, B))
+ __m128 b0 = _mm_loadu_ps(&B[0x0]);
+ __m128 b1 = _mm_loadu_ps(&B[0x4]);
+ __m128 b2 = _mm_loadu_ps(&B[0x8]);
+ __m128 x0 = _mm_mul_ps(_mm_set1_ps(A[0x0]), b0);
+ __m128 x1 = _mm_mul_ps(_mm_set1_ps(A[0x4]), b0);
+ __m128 x2 = _mm_mul_ps(_mm_set1_ps(A[0x8]), b0);
+ x0 = _mm_add_ps(x0, _mm_mul_ps(_mm_set1_ps(A[0x1]), b1));
+ x1 = _mm_add_ps(x1, _mm_mul_ps(_mm_set1_ps(A[0x5]), b1));
+ x2 = _mm_add_ps(x2, _mm_mul_ps(_mm_set1_ps(A[0x9]), b1));
+ x0 = _mm_add_ps(x0, _mm_mul_ps(_mm_set1_ps(A[0x2]), b2));
+ x1 = _mm_add_ps(x1, _mm_mul_ps(_mm_set1_ps(A[0x6]), b2));
+ x2 = _mm_add_ps(x2, _mm_mul_ps(_mm_set1_ps(A[0xA]), b2));
+ x0 = _mm_add_ps(x0, _mm_setr_ps(0.0f, 0.0f, 0.0f, A[0x3]));
+ x1 = _mm_add_ps(x1, _mm_setr_ps(0.0f, 0.0f, 0.0f, A[0x7]));
+ x2 = _mm_add_ps(x2, _mm_setr_ps(0.0f, 0.0f, 0.0f, A[0xB]));
+ _mm_storeu_ps(&X[0x0], x0);
+ _mm_storeu_ps(&X[0x4], x1);
+ _mm_storeu_ps(&X[0x8], x2);
+}
+
+inline real32 affine3D_inverse(real32* X, const real32* A)
+{
+ // cofactors of the upper 3x3
+ real32 C[9] = {
+  A[0x5]*A[0xA] - A[0x6]*A[0x9],
+  A[0x6]*A[0x8] - A[0x4]*A[0xA],
+  A[0x4]*A[0x9] - A[0x5]*A[0x8],
+  A[0x2]*A[0x9] - A[0x1]*A[0xA],
+  A[0x0]*A[0xA] - A[0x2]*A[0x8],
+  A[0x1]*A[0x8] - A[0x0]*A[0x9],
+  A[0x1]*A[0x6] - A[0x2]*A[0x5],
+  A[0x2]*A[0x4] - A[0x0]*A[0x6],
+  A[0x0]*A[0x5] - A[0x1]*A[0x4]
+ };
+
+ // X is left unchanged if the determinant is zero
+ real32 det = A[0x0]*C[0] + A[0x1]*C[1] + A[0x2]*C[2];
+ if(is_zero(det)) return det;
+
+ // inv(M) = inv(R) and -inv(R)*t, where inv(R) = inv(det(R)) * transpose(C)
+ real32 invdet = inv(det);
+ real32 T[12];
+ T[0x0] = C[0]*invdet;
+ T[0x1] = C[3]*invdet;
+ T[0x2] = C[6]*invdet;
+ T[0x4] = C[1]*invdet;
+ T[0x5] = C[4]*invdet;
+ T[0x6] = C[7]*invdet;
+ T[0x8] = C[2]*invdet;
+ T[0x9] = C[5]*invdet;
+ T[0xA] = C[8]*invdet;
+ T[0x3] = -(T[0x0]*A[0x3] + T[0x1]*A[0x7] + T[0x2]*A[0xB]);
+ T[0x7] = -(T[0x4]*A[0x3] + T[0x5]*A[0x7] + T[0x6]*A[0xB]);
+ T[0xB] = -(T[0x8]*A[0x3] + T[0x9]*A[0x7] + T[0xA]*A[0xB]);
+ affine3D_copy(X, T);
+ return det;
+}
+
+inline void affine3D_transform_point(real32* X, const real32* A, const real32* P)
+{
+ // safe to call with X = P
+ real32 T[3] = {
+  A[0x0]*P[0] + A[0x1]*P[1] + A[0x2]*P[2] + A[0x3],
+  A[0x4]*P[0] + A[0x5]*P[1] + A[0x6]*P[2] + A[0x7],
+  A[0x8]*P[0] + A[0x9]*P[1] + A[0xA]*P[2] + A[0xB]
+ };
+ X[0] = T[0];
+ X[1] = T[1];
+ X[2] = T[2];
+}
+
+inline void affine3D_transform_vector(real32* X, const real32* A, const real32* V)
+{
+ // rotation and scale only (safe to call with X = V)
+ real32 T[3] = {
+  A[0x0]*V[0] + A[0x1]*V[1] + A[0x2]*V[2],
+  A[0x4]*V[0] + A[0x5]*V[1] + A[0x6]*V[2],
+  A[0x8]*V[0] + A[0x9]*V[1] + A[0xA]*V[2]
+ };
+ X[0] = T[0];
+ X[1] = T[1];
+ X[2] = T[2];
+}
+
+inline void affine3D_transform_normal(real32* X, const real32* inv_A, const real32* N)
+{
+ // normals transform by the inverse transpose of A, so this takes the inverse of A and multiplies
+ // by its transpose (safe to call with X = N)
+ real32 T[3] = {
+  inv_A[0x0]*N[0] + inv_A[0x4]*N[1] + inv_A[0x8]*N[2],
+  inv_A[0x1]*N[0] + inv_A[0x5]*N[1] + inv_A[0x9]*N[2],
+  inv_A[0x2]*N[0] + inv_A[0x6]*N[1] + inv_A[0xA]*N[2]
+ };
+ X[0] = T[0];
+ X[1] = T[1];
+ X[2] = T[2];
+}
+
+#pragma endregion AFFINE3D_ARRAY_FUNCTIONS
+
+#pragma region AFFINE3D_CLASS_FUNCTIONS
+
+inline affine3D::affine3D()
+{
+}
+
+inline affine3D::affine3D(const real32* m)
+{
+ affine3D_copy(this->m, m);
+}
+
+inline affine3D::affine3D(const matrix4D& other)
+{
+ // the bottom row of other is dropped (it must be 0, 0, 0, 1)
+ affine3D_copy(this->m, other.m);
+}
+
+inline affine3D::affine3D(const affine3D& other)
+{
+ affine3D_copy(this->m, other.m);
+}
+
+inline real32 affine3D::determinant(void)const
+{
+ return this->m[0x0]*(this->m[0x5]*this->m[0xA] - this->m[0x6]*this->m[0x9]) +
+        this->m[0x1]*(this->m[0x6]*this->m[0x8] - this->m[0x4]*this->m[0xA]) +
+        this->m[0x2]*(this->m[0x4]*this->m[0x9] - this->m[0x5]*this->m[0x8]);
+}
+
+inline real32 affine3D::invert(void)
+{
+ // inverse is only kept if the determinant is not zero
+ return affine3D_inverse(this->m, this->m);
+}
+
+inline void affine3D::load(const real32* m)
+{
+ affine3D_copy(this->m, m);
+}
+
+inline void affine3D::load_identity(void)
+{
+ this->m[0x0] = 1.0f; this->m[0x1] = 0.0f; this->m[0x2] = 0.0f; this->m[0x3] = 0.0f;
+ this->m[0x4] = 0.0f; this->m[0x5] = 1.0f; this->m[0x6] = 0.0f; this->m[0x7] = 0.0f;
+ this->m[0x8] = 0.0f; this->m[0x9] = 0.0f; this->m[0xA] = 1.0f; this->m[0xB] = 0.0f;
+}
+
+inline void affine3D::load_scaling(real32 x, real32 y, real32 z)
+{
+ this->m[0x0] =    x; this->m[0x1] = 0.0f; this->m[0x2] = 0.0f; this->m[0x3] = 0.0f;
+ this->m[0x4] = 0.0f; this->m[0x5] =    y; this->m[0x6] = 0.0f; this->m[0x7] = 0.0f;
+ this->m[0x8] = 0.0f; this->m[0x9] = 0.0f; this->m[0xA] =    z; this->m[0xB] = 0.0f;
+}
+
+inline void affine3D::load_translation(real32 x, real32 y, real32 z)
+{
+ this->m[0x0] = 1.0f; this->m[0x1] = 0.0f; this->m[0x2] = 0.0f; this->m[0x3] = x;
+ this->m[0x4] = 0.0f; this->m[0x5] = 1.0f; this->m[0x6] = 0.0f; this->m[0x7] = y;
+ this->m[0x8] = 0.0f; this->m[0x9] = 0.0f; this->m[0xA] = 1.0f; this->m[0xB] = z;
+}
+
+inline void affine3D::load_quaternion(const real32* q)
+{
+ // same as matrix4D::load_quaternion (q = w, x, y, z)
+ load_transform(nullptr, q, nullptr);
+}
+
+inline void affine3D::load_transform(const real32* S, const real32* Q, const real32* T)
+{
+ // X = translate(T) * scale(S) * rotate(Q), the same matrix as computing S*R with matrix4D and
+ // adding T to the translation (S and T can be null for no scaling and no translation)
+ real32 b2 = Q[1] + Q[1];
+ real32 c2 = Q[2] + Q[2];
+ real32 d2 = Q[3] + Q[3];
+ real32 ab2 = Q[0] * b2;
+ real32 ac2 = Q[0] * c2;
+ real32 ad2 = Q[0] * d2;
+ real32 bb2 = Q[1] * b2;
+ real32 bc2 = Q[1] * c2;
+ real32 bd2 = Q[1] * d2;
+ real32 cc2 = Q[2] * c2;
+ real32 cd2 = Q[2] * d2;
+ real32 dd2 = Q[3] * d2;
+ real32 R[9] = {
+  1.0f - cc2 - dd2, bc2 - ad2, bd2 + ac2,
+  bc2 + ad2, 1.0f - bb2 - dd2, cd2 - ab2,
+  bd2 - ac2, cd2 + ab2, 1.0f - bb2 - cc2
+ };
+ if(S) {
+    for(int i = 0; i < 9; i++) R[i] *= S[i/3];
+   }
+ this->m[0x0] = R[0]; this->m[0x1] = R[1]; this->m[0x2] = R[2]; this->m[0x3] = (T ? T[0] : 0.0f);
+ this->m[0x4] = R[3]; this->m[0x5] = R[4]; this->m[0x6] = R[5]; this->m[0x7] = (T ? T[1] : 0.0f);
+ this->m[0x8] = R[6]; this->m[0x9] = R[7]; this->m[0xA] = R[8]; this->m[0xB] = (T ? T[2] : 0.0f);
+}
+
+inline affine3D::operator matrix4D(void)const
+{
+ matrix4D r;
+ r.m[0x0] = this->m[0x0]; r.m[0x1] = this->m[0x1]; r.m[0x2] = this->m[0x2]; r.m[0x3] = this->m[0x3];
+ r.m[0x4] = this->m[0x4]; r.m[0x5] = this->m[0x5]; r.m[0x6] = this->m[0x6]; r.m[0x7] = this->m[0x7];
+ r.m[0x8] = this->m[0x8]; r.m[0x9] = this->m[0x9]; r.m[0xA] = this->m[0xA]; r.m[0xB] = this->m[0xB];
+ r.m[0xC] = 0.0f; r.m[0xD] = 0.0f; r.m[0xE] = 0.0f; r.m[0xF] = 1.0f;
+ return r;
+}
+
+inline const real32& affine3D::operator [](size_t index)const
+{
+ return this->m[index];
+}
+
+inline real32& affine3D::operator [](size_t index)
+{
+ return this->m[index];
+}
+
+inline affine3D& affine3D::operator =(const affine3D& other)
+{
+ if(this == &other) return *this;
+ affine3D_copy(this->m, other.m);
+ return *this;
+}
+
+inline affine3D& affine3D::operator *=(const affine3D& other)
+{
+ affine3D_mul(this->m, this->m, other.m);
+ return *this;
+}
+
+#pragma endregion AFFINE3D_CLASS_FUNCTIONS
+
+#pragma region AFFINE3D_OPERATORS
+
+inline affine3D operator *(const affine3D& lhs, const affine3D& rhs)
+{
+ affine3D r;
+ affine3D_mul(r.m, lhs.m, rhs.m);
+ return r;
+}
+
+inline vector3D operator *(const affine3D& lhs, const vector3D& rhs)
+{
+ vector3D r;
+ affine3D_transform_point(r.v, lhs.m, rhs.v);
+ return r;
+}
+
+#pragma endregion AFFINE3D_OPERATORS
+
+#endif
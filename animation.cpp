@@ -0,0 +1,942 @@
+#include "stdafx.h"
+#include "animation.h"
+
+/** ConstructAnimationData
+ *  -# For an animation, this function collects all the keyframes and orders them. For example, if
+ *     one bone has keyframes at {0, 10}, and another bone has keyframes at {10, 20}, the keyframes
+ *     are collected into one collective and ordered set {0, 10, 20}.
+ *  -# Then for each bone that has a keyframe defined already, those keyframes are assigned to this
+ *     new collective set. For example:
+ *     For b1: {0, 10, 20} = {set, set, unset}
+ *     For b2: {0, 10, 20} = {unset, set, set}
+ *  -# Once the known keyframes are set, the missing keyframes must be set. In these cases, we may
+ *     or may not have to interpolate between known keyframes to compute keyframes for bones that
+ *     did not originally have keyframes. For example:
+ *     b1 has unset keyframe at 20. Since there is a keyframe before 20 but none after, we simply
+ *     just reuse the keyframe at 10.
+ *     For b1: {0, 10, 20} = {kf1, kf2, kf2} (reuse kf2 to set missing keyframe at 20)
+ *     For b2: {0, 10, 20} = {kf1, kf1, kf2} (reuse kf1 to set missing keyframe at 0}
+ *  -# The transforms that are computed are defined as follows:
+ *     - animation.animdata[key index].slist[bone index] (Scale Transform)
+ *     - animation.animdata[key index].tlist[bone index] (Translation Transform)
+ *     - animation.animdata[key index].qlist[bone index] (Quaternion Transform)
+ *  -# Once done, every bone will have a keyframe for all keyframes.
+ *  -# Finally, the bone matrix of every bone at every keyframe (m_abs times the transform made
+ *     from scale, quaternion, and translation) is baked into mlist, so that keyframe hits do not
+ *     have to rebuild it on every update. Bones that do not move between a keyframe and the next
+ *     keyframe are marked as held, so that the baked matrix is used for the whole interval.
+ */
+void ConstructAnimationData(MeshAnimation& animation, const std::vector<MeshBone>& bones)
+{
+ // 
+ size_t n_bones = bones.size();
+ size_t n_keys = animation.keymap.size();
+ animation.animdata.reset(new MeshAnimationData[n_keys]);
+ animation.compressed = MeshCompressedAnimation();
+
+ // compute frame times
+ // remember, minframe does not have to start at zero!
+ // you have to subtract minframe from frame to get zero offset
+ for(auto iter = animation.keymap.begin(); iter != animation.keymap.end(); iter++) {
+     uint32 frame = iter->first;
+     size_t index = iter->second;
+     animation.animdata[index].frame = frame;
+     animation.animdata[index].delta = SECONDS_PER_FRAME*(frame - animation.minframe);
+    }
+
+ // create keyframe data
+ for(size_t i = 0; i < n_keys; i++)
+    {
+     // create bone data
+     animation.animdata[i].keyed.reset(new bool[n_bones]);
+     animation.animdata[i].held.reset(new bool[n_bones]);
+     for(size_t j = 0; j < n_bones; j++) animation.animdata[i].keyed[j] = false;
+     for(size_t j = 0; j < n_bones; j++) animation.animdata[i].held[j] = false;
+
+     // create bone transform data
+     animation.animdata[i].slist.reset(new std::array<real32, 3>[n_bones]);
+     animation.animdata[i].tlist.reset(new std::array<real32, 3>[n_bones]);
+     animation.animdata[i].qlist.reset(new std::array<real32, 4>[n_bones]);
+     animation.animdata[i].mlist.reset(new affine3D[n_bones]);
+    }
+
+ // for each bone that IS keyframed
+ for(size_t i = 0; i < animation.bonelist.size(); i++)
+    {
+     // for each keyframe
+     for(size_t j = 0; j < animation.bonelist[i].keyframes.size(); j++)
+        {
+         // find keyframe index from frame
+         auto iter = animation.keymap.find(animation.bonelist[i].keyframes[j].frame);
+         if(iter == animation.keymap.end()) continue;
+
+         size_t b_index = animation.bonelist[i].bone_index;
+         size_t k_index = iter->second;
+         auto& kf = animation.bonelist[i].keyframes[j];
+
+         // mark as keyed
+         animation.animdata[k_index].keyed[b_index] = true;
+
+         // set scale
+         animation.animdata[k_index].slist[b_index][0] = kf.scale[0];
+         animation.animdata[k_index].slist[b_index][1] = kf.scale[1];
+         animation.animdata[k_index].slist[b_index][2] = kf.scale[2];
+
+         // set translation
+         animation.animdata[k_index].tlist[b_index][0] = kf.translation[0];
+         animation.animdata[k_index].tlist[b_index][1] = kf.translation[1];
+         animation.animdata[k_index].tlist[b_index][2] = kf.translation[2];
+
+         // set quaternion
+         animation.animdata[k_index].qlist[b_index][0] = kf.quaternion[0];
+         animation.animdata[k_index].qlist[b_index][1] = kf.quaternion[1];
+         animation.animdata[k_index].qlist[b_index][2] = kf.quaternion[2];
+         animation.animdata[k_index].qlist[b_index][3] = kf.quaternion[3];
+        }
+    }
+
+ // for each bone that IS NOT keyframed
+ for(size_t i = 0; i < n_keys; i++)
+    {
+     for(size_t j = 0; j < n_bones; j++)
+        {
+         if(animation.animdata[i].keyed[j]) continue;
+
+         // look for previous key (for this bone j)
+         size_t prev_key = 0xFFFFFFFFul;
+         for(size_t k = 0; k < i; k++) {
+             size_t k_rev = (i - 1) - k;
+             if(animation.animdata[k_rev].keyed[j]) {
+                prev_key = k_rev;
+                break;
+               }
+            }
+
+         // look for following key (for this bone j)
+         size_t next_key = 0xFFFFFFFFul;
+         for(size_t k = i + 1; k < n_keys; k++) {
+             if(animation.animdata[k].keyed[j]) {
+                next_key = k;
+                break;
+               }
+            }
+
+         // no previous key
+         if(prev_key == 0xFFFFFFFFul) {
+            animation.animdata[i].keyed[j] = true;
+            animation.animdata[i].slist[j][0] = 1.0f;
+            animation.animdata[i].slist[j][1] = 1.0f;
+            animation.animdata[i].slist[j][2] = 1.0f;
+            animation.animdata[i].tlist[j][0] = 0.0f;
+            animation.animdata[i].tlist[j][1] = 0.0f;
+            animation.animdata[i].tlist[j][2] = 0.0f;
+            animation.animdata[i].qlist[j][0] = 1.0f;
+            animation.animdata[i].qlist[j][1] = 0.0f;
+            animation.animdata[i].qlist[j][2] = 0.0f;
+            animation.animdata[i].qlist[j][3] = 0.0f;
+           }
+         // no next key
+         else if(next_key == 0xFFFFFFFFul) {
+            animation.animdata[i].keyed[j] = true;
+            animation.animdata[i].slist[j][0] = animation.animdata[prev_key].slist[j][0];
+            animation.animdata[i].slist[j][1] = animation.animdata[prev_key].slist[j][1];
+            animation.animdata[i].slist[j][2] = animation.animdata[prev_key].slist[j][2];
+            animation.animdata[i].tlist[j][0] = animation.animdata[prev_key].tlist[j][0];
+            animation.animdata[i].tlist[j][1] = animation.animdata[prev_key].tlist[j][1];
+            animation.animdata[i].tlist[j][2] = animation.animdata[prev_key].tlist[j][2];
+            animation.animdata[i].qlist[j][0] = animation.animdata[prev_key].qlist[j][0];
+            animation.animdata[i].qlist[j][1] = animation.animdata[prev_key].qlist[j][1];
+            animation.animdata[i].qlist[j][2] = animation.animdata[prev_key].qlist[j][2];
+            animation.animdata[i].qlist[j][3] = animation.animdata[prev_key].qlist[j][3];
+           }
+         // prev and next keys
+         else {
+            animation.animdata[i].keyed[j] = true;
+            real32 ratio = (animation.animdata[i].delta - animation.animdata[prev_key].delta)/(animation.animdata[next_key].delta - animation.animdata[prev_key].delta);
+            lerp3D(animation.animdata[i].slist[j].data(), animation.animdata[prev_key].slist[j].data(), animation.animdata[next_key].slist[j].data(), ratio);
+            lerp3D(animation.animdata[i].tlist[j].data(), animation.animdata[prev_key].tlist[j].data(), animation.animdata[next_key].tlist[j].data(), ratio);
+            qslerp(animation.animdata[i].qlist[j].data(), animation.animdata[prev_key].qlist[j].data(), animation.animdata[next_key].qlist[j].data(), ratio);
+           }
+        }
+    }
+ // bake bone matrices
+ for(size_t i = 0; i < n_keys; i++)
+    {
+     auto& kf = animation.animdata[i];
+     for(size_t j = 0; j < n_bones; j++)
+        {
+         // m_abs times keyed transform
+         affine3D m;
+         m.load_transform(&kf.slist[j][0], &kf.qlist[j][0], &kf.tlist[j][0]);
+         kf.mlist[j] = bones[j].m_abs * m;
+
+         // held if the next key is the same (interpolation scales the translation, so only
+         // bones without scaling give the same matrix as the baked one)
+         if((i + 1) < n_keys) {
+            auto& next = animation.animdata[i + 1];
+            bool unscaled = (kf.slist[j][0] == 1.0f && kf.slist[j][1] == 1.0f && kf.slist[j][2] == 1.0f);
+            kf.held[j] = unscaled && (kf.slist[j] == next.slist[j]) && (kf.tlist[j] == next.tlist[j]) && (kf.qlist[j] == next.qlist[j]);
+           }
+        }
+    }
+}
+
+/** FindAnimationKey
+ *  Returns the index k of the last keyframe such that animdata[k].delta <= time (or 0 if time is
+ *  before the first keyframe). Instances usually move forward through time a little bit at a
+ *  time, so the keyframe interval [cursor, cursor + 1] from the last update and the interval that
+ *  follows it are checked first. Otherwise (such as when a looping animation wraps around), the
+ *  keyframe times are binary searched.
+ */
+uint32 FindAnimationKey(const MeshAnimation& animation, real32 time, uint32 cursor)
+{
+ // check cursor interval and the interval that follows it
+ uint32 n_keys = static_cast<uint32>(animation.keymap.size());
+ if(!n_keys) return 0;
+ const MeshAnimationData* animdata = animation.animdata.get();
+ for(uint32 k = cursor; k < n_keys && k < cursor + 2; k++) {
+     if(time < animdata[k].delta) break;
+     if((k + 1) == n_keys || time < animdata[k + 1].delta) return k;
+    }
+
+ // binary search for first keyframe after time
+ auto iter = std::upper_bound(animdata, animdata + n_keys, time, [](real32 t, const MeshAnimationData& kf) { return t < kf.delta; });
+ return (iter == animdata ? 0 : static_cast<uint32>((iter - animdata) - 1));
+}
+
+// smallest three quaternions: the largest component (made positive, since q and -q are the same
+// rotation) is dropped and rebuilt from the other three, which are within +/- sqrt(1/2) and are
+// stored in 15 bits each (zero is exact); the index of the dropped component is stored in the
+// top bits of the first two words, and the top bit of the last word is set if nlerp can be used
+// instead of slerp between the key and the next key
+static const real32 SMALLEST_THREE_SCALE = 16383.0f*1.41421356f;
+
+static void EncodeQuaternion(uint16* x, const real32* q)
+{
+ uint32 index = 0;
+ for(uint32 i = 1; i < 4; i++) if(std::abs(q[index]) < std::abs(q[i])) index = i;
+ real32 sign = (q[index] < 0.0f ? -1.0f : 1.0f);
+ for(uint32 i = 0, j = 0; i < 4; i++) {
+     if(i == index) continue;
+     real32 v = std::round(sign*q[i]*SMALLEST_THREE_SCALE) + 16383.0f;
+     x[j++] = static_cast<uint16>(std::min(std::max(v, 0.0f), 32766.0f));
+    }
+ x[0] |= static_cast<uint16>((index & 1) << 15);
+ x[1] |= static_cast<uint16>((index >> 1) << 15);
+}
+
+static void DecodeQuaternion(real32* q, const uint16* x)
+{
+ uint32 index = (x[0] >> 15) | ((x[1] >> 15) << 1);
+ real32 a = (static_cast<real32>(x[0] & 0x7FFF) - 16383.0f)/SMALLEST_THREE_SCALE;
+ real32 b = (static_cast<real32>(x[1] & 0x7FFF) - 16383.0f)/SMALLEST_THREE_SCALE;
+ real32 c = (static_cast<real32>(x[2] & 0x7FFF) - 16383.0f)/SMALLEST_THREE_SCALE;
+ real32 d = std::sqrt(std::max(1.0f - a*a - b*b - c*c, 0.0f));
+ switch(index) {
+   case(0) : q[0] = d; q[1] = a; q[2] = b; q[3] = c; break;
+   case(1) : q[0] = a; q[1] = d; q[2] = b; q[3] = c; break;
+   case(2) : q[0] = a; q[1] = b; q[2] = d; q[3] = c; break;
+   default : q[0] = a; q[1] = b; q[2] = c; q[3] = d; break;
+  }
+}
+
+// normalized linear interpolation along the shortest arc, with t corrected by a polynomial fit so
+// that it moves at close to the constant speed of slerp, which is much cheaper than slerp (close
+// enough keys use it instead of slerp, see CompressRotationTrack)
+static void NlerpQuaternion(real32* q, const real32* A, const real32* B, real32 t)
+{
+ real32 dot = A[0]*B[0] + A[1]*B[1] + A[2]*B[2] + A[3]*B[3];
+ real32 d = std::abs(dot);
+ real32 a = 1.0904f + d*(-3.2452f + d*(3.55645f - d*1.43519f));
+ real32 b = 0.848013f + d*(-1.06021f + d*0.215638f);
+ real32 k = a*(t - 0.5f)*(t - 0.5f) + b;
+ real32 u = t + t*(t - 0.5f)*(t - 1.0f)*k;
+ real32 s = 1.0f - u;
+ if(dot < 0.0f) u = -u;
+ q[0] = s*A[0] + u*B[0];
+ q[1] = s*A[1] + u*B[1];
+ q[2] = s*A[2] + u*B[2];
+ q[3] = s*A[3] + u*B[3];
+ qnormalize(q);
+}
+
+// number of set bits
+static inline uint32 CountBits(uint64 x)
+{
+ x = x - ((x >> 1) & 0x5555555555555555ull);
+ x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+ x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+ return static_cast<uint32>((x*0x0101010101010101ull) >> 56);
+}
+
+// index of the key of a compressed track at or before dense keyframe index cursor, and the ratio
+// between that key and the next one at time (0 if time is at or before the key)
+// the key is the number of kept keys up to cursor, counted from the kept bits of the track
+static uint32 FindCompressedKey(const MeshAnimation& animation, const MeshCompressedTrack& track, uint32 cursor, real32 time, real32& ratio)
+{
+ const MeshCompressedAnimation& data = animation.compressed;
+ uint32 word = track.words + (cursor >> 6);
+ uint64 mask = (2ull << (cursor & 63)) - 1;
+ uint32 index = data.ranks[word] + CountBits(data.kept[word] & mask) - 1;
+ ratio = 0.0f;
+ if(index + 1 < track.n_keys) {
+    const uint16* keys = &data.keys[track.first];
+    real32 t1 = animation.animdata[keys[index]].delta;
+    real32 t2 = animation.animdata[keys[index + 1]].delta;
+    if(t1 < time) ratio = (time - t1)/(t2 - t1);
+   }
+ return track.first + index;
+}
+
+static void SampleCompressedRotation(real32* q, const MeshAnimation& animation, const MeshCompressedTrack& track, uint32 cursor, real32 time)
+{
+ const auto& values = animation.compressed.values;
+ if(track.n_keys == 1) {
+    DecodeQuaternion(q, values[track.first].data());
+    return;
+   }
+ real32 ratio;
+ uint32 index = FindCompressedKey(animation, track, cursor, time, ratio);
+ if(ratio == 0.0f) {
+    DecodeQuaternion(q, values[index].data());
+    return;
+   }
+ real32 A[4], B[4];
+ DecodeQuaternion(A, values[index].data());
+ DecodeQuaternion(B, values[index + 1].data());
+ if(values[index][2] & 0x8000) NlerpQuaternion(q, A, B, ratio);
+ else {
+    qslerp(q, A, B, ratio);
+    qnormalize(q);
+   }
+}
+
+static void SampleCompressedVector(real32* v, const MeshAnimation& animation, const MeshCompressedTrack& track, uint32 cursor, real32 time)
+{
+ const auto& values = animation.compressed.values;
+ if(track.n_keys == 1) {
+    v[0] = track.base[0];
+    v[1] = track.base[1];
+    v[2] = track.base[2];
+    return;
+   }
+ real32 ratio;
+ uint32 index = FindCompressedKey(animation, track, cursor, time, ratio);
+ const uint16* A = values[index].data();
+ const uint16* B = (ratio == 0.0f ? A : values[index + 1].data());
+ for(uint32 i = 0; i < 3; i++) {
+     real32 a = static_cast<real32>(A[i]);
+     real32 b = static_cast<real32>(B[i]);
+     v[i] = track.base[i] + track.step[i]*(a + ratio*(b - a));
+    }
+}
+
+// bone matrices of a compressed animation (see ComputeAnimationBones)
+static void ComputeCompressedBones(const std::vector<MeshBone>& bones, const MeshAnimation& animation, real32 time, uint32& cursor, affine3D* palette)
+{
+ // before first keyframe, after last keyframe, or stepped animation
+ uint32 n_keys = static_cast<uint32>(animation.keymap.size());
+ const MeshAnimationData* animdata = animation.animdata.get();
+ if(time <= animdata[0].delta) {
+    cursor = 0;
+    time = animdata[0].delta;
+   }
+ else if(time >= animdata[n_keys - 1].delta) {
+    cursor = n_keys - 1;
+    time = animdata[cursor].delta;
+   }
+ else {
+    cursor = FindAnimationKey(animation, time, cursor);
+    if(animation.stepped) time = animdata[cursor].delta;
+   }
+ bool hit = (time == animdata[cursor].delta);
+
+ // for each bone that is animated
+ const MeshCompressedAnimation& data = animation.compressed;
+ affine3D m;
+ for(size_t bi = 0; bi < bones.size(); bi++)
+    {
+     // bone does not move
+     const MeshCompressedBone& bone = data.bones[bi];
+     if(bone.held != 0xFFFFFFFFul) {
+        palette[bi] = data.mlist[bone.held];
+        continue;
+       }
+
+     // decode and interpolate tracks
+     real32 S[3], T[3], Q[4];
+     SampleCompressedVector(S, animation, bone.scale, cursor, time);
+     SampleCompressedVector(T, animation, bone.translation, cursor, time);
+     SampleCompressedRotation(Q, animation, bone.rotation, cursor, time);
+
+     // like keyframes, the scale applies to the translation between keys only
+     if(hit) m.load_transform(S, Q, T);
+     else {
+        real32 ST[3] = { S[0]*T[0], S[1]*T[1], S[2]*T[2] };
+        m.load_transform(S, Q, ST);
+       }
+     palette[bi] = bones[bi].m_abs * m;
+    }
+}
+
+// bone matrices before the hierarchy is applied (m_abs times the interpolated transform)
+static void ComputeAnimationBones(const std::vector<MeshBone>& bones, const MeshAnimation& animation, real32 time, uint32& cursor, affine3D* palette)
+{
+ // compressed keys
+ if(!animation.compressed.bones.empty()) {
+    ComputeCompressedBones(bones, animation, time, cursor, palette);
+    return;
+   }
+
+ // before first keyframe or after last keyframe
+ size_t n_keys = animation.keymap.size();
+ if(time <= animation.animdata[0].delta || time >= animation.animdata[n_keys - 1].delta) {
+    cursor = (time <= animation.animdata[0].delta ? 0 : static_cast<uint32>(n_keys - 1));
+    const auto& kf = animation.animdata[cursor];
+    for(size_t bi = 0; bi < bones.size(); bi++) palette[bi] = kf.mlist[bi];
+    return;
+   }
+
+ // using current time, find keyframes [a, b] that time is inbetween
+ cursor = FindAnimationKey(animation, time, cursor);
+ const auto& kf1 = animation.animdata[cursor];
+ const auto& kf2 = animation.animdata[cursor + 1];
+
+ // keyframe hit or stepped animation
+ if(time == kf1.delta || animation.stepped) {
+    for(size_t bi = 0; bi < bones.size(); bi++) palette[bi] = kf1.mlist[bi];
+    return;
+   }
+
+ // compute ratio between kf1 (0.0) and kf2 (1.0)
+ real32 ratio = (time - kf1.delta)/(kf2.delta - kf1.delta);
+
+ // for each bone that is animated
+ affine3D m;
+ for(size_t bi = 0; bi < bones.size(); bi++)
+    {
+     // bone does not move
+     if(kf1.held[bi]) {
+        palette[bi] = kf1.mlist[bi];
+        continue;
+       }
+
+     // interpolate scale
+     real32 S[3];
+     lerp3D(S, &kf1.slist[bi][0], &kf2.slist[bi][0], ratio);
+
+     // interpolate translation
+     real32 T[3];
+     lerp3D(T, &kf1.tlist[bi][0], &kf2.tlist[bi][0], ratio);
+
+     // interpolate quaternion
+     real32 Q[4];
+     qslerp(Q, &kf1.qlist[bi][0], &kf2.qlist[bi][0], ratio);
+     qnormalize(Q);
+
+     // rotate, translate, then scale (the scale applies to the translation too)
+     real32 ST[3] = { S[0]*T[0], S[1]*T[1], S[2]*T[2] };
+     m.load_transform(S, Q, ST);
+
+     // set matrix
+     palette[bi] = bones[bi].m_abs * m;
+    }
+}
+
+/** BakeAnimationPoses
+ *  Samples the bone matrices of an animation (before the hierarchy is applied) at a fixed rate,
+ *  from time zero to the duration of the animation. Once baked, ComputeAnimationPose blends the
+ *  two poses around time instead of interpolating keyframes, which costs the same for every bone
+ *  no matter how the animation is keyed. Blending matrices is not the same as interpolating
+ *  quaternions, so the rate should be high enough for the fastest moving bones (30 poses per
+ *  second matches the keyframe rate of model files). A rate of zero frees the poses.
+ */
+void BakeAnimationPoses(MeshAnimation& animation, const std::vector<MeshBone>& bones, real32 rate)
+{
+ // free previous
+ animation.rate = 0.0f;
+ animation.n_poses = 0;
+ animation.poses.reset();
+ if(!(rate > 0.0f) || animation.keymap.empty() || bones.empty()) return;
+
+ // last pose is at or after the end of the animation
+ uint32 n_poses = static_cast<uint32>(std::ceil(animation.duration*rate)) + 1;
+ if(n_poses < 2) n_poses = 2;
+
+ // sample poses
+ size_t n_bones = bones.size();
+ animation.poses.reset(new affine3D[n_poses*n_bones]);
+ uint32 cursor = 0;
+ for(uint32 i = 0; i < n_poses; i++) {
+     real32 time = static_cast<real32>(i)/rate;
+     ComputeAnimationBones(bones, animation, time, cursor, &animation.poses[i*n_bones]);
+    }
+ animation.rate = rate;
+ animation.n_poses = n_poses;
+}
+
+static size_t CompressedKeyBytes(const MeshCompressedAnimation& data)
+{
+ size_t bytes = data.bones.size()*sizeof(MeshCompressedBone);
+ bytes += data.keys.size()*sizeof(uint16);
+ bytes += data.values.size()*sizeof(std::array<uint16, 3>);
+ bytes += data.kept.size()*sizeof(uint64) + data.ranks.size()*sizeof(uint16);
+ bytes += data.mlist.size()*sizeof(affine3D);
+ return bytes;
+}
+
+/** AnimationKeyBytes
+ *  Returns the number of bytes of bone data of an animation: the keyframes expanded by
+ *  ConstructAnimationData, or the tracks made by CompressAnimation.
+ */
+size_t AnimationKeyBytes(const MeshAnimation& animation, size_t n_bones)
+{
+ if(!animation.compressed.bones.empty()) return CompressedKeyBytes(animation.compressed);
+ size_t bytes = 2*sizeof(bool) + 2*sizeof(std::array<real32, 3>) + sizeof(std::array<real32, 4>) + sizeof(affine3D);
+ return animation.keymap.size()*n_bones*bytes;
+}
+
+// keeps the first and the last key, and from each kept key, skips as many keys as possible while
+// interpolating between the kept keys reproduces every skipped key (reproduces(a, b, k) tests key
+// k against keys a and b)
+template<class F>
+static void ReduceAnimationKeys(uint32 n_keys, F reproduces, std::vector<uint32>& kept)
+{
+ kept.clear();
+ kept.push_back(0);
+ uint32 a = 0;
+ while(a + 1 < n_keys) {
+       uint32 b = a + 1;
+       while(b + 1 < n_keys) {
+             bool passed = true;
+             for(uint32 k = a + 1; k <= b && passed; k++) passed = reproduces(a, b + 1, k);
+             if(!passed) break;
+             b++;
+            }
+       kept.push_back(b);
+       a = b;
+      }
+}
+
+// appends the kept keys of a track, and if it has more than one key, the bits and ranks that find
+// its keys (see FindCompressedKey)
+static void SaveCompressedKeys(MeshCompressedAnimation& data, MeshCompressedTrack& track, const std::vector<uint32>& kept, const std::vector<std::array<uint16, 3>>& values, uint32 n_keys)
+{
+ for(uint32 k : kept) {
+     data.keys.push_back(static_cast<uint16>(k));
+     data.values.push_back(values[k]);
+    }
+ track.words = static_cast<uint32>(data.kept.size());
+ if(kept.size() < 2) return;
+ uint32 n_words = (n_keys + 63)/64;
+ data.kept.resize(data.kept.size() + n_words, 0);
+ data.ranks.resize(data.ranks.size() + n_words, 0);
+ for(uint32 k : kept) data.kept[track.words + (k >> 6)] |= (1ull << (k & 63));
+ for(uint32 i = 1; i < n_words; i++) data.ranks[track.words + i] = static_cast<uint16>(data.ranks[track.words + i - 1] + CountBits(data.kept[track.words + i - 1]));
+}
+
+// rotation track of a bone
+static void CompressRotationTrack(MeshCompressedAnimation& data, MeshCompressedTrack& track, const MeshAnimation& animation, size_t bone, real32 tolerance)
+{
+ // quantize every key
+ uint32 n_keys = static_cast<uint32>(animation.keymap.size());
+ std::vector<std::array<uint16, 3>> values(n_keys);
+ std::vector<std::array<real32, 4>> decoded(n_keys);
+ for(uint32 k = 0; k < n_keys; k++) {
+     EncodeQuaternion(values[k].data(), animation.animdata[k].qlist[bone].data());
+     DecodeQuaternion(decoded[k].data(), values[k].data());
+    }
+
+ // difference from a key (q and -q are the same rotation)
+ auto error = [&](const real32* q, uint32 k) {
+  const real32* x = animation.animdata[k].qlist[bone].data();
+  real32 sign = (q[0]*x[0] + q[1]*x[1] + q[2]*x[2] + q[3]*x[3] < 0.0f ? -1.0f : 1.0f);
+  real32 e = 0.0f;
+  for(uint32 i = 0; i < 4; i++) e = std::max(e, std::abs(sign*q[i] - x[i]));
+  return e;
+ };
+
+ // remove keys
+ std::vector<uint32> kept;
+ bool constant = true;
+ for(uint32 k = 1; k < n_keys && constant; k++) constant = (error(decoded[0].data(), k) <= tolerance);
+ if(constant) kept.assign(1, 0);
+ else {
+    auto reproduces = [&](uint32 a, uint32 b, uint32 k) {
+     real32 ratio = (animation.animdata[k].delta - animation.animdata[a].delta)/(animation.animdata[b].delta - animation.animdata[a].delta);
+     real32 q[4];
+     qslerp(q, decoded[a].data(), decoded[b].data(), ratio);
+     qnormalize(q);
+     return error(q, k) <= tolerance;
+    };
+    ReduceAnimationKeys(n_keys, reproduces, kept);
+   }
+
+ // use nlerp between kept keys if it stays within tolerance of slerp
+ for(size_t i = 0; i + 1 < kept.size(); i++) {
+     const real32* A = decoded[kept[i]].data();
+     const real32* B = decoded[kept[i + 1]].data();
+     real32 e = 0.0f;
+     for(uint32 j = 1; j < 16; j++) {
+         real32 x[4], y[4];
+         qslerp(x, A, B, j/16.0f);
+         qnormalize(x);
+         NlerpQuaternion(y, A, B, j/16.0f);
+         real32 dot = x[0]*y[0] + x[1]*y[1] + x[2]*y[2] + x[3]*y[3];
+         for(uint32 c = 0; c < 4; c++) e = std::max(e, std::abs((dot < 0.0f ? -y[c] : y[c]) - x[c]));
+        }
+     if(e <= tolerance) values[kept[i]][2] |= 0x8000;
+    }
+
+ // save keys
+ track.first = static_cast<uint32>(data.keys.size());
+ track.n_keys = static_cast<uint32>(kept.size());
+ for(uint32 i = 0; i < 3; i++) track.base[i] = track.step[i] = 0.0f;
+ SaveCompressedKeys(data, track, kept, values, n_keys);
+}
+
+// translation or scale track of a bone (list is tlist or slist)
+static void CompressVectorTrack(MeshCompressedAnimation& data, MeshCompressedTrack& track, const MeshAnimation& animation, std::unique_ptr<std::array<real32, 3>[]> MeshAnimationData::* list, size_t bone, real32 tolerance)
+{
+ // range of track
+ uint32 n_keys = static_cast<uint32>(animation.keymap.size());
+ real32 a[3], b[3];
+ for(uint32 i = 0; i < 3; i++) a[i] = b[i] = (animation.animdata[0].*list)[bone][i];
+ for(uint32 k = 1; k < n_keys; k++) {
+     const auto& v = (animation.animdata[k].*list)[bone];
+     for(uint32 i = 0; i < 3; i++) {
+         a[i] = std::min(a[i], v[i]);
+         b[i] = std::max(b[i], v[i]);
+        }
+    }
+
+ // track does not move (within tolerance)
+ track.first = static_cast<uint32>(data.keys.size());
+ if(b[0] - a[0] <= 2.0f*tolerance && b[1] - a[1] <= 2.0f*tolerance && b[2] - a[2] <= 2.0f*tolerance) {
+    track.n_keys = 1;
+    track.words = 0;
+    for(uint32 i = 0; i < 3; i++) {
+        track.base[i] = (a[i] == b[i] ? a[i] : 0.5f*(a[i] + b[i]));
+        track.step[i] = 0.0f;
+       }
+    return;
+   }
+
+ // quantize every key against range of track
+ for(uint32 i = 0; i < 3; i++) {
+     track.base[i] = a[i];
+     track.step[i] = (b[i] - a[i])/65535.0f;
+    }
+ std::vector<std::array<uint16, 3>> values(n_keys);
+ std::vector<std::array<real32, 3>> decoded(n_keys);
+ for(uint32 k = 0; k < n_keys; k++) {
+     const auto& v = (animation.animdata[k].*list)[bone];
+     for(uint32 i = 0; i < 3; i++) {
+         real32 x = (track.step[i] > 0.0f ? std::round((v[i] - a[i])/track.step[i]) : 0.0f);
+         values[k][i] = static_cast<uint16>(std::min(std::max(x, 0.0f), 65535.0f));
+         decoded[k][i] = track.base[i] + track.step[i]*static_cast<real32>(values[k][i]);
+        }
+    }
+
+ // remove keys
+ std::vector<uint32> kept;
+ auto reproduces = [&](uint32 a, uint32 b, uint32 k) {
+  real32 ratio = (animation.animdata[k].delta - animation.animdata[a].delta)/(animation.animdata[b].delta - animation.animdata[a].delta);
+  const auto& v = (animation.animdata[k].*list)[bone];
+  for(uint32 i = 0; i < 3; i++)
+      if(std::abs(decoded[a][i] + ratio*(decoded[b][i] - decoded[a][i]) - v[i]) > tolerance) return false;
+  return true;
+ };
+ ReduceAnimationKeys(n_keys, reproduces, kept);
+
+ // save keys
+ track.n_keys = static_cast<uint32>(kept.size());
+ SaveCompressedKeys(data, track, kept, values, n_keys);
+}
+
+/** CompressAnimation
+ *  Replaces the keyframes of every bone (which ConstructAnimationData expands to every keyframe
+ *  of the animation) with compressed tracks. Each bone has a rotation, translation, and scale
+ *  track. Keys that interpolating the keys around them reproduces within the given tolerance are
+ *  removed, and tracks that do not move keep one key. Tolerances bound the error of each track
+ *  in the space of its parent bone, not the error of the final palette, which adds up the errors
+ *  of the parent bones and can be several times larger. Rotations are stored as 48-bit smallest
+ *  three quaternions, and translations and scales as 16 bits per component quantized against
+ *  the range of the track. Bones that do not move at all keep their bone matrix. Once done, the
+ *  keyframe bone data of animdata is freed (keyframe times are kept), and ComputeAnimationPose
+ *  decodes the tracks instead. Returns false if the animation is not compressed (too many
+ *  keyframes, already compressed, or the tracks would not take less memory than the keyframes).
+ */
+bool CompressAnimation(MeshAnimation& animation, const std::vector<MeshBone>& bones, const AnimationCompressionOptions& options)
+{
+ // validate
+ size_t n_bones = bones.size();
+ size_t n_keys = animation.keymap.size();
+ if(!n_bones || !n_keys || n_keys > 0x10000) return false;
+ if(!animation.compressed.bones.empty() || !animation.animdata[0].qlist) return false;
+
+ // compress tracks
+ MeshCompressedAnimation data;
+ data.bones.resize(n_bones);
+ for(size_t bi = 0; bi < n_bones; bi++) {
+     MeshCompressedBone& bone = data.bones[bi];
+     CompressRotationTrack(data, bone.rotation, animation, bi, options.local_rotation);
+     CompressVectorTrack(data, bone.translation, animation, &MeshAnimationData::tlist, bi, options.local_translation);
+     CompressVectorTrack(data, bone.scale, animation, &MeshAnimationData::slist, bi, options.local_scale);
+
+     // keep bone matrix of bones that do not move (like held bones, only if unscaled)
+     bone.held = 0xFFFFFFFFul;
+     bool unscaled = (bone.scale.n_keys == 1 && bone.scale.base[0] == 1.0f && bone.scale.base[1] == 1.0f && bone.scale.base[2] == 1.0f);
+     if(unscaled && bone.rotation.n_keys == 1 && bone.translation.n_keys == 1) {
+        real32 Q[4];
+        DecodeQuaternion(Q, data.values[bone.rotation.first].data());
+        affine3D m;
+        m.load_transform(bone.scale.base, Q, bone.translation.base);
+        bone.held = static_cast<uint32>(data.mlist.size());
+        data.mlist.push_back(bones[bi].m_abs * m);
+       }
+    }
+
+ // keep keyframes if they take less memory
+ if(!(CompressedKeyBytes(data) < AnimationKeyBytes(animation, n_bones))) return false;
+ data.keys.shrink_to_fit();
+ data.values.shrink_to_fit();
+ data.kept.shrink_to_fit();
+ data.ranks.shrink_to_fit();
+ animation.compressed = std::move(data);
+
+ // free keyframe bone data
+ for(size_t i = 0; i < n_keys; i++) {
+     MeshAnimationData& kf = animation.animdata[i];
+     kf.keyed.reset();
+     kf.held.reset();
+     kf.slist.reset();
+     kf.tlist.reset();
+     kf.qlist.reset();
+     kf.mlist.reset();
+    }
+ return true;
+}
+
+/** ComputeAnimationPose
+ *  Computes the skinning palette (one matrix per bone) of an animation at a given time. Since all
+ *  bones share the same keyframe times, the keyframe interval is found once per call instead of
+ *  once per bone. The cursor is the keyframe index found by the last call (see FindAnimationKey),
+ *  and is updated with the keyframe index found by this call. Keyframe hits, stepped animations,
+ *  and bones that do not move use the bone matrices baked by ConstructAnimationData, and baked
+ *  animations blend the two poses around time (see BakeAnimationPoses).
+ */
+void ComputeAnimationPose(const std::vector<MeshBone>& bones, const MeshAnimation& animation, real32 time, uint32& cursor, affine3D* palette)
+{
+ // no keyframes, render in bind pose
+ if(animation.keymap.empty()) {
+    for(size_t bi = 0; bi < bones.size(); bi++) palette[bi].load_identity();
+    cursor = 0;
+    return;
+   }
+
+ // blend baked poses or interpolate keyframes
+ if(animation.n_poses) {
+    real32 x = std::max(time*animation.rate, 0.0f);
+    uint32 index = std::min(static_cast<uint32>(x), animation.n_poses - 2);
+    real32 ratio = std::min(x - static_cast<real32>(index), 1.0f);
+    const affine3D* A = &animation.poses[index*bones.size()];
+    const affine3D* B = A + bones.size();
+    for(size_t bi = 0; bi < bones.size(); bi++) affine3D_lerp(palette[bi].m, A[bi].m, B[bi].m, ratio);
+   }
+ else
+    ComputeAnimationBones(bones, animation, time, cursor, palette);
+
+ // for each bone that is animated
+ // these transformation matrices are interpolated in relative space
+ for(size_t bi = 1; bi < bones.size(); bi++) {
+     uint32 parent = bones[bi].parent;
+     palette[bi] = (palette[parent] * bones[parent].m_inv) * palette[bi];
+    }
+ for(size_t bi = 0; bi < bones.size(); bi++) {
+     // no transpose is necessary, since the shader declares mskin as row_major float3x4
+     // and uses: mul(mskin[input.bi[i]], input.position)
+     palette[bi] = palette[bi] * bones[bi].m_inv;
+    }
+}
+
+/** WrapAnimationTime
+ *  Returns time moved into [0, duration], wrapping around if the animation loops and clamping it
+ *  otherwise.
+ */
+real32 WrapAnimationTime(real32 time, real32 duration, bool loop)
+{
+ if(time < 0.0f) {
+    if(loop && duration > 0.0f)
+       while(time < 0.0f) time += duration;
+    else
+       time = 0.0f;
+   }
+ else if(time > duration) {
+    if(loop && duration > 0.0f)
+       while(!(time < duration)) time -= duration;
+    else
+       time = duration;
+   }
+ return time;
+}
+
+/** ComputeInstancePose
+ *  Returns the skinning palette of an instance that plays animation anim of a mesh. The palette
+ *  is shared from the cache if the animation is cached (see AnimationCache::lookup), otherwise it
+ *  is computed into palette (see ComputeAnimationPose). This does not cache animations, so it can
+ *  be called by many threads at once as long as no thread changes the cache.
+ */
+const affine3D* ComputeInstancePose(const std::vector<MeshBone>& bones, const MeshAnimation& animation, const AnimationCache& cache, uint32 anim, real32 time, uint32& cursor, affine3D* palette)
+{
+ const affine3D* cached = cache.lookup(anim, time, palette);
+ if(cached) return cached;
+ ComputeAnimationPose(bones, animation, time, cursor, palette);
+ return palette;
+}
+
+/** AnimationCache::construct
+ *  Sets up a cache for the animations of a mesh. Unless the cache is lazy, every animation that
+ *  fits in the budget is cached right away (in order, so the first animations are preferred).
+ */
+void AnimationCache::construct(const std::vector<MeshBone>& bones, const std::vector<MeshAnimation>& animations, const AnimationCacheOptions& options)
+{
+ // reset cache
+ clear();
+ if(bones.empty() || animations.empty() || !(options.rate > 0.0f)) return;
+ this->options = options;
+ this->n_bones = bones.size();
+ this->entries.resize(animations.size());
+ for(size_t i = 0; i < entries.size(); i++) {
+     entries[i].n_frames = 0;
+     entries[i].rate = 0.0f;
+     entries[i].error = 0.0f;
+     entries[i].live = false;
+    }
+
+ // cache animations now
+ if(!options.lazy)
+    for(uint32 i = 0; i < static_cast<uint32>(animations.size()); i++) cache(bones, animations[i], i);
+}
+
+// largest difference between palettes relative to the size of the element in B (at least 1)
+static real32 PaletteError(const affine3D* A, const affine3D* B, size_t n_bones)
+{
+ real32 error = 0.0f;
+ for(size_t bi = 0; bi < n_bones; bi++)
+     for(uint32 j = 0; j < 12; j++) error = std::max(error, std::abs(A[bi][j] - B[bi][j])/std::max(1.0f, std::abs(B[bi][j])));
+ return error;
+}
+
+/** AnimationCache::cache
+ *  Samples the palettes of an animation from time zero to the duration of the animation, and
+ *  compares lookups halfway between samples against live evaluation. If the error is over the
+ *  tolerance, the rate is doubled (up to max_rate) and the animation is sampled again. If the
+ *  palettes do not fit in the budget or the error stays over the tolerance, the animation is
+ *  marked as live and false is returned.
+ */
+bool AnimationCache::cache(const std::vector<MeshBone>& bones, const MeshAnimation& animation, uint32 anim)
+{
+ // already cached or does not fit
+ if(!(anim < entries.size())) return false;
+ AnimationCacheEntry& entry = entries[anim];
+ if(entry.n_frames) return true;
+ if(entry.live) return false;
+ if(animation.keymap.empty()) {
+    entry.live = true;
+    return false;
+   }
+
+ std::unique_ptr<affine3D[]> live(new affine3D[n_bones]);
+ std::unique_ptr<affine3D[]> blend(new affine3D[n_bones]);
+ for(real32 rate = options.rate; ; rate *= 2.0f)
+    {
+     // last palette is at or after the end of the animation
+     uint32 n_frames = static_cast<uint32>(std::ceil(animation.duration*rate)) + 1;
+     if(n_frames < 2) n_frames = 2;
+     size_t bytes = n_frames*n_bones*sizeof(affine3D);
+     if(size + bytes > options.budget) break;
+
+     // sample palettes
+     std::unique_ptr<affine3D[]> palettes(new affine3D[n_frames*n_bones]);
+     uint32 cursor = 0;
+     for(uint32 i = 0; i < n_frames; i++) {
+         real32 time = static_cast<real32>(i)/rate;
+         ComputeAnimationPose(bones, animation, time, cursor, &palettes[i*n_bones]);
+        }
+
+     // check lookups halfway between palettes (nearest lookups may return either one)
+     real32 error = 0.0f;
+     cursor = 0;
+     for(uint32 i = 0; i + 1 < n_frames && options.tolerance > 0.0f; i++) {
+         real32 time = std::min((static_cast<real32>(i) + 0.5f)/rate, animation.duration);
+         ComputeAnimationPose(bones, animation, time, cursor, live.get());
+         const affine3D* A = &palettes[i*n_bones];
+         const affine3D* B = A + n_bones;
+         if(options.blend) {
+            for(size_t bi = 0; bi < n_bones; bi++) affine3D_lerp(blend[bi].m, A[bi].m, B[bi].m, 0.5f);
+            error = std::max(error, PaletteError(blend.get(), live.get(), n_bones));
+           }
+         else
+            error = std::max(error, std::max(PaletteError(A, live.get(), n_bones), PaletteError(B, live.get(), n_bones)));
+        }
+
+     // keep palettes that are within tolerance
+     if(options.tolerance > 0.0f && !(error <= options.tolerance)) {
+        if(2.0f*rate <= options.max_rate) continue;
+        break;
+       }
+     entry.palettes = std::move(palettes);
+     entry.n_frames = n_frames;
+     entry.rate = rate;
+     entry.error = error;
+     size += bytes;
+     return true;
+    }
+
+ // does not fit or is not accurate enough
+ entry.live = true;
+ return false;
+}
+
+void AnimationCache::refresh(const std::vector<MeshBone>& bones, const std::vector<MeshAnimation>& animations)
+{
+ // resample cached palettes after animations change
+ if(!enabled()) return;
+ AnimationCacheOptions temp = options;
+ construct(bones, animations, temp);
+}
+
+void AnimationCache::clear(void)
+{
+ entries.clear();
+ n_bones = 0;
+ size = 0;
+}
+
+/** AnimationCache::lookup
+ *  Returns the cached palette nearest to time, without copying it. If the cache blends, the two
+ *  palettes around time are blended into palette, which is returned. If the animation is not
+ *  cached, nullptr is returned.
+ */
+const affine3D* AnimationCache::lookup(uint32 anim, real32 time, affine3D* palette)const
+{
+ // not cached
+ if(!cached(anim)) return nullptr;
+ const AnimationCacheEntry& entry = entries[anim];
+ real32 x = std::max(time*entry.rate, 0.0f);
+
+ // nearest palette
+ if(!options.blend) {
+    uint32 index = std::min(static_cast<uint32>(x + 0.5f), entry.n_frames - 1);
+    return &entry.palettes[index*n_bones];
+   }
+
+ // blend palettes
+ uint32 index = std::min(static_cast<uint32>(x), entry.n_frames - 2);
+ real32 ratio = std::min(x - static_cast<real32>(index), 1.0f);
+ const affine3D* A = &entry.palettes[index*n_bones];
+ const affine3D* B = A + n_bones;
+ for(size_t bi = 0; bi < n_bones; bi++) affine3D_lerp(palette[bi].m, A[bi].m, B[bi].m, ratio);
+ return palette;
+}
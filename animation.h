@@ -0,0 +1,161 @@
+#ifndef __CS489_ANIMATION_H
+#define __CS489_ANIMATION_H
+
+#include "affine3.h"
+
+// keyframe rate of model files
+static const uint32 FRAMES_PER_SECOND = 30ul;
+static const real32 SECONDS_PER_FRAME = 1.0f/30.0f;
+
+struct MeshBone {
+ STDSTRINGW name;
+ uint32 parent;
+ real32 position[3];
+ affine3D m_abs;
+ affine3D m_inv;
+ affine3D m_rel;
+};
+
+struct MeshKeyFrame {
+ uint32 frame;
+ real32 translation[3];
+ real32 quaternion[4];
+ real32 scale[3];
+};
+
+struct MeshAnimatedBoneKeys {
+ uint32 bone_index;
+ uint32 minframe;
+ uint32 maxframe;
+ std::vector<MeshKeyFrame> keyframes;
+};
+
+struct MeshAnimationData {
+ uint32 frame;
+ real32 delta;
+ std::unique_ptr<bool[]> keyed;
+ std::unique_ptr<bool[]> held; // bone does not move between this key and the next
+ std::unique_ptr<std::array<real32, 3>[]> slist;
+ std::unique_ptr<std::array<real32, 3>[]> tlist;
+ std::unique_ptr<std::array<real32, 4>[]> qlist;
+ std::unique_ptr<affine3D[]> mlist; // m_abs times keyed transform (baked at load)
+};
+
+// keys of one track of a compressed bone (see CompressAnimation)
+struct MeshCompressedTrack {
+ uint32 first;   // index of first key in keys and values
+ uint32 n_keys;  // number of keys (1 if the track does not move, and vectors store no key)
+ uint32 words;   // index of first word in kept and ranks (if more than 1 key)
+ real32 base[3]; // translation and scale: value = base + step*quantized value (or base if 1 key)
+ real32 step[3];
+};
+
+struct MeshCompressedBone {
+ MeshCompressedTrack rotation;
+ MeshCompressedTrack translation;
+ MeshCompressedTrack scale;
+ uint32 held; // index in mlist if no track moves and the bone is not scaled (or 0xFFFFFFFF)
+};
+
+struct MeshCompressedAnimation {
+ std::vector<MeshCompressedBone> bones;
+ std::vector<uint16> keys;                  // dense keyframe index of each key
+ std::vector<uint64> kept;                  // bit k of the words of a track is set if dense key k is kept
+ std::vector<uint16> ranks;                 // number of keys of the track before each word of kept
+ std::vector<std::array<uint16, 3>> values; // smallest three quaternion, or quantized vector
+ std::vector<affine3D> mlist;               // bone matrices of bones that do not move
+};
+
+// tolerances are per track, relative to the parent bone: errors of parent bones add up down the
+// hierarchy, so palette errors can be several times larger (see CompressAnimation)
+struct AnimationCompressionOptions {
+ real32 local_rotation = 1.0e-3f;    // largest quaternion component error of removed keys
+ real32 local_translation = 1.0e-3f; // largest translation error of removed keys (model units)
+ real32 local_scale = 1.0e-3f;       // largest scale error of removed keys
+};
+
+struct MeshAnimation {
+ STDSTRINGW name;
+ bool loop;
+ uint32 minframe;
+ uint32 maxframe;
+ real32 duration;
+ std::set<uint32> keyset;
+ std::map<uint32, size_t> keymap;
+ std::vector<MeshAnimatedBoneKeys> bonelist;
+ std::unique_ptr<MeshAnimationData[]> animdata;
+ bool stepped = false;                 // hold each key until the next key (no interpolation)
+ real32 rate = 0.0f;                   // poses per second of baked poses
+ uint32 n_poses = 0;                   // number of baked poses (0 = not baked)
+ std::unique_ptr<affine3D[]> poses;    // n_poses*n_bones bone matrices (see BakeAnimationPoses)
+ MeshCompressedAnimation compressed;   // replaces animdata bone data if not empty (see CompressAnimation)
+};
+
+struct AnimationCacheOptions {
+ real32 rate = 30.0f;             // cached palettes per second
+ real32 max_rate = 120.0f;        // highest rate the rate is doubled up to to meet tolerance
+ real32 tolerance = 1.0e-2f;      // largest palette error of cached animations (0 = not checked)
+ size_t budget = 0x1000000;       // largest number of bytes of cached palettes (16 MB)
+ bool blend = true;               // blend the two palettes around time instead of the nearest one
+ bool lazy = true;                // cache animations when first played (otherwise when enabled)
+};
+
+// Skinning palette cache
+// Instances of a mesh that play the same animation compute the same palettes, so final palettes
+// (after the hierarchy is applied) can be sampled once at a fixed rate and shared by all of them.
+// Animations that would go over the memory budget are not cached, and instances evaluate them
+// live instead (see ComputeAnimationPose). Cached palettes are checked against live evaluation
+// halfway between samples, where lookup errors are largest, and animations that are over the
+// tolerance are resampled at twice the rate (up to max_rate) or else evaluated live. Palette
+// errors are matrix element differences relative to the size of the element (at least 1), which
+// are model units for translations. Caching an animation is not thread-safe, so lazy caches are
+// filled between updates, while no thread is looking up palettes (see ComputeInstancePose).
+class AnimationCache {
+ private :
+  struct AnimationCacheEntry {
+   uint32 n_frames;                      // number of cached palettes (0 = not cached)
+   real32 rate;                          // cached palettes per second (options.rate or higher)
+   real32 error;                         // largest palette error found halfway between palettes
+   bool live;                            // does not fit in budget (always evaluated live)
+   std::unique_ptr<affine3D[]> palettes; // n_frames*n_bones matrices
+  };
+  AnimationCacheOptions options;
+  std::vector<AnimationCacheEntry> entries;
+  size_t n_bones;
+  size_t size;
+ public :
+  void construct(const std::vector<MeshBone>& bones, const std::vector<MeshAnimation>& animations, const AnimationCacheOptions& options);
+  bool cache(const std::vector<MeshBone>& bones, const MeshAnimation& animation, uint32 anim);
+  void refresh(const std::vector<MeshBone>& bones, const std::vector<MeshAnimation>& animations);
+  void clear(void);
+  const affine3D* lookup(uint32 anim, real32 time, affine3D* palette)const;
+  bool enabled(void)const { return !entries.empty(); }
+  bool cached(uint32 anim)const { return anim < entries.size() && entries[anim].n_frames; }
+  bool live(uint32 anim)const { return !(anim < entries.size()) || entries[anim].live; }
+  real32 rate(uint32 anim)const { return cached(anim) ? entries[anim].rate : 0.0f; }
+  real32 error(uint32 anim)const { return cached(anim) ? entries[anim].error : 0.0f; }
+  bool lazy(void)const { return options.lazy; }
+  size_t bytes(void)const { return size; }
+ public :
+  AnimationCache() : n_bones(0), size(0) {}
+  AnimationCache(AnimationCache&& other) = default;
+  AnimationCache& operator =(AnimationCache&& other) = default;
+  AnimationCache(const AnimationCache&) = delete;
+  void operator =(const AnimationCache&) = delete;
+};
+
+// construction
+void ConstructAnimationData(MeshAnimation& animation, const std::vector<MeshBone>& bones);
+void BakeAnimationPoses(MeshAnimation& animation, const std::vector<MeshBone>& bones, real32 rate);
+bool CompressAnimation(MeshAnimation& animation, const std::vector<MeshBone>& bones, const AnimationCompressionOptions& options);
+size_t AnimationKeyBytes(const MeshAnimation& animation, size_t n_bones);
+
+// evaluation
+uint32 FindAnimationKey(const MeshAnimation& animation, real32 time, uint32 cursor = 0);
+void ComputeAnimationPose(const std::vector<MeshBone>& bones, const MeshAnimation& animation, real32 time, uint32& cursor, affine3D* palette);
+
+// instances
+real32 WrapAnimationTime(real32 time, real32 duration, bool loop);
+const affine3D* ComputeInstancePose(const std::vector<MeshBone>& bones, const MeshAnimation& animation, const AnimationCache& cache, uint32 anim, real32 time, uint32& cursor, affine3D* palette);
+
+#endif
@@ -0,0 +1,217 @@
+#include "stdafx.h"
+#include "broadphase.h"
+
+// Intervals are half-open in the sense that touching is not overlapping, and endpoints with
+// equal values are ordered with maximums before minimums. With this ordering, one interval
+// overlaps another exactly when its minimum comes before the other maximum in the list, so
+// the lists and the overlap test always agree. Point intervals (minimum equal to maximum) go
+// between the maximums and the minimums, each with its minimum right before its maximum and in
+// proxy order, so that a proxy never has its maximum before its own minimum.
+bool SweepAndPrune::less(uint32 axis, const SAPEndpoint& e1, const SAPEndpoint& e2)const
+{
+ if(e1.value < e2.value) return true;
+ if(e2.value < e1.value) return false;
+ auto RANK = [&](uint32 data) {
+  const AABB_minmax& aabb = proxies[data & 0x7FFFFFFFul].aabb;
+  if(aabb.a[axis] == aabb.b[axis]) return 1u;
+  return ((data & 0x80000000ul) ? 0u : 2u);
+ };
+ uint32 r1 = RANK(e1.data);
+ uint32 r2 = RANK(e2.data);
+ if(r1 != r2) return (r1 < r2);
+ if(r1 != 1) return false;
+ uint32 p1 = (e1.data & 0x7FFFFFFFul);
+ uint32 p2 = (e2.data & 0x7FFFFFFFul);
+ if(p1 != p2) return (p1 < p2);
+ return !(e1.data & 0x80000000ul) && (e2.data & 0x80000000ul);
+}
+
+bool SweepAndPrune::test(uint32 a, uint32 b)const
+{
+ const SAPProxy& A = proxies[a];
+ const SAPProxy& B = proxies[b];
+ if(!((A.group & B.mask) || (B.group & A.mask))) return false;
+ for(int i = 0; i < 3; i++) {
+     if(!(A.aabb.a[i] < B.aabb.b[i])) return false;
+     if(!(B.aabb.a[i] < A.aabb.b[i])) return false;
+    }
+ return true;
+}
+
+void SweepAndPrune::swap(uint32 axis, uint32 i, uint32 j)
+{
+ // swap endpoints
+ std::vector<SAPEndpoint>& list = axes[axis];
+ std::swap(list[i], list[j]);
+ uint32 p1 = (list[i].data & 0x7FFFFFFFul);
+ uint32 p2 = (list[j].data & 0x7FFFFFFFul);
+ proxies[p1].endpoint[axis][(list[i].data >> 31)] = i;
+ proxies[p2].endpoint[axis][(list[j].data >> 31)] = j;
+
+ // a minimum passing a maximum (of another proxy) can change the overlap state
+ if(p1 == p2) return;
+ if(!((list[i].data ^ list[j].data) & 0x80000000ul)) return;
+ uint64 pair = key(p1, p2);
+ bool prev = (pairs.find(pair) != pairs.end());
+ bool curr = test(p1, p2);
+ if(prev == curr) return;
+
+ // report
+ SAPEvent event;
+ event.proxy[0] = std::min(p1, p2);
+ event.proxy[1] = std::max(p1, p2);
+ if(curr) {
+    pairs.insert(pair);
+    event.type = SAP_BEGIN_OVERLAP;
+   }
+ else {
+    pairs.erase(pair);
+    event.type = SAP_END_OVERLAP;
+   }
+ event_list.push_back(event);
+}
+
+void SweepAndPrune::sort(uint32 axis, uint32 index)
+{
+ // move down
+ std::vector<SAPEndpoint>& list = axes[axis];
+ uint32 i = index;
+ while(i > 0 && less(axis, list[i], list[i - 1])) {
+       swap(axis, i - 1, i);
+       i--;
+      }
+ if(i != index) return;
+
+ // move up
+ uint32 n = static_cast<uint32>(list.size());
+ while(i + 1 < n && less(axis, list[i + 1], list[i])) {
+       swap(axis, i, i + 1);
+       i++;
+      }
+}
+
+uint32 SweepAndPrune::insert(const AABB_minmax& aabb, uint32 group, uint32 mask, uint32 id)
+{
+ // reuse proxy
+ uint32 index = 0;
+ if(free_list.size()) {
+    index = free_list.back();
+    free_list.pop_back();
+   }
+ else {
+    index = static_cast<uint32>(proxies.size());
+    proxies.emplace_back();
+   }
+
+ // initialize proxy
+ SAPProxy& proxy = proxies[index];
+ proxy.aabb.from(aabb);
+ proxy.group = group;
+ proxy.mask = mask;
+ proxy.id = id;
+ proxy.valid = true;
+
+ // insert endpoints at their sorted positions
+ for(uint32 i = 0; i < 3; i++) {
+     std::vector<SAPEndpoint>& list = axes[i];
+     SAPEndpoint endpoints[2] = {
+      { aabb.a[i], index },
+      { aabb.b[i], static_cast<uint32>(index | 0x80000000ul) }
+     };
+     for(uint32 j = 0; j < 2; j++) {
+         auto iter = std::upper_bound(list.begin(), list.end(), endpoints[j], [this, i](const SAPEndpoint& e1, const SAPEndpoint& e2) {
+          return less(i, e1, e2);
+         });
+         uint32 position = static_cast<uint32>(iter - list.begin());
+         list.insert(iter, endpoints[j]);
+         for(uint32 k = position; k < list.size(); k++)
+             proxies[list[k].data & 0x7FFFFFFFul].endpoint[i][list[k].data >> 31] = k;
+        }
+    }
+
+ // new pairs are among proxies that overlap along the x-axis, which are the ones with a
+ // minimum before this maximum and a maximum after this minimum
+ const std::vector<SAPEndpoint>& list = axes[0];
+ uint32 first = proxy.endpoint[0][0];
+ uint32 last = proxy.endpoint[0][1];
+ for(uint32 k = 0; k < last; k++) {
+     if(list[k].data & 0x80000000ul) continue;
+     uint32 other = list[k].data;
+     if(other == index || !(proxies[other].endpoint[0][1] > first)) continue;
+     if(!test(index, other)) continue;
+     pairs.insert(key(index, other));
+     SAPEvent event;
+     event.type = SAP_BEGIN_OVERLAP;
+     event.proxy[0] = std::min(index, other);
+     event.proxy[1] = std::max(index, other);
+     event_list.push_back(event);
+    }
+ return index;
+}
+
+void SweepAndPrune::move(uint32 proxy, const AABB_minmax& aabb)
+{
+ // set bounds first, so that overlap tests during the sort see where the proxy ends up
+ SAPProxy& p = proxies[proxy];
+ if(!p.valid) return;
+ real32 prev[3];
+ for(uint32 i = 0; i < 3; i++) prev[i] = p.aabb.a[i];
+ p.aabb.from(aabb);
+
+ // sort endpoints (leading endpoint first so that a proxy never passes its own endpoint)
+ for(uint32 i = 0; i < 3; i++) {
+     axes[i][p.endpoint[i][0]].value = aabb.a[i];
+     axes[i][p.endpoint[i][1]].value = aabb.b[i];
+     if(aabb.a[i] < prev[i]) {
+        sort(i, p.endpoint[i][0]);
+        sort(i, p.endpoint[i][1]);
+       }
+     else {
+        sort(i, p.endpoint[i][1]);
+        sort(i, p.endpoint[i][0]);
+       }
+    }
+}
+
+void SweepAndPrune::remove(uint32 proxy)
+{
+ // end all overlaps
+ SAPProxy& p = proxies[proxy];
+ if(!p.valid) return;
+ for(auto iter = pairs.begin(); iter != pairs.end(); ) {
+     uint32 a = static_cast<uint32>(*iter >> 32);
+     uint32 b = static_cast<uint32>(*iter & 0xFFFFFFFFul);
+     if(a == proxy || b == proxy) {
+        SAPEvent event;
+        event.type = SAP_END_OVERLAP;
+        event.proxy[0] = a;
+        event.proxy[1] = b;
+        event_list.push_back(event);
+        iter = pairs.erase(iter);
+       }
+     else
+        ++iter;
+    }
+
+ // remove endpoints (higher index first, so that the lower index is still valid)
+ for(uint32 i = 0; i < 3; i++) {
+     std::vector<SAPEndpoint>& list = axes[i];
+     uint32 first = std::min(p.endpoint[i][0], p.endpoint[i][1]);
+     uint32 last = std::max(p.endpoint[i][0], p.endpoint[i][1]);
+     list.erase(list.begin() + last);
+     list.erase(list.begin() + first);
+     for(uint32 k = first; k < list.size(); k++)
+         proxies[list[k].data & 0x7FFFFFFFul].endpoint[i][list[k].data >> 31] = k;
+    }
+ p.valid = false;
+ free_list.push_back(proxy);
+}
+
+void SweepAndPrune::clear(void)
+{
+ for(uint32 i = 0; i < 3; i++) axes[i].clear();
+ proxies.clear();
+ free_list.clear();
+ pairs.clear();
+ event_list.clear();
+}
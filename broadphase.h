@@ -0,0 +1,71 @@
+#ifndef __CS489_BROADPHASE_H
+#define __CS489_BROADPHASE_H
+
+#include "aabb.h"
+
+// overlap events
+enum SAPEventType {
+ SAP_BEGIN_OVERLAP = 0,
+ SAP_END_OVERLAP = 1,
+};
+
+struct SAPEvent {
+ SAPEventType type;
+ uint32 proxy[2]; // proxy[0] < proxy[1]
+};
+
+// Sweep and prune broadphase
+// Keeps the bounds of every proxy as sorted lists of interval endpoints, one list per axis.
+// Moving a proxy updates the lists with insertion sort, which is nearly linear when things
+// move a little each frame. Two proxies can only start or stop overlapping when one of
+// their endpoints passes the other on some axis, so overlapping pairs are tracked on those
+// swaps alone and reported as begin and end overlap events.
+// Pairs are only tracked if (group[a] & mask[b]) or (group[b] & mask[a]) is nonzero, so that
+// static things like doors and triggers do not report pairs among themselves.
+class SweepAndPrune {
+ private :
+  // endpoint data is proxy index | 0x80000000 for maximum endpoints
+  struct SAPEndpoint {
+   real32 value;
+   uint32 data;
+  };
+  struct SAPProxy {
+   AABB_minmax aabb;
+   uint32 group;
+   uint32 mask;
+   uint32 id;
+   uint32 endpoint[3][2]; // index of min and max endpoints on each axis
+   bool valid;
+  };
+ private :
+  std::vector<SAPEndpoint> axes[3];
+  std::vector<SAPProxy> proxies;
+  std::vector<uint32> free_list;
+  std::unordered_set<uint64> pairs;
+  std::vector<SAPEvent> event_list;
+ private :
+  static uint64 key(uint32 a, uint32 b) { return (a < b ? ((static_cast<uint64>(a) << 32) | b) : ((static_cast<uint64>(b) << 32) | a)); }
+  bool less(uint32 axis, const SAPEndpoint& e1, const SAPEndpoint& e2)const;
+  bool test(uint32 a, uint32 b)const;
+  void swap(uint32 axis, uint32 i, uint32 j);
+  void sort(uint32 axis, uint32 index);
+ public :
+  uint32 insert(const AABB_minmax& aabb, uint32 group, uint32 mask, uint32 id);
+  void move(uint32 proxy, const AABB_minmax& aabb);
+  void remove(uint32 proxy);
+  void clear(void);
+ public :
+  uint32 id(uint32 proxy)const { return proxies[proxy].id; }
+  uint32 group(uint32 proxy)const { return proxies[proxy].group; }
+  const AABB_minmax& bounds(uint32 proxy)const { return proxies[proxy].aabb; }
+  bool overlapping(uint32 a, uint32 b)const { return pairs.find(key(a, b)) != pairs.end(); }
+  size_t n_pairs(void)const { return pairs.size(); }
+  const std::vector<SAPEvent>& events(void)const { return event_list; }
+  void clear_events(void) { event_list.clear(); }
+ public :
+  SweepAndPrune() {}
+  SweepAndPrune(const SweepAndPrune&) = delete;
+  void operator =(const SweepAndPrune&) = delete;
+};
+
+#endif
@@ -1,15 +1,42 @@
 #include "stdafx.h"
+#include "ray.h"
+#include "triangle.h"
 #include "bvh.h"
 
+// runs func(first, last, thread) over [first, last) split into one contiguous chunk per thread
+template<class F>
+static void parallel_for(uint32 n_threads, unsigned int first, unsigned int last, F func)
+{
+ unsigned int n = last - first;
+ if(n_threads < 2 || n < n_threads) {
+    func(first, last, 0u);
+    return;
+   }
+ unsigned int chunk = (n + n_threads - 1)/n_threads;
+ std::vector<std::thread> threads;
+ for(uint32 i = 1; i < n_threads; i++) {
+     unsigned int a = first + i*chunk;
+     unsigned int b = std::min(a + chunk, last);
+     if(a < b) threads.push_back(std::thread(func, a, b, static_cast<unsigned int>(i)));
+    }
+ func(first, first + chunk, 0u);
+ for(auto& thread : threads) thread.join();
+}
+
 void BVH::construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32 n_indices)
 {
- // binning example
- // dv = (max_v - min_v)/n_bin = (2*box_w)/n_bin
- // bin       0     1     2     3     4     5     6     7
- // range 4.0 - 4.5 - 5.0 - 5.5 - 6.0 - 6.5 - 7.0 - 7.5 - 8.0 (split_v)
- // L_cnt     x     x     x     x     x     x     x     x
- // R_cnt     x     x     x     x     x     x     x     x 
+ construct(verts, n_verts, faces, n_indices, BVHBuildOptions());
+}
 
+void BVH::construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32 n_indices, uint32 n_threads)
+{
+ BVHBuildOptions options;
+ options.n_threads = n_threads;
+ construct(verts, n_verts, faces, n_indices, options);
+}
+
+void BVH::construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32 n_indices, const BVHBuildOptions& params)
+{
  if(!verts || !n_verts) return;
  if(!faces || !n_indices) return;
 
@@ -17,16 +44,18 @@ void BVH::construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32
  uint32 n_faces = n_indices/3;
  if(!n_faces) return;
 
- // per-bin data
- AABB_minmax binlist[n_bins];
- unsigned int bintris[n_bins];
+ // remove previous tree
+ clear();
 
- // per-partition data
- float costs[n_part];
- unsigned int NL[n_part];
- unsigned int NR[n_part];
- AABB_minmax BL[n_part];
- AABB_minmax BR[n_part];
+ // validate options
+ BVHBuildOptions options(params);
+ if(options.n_bins < 2) options.n_bins = 2;
+ if(options.n_bins > max_bins) options.n_bins = max_bins;
+ if(options.max_leaf_size < 1) options.max_leaf_size = 1;
+
+ // number of threads
+ uint32 n_threads = options.n_threads;
+ if(!n_threads) n_threads = std::max(std::thread::hardware_concurrency(), 1u);
 
  //
  // PHASE #1
@@ -41,14 +70,21 @@ void BVH::construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32
  std::unique_ptr<vector3D[]> clist(new vector3D[n_faces]);
 
  // compute per-face data
- size_t vindex = 0;
- for(size_t i = 0; i < n_faces; i++) {
-     vector3D v1 = verts[faces[vindex++]];
-     vector3D v2 = verts[faces[vindex++]];
-     vector3D v3 = verts[faces[vindex++]];
-     blist[i].from(v1.v, v2.v, v3.v);
-     centroid(blist[i], clist[i].v);
-    }
+ parallel_for(n_threads, 0, n_faces, [&](unsigned int first, unsigned int last, unsigned int) {
+  for(size_t i = first; i < last; i++) {
+      size_t vindex = 3*i;
+      vector3D v1 = verts[faces[vindex++]];
+      vector3D v2 = verts[faces[vindex++]];
+      vector3D v3 = verts[faces[vindex++]];
+      blist[i].from(v1.v, v2.v, v3.v);
+      centroid(blist[i], clist[i].v);
+     }
+ });
+
+ BVHFACEDATA data;
+ data.blist = blist.get();
+ data.clist = clist.get();
+ data.faces = faces;
 
  //
  // PHASE #2
@@ -57,265 +93,1101 @@ void BVH::construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32
 
  // add root node
  tree.push_back(AABB_node());
+ BVHSTACKITEM root;
+ root.tree_index = 0;
+ root.face_index[0] = 0;
+ root.face_index[1] = n_faces;
+
+ // Morton code builder
+ if(options.morton) morton(tree, data, n_faces, options, n_threads);
 
+ // single-threaded
+ else if(n_threads < 2) build(tree, root, data, options);
+
+ // multithreaded
+ // Upper levels are split one at a time, but the bounds and binning of large partitions are
+ // computed by all threads. Partitions below the task size are built as independent subtrees
+ // by worker threads. Each partition is split exactly as in the single-threaded build, so the
+ // tree only differs in node order, which flatten removes.
+ else
+   {
+    // partitions smaller than this are subtrees for worker threads
+    const unsigned int task_faces = std::max(n_faces/(8*n_threads), 0x1000u);
+    std::vector<BVHSTACKITEM> tasks;
+
+    // split upper levels
+    std::deque<BVHSTACKITEM> stack;
+    stack.push_front(root);
+    while(stack.size()) {
+          BVHSTACKITEM item = stack.front();
+          stack.pop_front();
+          unsigned int n = item.face_index[1] - item.face_index[0];
+          if(n < task_faces) {
+             tasks.push_back(item);
+             continue;
+            }
+          BVHSTACKITEM children[2];
+          unsigned int n_children = split(tree, item, data, options, children, (n < 0x10000u ? 1 : n_threads));
+          for(unsigned int i = 0; i < n_children; i++) stack.push_front(children[i]);
+         }
+
+    // largest subtrees first
+    std::sort(tasks.begin(), tasks.end(), [](const BVHSTACKITEM& a, const BVHSTACKITEM& b) {
+     return (a.face_index[1] - a.face_index[0]) > (b.face_index[1] - b.face_index[0]);
+    });
+
+    // build subtrees (each subtree root is node 0 of its own node list)
+    std::vector<std::vector<AABB_node>> subtrees(tasks.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+     for(size_t i = next++; i < tasks.size(); i = next++) {
+         BVHSTACKITEM item = tasks[i];
+         item.tree_index = 0;
+         subtrees[i].push_back(AABB_node());
+         build(subtrees[i], item, data, options);
+        }
+    };
+    std::vector<std::thread> threads;
+    for(uint32 i = 1; i < n_threads; i++) threads.push_back(std::thread(worker));
+    worker();
+    for(auto& thread : threads) thread.join();
+
+    // merge subtrees
+    for(size_t i = 0; i < tasks.size(); i++) {
+        unsigned int offset = static_cast<unsigned int>(tree.size()) - 1;
+        for(size_t j = 0; j < subtrees[i].size(); j++) {
+            AABB_node node = subtrees[i][j];
+            if(!(node.params[0] & 0x80000000ul)) {
+               node.params[0] += offset;
+               node.params[1] += offset;
+              }
+            if(j == 0) tree[tasks[i].tree_index] = node;
+            else tree.push_back(node);
+           }
+       }
+   }
+
+ //
+ // PHASE #3
+ // DEPTH-FIRST LAYOUT
+ //
+
+ // reorder nodes for stackless traversal
+ flatten();
+
+ // keep vertices and sorted faces for queries
+ this->verts = verts;
+ this->faces = faces;
+
+ // initial tree quality (for refitting)
+ build_cost = refit_cost = sah();
+
+ // optional leaf triangle storage
+ if(options.triangle_blocks) bake();
+}
+
+void BVH::build(std::vector<AABB_node>& nodes, const BVHSTACKITEM& root, const BVHFACEDATA& data, const BVHBuildOptions& options)
+{
  // add root node to process stack
- struct BVHSTACKITEM {
-  unsigned int tree_index;
-  unsigned int face_index[2];
- };
  std::deque<BVHSTACKITEM> stack;
- stack.push_front(BVHSTACKITEM());
- stack.front().tree_index = 0;
- stack.front().face_index[0] = 0;
- stack.front().face_index[1] = n_faces;
+ stack.push_front(root);
 
  // non-recursive partitioning
- while(stack.size())
-      {
-       //
-       // STEP #1
-       // OBTAIN PARTITION
-       //
-
+ while(stack.size()) {
        // get and pop item from stack
        BVHSTACKITEM item = stack.front();
-       unsigned int tree_index = item.tree_index;
-       unsigned int face_index[2] = { item.face_index[0], item.face_index[1] };
        stack.pop_front();
+       // split and process children
+       BVHSTACKITEM children[2];
+       unsigned int n_children = split(nodes, item, data, options, children, 1);
+       for(unsigned int i = 0; i < n_children; i++) stack.push_front(children[i]);
+      }
+}
 
-       //
-       // STEP #2
-       // CALCULATE PARTITION BOUNDS
-       //
-
-       // per-partition data (all triangle bounds, all centroid bounds)
-       AABB_minmax tbounds(blist[face_index[0]]);
-       AABB_minmax cbounds(clist[face_index[0]]);
-       for(unsigned int i = (face_index[0] + 1); i < face_index[1]; i++) {
-           tbounds.grow(blist[i]);
-           cbounds.grow(clist[i]);
-          }
+// spreads the lower 10 bits of x so that there are two zero bits between each bit
+static inline uint32 morton_expand(uint32 x)
+{
+ x &= 0x3FFul;
+ x = (x | (x << 16)) & 0x030000FFul;
+ x = (x | (x <<  8)) & 0x0300F00Ful;
+ x = (x | (x <<  4)) & 0x030C30C3ul;
+ x = (x | (x <<  2)) & 0x09249249ul;
+ return x;
+}
+
+void BVH::morton(std::vector<AABB_node>& nodes, const BVHFACEDATA& data, unsigned int n_faces, const BVHBuildOptions& options, uint32 n_threads)
+{
+ //
+ // STEP #1
+ // MORTON CODES
+ // Centroids are scaled to 10 bits per axis within the centroid bounds and the bits are
+ // interleaved, so that sorting the codes sorts the faces along a Z-order curve.
+ //
+
+ // centroid bounds
+ AABB_minmax cbounds(data.clist[0]);
+ for(unsigned int i = 1; i < n_faces; i++) cbounds.grow(data.clist[i]);
+ float scale[3];
+ for(int j = 0; j < 3; j++) {
+     float dv = cbounds.b[j] - cbounds.a[j];
+     scale[j] = (dv > 1.0e-12f ? 1023.0f/dv : 0.0f);
+    }
+
+ // 30-bit codes
+ std::vector<uint32> codes(n_faces);
+ parallel_for(n_threads, 0, n_faces, [&](unsigned int first, unsigned int last, unsigned int) {
+  for(unsigned int i = first; i < last; i++) {
+      uint32 x = static_cast<uint32>((data.clist[i][0] - cbounds.a[0])*scale[0]);
+      uint32 y = static_cast<uint32>((data.clist[i][1] - cbounds.a[1])*scale[1]);
+      uint32 z = static_cast<uint32>((data.clist[i][2] - cbounds.a[2])*scale[2]);
+      codes[i] = (morton_expand(x) << 2) | (morton_expand(y) << 1) | morton_expand(z);
+     }
+ });
+
+ //
+ // STEP #2
+ // RADIX SORT
+ // Three stable counting sort passes of 10 bits each (least significant digit first).
+ //
+
+ std::vector<uint32> order(n_faces);
+ std::vector<uint32> swap_order(n_faces);
+ std::vector<uint32> swap_codes(n_faces);
+ for(unsigned int i = 0; i < n_faces; i++) order[i] = i;
+ for(uint32 shift = 0; shift < 30; shift += 10) {
+     uint32 count[1024] = { 0 };
+     for(unsigned int i = 0; i < n_faces; i++) count[(codes[i] >> shift) & 0x3FFul]++;
+     uint32 sum = 0;
+     for(uint32 j = 0; j < 1024; j++) {
+         uint32 n = count[j];
+         count[j] = sum;
+         sum += n;
+        }
+     for(unsigned int i = 0; i < n_faces; i++) {
+         uint32 j = count[(codes[i] >> shift) & 0x3FFul]++;
+         swap_codes[j] = codes[i];
+         swap_order[j] = order[i];
+        }
+     codes.swap(swap_codes);
+     order.swap(swap_order);
+    }
+
+ // sort per-face data
+ std::vector<uint32> sorted_faces(data.faces, data.faces + 3*n_faces);
+ std::vector<AABB_minmax> sorted_bounds(data.blist, data.blist + n_faces);
+ std::vector<vector3D> sorted_centroids(data.clist, data.clist + n_faces);
+ parallel_for(n_threads, 0, n_faces, [&](unsigned int first, unsigned int last, unsigned int) {
+  for(unsigned int i = first; i < last; i++) {
+      uint32 j = order[i];
+      data.faces[3*i + 0] = sorted_faces[3*j + 0];
+      data.faces[3*i + 1] = sorted_faces[3*j + 1];
+      data.faces[3*i + 2] = sorted_faces[3*j + 2];
+      data.blist[i].from(sorted_bounds[j]);
+      data.clist[i] = sorted_centroids[j];
+     }
+ });
 
-       //
-       // STEP #3
-       // DOMINANT AXIS
-       //
-
-       // choose dominant axis from "longest-axis" of centroid bounds
-       float dv[3]; // dx, dy, dz saved from computing dominator
-       unsigned int axis = cbounds.dominator(dv);
-
-       // dominant axis is too small, make this is a leaf node
-       // 1.0e-6f is just a suggestion, but it can be made bigger, like 0.01f or something
-       if(dv[axis] < 1.0e-6f) {
-          tree[tree_index].aabb = tbounds;
-          tree[tree_index].params[0] = face_index[0] | 0x80000000ul; // mark as a leaf node
-          tree[tree_index].params[1] = face_index[1] - face_index[0];
+ //
+ // STEP #3
+ // EMIT HIERARCHY
+ // Each range of sorted codes shares its leading bits, so it is split where the highest bit
+ // that differs between its first and last code changes from 0 to 1. Ranges of identical
+ // codes (faces in the same grid cell) are handed to the binned builder, since their order
+ // along the curve says nothing about where they are. Nodes use explicit left child indices
+ // like the binned builder, and children always come after their parent.
+ //
+
+ struct MORTONSTACKITEM {
+  unsigned int first;
+  unsigned int last;
+  unsigned int parent;
+ };
+ nodes.clear();
+ nodes.reserve(2*n_faces);
+ std::vector<MORTONSTACKITEM> stack;
+ stack.push_back({ 0, n_faces, 0xFFFFFFFFul });
+ while(stack.size())
+      {
+       MORTONSTACKITEM item = stack.back();
+       stack.pop_back();
+       unsigned int index = static_cast<unsigned int>(nodes.size());
+       nodes.push_back(AABB_node());
+       if(item.parent != 0xFFFFFFFFul && index != item.parent + 1) nodes[item.parent].params[1] = index;
+
+       // leaf
+       if(item.last - item.first == 1) {
+          nodes[index].params[0] = item.first | 0x80000000ul;
+          nodes[index].params[1] = 1;
           continue;
          }
 
-       //
-       // STEP #4
-       // COMPUTE BINS
-       //
-
-       // start = cbounds.a[axis] + i*(dv[axis]/n_bins)
-       // i = (start - cbounds.a[axis])/(dv[axis]/n_bins)
-       // i = n_bins*(start - cbounds.a[axis])/dv[axis]
-       // let k0 = cbounds.a[axis]
-       // let k1 = n_bins/dv[axis]
-       // i = k1*(start - k0)
-
-       //   0     1     2     3     4     5     6     7     8
-       // 1.7 - 2.5 - 3.3 - 4.1 - 4.9 - 5.7 - 6.5 - 7.3 - 8.1
-       // dv[x] = (8.1 - 1.7) = 6.4
-       // k1 = 8*1/6.4 = 1.25 (1.24999875 with epsilon)
-
-       // for example given, start = 3.0
-       // i = k1*(3.0 - k0)
-       // i = (1.25)*(3.0 - 1.7) = 1.625
-
-       // for example given, start = 3.3
-       // i = k1*(3.3 - k0)
-       // i = (1.25)*(3.3 - 1.7) = 2.0
-
-       // so what the epsilon does is that if anything is on the edge
-       // of the next bin, like for example when start = 8.1, it will
-       // place that triangle in the bin before it
-
-       // binning constants
-       const float k0 = cbounds.a[axis];
-       const float k1 = n_bins*(1.0f - 1.0e-6f)/dv[axis];
-
-       // lambdas
-       auto BIN_INDEX_FROM_FACE = [&](unsigned int face) { return static_cast<unsigned int>(k1*(clist[face][axis] - k0)); };
-       auto BIN_LIMIT_TEST = [](unsigned int a) { return (a < 2ul); };
-
-       // initialize per-bin data
-       for(unsigned int i = 0; i < n_bins; i++) {
-           bintris[i] = 0;
-           binlist[i].from(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
-          }
+       // identical codes
+       uint32 diff = codes[item.first] ^ codes[item.last - 1];
+       if(!diff) {
+          BVHSTACKITEM subtree;
+          subtree.tree_index = index;
+          subtree.face_index[0] = item.first;
+          subtree.face_index[1] = item.last;
+          build(nodes, subtree, data, options);
+          continue;
+         }
 
-       // count number of triangles in bins and grow the bin AABBs to fit the triangles that are in each bin
-       for(unsigned int i = face_index[0]; i < face_index[1]; i++) {
-           unsigned int binindex = BIN_INDEX_FROM_FACE(i);
-           bintris[binindex]++;
-           binlist[binindex].grow(blist[i]);
-          }
+       // split position
+       uint32 bit = 0x80000000ul;
+       while(!(diff & bit)) bit >>= 1;
+       unsigned int mid = static_cast<unsigned int>(std::partition_point(codes.begin() + item.first, codes.begin() + item.last, [bit](uint32 code) { return (code & bit) == 0; }) - codes.begin());
 
-       //
-       // STEP #5
-       // PARTITIONING
-       //
-
-       //  bin:   0     1     2     3     4     5     6     7     8
-       // axis: 1.7 - 2.5 - 3.3 - 4.1 - 4.9 - 5.7 - 6.5 - 7.3 - 8.1
-
-       // there are n_bins - 1 cases we need to think about
-       // L part[0]: bin 0         - AND - R part[0]: bin 1 - bin 7
-       // L part[1]: bin 0 - bin 1 - AND - R part[1]: bin 2 - bin 7
-       // L part[2]: bin 0 - bin 2 - AND - R part[2]: bin 3 - bin 7
-       // L part[3]: bin 0 - bin 3 - AND - R part[3]: bin 4 - bin 7
-       // L part[4]: bin 0 - bin 4 - AND - R part[4]: bin 5 - bin 7
-       // L part[5]: bin 0 - bin 5 - AND - R part[5]: bin 6 - bin 7
-       // L part[6]: bin 0 - bin 6 - AND - R part[6]: bin 7
-
-       // L-side computation
-       NL[0] = bintris[0];
-       BL[0] = binlist[0];
-       for(unsigned int i = 1; i < n_part; i++) {
-           NL[i] = NL[i - 1] + bintris[i];
-           BL[i].from(BL[i - 1], binlist[i]);
-          }
+       // left child is pushed last so that it is the next node
+       nodes[index].params[0] = index + 1;
+       stack.push_back({ mid, item.last, index });
+       stack.push_back({ item.first, mid, index });
+      }
 
-       // R-side computation
-       unsigned int j = n_part - 1;
-       unsigned int k = n_part;
-       NR[j] = bintris[k];
-       BR[j] = binlist[k];
-       for(unsigned int i = 1; i < n_part; i++) {
-           j--;
-           k--;           
-           NR[j] = NR[k] + bintris[k];
-           BR[j].from(BR[k], binlist[k]);
-          }
+ // bounds (reverse pass)
+ for(size_t i = nodes.size(); i > 0; i--) {
+     AABB_node& node = nodes[i - 1];
+     if(node.params[0] & 0x80000000ul) {
+        unsigned int first = (node.params[0] & 0x7FFFFFFFul);
+        node.aabb.from(data.blist[first]);
+        for(unsigned int j = 1; j < node.params[1]; j++) node.aabb.grow(data.blist[first + j]);
+       }
+     else node.aabb.from(nodes[node.params[0]].aabb, nodes[node.params[1]].aabb);
+    }
+
+ // optional SAH restructuring
+ if(options.treelets) treelets(nodes, options);
+}
+
+void BVH::treelets(std::vector<AABB_node>& nodes, const BVHBuildOptions& options)
+{
+ // Treelet restructuring (Karras and Aila, 2013)
+ // A treelet is a node plus its subtree cut off at up to seven treelet leaves, found by
+ // repeatedly opening the treelet leaf with the largest area. The best SAH topology over the
+ // treelet leaves is found by dynamic programming over all subsets of the leaves, and then
+ // built from the same nodes. Nodes are visited bottom-up so that subtrees below a treelet
+ // have already been optimized. Nodes use explicit left child indices here, so node order
+ // does not matter until the tree is flattened.
+ const unsigned int max_leaves = 7;
+ const unsigned int n_subsets = (1u << max_leaves);
+ const float Ct = options.traversal_cost;
+ const float Ci = options.intersect_cost;
+ auto LEAF = [&](unsigned int index) { return (nodes[index].params[0] & 0x80000000ul) != 0; };
 
-       // if unrolling loops and hardcoding bins
-       // NR[6] = bintris[7];
-       // BR[6] = binlist[7];
-       // NR[5] = NR[6] + bintris[6]; BR[5].from(BR[6], binlist[6]);
-       // NR[4] = NR[5] + bintris[5]; BR[4].from(BR[5], binlist[5]);
-       // NR[3] = NR[4] + bintris[4]; BR[3].from(BR[4], binlist[4]);
-       // NR[2] = NR[3] + bintris[3]; BR[2].from(BR[3], binlist[3]);
-       // NR[1] = NR[2] + bintris[2]; BR[1].from(BR[2], binlist[2]);
-       // NR[0] = NR[1] + bintris[1]; BR[0].from(BR[1], binlist[1]);
-
-       // compute index of best partition
-       unsigned int best_index = 0;
-       costs[0] = NL[0]*half_surface_area(BL[0]) + NR[0]*half_surface_area(BR[0]);
-       for(unsigned int i = 1; i < n_part; i++) {
-           costs[i] = NL[i]*half_surface_area(BL[i]) + NR[i]*half_surface_area(BR[i]);
-           if(costs[i] < costs[best_index]) best_index = i;
+ // SAH cost of every subtree (bottom-up)
+ std::vector<float> cost(nodes.size());
+ for(size_t i = nodes.size(); i > 0; i--) {
+     const AABB_node& node = nodes[i - 1];
+     if(node.params[0] & 0x80000000ul) cost[i - 1] = Ci*node.params[1]*half_surface_area(node.aabb);
+     else cost[i - 1] = Ct*half_surface_area(node.aabb) + cost[node.params[0]] + cost[node.params[1]];
+    }
+
+ // per-subset data
+ AABB_minmax bounds[n_subsets];
+ float best_cost[n_subsets];
+ unsigned int best_split[n_subsets];
+
+ // the root of a treelet keeps its index, and nodes inside a treelet are only reused within
+ // the same treelet, so visiting nodes in reverse index order is still bottom-up
+ for(size_t r = nodes.size(); r > 0; r--)
+    {
+     unsigned int root = static_cast<unsigned int>(r - 1);
+     if(LEAF(root)) continue;
+
+     // form treelet
+     unsigned int leaves[max_leaves];
+     unsigned int inner[max_leaves];
+     unsigned int n_leaves = 0;
+     unsigned int n_inner = 0;
+     inner[n_inner++] = root;
+     leaves[n_leaves++] = nodes[root].params[0];
+     leaves[n_leaves++] = nodes[root].params[1];
+     while(n_leaves < max_leaves) {
+           unsigned int best = max_leaves;
+           float best_area = -1.0f;
+           for(unsigned int i = 0; i < n_leaves; i++) {
+               if(LEAF(leaves[i])) continue;
+               float area = half_surface_area(nodes[leaves[i]].aabb);
+               if(best_area < area) { best = i; best_area = area; }
+              }
+           if(best == max_leaves) break;
+           unsigned int index = leaves[best];
+           inner[n_inner++] = index;
+           leaves[best] = nodes[index].params[0];
+           leaves[n_leaves++] = nodes[index].params[1];
           }
+     if(n_leaves < 3) continue;
 
-       //
-       // STEP #6
-       // INDEX BUFFER SORTING
-       //
-
-       // sort index buffer
-       unsigned int L_count = 0;
-       unsigned int L_pivot = face_index[0];
-       unsigned int R_pivot = face_index[1] - 1;
-
-       // stop when L_count matches with the number of faces on the L-side
-       while(L_count < NL[best_index])
-            {
-             // bin for L_pivot is on R-side
-             unsigned int i = BIN_INDEX_FROM_FACE(L_pivot);
-             if(best_index < i)
-               {
-                for(;;)
-                   {
-                    // bin for R_pivot is on R-side (just move R_pivot over)
-                    unsigned int j = BIN_INDEX_FROM_FACE(R_pivot);
-                    if(best_index < j) R_pivot--;
-                    // bin for R_pivot is on L-side
-                    else
-                      {
-                       // swap faces
-                       unsigned int L_face = 3*L_pivot;
-                       unsigned int R_face = 3*R_pivot;
-                       std::swap(faces[L_face++], faces[R_face++]);
-                       std::swap(faces[L_face++], faces[R_face++]);
-                       std::swap(faces[L_face], faces[R_face]);
-                       // swap per-face centroids
-                       std::swap(clist[L_pivot][0], clist[R_pivot][0]);
-                       std::swap(clist[L_pivot][1], clist[R_pivot][1]);
-                       std::swap(clist[L_pivot][2], clist[R_pivot][2]);
-                       // swap per-face AABBs
-                       std::swap(blist[L_pivot], blist[R_pivot]);
-                       // move pivots
-                       L_pivot++;
-                       R_pivot--;
-                       L_count++;
-                       break;
-                      }
-                   }
-               }
-             // bin for L_pivot is on L-side (just move L_pivot over)
-             else {
-                L_pivot++;
-                L_count++;
+     // subset bounds and costs (a subset is a bit mask of treelet leaves)
+     unsigned int full = (1u << n_leaves) - 1;
+     for(unsigned int s = 1; s <= full; s++) {
+         unsigned int lowest = (s & (~s + 1));
+         unsigned int i = 0;
+         while(!(lowest & (1u << i))) i++;
+         if(s == lowest) {
+            bounds[s].from(nodes[leaves[i]].aabb);
+            best_cost[s] = cost[leaves[i]];
+            continue;
+           }
+         bounds[s].from(bounds[s ^ lowest], nodes[leaves[i]].aabb);
+
+         // try every split of s into two nonempty subsets (p always holds the lowest leaf so
+         // that each split is tried once)
+         best_cost[s] = std::numeric_limits<float>::max();
+         best_split[s] = 0;
+         unsigned int rest = (s ^ lowest);
+         for(unsigned int q = rest; ; q = (q - 1) & rest) {
+             unsigned int p = (q | lowest);
+             if(p != s) {
+                float c = best_cost[p] + best_cost[s ^ p];
+                if(c < best_cost[s]) {
+                   best_cost[s] = c;
+                   best_split[s] = p;
+                  }
                }
+             if(!q) break;
+            }
+         best_cost[s] += Ct*half_surface_area(bounds[s]);
+        }
+
+     // keep current topology unless it is improved
+     if(!(best_cost[full] < 0.999f*cost[root])) continue;
+
+     // rebuild treelet with its own inner nodes (root first)
+     struct { unsigned int subset; unsigned int index; } stack[max_leaves];
+     unsigned int size = 0;
+     unsigned int next = 1;
+     stack[size].subset = full;
+     stack[size].index = root;
+     size++;
+     while(size) {
+           size--;
+           unsigned int s = stack[size].subset;
+           unsigned int index = stack[size].index;
+           unsigned int children[2] = { best_split[s], s ^ best_split[s] };
+           for(unsigned int k = 0; k < 2; k++) {
+               unsigned int c = children[k];
+               if(!(c & (c - 1))) {
+                  unsigned int i = 0;
+                  while(!(c & (1u << i))) i++;
+                  nodes[index].params[k] = leaves[i];
+                 }
+               else {
+                  unsigned int child = inner[next++];
+                  nodes[index].params[k] = child;
+                  stack[size].subset = c;
+                  stack[size].index = child;
+                  size++;
+                 }
+              }
+           nodes[index].aabb.from(bounds[s]);
+           cost[index] = best_cost[s];
+          }
+    }
+}
+
+unsigned int BVH::split(std::vector<AABB_node>& nodes, const BVHSTACKITEM& item, const BVHFACEDATA& data, const BVHBuildOptions& options, BVHSTACKITEM* children, uint32 n_threads)
+{
+ // binning example
+ // dv = (max_v - min_v)/n_bin = (2*box_w)/n_bin
+ // bin       0     1     2     3     4     5     6     7
+ // range 4.0 - 4.5 - 5.0 - 5.5 - 6.0 - 6.5 - 7.0 - 7.5 - 8.0 (split_v)
+ // L_cnt     x     x     x     x     x     x     x     x
+ // R_cnt     x     x     x     x     x     x     x     x 
+
+ // per-face data
+ AABB_minmax* blist = data.blist;
+ vector3D* clist = data.clist;
+ uint32* faces = data.faces;
+
+ // per-bin data (for each axis)
+ AABB_minmax binlist[3][max_bins];
+ unsigned int bintris[3][max_bins];
+
+ // per-partition data
+ float costs[max_bins - 1];
+ unsigned int NL[max_bins - 1];
+ unsigned int NR[max_bins - 1];
+ AABB_minmax BL[max_bins - 1];
+ AABB_minmax BR[max_bins - 1];
+
+ //
+ // STEP #1
+ // OBTAIN PARTITION
+ //
+
+ unsigned int tree_index = item.tree_index;
+ unsigned int face_index[2] = { item.face_index[0], item.face_index[1] };
+ unsigned int n_children = 0;
+
+ //
+ // STEP #2
+ // CALCULATE PARTITION BOUNDS
+ //
+
+ // per-partition data (all triangle bounds, all centroid bounds)
+ // with multiple threads, each thread reduces a chunk and the chunks are merged (min/max is
+ // order independent, so the result is the same as a single-threaded reduction)
+ std::vector<AABB_minmax> tpart(n_threads, AABB_minmax(blist[face_index[0]]));
+ std::vector<AABB_minmax> cpart(n_threads, AABB_minmax(clist[face_index[0]]));
+ parallel_for(n_threads, face_index[0], face_index[1], [&](unsigned int first, unsigned int last, unsigned int thread) {
+  for(unsigned int i = first; i < last; i++) {
+      tpart[thread].grow(blist[i]);
+      cpart[thread].grow(clist[i]);
+     }
+ });
+ AABB_minmax tbounds(tpart[0]);
+ AABB_minmax cbounds(cpart[0]);
+ for(uint32 i = 1; i < n_threads; i++) {
+     tbounds.grow(tpart[i]);
+     cbounds.grow(cpart[i]);
+    }
+
+ //
+ // STEP #3
+ // SPLIT AXES
+ //
+
+ // choose dominant axis from "longest-axis" of centroid bounds
+ float dv[3]; // dx, dy, dz saved from computing dominator
+ unsigned int axis = cbounds.dominator(dv);
+
+ // dominant axis is too small, make this is a leaf node
+ // 1.0e-6f is just a suggestion, but it can be made bigger, like 0.01f or something
+ if(dv[axis] < 1.0e-6f) {
+    nodes[tree_index].aabb.from(tbounds);
+    nodes[tree_index].params[0] = face_index[0] | 0x80000000ul; // mark as a leaf node
+    nodes[tree_index].params[1] = face_index[1] - face_index[0];
+    return n_children;
+   }
+
+ // bin along the dominant axis only or along every axis that is not too small
+ unsigned int axes[3] = { axis, 0, 0 };
+ unsigned int n_axes = 1;
+ if(options.all_axes) {
+    n_axes = 0;
+    for(unsigned int i = 0; i < 3; i++)
+        if(!(dv[i] < 1.0e-6f)) axes[n_axes++] = i;
+   }
+
+ //
+ // STEP #4
+ // COMPUTE BINS
+ //
+
+ // start = cbounds.a[axis] + i*(dv[axis]/n_bins)
+ // i = (start - cbounds.a[axis])/(dv[axis]/n_bins)
+ // i = n_bins*(start - cbounds.a[axis])/dv[axis]
+ // let k0 = cbounds.a[axis]
+ // let k1 = n_bins/dv[axis]
+ // i = k1*(start - k0)
+
+ //   0     1     2     3     4     5     6     7     8
+ // 1.7 - 2.5 - 3.3 - 4.1 - 4.9 - 5.7 - 6.5 - 7.3 - 8.1
+ // dv[x] = (8.1 - 1.7) = 6.4
+ // k1 = 8*1/6.4 = 1.25 (1.24999875 with epsilon)
+
+ // for example given, start = 3.0
+ // i = k1*(3.0 - k0)
+ // i = (1.25)*(3.0 - 1.7) = 1.625
+
+ // for example given, start = 3.3
+ // i = k1*(3.3 - k0)
+ // i = (1.25)*(3.3 - 1.7) = 2.0
+
+ // so what the epsilon does is that if anything is on the edge
+ // of the next bin, like for example when start = 8.1, it will
+ // place that triangle in the bin before it
+
+ // binning constants
+ const unsigned int n_bins = options.n_bins;
+ const unsigned int n_part = n_bins - 1;
+ float k0[3];
+ float k1[3];
+ for(unsigned int i = 0; i < n_axes; i++) {
+     k0[axes[i]] = cbounds.a[axes[i]];
+     k1[axes[i]] = n_bins*(1.0f - 1.0e-6f)/dv[axes[i]];
+    }
+
+ // lambdas
+ auto BIN_INDEX_FROM_FACE = [&](unsigned int face, unsigned int axis) { return static_cast<unsigned int>(k1[axis]*(clist[face][axis] - k0[axis])); };
+ auto BIN_LIMIT_TEST = [](unsigned int a) { return (a < 2ul); };
+
+ // initialize per-bin data
+ for(unsigned int a = 0; a < n_axes; a++) {
+     for(unsigned int i = 0; i < n_bins; i++) {
+         bintris[a][i] = 0;
+         binlist[a][i].from(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+        }
+    }
+
+ // count number of triangles in bins and grow the bin AABBs to fit the triangles that are in each bin
+ if(n_threads < 2) {
+    for(unsigned int i = face_index[0]; i < face_index[1]; i++) {
+        for(unsigned int a = 0; a < n_axes; a++) {
+            unsigned int binindex = BIN_INDEX_FROM_FACE(i, axes[a]);
+            bintris[a][binindex]++;
+            binlist[a][binindex].grow(blist[i]);
+           }
+       }
+   }
+ // with multiple threads, each thread bins a chunk and the per-thread bins are merged
+ else {
+    const unsigned int stride = 3*max_bins;
+    std::vector<unsigned int> tbintris(n_threads*stride, 0);
+    std::vector<AABB_minmax> tbinlist(n_threads*stride, binlist[0][0]);
+    parallel_for(n_threads, face_index[0], face_index[1], [&](unsigned int first, unsigned int last, unsigned int thread) {
+     unsigned int* counts = &tbintris[thread*stride];
+     AABB_minmax* bounds = &tbinlist[thread*stride];
+     for(unsigned int i = first; i < last; i++) {
+         for(unsigned int a = 0; a < n_axes; a++) {
+             unsigned int binindex = a*max_bins + BIN_INDEX_FROM_FACE(i, axes[a]);
+             counts[binindex]++;
+             bounds[binindex].grow(blist[i]);
             }
+        }
+    });
+    for(uint32 i = 0; i < n_threads; i++) {
+        for(unsigned int a = 0; a < n_axes; a++) {
+            for(unsigned int j = 0; j < n_bins; j++) {
+                bintris[a][j] += tbintris[i*stride + a*max_bins + j];
+                binlist[a][j].grow(tbinlist[i*stride + a*max_bins + j]);
+               }
+           }
+       }
+   }
 
-       //
-       // STEP #7
-       // DIVIDE AND CONQUER
-       //
-
-       // this node
-       tree[tree_index].aabb = tbounds;
-       tree[tree_index].params[0] = static_cast<uint32>(tree.size());
-       tree[tree_index].params[1] = static_cast<uint32>(tree.size() + 1);
-
-       // L = leaf
-       tree.push_back(AABB_node());
-       if(BIN_LIMIT_TEST(NL[best_index])) {
-          tree.back().params[0] = (face_index[0] | 0x80000000ul);
-          tree.back().params[1] = NL[best_index];
-          tree.back().aabb.from(BL[best_index]);
+ //
+ // STEP #5
+ // PARTITIONING
+ //
+
+ //  bin:   0     1     2     3     4     5     6     7     8
+ // axis: 1.7 - 2.5 - 3.3 - 4.1 - 4.9 - 5.7 - 6.5 - 7.3 - 8.1
+
+ // there are n_bins - 1 cases we need to think about
+ // L part[0]: bin 0         - AND - R part[0]: bin 1 - bin 7
+ // L part[1]: bin 0 - bin 1 - AND - R part[1]: bin 2 - bin 7
+ // L part[2]: bin 0 - bin 2 - AND - R part[2]: bin 3 - bin 7
+ // L part[3]: bin 0 - bin 3 - AND - R part[3]: bin 4 - bin 7
+ // L part[4]: bin 0 - bin 4 - AND - R part[4]: bin 5 - bin 7
+ // L part[5]: bin 0 - bin 5 - AND - R part[5]: bin 6 - bin 7
+ // L part[6]: bin 0 - bin 6 - AND - R part[6]: bin 7
+
+ // best partition over all axes
+ unsigned int best_axis = axes[0];
+ unsigned int best_index = 0;
+ float best_cost = std::numeric_limits<float>::max();
+ unsigned int best_NL = 0;
+ unsigned int best_NR = 0;
+ AABB_minmax best_BL(tbounds);
+ AABB_minmax best_BR(tbounds);
+
+ for(unsigned int a = 0; a < n_axes; a++)
+    {
+     // L-side computation
+     NL[0] = bintris[a][0];
+     BL[0].from(binlist[a][0]);
+     for(unsigned int i = 1; i < n_part; i++) {
+         NL[i] = NL[i - 1] + bintris[a][i];
+         BL[i].from(BL[i - 1], binlist[a][i]);
+        }
+
+     // R-side computation
+     unsigned int j = n_part - 1;
+     unsigned int k = n_part;
+     NR[j] = bintris[a][k];
+     BR[j].from(binlist[a][k]);
+     for(unsigned int i = 1; i < n_part; i++) {
+         j--;
+         k--;
+         NR[j] = NR[k] + bintris[a][k];
+         BR[j].from(BR[k], binlist[a][k]);
+        }
+
+     // compute index of best partition
+     for(unsigned int i = 0; i < n_part; i++) {
+         costs[i] = NL[i]*half_surface_area(BL[i]) + NR[i]*half_surface_area(BR[i]);
+         if(costs[i] < best_cost) {
+            best_axis = axes[a];
+            best_index = i;
+            best_cost = costs[i];
+            best_NL = NL[i];
+            best_NR = NR[i];
+            best_BL.from(BL[i]);
+            best_BR.from(BR[i]);
+           }
+        }
+    }
+
+ // SAH termination
+ // a leaf costs one intersection per triangle, while a split costs one traversal plus the
+ // intersections of both children weighted by the probability of hitting them
+ unsigned int n_faces = face_index[1] - face_index[0];
+ if(options.sah_termination && n_faces <= options.max_leaf_size) {
+    float area = half_surface_area(tbounds);
+    float leaf_cost = options.intersect_cost*n_faces*area;
+    float split_cost = options.traversal_cost*area + options.intersect_cost*best_cost;
+    if(!(split_cost < leaf_cost)) {
+       nodes[tree_index].aabb.from(tbounds);
+       nodes[tree_index].params[0] = face_index[0] | 0x80000000ul; // mark as a leaf node
+       nodes[tree_index].params[1] = n_faces;
+       return n_children;
+      }
+   }
+
+ //
+ // STEP #6
+ // INDEX BUFFER SORTING
+ //
+
+ // sort index buffer
+ unsigned int L_count = 0;
+ unsigned int L_pivot = face_index[0];
+ unsigned int R_pivot = face_index[1] - 1;
+
+ // stop when L_count matches with the number of faces on the L-side
+ while(L_count < best_NL)
+      {
+       // bin for L_pivot is on R-side
+       unsigned int i = BIN_INDEX_FROM_FACE(L_pivot, best_axis);
+       if(best_index < i)
+         {
+          for(;;)
+             {
+              // bin for R_pivot is on R-side (just move R_pivot over)
+              unsigned int j = BIN_INDEX_FROM_FACE(R_pivot, best_axis);
+              if(best_index < j) R_pivot--;
+              // bin for R_pivot is on L-side
+              else
+                {
+                 // swap faces
+                 unsigned int L_face = 3*L_pivot;
+                 unsigned int R_face = 3*R_pivot;
+                 std::swap(faces[L_face++], faces[R_face++]);
+                 std::swap(faces[L_face++], faces[R_face++]);
+                 std::swap(faces[L_face], faces[R_face]);
+                 // swap per-face centroids
+                 std::swap(clist[L_pivot][0], clist[R_pivot][0]);
+                 std::swap(clist[L_pivot][1], clist[R_pivot][1]);
+                 std::swap(clist[L_pivot][2], clist[R_pivot][2]);
+                 // swap per-face AABBs
+                 std::swap(blist[L_pivot], blist[R_pivot]);
+                 // move pivots
+                 L_pivot++;
+                 R_pivot--;
+                 L_count++;
+                 break;
+                }
+             }
          }
-       // L = node
+       // bin for L_pivot is on L-side (just move L_pivot over)
        else {
-          stack.push_front(BVHSTACKITEM());
-          stack.front().tree_index = tree[tree_index].params[0];
-          stack.front().face_index[0] = face_index[0];
-          stack.front().face_index[1] = face_index[0] + L_count;
+          L_pivot++;
+          L_count++;
          }
+      }
 
-         // R = leaf
-         tree.push_back(AABB_node());
-         if(BIN_LIMIT_TEST(NR[best_index])) {
-            unsigned int pivot = face_index[0] + L_count;
-            tree.back().params[0] = (pivot | 0x80000000ul);
-            tree.back().params[1] = NR[best_index];
-            tree.back().aabb.from(BR[best_index]);
-           }
-         // R = node
-         else {
-            stack.push_front(BVHSTACKITEM());
-            stack.front().tree_index = tree[tree_index].params[1];
-            stack.front().face_index[0] = face_index[0] + L_count;
-            stack.front().face_index[1] = face_index[1];
+ //
+ // STEP #7
+ // DIVIDE AND CONQUER
+ //
+
+ // this node
+ nodes[tree_index].aabb.from(tbounds);
+ nodes[tree_index].params[0] = static_cast<uint32>(nodes.size());
+ nodes[tree_index].params[1] = static_cast<uint32>(nodes.size() + 1);
+
+ // L = leaf
+ nodes.push_back(AABB_node());
+ if(BIN_LIMIT_TEST(best_NL)) {
+    nodes.back().params[0] = (face_index[0] | 0x80000000ul);
+    nodes.back().params[1] = best_NL;
+    nodes.back().aabb.from(best_BL);
+   }
+ // L = node
+ else {
+    children[n_children].tree_index = nodes[tree_index].params[0];
+    children[n_children].face_index[0] = face_index[0];
+    children[n_children].face_index[1] = face_index[0] + L_count;
+    n_children++;
+   }
+
+   // R = leaf
+   nodes.push_back(AABB_node());
+   if(BIN_LIMIT_TEST(best_NR)) {
+      unsigned int pivot = face_index[0] + L_count;
+      nodes.back().params[0] = (pivot | 0x80000000ul);
+      nodes.back().params[1] = best_NR;
+      nodes.back().aabb.from(best_BR);
+     }
+   // R = node
+   else {
+      children[n_children].tree_index = nodes[tree_index].params[1];
+      children[n_children].face_index[0] = face_index[0] + L_count;
+      children[n_children].face_index[1] = face_index[1];
+      n_children++;
+     }
+
+ return n_children;
+}
+
+void BVH::flatten(void)
+{
+ // nothing to do
+ if(tree.empty()) return;
+
+ // copy nodes in depth-first order (left subtree before right subtree)
+ std::vector<AABB_node> dfs;
+ dfs.reserve(tree.size());
+ std::vector<unsigned int> remap(tree.size());
+ std::vector<unsigned int> stack;
+ stack.push_back(0);
+ while(stack.size()) {
+       unsigned int index = stack.back();
+       stack.pop_back();
+       remap[index] = static_cast<unsigned int>(dfs.size());
+       dfs.push_back(tree[index]);
+       if(!(tree[index].params[0] & 0x80000000ul)) {
+          stack.push_back(tree[index].params[1]);
+          stack.push_back(tree[index].params[0]);
+         }
+      }
+
+ // right child indices (old to new)
+ for(size_t i = 0; i < dfs.size(); i++)
+     if(!(dfs[i].params[0] & 0x80000000ul)) dfs[i].params[1] = remap[dfs[i].params[1]];
+
+ // escape indices (in reverse order so that right children are done first)
+ // the subtree of a node ends where the subtree of its right child ends
+ for(size_t i = dfs.size(); i > 0; i--) {
+     AABB_node& node = dfs[i - 1];
+     if(node.params[0] & 0x80000000ul) continue;
+     unsigned int R = node.params[1];
+     node.params[0] = ((dfs[R].params[0] & 0x80000000ul) ? (R + 1) : dfs[R].params[0]);
+    }
+
+ tree = std::move(dfs);
+ bind();
+}
+
+float BVH::sah(void)const
+{
+ // SAH cost relative to root surface area (unit traversal and intersection costs)
+ if(!view_size) return 0.0f;
+ float cost = 0.0f;
+ for(size_t i = 0; i < view_size; i++) {
+     const AABB_node& node = view[i];
+     if(node.params[0] & 0x80000000ul) cost += node.params[1]*half_surface_area(node.aabb);
+     else cost += half_surface_area(node.aabb);
+    }
+ float root_area = half_surface_area(view[0].aabb);
+ return (root_area < 1.0e-12f ? 0.0f : cost/root_area);
+}
+
+void BVH::refit(const vector3D* verts)
+{
+ // vertices have moved, but the faces and the tree topology stay the same
+ if(!view_size || !verts) return;
+ this->verts = verts;
+ own();
+
+ // children always come after their parent in depth-first order, so a reverse pass updates
+ // both children of a node before the node itself
+ for(size_t i = tree.size(); i > 0; i--)
+    {
+     AABB_node& node = tree[i - 1];
+     // leaf
+     if(node.params[0] & 0x80000000ul) {
+        unsigned int face = (node.params[0] & 0x7FFFFFFFul);
+        unsigned int last = face + node.params[1];
+        const uint32* f = &faces[3*face];
+        node.aabb.from(verts[f[0]].v, verts[f[1]].v, verts[f[2]].v);
+        for(face++; face < last; face++) {
+            f = &faces[3*face];
+            node.aabb.grow(verts[f[0]].v);
+            node.aabb.grow(verts[f[1]].v);
+            node.aabb.grow(verts[f[2]].v);
            }
+       }
+     // node
+     else
+        node.aabb.from(tree[i].aabb, tree[node.params[1]].aabb);
+    }
+
+ // tree quality
+ refit_cost = sah();
+
+ // baked triangles have moved too
+ if(baked()) bake();
+}
+
+bool BVH::rebalance(float threshold)
+{
+ // rotations need at least one grandchild
+ if(view_size < 5) return false;
+ if(!(refit_cost > threshold*build_cost)) return false;
+ own();
+
+ // store left children explicitly (node order is about to change)
+ for(size_t i = 0; i < tree.size(); i++)
+     if(!(tree[i].params[0] & 0x80000000ul)) tree[i].params[0] = static_cast<unsigned int>(i + 1);
+
+ // tree rotations (bottom-up)
+ // a child can be swapped with a grandchild under the other child, which only changes the
+ // bounds of the other child, so keep the swap that shrinks the other child the most
+ auto LEAF = [&](unsigned int index) { return (tree[index].params[0] & 0x80000000ul) != 0; };
+ bool rotated = false;
+ for(size_t i = tree.size(); i > 0; i--)
+    {
+     AABB_node& node = tree[i - 1];
+     if(node.params[0] & 0x80000000ul) continue;
+     float best_delta = 0.0f;
+     unsigned int best_side = 0;
+     unsigned int best_grandchild = 0;
+     AABB_minmax best_aabb(node.aabb);
+     for(unsigned int side = 0; side < 2; side++) {
+         unsigned int child = node.params[side];
+         unsigned int other = node.params[side ^ 1];
+         if(LEAF(other)) continue;
+         for(unsigned int g = 0; g < 2; g++) {
+             // other's children become child and other's remaining child
+             AABB_minmax aabb;
+             aabb.from(tree[child].aabb, tree[tree[other].params[g ^ 1]].aabb);
+             float delta = half_surface_area(aabb) - half_surface_area(tree[other].aabb);
+             if(delta < best_delta) {
+                best_delta = delta;
+                best_side = side;
+                best_grandchild = g;
+                best_aabb.from(aabb);
+               }
+            }
+        }
+     if(!(best_delta < 0.0f)) continue;
+     unsigned int child = node.params[best_side];
+     unsigned int other = node.params[best_side ^ 1];
+     node.params[best_side] = tree[other].params[best_grandchild];
+     tree[other].params[best_grandchild] = child;
+     tree[other].aabb.from(best_aabb);
+     rotated = true;
+    }
+
+ // restore depth-first order (node order is unchanged if nothing was rotated, but escape
+ // indices were overwritten)
+ flatten();
+ refit_cost = sah();
+
+ // leaves have new node indices
+ if(baked()) bake();
+ return rotated;
+}
+
+void BVH::bake(void)
+{
+ // bake triangles of each leaf into SoA blocks of four (a leaf of n triangles uses n/4 blocks,
+ // rounded up, and unused slots are degenerate triangles that can never be hit)
+ blocks.clear();
+ leaf_blocks.assign(view_size, 0);
+ if(!view_size || !verts || !faces) return;
+ for(unsigned int i = 0; i < view_size; i++) {
+     const AABB_node& node = view[i];
+     if(!(node.params[0] & 0x80000000ul)) continue;
+     leaf_blocks[i] = static_cast<unsigned int>(blocks.size());
+     unsigned int face = (node.params[0] & 0x7FFFFFFFul);
+     unsigned int last = face + node.params[1];
+     for(; face < last; face += 4) {
+         BVHTriangleBlock block = {};
+         for(unsigned int j = 0; j < 4 && (face + j) < last; j++) {
+             const uint32* f = &faces[3*(face + j)];
+             const vector3D& A = verts[f[0]];
+             const vector3D& B = verts[f[1]];
+             const vector3D& C = verts[f[2]];
+             for(int k = 0; k < 3; k++) {
+                 block.A[k][j] = A[k];
+                 block.E1[k][j] = B[k] - A[k];
+                 block.E2[k][j] = C[k] - A[k];
+                }
+            }
+         blocks.push_back(block);
+        }
+    }
+}
+
+bool BVH::identical(const BVH& other)const
+{
+ // same nodes in the same order
+ if(view_size != other.view_size) return false;
+ for(size_t i = 0; i < view_size; i++) {
+     const AABB_node& a = view[i];
+     const AABB_node& b = other.view[i];
+     if(a.params[0] != b.params[0] || a.params[1] != b.params[1]) return false;
+     for(int j = 0; j < 3; j++) {
+         if(a.aabb.a[j] != b.aabb.a[j]) return false;
+         if(a.aabb.b[j] != b.aabb.b[j]) return false;
+        }
+    }
+ return true;
+}
+
+void BVH::quality(BVHQualityReport& report, float traversal_cost, float intersect_cost)const
+{
+ report.sah_cost = 0.0f;
+ report.n_nodes = view_size;
+ report.n_leaves = 0;
+ report.max_depth = 0;
+ report.avg_depth = 0.0f;
+ report.avg_leaf_size = 0.0f;
+ report.leaf_sizes.clear();
+ report.depths.clear();
+ if(!view_size) return;
+
+ // children always come after their parent in depth-first order, so depths can be set in one pass
+ std::vector<uint32> depth(view_size, 0);
+ float root_area = half_surface_area(view[0].aabb);
+ if(root_area < 1.0e-12f) root_area = 1.0f;
+ uint64 n_faces = 0;
+ uint64 sum_depth = 0;
+
+ for(size_t i = 0; i < view_size; i++)
+    {
+     const AABB_node& node = view[i];
+     float p = half_surface_area(node.aabb)/root_area;
+     // leaf
+     if(node.params[0] & 0x80000000ul) {
+        uint32 n = node.params[1];
+        uint32 d = depth[i];
+        report.sah_cost += intersect_cost*n*p;
+        report.n_leaves++;
+        if(report.max_depth < d) report.max_depth = d;
+        if(report.leaf_sizes.size() <= n) report.leaf_sizes.resize(n + 1, 0);
+        if(report.depths.size() <= d) report.depths.resize(d + 1, 0);
+        report.leaf_sizes[n]++;
+        report.depths[d]++;
+        n_faces += n;
+        sum_depth += static_cast<uint64>(n)*d;
+       }
+     // node
+     else {
+        report.sah_cost += traversal_cost*p;
+        depth[i + 1] = depth[i] + 1;
+        depth[node.params[1]] = depth[i] + 1;
+       }
+    }
+
+ if(report.n_leaves) report.avg_leaf_size = static_cast<float>(n_faces)/report.n_leaves;
+ if(n_faces) report.avg_depth = static_cast<float>(sum_depth)/n_faces;
+}
+
+static inline bool ray3D_triangle_block_intersect(real32& t, const __m128* O, const __m128* V, const BVHTriangleBlock& block)
+{
+ // Moller-Trumbore test of four triangles (same operations in the same order as
+ // ray3D_triangle_intersect, so each lane gives exactly the same answer)
+ __m128 e1[3] = { _mm_load_ps(block.E1[0]), _mm_load_ps(block.E1[1]), _mm_load_ps(block.E1[2]) };
+ __m128 e2[3] = { _mm_load_ps(block.E2[0]), _mm_load_ps(block.E2[1]), _mm_load_ps(block.E2[2]) };
+
+ // determinant is zero when ray is parallel to triangle plane (and for unused slots)
+ __m128 p[3];
+ p[0] = _mm_sub_ps(_mm_mul_ps(V[1], e2[2]), _mm_mul_ps(V[2], e2[1]));
+ p[1] = _mm_sub_ps(_mm_mul_ps(V[2], e2[0]), _mm_mul_ps(V[0], e2[2]));
+ p[2] = _mm_sub_ps(_mm_mul_ps(V[0], e2[1]), _mm_mul_ps(V[1], e2[0]));
+ __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], p[0]), _mm_mul_ps(e1[1], p[1])), _mm_mul_ps(e1[2], p[2]));
+ __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+ __m128 mask = _mm_cmpnlt_ps(abs_det, _mm_set1_ps(epsilon()));
+ if(!_mm_movemask_ps(mask)) return false;
+ __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+ // first barycentric coordinate
+ __m128 s[3] = { _mm_sub_ps(O[0], _mm_load_ps(block.A[0])), _mm_sub_ps(O[1], _mm_load_ps(block.A[1])), _mm_sub_ps(O[2], _mm_load_ps(block.A[2])) };
+ __m128 u = _mm_mul_ps(inv_det, _mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], p[0]), _mm_mul_ps(s[1], p[1])), _mm_mul_ps(s[2], p[2])));
+ mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpnlt_ps(u, _mm_setzero_ps()), _mm_cmpngt_ps(u, _mm_set1_ps(1.0f))));
+ if(!_mm_movemask_ps(mask)) return false;
+
+ // second barycentric coordinate
+ __m128 q[3];
+ q[0] = _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1]));
+ q[1] = _mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2]));
+ q[2] = _mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0]));
+ __m128 v = _mm_mul_ps(inv_det, _mm_add_ps(_mm_add_ps(_mm_mul_ps(V[0], q[0]), _mm_mul_ps(V[1], q[1])), _mm_mul_ps(V[2], q[2])));
+ mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpnlt_ps(v, _mm_setzero_ps()), _mm_cmpngt_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f))));
+ if(!_mm_movemask_ps(mask)) return false;
+
+ // distance along ray (must be in front of the ray and no farther than the closest hit)
+ __m128 distance = _mm_mul_ps(inv_det, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], q[0]), _mm_mul_ps(e2[1], q[1])), _mm_mul_ps(e2[2], q[2])));
+ mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpnlt_ps(distance, _mm_setzero_ps()), _mm_cmpnlt_ps(_mm_set1_ps(t), distance)));
+ int bits = _mm_movemask_ps(mask);
+ if(!bits) return false;
+
+ // keep nearest hit
+ alignas(16) real32 d[4];
+ _mm_store_ps(d, distance);
+ for(int i = 0; i < 4; i++) if((bits & (1 << i)) && d[i] < t) t = d[i];
+ return true;
+}
+
+bool BVH::intersect(const real32* O, const real32* V, real32& t, uint32& visits)const
+{
+ // reciprocal of segment vector (zero components map to a huge value instead of infinity so
+ // that 0*inv_V stays 0 when the segment starts on a slab plane)
+ real32 inv_V[3];
+ for(int i = 0; i < 3; i++) inv_V[i] = (V[i] != 0.0f ? inv(V[i]) : std::numeric_limits<real32>::max());
+
+ // box padding (see segment_AABB_test)
+ if(!view_size) return false;
+ const real32 pad = segment_AABB_padding(view[0].aabb, O, V);
+
+ // segment broadcast for baked triangles
+ const bool baked = this->baked();
+ const __m128 O4[3] = { _mm_set1_ps(O[0]), _mm_set1_ps(O[1]), _mm_set1_ps(O[2]) };
+ const __m128 V4[3] = { _mm_set1_ps(V[0]), _mm_set1_ps(V[1]), _mm_set1_ps(V[2]) };
+
+ // stackless traversal
+ // hit: move to next node (left child if node, next subtree if leaf)
+ // miss: move to escape index (next node if leaf)
+ bool hit = false;
+ unsigned int index = 0;
+ const unsigned int n_nodes = view_size;
+ while(index < n_nodes)
+      {
+       const AABB_node& node = view[index];
+       bool leaf = ((node.params[0] & 0x80000000ul) != 0);
+       visits++;
+       if(!segment_AABB_test(node.aabb, O, inv_V, t, pad)) {
+          index = (leaf ? index + 1 : node.params[0]);
+          continue;
+         }
+
+       // test baked leaf triangles four at a time
+       if(leaf && baked) {
+          const BVHTriangleBlock* block = &blocks[leaf_blocks[index]];
+          const BVHTriangleBlock* last = block + (node.params[1] + 3)/4;
+          for(; block < last; block++) if(ray3D_triangle_block_intersect(t, O4, V4, *block)) hit = true;
+         }
+       // test leaf triangles, keeping the earliest hit
+       else if(leaf) {
+          unsigned int face = (node.params[0] & 0x7FFFFFFFul);
+          unsigned int last = face + node.params[1];
+          for(; face < last; face++) {
+              const uint32* f = &faces[3*face];
+              real32 distance;
+              if(ray3D_triangle_intersect(&distance, O, V, verts[f[0]].v, verts[f[1]].v, verts[f[2]].v) && !(t < distance)) {
+                 t = distance;
+                 hit = true;
+                }
+             }
+         }
+       index++;
       }
+
+ return hit;
 }
 
 void BVH::collide(PointLinearCollisionTest& info)
 {
+ // initialize results
+ info.collide = false;
+ info.t = info.t2;
+ info.visits = 0;
+ if(!view_size) return;
+
  // compute points along timeline
  vector3D& p1 = info.point;
  vector3D p2;
@@ -323,10 +1195,443 @@ void BVH::collide(PointLinearCollisionTest& info)
  p2[1] = p1[1] + (info.t2 - info.t1)*info.D[1];
  p2[2] = p1[2] + (info.t2 - info.t1)*info.D[2];
 
+ // convert segment ratio to time
+ vector3D V = p2 - p1;
+ real32 ratio = 1.0f;
+ info.collide = intersect(p1.v, V.v, ratio, info.visits);
+ if(info.collide) info.t = info.t1 + ratio*(info.t2 - info.t1);
+}
 
+void BVH::collide(RayCollisionTest& info)
+{
+ info.collide = false;
+ info.t = info.t_max;
+ info.visits = 0;
+ if(!view_size) return;
+ info.collide = intersect(info.origin.v, info.direction.v, info.t, info.visits);
+}
 
+int BVH::intersect(const RayPacketCollisionTest& info, real32* t, uint32& visits)const
+{
+ // splat rays (unused lanes get a negative distance so that they never hit anything) and their
+ // box padding (see segment_AABB_test)
+ const uint32 n = std::min(info.n_rays, 4u);
+ alignas(16) real32 data[8][4];
+ for(uint32 i = 0; i < 4; i++) {
+     bool used = (i < n);
+     const vector3D& O = info.origin[used ? i : 0];
+     const vector3D& V = info.direction[used ? i : 0];
+     for(int j = 0; j < 3; j++) {
+         data[0 + j][i] = O[j];
+         data[3 + j][i] = V[j];
+        }
+     data[6][i] = (used ? t[i] : -1.0f);
+     data[7][i] = segment_AABB_padding(view[0].aabb, O.v, V.v);
+    }
+ const __m128 Ox = _mm_load_ps(data[0]);
+ const __m128 Oy = _mm_load_ps(data[1]);
+ const __m128 Oz = _mm_load_ps(data[2]);
+ const __m128 Vx = _mm_load_ps(data[3]);
+ const __m128 Vy = _mm_load_ps(data[4]);
+ const __m128 Vz = _mm_load_ps(data[5]);
+ __m128 T = _mm_load_ps(data[6]);
+ const __m128 pad = _mm_load_ps(data[7]);
+ const __m128 robust = _mm_set1_ps(AABB_SLAB_ROBUST);
+
+ // reciprocal of ray vectors (see BVH::intersect)
+ const __m128 zero = _mm_setzero_ps();
+ const __m128 one = _mm_set1_ps(1.0f);
+ const __m128 huge = _mm_set1_ps(std::numeric_limits<real32>::max());
+ auto INVERT = [&](__m128 x) {
+  __m128 is_zero = _mm_cmpeq_ps(x, zero);
+  return _mm_or_ps(_mm_and_ps(is_zero, huge), _mm_andnot_ps(is_zero, _mm_div_ps(one, x)));
+ };
+ const __m128 Ix = INVERT(Vx);
+ const __m128 Iy = INVERT(Vy);
+ const __m128 Iz = INVERT(Vz);
+
+ // stackless traversal, where a node is entered if any ray hits its box (a ray that misses a
+ // box misses all of its children, so there is no need to keep a mask per subtree)
+ const __m128 eps = _mm_set1_ps(epsilon());
+ const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+ int hits = 0;
+ unsigned int index = 0;
+ const unsigned int n_nodes = view_size;
+ while(index < n_nodes)
+      {
+       const AABB_node& node = view[index];
+       bool leaf = ((node.params[0] & 0x80000000ul) != 0);
+       visits++;
+
+       // slab test one box against all four rays
+       __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(node.aabb.a[0]), pad), Ox), Ix);
+       __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node.aabb.b[0]), pad), Ox), Ix);
+       __m128 t_min = _mm_min_ps(t1, t2);
+       __m128 t_max = _mm_max_ps(t1, t2);
+       t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(node.aabb.a[1]), pad), Oy), Iy);
+       t2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node.aabb.b[1]), pad), Oy), Iy);
+       t_min = _mm_max_ps(t_min, _mm_min_ps(t1, t2));
+       t_max = _mm_min_ps(t_max, _mm_max_ps(t1, t2));
+       t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(node.aabb.a[2]), pad), Oz), Iz);
+       t2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node.aabb.b[2]), pad), Oz), Iz);
+       t_min = _mm_max_ps(t_min, _mm_min_ps(t1, t2));
+       t_max = _mm_min_ps(t_max, _mm_max_ps(t1, t2));
+       t_min = _mm_max_ps(t_min, zero);
+       t_max = _mm_min_ps(_mm_mul_ps(t_max, robust), T);
+       if(!_mm_movemask_ps(_mm_cmple_ps(t_min, t_max))) {
+          index = (leaf ? index + 1 : node.params[0]);
+          continue;
+         }
+
+       // Moller-Trumbore test of each leaf triangle against all four rays (see ray.h)
+       if(leaf) {
+          unsigned int face = (node.params[0] & 0x7FFFFFFFul);
+          unsigned int last = face + node.params[1];
+          for(; face < last; face++)
+             {
+              const uint32* f = &faces[3*face];
+              const real32* A = verts[f[0]].v;
+              const real32* B = verts[f[1]].v;
+              const real32* C = verts[f[2]].v;
+              real32 e1[3] = { B[0] - A[0], B[1] - A[1], B[2] - A[2] };
+              real32 e2[3] = { C[0] - A[0], C[1] - A[1], C[2] - A[2] };
+              const __m128 e1x = _mm_set1_ps(e1[0]);
+              const __m128 e1y = _mm_set1_ps(e1[1]);
+              const __m128 e1z = _mm_set1_ps(e1[2]);
+              const __m128 e2x = _mm_set1_ps(e2[0]);
+              const __m128 e2y = _mm_set1_ps(e2[1]);
+              const __m128 e2z = _mm_set1_ps(e2[2]);
+
+              // determinant
+              __m128 px = _mm_sub_ps(_mm_mul_ps(Vy, e2z), _mm_mul_ps(Vz, e2y));
+              __m128 py = _mm_sub_ps(_mm_mul_ps(Vz, e2x), _mm_mul_ps(Vx, e2z));
+              __m128 pz = _mm_sub_ps(_mm_mul_ps(Vx, e2y), _mm_mul_ps(Vy, e2x));
+              __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+              __m128 valid = _mm_cmpge_ps(_mm_and_ps(det, abs_mask), eps);
+              if(!_mm_movemask_ps(valid)) continue;
+              __m128 inv_det = _mm_div_ps(one, det);
+
+              // first barycentric coordinate
+              __m128 sx = _mm_sub_ps(Ox, _mm_set1_ps(A[0]));
+              __m128 sy = _mm_sub_ps(Oy, _mm_set1_ps(A[1]));
+              __m128 sz = _mm_sub_ps(Oz, _mm_set1_ps(A[2]));
+              __m128 u = _mm_mul_ps(inv_det, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)));
+              valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+              // second barycentric coordinate
+              __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+              __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+              __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+              __m128 v = _mm_mul_ps(inv_det, _mm_add_ps(_mm_add_ps(_mm_mul_ps(Vx, qx), _mm_mul_ps(Vy, qy)), _mm_mul_ps(Vz, qz)));
+              valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+              // distance along rays, keeping the earliest hits
+              __m128 distance = _mm_mul_ps(inv_det, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+              valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(distance, zero), _mm_cmple_ps(distance, T)));
+              int mask = _mm_movemask_ps(valid);
+              if(!mask) continue;
+              T = _mm_or_ps(_mm_and_ps(valid, distance), _mm_andnot_ps(valid, T));
+              hits |= mask;
+             }
+         }
+       index++;
+      }
+
+ // closest hits
+ _mm_store_ps(data[6], T);
+ for(uint32 i = 0; i < n; i++) if(hits & (1 << i)) t[i] = data[6][i];
+ return hits;
+}
+
+void BVH::collide(RayPacketCollisionTest& info)
+{
+ // initialize results
+ uint32 n = std::min(info.n_rays, 4u);
+ for(uint32 i = 0; i < 4; i++) {
+     info.collide[i] = false;
+     info.t[i] = (i < n ? info.t_max[i] : 0.0f);
+    }
+ info.packet = false;
+ info.visits = 0;
+ if(!view_size || !n) return;
+
+ // rays are coherent when all directions are within about 25 degrees of the first one, so
+ // that they mostly visit the same nodes
+ bool coherent = (n > 1);
+ vector3D D = info.direction[0];
+ real32 DD = squared_norm(D);
+ for(uint32 i = 1; i < n && coherent; i++) {
+     const vector3D& E = info.direction[i];
+     real32 DE = scalar_product(D, E);
+     if(DE < 0.0f || DE*DE < 0.8f*DD*squared_norm(E)) coherent = false;
+    }
+
+ // fall back to single rays when rays diverge
+ if(!coherent) {
+    for(uint32 i = 0; i < n; i++) info.collide[i] = intersect(info.origin[i].v, info.direction[i].v, info.t[i], info.visits);
+    return;
+   }
+
+ // traverse as packet
+ info.packet = true;
+ int hits = intersect(info, info.t, info.visits);
+ for(uint32 i = 0; i < n; i++) info.collide[i] = ((hits & (1 << i)) != 0);
+}
+
+bool BVH::sweep(const real32* O, real32 radius, const real32* V, real32& t, real32* X, uint32& triangle, uint32& visits)const
+{
+ // reciprocal of sweep vector
+ real32 inv_V[3];
+ for(int i = 0; i < 3; i++) inv_V[i] = (V[i] != 0.0f ? inv(V[i]) : std::numeric_limits<real32>::max());
+
+ // stackless traversal of node AABBs inflated by the radius (the inflated box contains every
+ // position where the sphere touches the node AABB, so nothing is missed)
+ if(!view_size) return false;
+ const real32 pad = segment_AABB_padding(view[0].aabb, O, V);
+ bool hit = false;
+ unsigned int index = 0;
+ const unsigned int n_nodes = view_size;
+ while(index < n_nodes)
+      {
+       const AABB_node& node = view[index];
+       bool leaf = ((node.params[0] & 0x80000000ul) != 0);
+       visits++;
+       AABB_minmax aabb;
+       for(int i = 0; i < 3; i++) {
+           aabb.a[i] = node.aabb.a[i] - radius;
+           aabb.b[i] = node.aabb.b[i] + radius;
+          }
+       if(!segment_AABB_test(aabb, O, inv_V, t, pad)) {
+          index = (leaf ? index + 1 : node.params[0]);
+          continue;
+         }
+
+       // test leaf triangles, keeping the earliest hit
+       if(leaf) {
+          unsigned int face = (node.params[0] & 0x7FFFFFFFul);
+          unsigned int last = face + node.params[1];
+          for(; face < last; face++) {
+              const uint32* f = &faces[3*face];
+              real32 toi = t;
+              real32 contact[3];
+              if(sphere3D_triangle_sweep(&toi, contact, O, radius, V, verts[f[0]].v, verts[f[1]].v, verts[f[2]].v)) {
+                 t = toi;
+                 X[0] = contact[0];
+                 X[1] = contact[1];
+                 X[2] = contact[2];
+                 triangle = face;
+                 hit = true;
+                }
+             }
+         }
+       index++;
+      }
+
+ return hit;
 }
 
 void BVH::collide(SphereLinearCollisionTest& info)
 {
+ // initialize results
+ info.collide = false;
+ info.t = info.t2;
+ info.visits = 0;
+ if(!view_size) return;
+
+ // sweep vector over time interval
+ const real32* O = info.S.center;
+ vector3D V = (info.t2 - info.t1)*info.D;
+
+ // convert sweep ratio to time
+ real32 ratio = 1.0f;
+ uint32 triangle = 0;
+ info.collide = sweep(O, info.S.radius, V.v, ratio, info.contact.v, triangle, info.visits);
+ if(!info.collide) return;
+ info.t = info.t1 + ratio*(info.t2 - info.t1);
+
+ // normal points from contact point to sphere center at time of impact
+ vector3D center(O[0] + ratio*V[0], O[1] + ratio*V[1], O[2] + ratio*V[2]);
+ info.normal = center - info.contact;
+ real32 norm = length(info.normal);
+ if(norm > epsilon()) {
+    info.normal *= inv(norm);
+    return;
+   }
+
+ // center is on the triangle, so use the triangle normal facing against the motion
+ const uint32* f = &faces[3*triangle];
+ info.normal = vector_product(verts[f[1]] - verts[f[0]], verts[f[2]] - verts[f[0]]);
+ if(squared_norm(info.normal) < epsilon()) info.normal = -V;
+ if(squared_norm(info.normal) < epsilon()) {
+    info.normal.reset(0.0f, 0.0f, 0.0f);
+    return;
+   }
+ info.normal = unit(info.normal);
+ if(scalar_product(info.normal, V) > 0.0f) info.normal = -info.normal;
+}
+
+static inline real32 AABB_squared_distance(const AABB_minmax& aabb, const real32* P)
+{
+ // squared distance from point to nearest point in box (zero if inside)
+ real32 d = 0.0f;
+ for(int i = 0; i < 3; i++) {
+     real32 x = std::max(std::max(aabb.a[i] - P[i], P[i] - aabb.b[i]), 0.0f);
+     d += x*x;
+    }
+ return d;
+}
+
+void BVH::nearest(unsigned int index, const real32* P, real32& best, ClosestPointTest& info)const
+{
+ // depth-first search of subtree rooted at index (stackless, so it needs no scratch space)
+ const AABB_node& root = view[index];
+ unsigned int last = ((root.params[0] & 0x80000000ul) ? index + 1 : root.params[0]);
+ while(index < last)
+      {
+       const AABB_node& node = view[index];
+       bool leaf = ((node.params[0] & 0x80000000ul) != 0);
+       info.visits++;
+       if(AABB_squared_distance(node.aabb, P) > best) {
+          index = (leaf ? index + 1 : node.params[0]);
+          continue;
+         }
+
+       // test leaf triangles, keeping the closest (the first one found can be at exactly the radius)
+       if(leaf) {
+          unsigned int face = (node.params[0] & 0x7FFFFFFFul);
+          unsigned int stop = face + node.params[1];
+          for(; face < stop; face++) {
+              const uint32* f = &faces[3*face];
+              real32 X[3];
+              real32 d = triangle3D_closest_point(X, P, verts[f[0]].v, verts[f[1]].v, verts[f[2]].v);
+              if(d < best || (!info.found && d <= best)) {
+                 best = d;
+                 info.closest.reset(X[0], X[1], X[2]);
+                 info.triangle = face;
+                 info.found = true;
+                }
+             }
+         }
+       index++;
+      }
+}
+
+void BVH::collide(ClosestPointTest& info)
+{
+ // initialize results
+ info.found = false;
+ info.distance = info.radius;
+ info.triangle = 0;
+ info.visits = 0;
+ if(!view_size) return;
+
+ // squared distance to beat
+ const real32* P = info.point.v;
+ real32 best = info.radius*info.radius;
+
+ // a leaf root has nothing to order
+ if(view[0].params[0] & 0x80000000ul) nearest(0, P, best, info);
+
+ // best-first traversal using a binary min-heap of node distances in the scratch space
+ BVHScratchItem* heap = info.scratch;
+ uint32 n = 0;
+ auto PUSH = [&](real32 distance, uint32 node) {
+  uint32 i = n++;
+  while(i) {
+        uint32 parent = (i - 1)/2;
+        if(!(distance < heap[parent].distance)) break;
+        heap[i] = heap[parent];
+        i = parent;
+       }
+  heap[i].distance = distance;
+  heap[i].node = node;
+ };
+ auto POP = [&]() {
+  BVHScratchItem item = heap[--n];
+  uint32 i = 0;
+  for(;;) {
+      uint32 child = 2*i + 1;
+      if(!(child < n)) break;
+      if(child + 1 < n && heap[child + 1].distance < heap[child].distance) child++;
+      if(!(heap[child].distance < item.distance)) break;
+      heap[i] = heap[child];
+      i = child;
+     }
+  heap[i] = item;
+ };
+
+ // push root
+ if(!(view[0].params[0] & 0x80000000ul)) {
+    info.visits++;
+    real32 d = AABB_squared_distance(view[0].aabb, P);
+    if(d <= best) {
+       if(info.scratch_size) PUSH(d, 0);
+       else nearest(0, P, best, info);
+      }
+   }
+
+ while(n)
+      {
+       // every node left in the heap is farther than the closest triangle
+       BVHScratchItem item = heap[0];
+       if(item.distance > best) break;
+       POP();
+
+       // leaves are searched right away, nodes go into the heap (or are searched depth-first
+       // if the heap is full)
+       const AABB_node& node = view[item.node];
+       const unsigned int children[2] = { item.node + 1, node.params[1] };
+       for(int i = 0; i < 2; i++) {
+           const AABB_node& child = view[children[i]];
+           if(child.params[0] & 0x80000000ul) {
+              nearest(children[i], P, best, info);
+              continue;
+             }
+           info.visits++;
+           real32 d = AABB_squared_distance(child.aabb, P);
+           if(d > best) continue;
+           if(n < info.scratch_size) PUSH(d, children[i]);
+           else nearest(children[i], P, best, info);
+          }
+      }
+
+ if(info.found) info.distance = std::sqrt(best);
+}
+
+void BVH::collide(SphereOverlapTest& info)
+{
+ // initialize results
+ info.n_triangles = 0;
+ info.visits = 0;
+ if(!view_size) return;
+
+ // stackless traversal, triangles touch the sphere if their closest point is within the radius
+ const real32* P = info.S.center;
+ real32 rr = info.S.radius*info.S.radius;
+ unsigned int index = 0;
+ const unsigned int n_nodes = view_size;
+ while(index < n_nodes)
+      {
+       const AABB_node& node = view[index];
+       bool leaf = ((node.params[0] & 0x80000000ul) != 0);
+       info.visits++;
+       if(AABB_squared_distance(node.aabb, P) > rr) {
+          index = (leaf ? index + 1 : node.params[0]);
+          continue;
+         }
+
+       // count every overlapping triangle, but only store as many as the caller has room for
+       if(leaf) {
+          unsigned int face = (node.params[0] & 0x7FFFFFFFul);
+          unsigned int last = face + node.params[1];
+          for(; face < last; face++) {
+              const uint32* f = &faces[3*face];
+              real32 X[3];
+              if(triangle3D_closest_point(X, P, verts[f[0]].v, verts[f[1]].v, verts[f[2]].v) > rr) continue;
+              if(info.n_triangles < info.max_triangles) info.triangles[info.n_triangles] = face;
+              info.n_triangles++;
+             }
+         }
+       index++;
+      }
 }
@@ -14,35 +14,192 @@ struct PointLinearCollisionTest {
  // results
  bool collide;   // is there a collision
  float t;        // time interval
+ uint32 visits;  // number of nodes visited
+};
+
+struct RayCollisionTest {
+ // data
+ vector3D origin;    // ray origin
+ vector3D direction; // ray direction
+ float t_max;        // maximum distance (in multiples of direction)
+ // results
+ bool collide;       // is there a collision
+ float t;            // distance (in multiples of direction)
+ uint32 visits;      // number of nodes visited
+};
+
+// up to four rays traversed together (such as hitscans fired by all players in one frame)
+// rays that do not point in about the same direction are traversed one at a time
+struct RayPacketCollisionTest {
+ // data
+ vector3D origin[4];    // ray origins
+ vector3D direction[4]; // ray directions
+ float t_max[4];        // maximum distances (in multiples of direction)
+ uint32 n_rays;         // number of rays in packet (1 to 4)
+ // results
+ bool collide[4];       // is there a collision
+ float t[4];            // distances (in multiples of direction)
+ bool packet;           // rays were traversed together
+ uint32 visits;         // number of nodes visited
 };
 
 struct SphereLinearCollisionTest {
  // data
- sphere3D S;     // sphere to test
- vector3D D;     // direction point is moving
- float t1;       // time interval
- float t2;       // time interval
+ sphere3D S;       // sphere to test
+ vector3D D;       // direction point is moving
+ float t1;         // time interval
+ float t2;         // time interval
  // results
- bool collide;   // is there a collision
- float t;        // time interval
+ bool collide;     // is there a collision
+ float t;          // time of impact
+ vector3D contact; // contact point on triangle
+ vector3D normal;  // unit normal at contact point (points towards sphere center)
+ uint32 visits;    // number of nodes visited
+};
+
+// scratch entry for best-first traversal (squared distance to node AABB and node index)
+struct BVHScratchItem {
+ float distance;
+ uint32 node;
+};
+
+// nearest point on mesh within a maximum distance (such as pushing a player out of geometry)
+// the caller provides the scratch space, so the query never allocates memory; if it fills up,
+// the remaining subtrees are searched depth-first (still correct, only less efficient)
+struct ClosestPointTest {
+ // data
+ vector3D point;          // point to test
+ float radius;            // maximum distance
+ BVHScratchItem* scratch; // priority queue storage
+ uint32 scratch_size;     // number of items in scratch (64 is plenty)
+ // results
+ bool found;              // is there a triangle within radius
+ float distance;          // distance to closest point
+ vector3D closest;        // closest point on mesh
+ uint32 triangle;         // index of closest triangle (see BVH::face)
+ uint32 visits;           // number of nodes visited
+};
+
+// all triangles that touch a sphere (such as finding triangles for decal placement)
+struct SphereOverlapTest {
+ // data
+ sphere3D S;              // sphere to test
+ uint32* triangles;       // caller provided storage for triangle indices (see BVH::face)
+ uint32 max_triangles;    // number of indices triangles can hold
+ // results
+ uint32 n_triangles;      // number of overlapping triangles (can be more than max_triangles)
+ uint32 visits;           // number of nodes visited
+};
+
+// four leaf triangles stored as structure of arrays (vertex A and edges B - A and C - A) so
+// that a ray can be tested against all four at once without gathering vertices through faces
+struct alignas(16) BVHTriangleBlock {
+ real32 A[3][4];
+ real32 E1[3][4];
+ real32 E2[3][4];
+};
+
+struct BVHBuildOptions {
+ uint32 n_bins = 8;              // number of bins per axis (8, 16, or 32)
+ bool all_axes = false;          // bin along all three axes instead of the dominant axis only
+ bool sah_termination = false;   // make a leaf when it is cheaper than the best split
+ uint32 max_leaf_size = 4;       // largest leaf made by SAH termination
+ float traversal_cost = 1.0f;    // SAH cost of visiting a node
+ float intersect_cost = 1.0f;    // SAH cost of testing a triangle
+ uint32 n_threads = 1;           // number of build threads (0 = hardware concurrency)
+ bool morton = false;            // use Morton code (LBVH) builder instead of binning
+ bool treelets = false;          // optimize treelets after Morton code build
+ bool triangle_blocks = false;   // bake leaf triangles into SoA blocks (see BVH::bake)
+};
+
+struct BVHQualityReport {
+ float sah_cost;                 // SAH cost of tree relative to root surface area
+ uint32 n_nodes;                 // number of nodes
+ uint32 n_leaves;                // number of leaf nodes
+ uint32 max_depth;               // depth of deepest leaf
+ float avg_depth;                // average leaf depth (weighted by triangles)
+ float avg_leaf_size;            // average triangles per leaf
+ std::vector<uint32> leaf_sizes; // number of leaves that have [index] triangles
+ std::vector<uint32> depths;     // number of leaves at depth [index]
 };
 
 class BVH {
+ friend class QBVH;
+ friend class CBVH;
+ friend class SceneBVH;
+ friend class BVHCache;
  private :
-  static const int n_bins = 8;
-  static const int n_part = n_bins - 1;
+  static const uint32 max_bins = 32;
  private :
+  // nodes are stored in depth-first order, so the left child of node i is always node i + 1
+  // node: params[0] = escape index (next node to visit if this subtree is skipped)
+  //       params[1] = index of right child
+  // leaf: params[0] = index of first face | 0x80000000
+  //       params[1] = number of faces
   struct AABB_node {
    AABB_minmax aabb;
    unsigned int params[2];
   };
   std::vector<AABB_node> tree;
+  const AABB_node* view;   // nodes used by queries (tree or nodes mapped from a cache file)
+  unsigned int view_size;  // number of nodes in view
+  const vector3D* verts;
+  const uint32* faces;
+  std::vector<BVHTriangleBlock> blocks; // baked leaf triangles (empty if not baked)
+  std::vector<unsigned int> leaf_blocks; // index of first block of each leaf node
+  float build_cost; // SAH cost after construction
+  float refit_cost; // SAH cost after last refit
+ private :
+  // construction partition (node index and range of faces)
+  struct BVHSTACKITEM {
+   unsigned int tree_index;
+   unsigned int face_index[2];
+  };
+  // construction per-face data (sorted along with faces)
+  struct BVHFACEDATA {
+   AABB_minmax* blist;
+   vector3D* clist;
+   uint32* faces;
+  };
+  static unsigned int split(std::vector<AABB_node>& nodes, const BVHSTACKITEM& item, const BVHFACEDATA& data, const BVHBuildOptions& options, BVHSTACKITEM* children, uint32 n_threads);
+  static void build(std::vector<AABB_node>& nodes, const BVHSTACKITEM& root, const BVHFACEDATA& data, const BVHBuildOptions& options);
+  static void morton(std::vector<AABB_node>& nodes, const BVHFACEDATA& data, unsigned int n_faces, const BVHBuildOptions& options, uint32 n_threads);
+  static void treelets(std::vector<AABB_node>& nodes, const BVHBuildOptions& options);
+  void flatten(void);
+  void bind(void);
+  void own(void);
+  float sah(void)const;
+  bool intersect(const real32* O, const real32* V, real32& t, uint32& visits)const;
+  int intersect(const RayPacketCollisionTest& info, real32* t, uint32& visits)const;
+  bool sweep(const real32* O, real32 radius, const real32* V, real32& t, real32* X, uint32& triangle, uint32& visits)const;
+  void nearest(unsigned int index, const real32* P, real32& best, ClosestPointTest& info)const;
+ public :
+  static const uint32 builder_version = 1; // bump when construct changes the trees it builds
  public :
   void construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32 n_indices);
+  void construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32 n_indices, uint32 n_threads);
+  void construct(const vector3D* verts, uint32 n_verts, uint32* faces, uint32 n_indices, const BVHBuildOptions& options);
   void clear();
+  size_t nodes(void)const { return view_size; }
+  size_t bytes(void)const { return view_size*sizeof(AABB_node); }
+  size_t block_bytes(void)const { return blocks.size()*sizeof(BVHTriangleBlock) + leaf_blocks.size()*sizeof(unsigned int); }
+  bool identical(const BVH& other)const;
+  void quality(BVHQualityReport& report, float traversal_cost = 1.0f, float intersect_cost = 1.0f)const;
+ public :
+  void refit(const vector3D* verts);
+  bool rebalance(float threshold);
+  float degradation(void)const;
+  void bake(void);
+  void unbake(void);
+  bool baked(void)const { return !blocks.empty(); }
  public :
   void collide(PointLinearCollisionTest& info);
+  void collide(RayCollisionTest& info);
+  void collide(RayPacketCollisionTest& info);
   void collide(SphereLinearCollisionTest& info);
+  void collide(ClosestPointTest& info);
+  void collide(SphereOverlapTest& info);
+  const uint32* face(uint32 index)const { return faces + 3*index; }
  public :
   BVH& operator =(const BVH& other) = delete;
   BVH& operator =(BVH&& other);
@@ -53,13 +210,26 @@ class BVH {
  ~BVH();
 };
 
-inline BVH::BVH()
+inline BVH::BVH() : view(nullptr), view_size(0), verts(nullptr), faces(nullptr), build_cost(0.0f), refit_cost(0.0f)
 {
 }
 
 inline BVH::BVH(BVH&& other)
 {
+ // moving a vector keeps its buffer, so a view of it stays valid
  this->tree = std::move(other.tree);
+ this->view = other.view;
+ this->view_size = other.view_size;
+ this->verts = other.verts;
+ this->faces = other.faces;
+ this->blocks = std::move(other.blocks);
+ this->leaf_blocks = std::move(other.leaf_blocks);
+ this->build_cost = other.build_cost;
+ this->refit_cost = other.refit_cost;
+ other.view = nullptr;
+ other.view_size = 0;
+ other.verts = nullptr;
+ other.faces = nullptr;
 }
 
 inline BVH::~BVH()
@@ -70,12 +240,59 @@ inline BVH& BVH::operator =(BVH&& other)
 {
  if(this == &other) return *this;
  this->tree = std::move(other.tree);
+ this->view = other.view;
+ this->view_size = other.view_size;
+ this->verts = other.verts;
+ this->faces = other.faces;
+ this->blocks = std::move(other.blocks);
+ this->leaf_blocks = std::move(other.leaf_blocks);
+ this->build_cost = other.build_cost;
+ this->refit_cost = other.refit_cost;
+ other.view = nullptr;
+ other.view_size = 0;
+ other.verts = nullptr;
+ other.faces = nullptr;
  return *this;
 }
 
 inline void BVH::clear()
 {
  this->tree.clear();
+ this->view = nullptr;
+ this->view_size = 0;
+ this->verts = nullptr;
+ this->faces = nullptr;
+ this->blocks.clear();
+ this->leaf_blocks.clear();
+ this->build_cost = 0.0f;
+ this->refit_cost = 0.0f;
+}
+
+inline void BVH::bind(void)
+{
+ // queries use the nodes in tree
+ this->view = (tree.empty() ? nullptr : tree.data());
+ this->view_size = static_cast<unsigned int>(tree.size());
+}
+
+inline void BVH::own(void)
+{
+ // copy mapped nodes into tree so that they can be changed
+ if(view_size && view != tree.data()) tree.assign(view, view + view_size);
+ bind();
+}
+
+inline void BVH::unbake(void)
+{
+ // free baked triangles (queries go back to gathering vertices through faces)
+ std::vector<BVHTriangleBlock>().swap(blocks);
+ std::vector<unsigned int>().swap(leaf_blocks);
+}
+
+inline float BVH::degradation(void)const
+{
+ // ratio of current SAH cost to SAH cost after construction
+ return (build_cost > 0.0f ? refit_cost/build_cost : 1.0f);
 }
 
 
@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include "bvhcache.h"
+#ifndef _WIN32
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#endif
+
+BVHCache::BVHCache()
+{
+#ifdef _WIN32
+ file = INVALID_HANDLE_VALUE;
+ mapping = NULL;
+#else
+ file = -1;
+#endif
+ data = nullptr;
+ size = 0;
+}
+
+BVHCache::~BVHCache()
+{
+ close();
+}
+
+uint64 BVHCache::hash(const vector3D* verts, uint32 n_verts, const uint32* faces, uint32 n_indices, const BVHBuildOptions& options)
+{
+ // 64-bit FNV-1a of vertex and face data (hash the faces before construct sorts them)
+ uint64 key = 0xCBF29CE484222325ull;
+ auto HASH = [&key](const void* ptr, size_t n) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(ptr);
+  for(size_t i = 0; i < n; i++) {
+      key ^= bytes[i];
+      key *= 0x00000100000001B3ull;
+     }
+ };
+ HASH(&n_verts, sizeof(n_verts));
+ HASH(&n_indices, sizeof(n_indices));
+ for(uint32 i = 0; i < n_verts; i++) HASH(verts[i].v, 3*sizeof(real32));
+ HASH(faces, n_indices*sizeof(uint32));
+
+ // options that change the saved tree (thread count gives identical trees and triangle blocks
+ // are not saved), hashed field by field so that struct padding is not hashed
+ uint32 builder = BVH::builder_version;
+ uint32 flags = (options.all_axes ? 1 : 0) | (options.sah_termination ? 2 : 0) | (options.morton ? 4 : 0) | (options.treelets ? 8 : 0);
+ HASH(&builder, sizeof(builder));
+ HASH(&flags, sizeof(flags));
+ HASH(&options.n_bins, sizeof(options.n_bins));
+ HASH(&options.max_leaf_size, sizeof(options.max_leaf_size));
+ HASH(&options.traversal_cost, sizeof(options.traversal_cost));
+ HASH(&options.intersect_cost, sizeof(options.intersect_cost));
+ return key;
+}
+
+std::wstring BVHCache::filename(const wchar_t* path, uint64 key)
+{
+ wchar_t name[32];
+ swprintf(name, 32, L"%016llx.bvh", static_cast<unsigned long long>(key));
+ std::wstring retval(path ? path : L"");
+#ifdef _WIN32
+ if(retval.length() && retval.back() != L'\\' && retval.back() != L'/') retval += L'\\';
+#else
+ if(retval.length() && retval.back() != L'/') retval += L'/';
+#endif
+ return retval + name;
+}
+
+bool BVHCache::save(const wchar_t* path, uint64 key, const BVH& bvh, uint32 n_verts)
+{
+ // nothing to save
+ if(!bvh.view_size || !bvh.faces) return false;
+
+ // count face indices used by leaves
+ uint32 n_indices = 0;
+ for(unsigned int i = 0; i < bvh.view_size; i++) {
+     const BVH::AABB_node& node = bvh.view[i];
+     if(!(node.params[0] & 0x80000000ul)) continue;
+     uint32 last = (node.params[0] & 0x7FFFFFFFul) + node.params[1];
+     n_indices = std::max(n_indices, 3*last);
+    }
+
+ // create cache folder
+#ifdef _WIN32
+ if(path && path[0]) CreateDirectoryW(path, NULL);
+#else
+ std::string folder;
+ if(path) for(const wchar_t* p = path; *p; p++) folder += static_cast<char>(*p);
+ if(folder.length()) mkdir(folder.c_str(), 0755);
+#endif
+
+ // header
+ BVHCacheHeader header;
+ std::memset(&header, 0, sizeof(header));
+ std::memcpy(header.magic, "BVHC", 4);
+ header.version = version;
+ header.key = key;
+ header.n_verts = n_verts;
+ header.n_indices = n_indices;
+ header.n_nodes = bvh.view_size;
+ header.node_size = sizeof(BVH::AABB_node);
+ header.build_cost = bvh.build_cost;
+ header.builder = BVH::builder_version;
+
+ // write header, nodes, and sorted faces
+ std::wstring name = filename(path, key);
+#ifdef _WIN32
+ std::ofstream ofile(name.c_str(), std::ios::binary);
+#else
+ std::ofstream ofile(std::string(name.begin(), name.end()).c_str(), std::ios::binary);
+#endif
+ if(!ofile) return false;
+ ofile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+ ofile.write(reinterpret_cast<const char*>(bvh.view), bvh.view_size*sizeof(BVH::AABB_node));
+ ofile.write(reinterpret_cast<const char*>(bvh.faces), n_indices*sizeof(uint32));
+ return !ofile.fail();
+}
+
+bool BVHCache::load(const wchar_t* path, uint64 key, BVH& bvh, const vector3D* verts, uint32 n_verts)
+{
+ // close previous
+ close();
+ if(!verts || !n_verts) return false;
+
+ // map file
+ std::wstring name = filename(path, key);
+#ifdef _WIN32
+ file = CreateFileW(name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+ if(file == INVALID_HANDLE_VALUE) return false;
+ LARGE_INTEGER filesize;
+ if(!GetFileSizeEx(file, &filesize) || filesize.QuadPart < static_cast<LONGLONG>(sizeof(BVHCacheHeader))) { close(); return false; }
+ mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+ if(!mapping) { close(); return false; }
+ data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+ if(!data) { close(); return false; }
+ size = static_cast<size_t>(filesize.QuadPart);
+#else
+ file = open(std::string(name.begin(), name.end()).c_str(), O_RDONLY);
+ if(file < 0) return false;
+ struct stat info;
+ if(fstat(file, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(BVHCacheHeader))) { close(); return false; }
+ void* ptr = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+ if(ptr == MAP_FAILED) { close(); return false; }
+ data = ptr;
+ size = static_cast<size_t>(info.st_size);
+#endif
+
+ // validate header (files from other versions, builds, or meshes are rejected)
+ const BVHCacheHeader* header = static_cast<const BVHCacheHeader*>(data);
+ bool valid = (std::memcmp(header->magic, "BVHC", 4) == 0);
+ valid = valid && (header->version == version);
+ valid = valid && (header->key == key);
+ valid = valid && (header->n_verts == n_verts);
+ valid = valid && (header->node_size == sizeof(BVH::AABB_node));
+ valid = valid && (header->builder == BVH::builder_version);
+ valid = valid && (header->n_nodes > 0);
+ valid = valid && (header->n_indices % 3 == 0);
+ valid = valid && (size == sizeof(BVHCacheHeader) + header->n_nodes*sizeof(BVH::AABB_node) + header->n_indices*sizeof(uint32));
+ if(!valid) {
+    close();
+    return false;
+   }
+
+ // validate nodes (a bad child, escape, or face index would send traversal outside the file)
+ const char* bytes = static_cast<const char*>(data);
+ const BVH::AABB_node* nodes = reinterpret_cast<const BVH::AABB_node*>(bytes + sizeof(BVHCacheHeader));
+ const uint32 n_nodes = header->n_nodes;
+ const uint32 n_faces = header->n_indices/3;
+ for(uint32 i = 0; valid && i < n_nodes; i++) {
+     const BVH::AABB_node& node = nodes[i];
+     if(node.params[0] & 0x80000000ul) {
+        uint64 last = static_cast<uint64>(node.params[0] & 0x7FFFFFFFul) + node.params[1];
+        valid = (last <= n_faces);
+       }
+     else {
+        // left child is next node, right child follows left subtree, escape follows right subtree
+        uint32 escape = node.params[0];
+        uint32 R = node.params[1];
+        valid = (i + 1 < R) && (R < escape) && (escape <= n_nodes);
+       }
+    }
+ if(!valid) {
+    close();
+    return false;
+   }
+
+ // point tree at mapped nodes and faces
+ bvh.clear();
+ bvh.view = nodes;
+ bvh.view_size = header->n_nodes;
+ bvh.verts = verts;
+ bvh.faces = reinterpret_cast<const uint32*>(bytes + sizeof(BVHCacheHeader) + header->n_nodes*sizeof(BVH::AABB_node));
+ bvh.build_cost = bvh.refit_cost = header->build_cost;
+ return true;
+}
+
+void BVHCache::close(void)
+{
+#ifdef _WIN32
+ if(data) UnmapViewOfFile(data);
+ if(mapping) CloseHandle(mapping);
+ if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+ file = INVALID_HANDLE_VALUE;
+ mapping = NULL;
+#else
+ if(data) munmap(const_cast<void*>(data), size);
+ if(file >= 0) ::close(file);
+ file = -1;
+#endif
+ data = nullptr;
+ size = 0;
+}
+
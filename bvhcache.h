@@ -0,0 +1,53 @@
+#ifndef __CS_BVHCACHE_H
+#define __CS_BVHCACHE_H
+
+#include "bvh.h"
+
+// Binary BVH cache file
+// A cache file holds the flat node array and the face indices in the order construct sorted
+// them, and is named after a content hash of the source mesh, the build options and the
+// builder version, so a mesh or build that changes gets a different file and a stale file is
+// never loaded. Loading maps the file into memory and
+// points a BVH at the mapped nodes and faces without copying or rebuilding anything, so the
+// cache must stay open for as long as the BVH is used.
+class BVHCache {
+ private :
+  static const uint32 version = 2;
+  struct BVHCacheHeader {
+   char magic[4];      // BVHC
+   uint32 version;     // file version
+   uint64 key;         // content hash of source mesh and build options
+   uint32 n_verts;     // number of source vertices
+   uint32 n_indices;   // number of face indices
+   uint32 n_nodes;     // number of nodes
+   uint32 node_size;   // size of a node in bytes
+   float build_cost;   // SAH cost after construction
+   uint32 builder;     // BVH::builder_version of the tree
+   uint32 reserved[6];
+  };
+ private :
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int file;
+#endif
+  const void* data;
+  size_t size;
+ public :
+  static uint64 hash(const vector3D* verts, uint32 n_verts, const uint32* faces, uint32 n_indices, const BVHBuildOptions& options = BVHBuildOptions());
+  static std::wstring filename(const wchar_t* path, uint64 key);
+  static bool save(const wchar_t* path, uint64 key, const BVH& bvh, uint32 n_verts);
+ public :
+  bool load(const wchar_t* path, uint64 key, BVH& bvh, const vector3D* verts, uint32 n_verts);
+  void close(void);
+  bool loaded(void)const { return data != nullptr; }
+  size_t bytes(void)const { return size; }
+ public :
+  BVHCache();
+  BVHCache(const BVHCache&) = delete;
+  void operator =(const BVHCache&) = delete;
+ ~BVHCache();
+};
+
+#endif
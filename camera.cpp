@@ -147,6 +147,36 @@ bool OrbitCamera::GetClippingPlaneCoords(real32* coords)const
  return true;
 }
 
+bool OrbitCamera::GetFrustum(real32 (*planes)[4])const
+{
+ // view direction is x-axis and up is z-axis (see UpdateViewportCamera)
+ if(!planes || !FrustumPlanesValid()) return false;
+ real32 hy = std::abs(std::tan(radians(fovy/2.0f)));
+ real32 hx = hy*aspect;
+ real32 R[3];
+ vector3D_vector_product(R, cam_X, cam_Z);
+ vector3D_normalize(R);
+
+ // inward plane normals (left, right, bottom, top, near, far)
+ for(int i = 0; i < 3; i++) {
+     planes[0][i] =  R[i] + hx*cam_X[i];
+     planes[1][i] = -R[i] + hx*cam_X[i];
+     planes[2][i] =  cam_Z[i] + hy*cam_X[i];
+     planes[3][i] = -cam_Z[i] + hy*cam_X[i];
+     planes[4][i] =  cam_X[i];
+     planes[5][i] = -cam_X[i];
+    }
+
+ // inside is n*x + d >= 0
+ for(int i = 0; i < 6; i++) {
+     if(i < 4) vector3D_normalize(planes[i]);
+     planes[i][3] = -vector3D_scalar_product(planes[i], cam_E);
+    }
+ planes[4][3] -= nplane;
+ planes[5][3] += fplane;
+ return true;
+}
+
 #pragma endregion FRUSTUM_FUNCTIONS
 
 #pragma region FOVY_FUNCTIONS
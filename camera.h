@@ -60,6 +60,7 @@ class OrbitCamera {
   bool SetFrustumPlanes(real32 n, real32 f);
   bool FrustumPlanesValid(void)const;
   bool GetClippingPlaneCoords(real32* coords)const;
+  bool GetFrustum(real32 (*planes)[4])const;
  // FOVY Functions
  public :
   real32 GetFOVY(void)const;
@@ -0,0 +1,266 @@
+#include "stdafx.h"
+#include "ray.h"
+#include "cbvh.h"
+
+// size of one quantization step relative to node size
+static const real32 quantization_scale = 1.0f/65535.0f;
+
+// child bounds from node bounds (construct and traversal must decode with the same operations
+// so that the containment checks done during construction also hold during traversal)
+static inline real32 decode_min(real32 node_min, real32 step, uint16 q)
+{
+ return node_min + static_cast<real32>(q)*step;
+}
+
+static inline real32 decode_max(real32 node_max, real32 step, uint16 q)
+{
+ return node_max - static_cast<real32>(q)*step;
+}
+
+bool CBVH::construct(const BVH& bvh)
+{
+ // remove previous tree
+ clear();
+ if(!bvh.view_size) return false;
+
+ // share vertices and sorted faces with binary tree
+ this->verts = bvh.verts;
+ this->faces = bvh.faces;
+
+ // root bounds are not compressed
+ const BVH::AABB_node& root = bvh.view[0];
+ for(int j = 0; j < 3; j++) {
+     root_bounds[0][j] = root.aabb.a[j];
+     root_bounds[1][j] = root.aabb.b[j];
+    }
+ if(root.params[0] & 0x80000000ul) {
+    root_child = root.params[0];
+    root_count = root.params[1];
+    return true;
+   }
+ root_child = 0;
+
+ // process stack (binary node index, compressed node index, level, decoded bounds)
+ struct CBVHSTACKITEM {
+  unsigned int binary_index;
+  unsigned int tree_index;
+  unsigned int level;
+  real32 bounds[2][3];
+ };
+ std::vector<CBVHSTACKITEM> stack;
+ tree.reserve(bvh.view_size/2);
+ tree.push_back(CBVH_node());
+ stack.push_back(CBVHSTACKITEM());
+ stack.back().binary_index = 0;
+ stack.back().tree_index = 0;
+ stack.back().level = 1;
+ std::copy(&root_bounds[0][0], &root_bounds[0][0] + 6, &stack.back().bounds[0][0]);
+
+ while(stack.size())
+      {
+       CBVHSTACKITEM item = stack.back();
+       stack.pop_back();
+       depth = std::max(depth, item.level);
+
+       // quantization step along each axis
+       real32 step[3];
+       for(int j = 0; j < 3; j++) step[j] = (item.bounds[1][j] - item.bounds[0][j])*quantization_scale;
+
+       // left and right children
+       const unsigned int list[2] = { item.binary_index + 1, bvh.view[item.binary_index].params[1] };
+       for(unsigned int i = 0; i < 2; i++)
+          {
+           const BVH::AABB_node& src = bvh.view[list[i]];
+           real32 decoded[2][3];
+           uint16 q[6];
+           for(int j = 0; j < 3; j++)
+              {
+               // round down to a step at or below child minimum (zero steps is the node minimum,
+               // which always works because the node contains the child)
+               real32 qmin = 0.0f;
+               real32 qmax = 0.0f;
+               if(step[j] > 0.0f) {
+                  qmin = std::floor((src.aabb.a[j] - item.bounds[0][j])/step[j]);
+                  qmax = std::floor((item.bounds[1][j] - src.aabb.b[j])/step[j]);
+                 }
+               q[j + 0] = static_cast<uint16>(std::min(std::max(qmin, 0.0f), 65535.0f));
+               q[j + 3] = static_cast<uint16>(std::min(std::max(qmax, 0.0f), 65535.0f));
+               while(q[j + 0] && src.aabb.a[j] < decode_min(item.bounds[0][j], step[j], q[j + 0])) q[j + 0]--;
+               while(q[j + 3] && decode_max(item.bounds[1][j], step[j], q[j + 3]) < src.aabb.b[j]) q[j + 3]--;
+               decoded[0][j] = decode_min(item.bounds[0][j], step[j], q[j + 0]);
+               decoded[1][j] = decode_max(item.bounds[1][j], step[j], q[j + 3]);
+              }
+
+           // set child (node reference is invalid after push_back)
+           for(int j = 0; j < 6; j++) tree[item.tree_index].bounds[i][j] = q[j];
+           if(src.params[0] & 0x80000000ul) {
+              // leaf sizes that do not fit in 16 bits cannot be compressed
+              if(src.params[1] > 0xFFFFul) {
+                 clear();
+                 return false;
+                }
+              tree[item.tree_index].child[i] = src.params[0];
+              tree[item.tree_index].count[i] = static_cast<uint16>(src.params[1]);
+             }
+           else {
+              unsigned int tree_index = static_cast<unsigned int>(tree.size());
+              tree[item.tree_index].child[i] = tree_index;
+              tree[item.tree_index].count[i] = 0;
+              tree.push_back(CBVH_node());
+              stack.push_back(CBVHSTACKITEM());
+              stack.back().binary_index = list[i];
+              stack.back().tree_index = tree_index;
+              stack.back().level = item.level + 1;
+              std::copy(&decoded[0][0], &decoded[0][0] + 6, &stack.back().bounds[0][0]);
+             }
+          }
+      }
+
+ return true;
+}
+
+bool CBVH::intersect(const real32* O, const real32* V, real32& t, uint32& visits)const
+{
+ // reciprocal of segment vector (see BVH::intersect)
+ real32 inv_V[3];
+ for(int i = 0; i < 3; i++) inv_V[i] = (V[i] != 0.0f ? inv(V[i]) : std::numeric_limits<real32>::max());
+
+ // test leaf triangles, keeping the earliest hit
+ bool hit = false;
+ auto LEAF = [&](uint32 child, uint32 count) {
+  unsigned int face = (child & 0x7FFFFFFFul);
+  unsigned int last = face + count;
+  for(; face < last; face++) {
+      const uint32* f = &faces[3*face];
+      real32 distance;
+      if(ray3D_triangle_intersect(&distance, O, V, verts[f[0]].v, verts[f[1]].v, verts[f[2]].v) && !(t < distance)) {
+         t = distance;
+         hit = true;
+        }
+     }
+ };
+
+ // segment and slab test of a box in x, y, z lanes (w lane is ignored), which returns the
+ // entry distance or a negative value on a miss
+ // boxes are padded and the exit distance is scaled like segment_AABB_test, so rays that graze
+ // a box are not rejected when the triangle test would hit
+ AABB_minmax bounds;
+ bounds.from(root_bounds[0], root_bounds[1]);
+ const __m128 O4 = _mm_setr_ps(O[0], O[1], O[2], 0.0f);
+ const __m128 I4 = _mm_setr_ps(inv_V[0], inv_V[1], inv_V[2], 0.0f);
+ const __m128 pad = _mm_set1_ps(segment_AABB_padding(bounds, O, V));
+ const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+ const __m128 w_max = _mm_setr_ps(0.0f, 0.0f, 0.0f, std::numeric_limits<real32>::max());
+ auto SLAB = [&](__m128 lo, __m128 hi) {
+  __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(lo, pad), O4), I4);
+  __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(hi, pad), O4), I4);
+  __m128 t_min = _mm_and_ps(_mm_min_ps(t1, t2), xyz);
+  __m128 t_max = _mm_or_ps(_mm_and_ps(_mm_max_ps(t1, t2), xyz), w_max);
+  t_min = _mm_max_ps(t_min, _mm_shuffle_ps(t_min, t_min, _MM_SHUFFLE(1, 0, 3, 2)));
+  t_min = _mm_max_ps(t_min, _mm_shuffle_ps(t_min, t_min, _MM_SHUFFLE(2, 3, 0, 1)));
+  t_max = _mm_min_ps(t_max, _mm_shuffle_ps(t_max, t_max, _MM_SHUFFLE(1, 0, 3, 2)));
+  t_max = _mm_min_ps(t_max, _mm_shuffle_ps(t_max, t_max, _MM_SHUFFLE(2, 3, 0, 1)));
+  real32 entry = _mm_cvtss_f32(t_min);
+  real32 leave = std::min(AABB_SLAB_ROBUST*_mm_cvtss_f32(t_max), t);
+  return (entry <= leave ? entry : -1.0f);
+ };
+
+ // root
+ __m128 root_lo = _mm_setr_ps(root_bounds[0][0], root_bounds[0][1], root_bounds[0][2], 0.0f);
+ __m128 root_hi = _mm_setr_ps(root_bounds[1][0], root_bounds[1][1], root_bounds[1][2], 0.0f);
+ real32 entry = SLAB(root_lo, root_hi);
+ if(entry < 0.0f) return false;
+ if(root_child & 0x80000000ul) {
+    LEAF(root_child, root_count);
+    return hit;
+   }
+
+ // traversal stack (node, decoded node bounds, entry distance), where each level holds at
+ // most one sibling waiting to be popped plus the two children of the last node popped
+ struct CBVHTRAVERSAL { __m128 lo; __m128 hi; unsigned int index; real32 t; };
+ CBVHTRAVERSAL local[256];
+ std::unique_ptr<CBVHTRAVERSAL[]> heap;
+ CBVHTRAVERSAL* stack = local;
+ if(depth + 2 > 256) {
+    heap.reset(new CBVHTRAVERSAL[depth + 2]);
+    stack = heap.get();
+   }
+ int size = 0;
+ stack[size].lo = root_lo;
+ stack[size].hi = root_hi;
+ stack[size].index = root_child;
+ stack[size].t = entry;
+ size++;
+
+ const __m128 scale = _mm_set1_ps(quantization_scale);
+ const __m128i zero = _mm_setzero_si128();
+ while(size)
+      {
+       // pop node, skipping it if it starts beyond closest hit
+       size--;
+       if(t < stack[size].t) continue;
+       const CBVH_node& node = tree[stack[size].index];
+       const __m128 lo = stack[size].lo;
+       const __m128 hi = stack[size].hi;
+       visits++;
+
+       // decode both children (same operations as decode_min and decode_max) and test them
+       // the max load reads two bytes past the z maximum, which lands in the w lane
+       const __m128 step = _mm_mul_ps(_mm_sub_ps(hi, lo), scale);
+       __m128 child_lo[2];
+       __m128 child_hi[2];
+       real32 child_entry[2];
+       for(unsigned int i = 0; i < 2; i++) {
+           __m128i q_min = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&node.bounds[i][0])), zero);
+           __m128i q_max = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&node.bounds[i][3])), zero);
+           child_lo[i] = _mm_add_ps(lo, _mm_mul_ps(_mm_cvtepi32_ps(q_min), step));
+           child_hi[i] = _mm_sub_ps(hi, _mm_mul_ps(_mm_cvtepi32_ps(q_max), step));
+           child_entry[i] = SLAB(child_lo[i], child_hi[i]);
+           if(!(child_entry[i] < 0.0f) && (node.child[i] & 0x80000000ul)) {
+              LEAF(node.child[i], node.count[i]);
+              child_entry[i] = -1.0f;
+             }
+          }
+
+       // push far child first so that near child is popped first
+       unsigned int order[2] = { 0, 1 };
+       if(child_entry[0] < child_entry[1]) std::swap(order[0], order[1]);
+       for(unsigned int k = 0; k < 2; k++) {
+           unsigned int i = order[k];
+           if(child_entry[i] < 0.0f) continue;
+           stack[size].lo = child_lo[i];
+           stack[size].hi = child_hi[i];
+           stack[size].index = node.child[i];
+           stack[size].t = child_entry[i];
+           size++;
+          }
+      }
+
+ return hit;
+}
+
+void CBVH::collide(PointLinearCollisionTest& info)
+{
+ // initialize results
+ info.collide = false;
+ info.t = info.t2;
+ info.visits = 0;
+ if(root_child == 0xFFFFFFFFul) return;
+
+ // compute segment from timeline
+ vector3D V = (info.t2 - info.t1)*info.D;
+
+ // convert segment ratio to time
+ real32 ratio = 1.0f;
+ info.collide = intersect(info.point.v, V.v, ratio, info.visits);
+ if(info.collide) info.t = info.t1 + ratio*(info.t2 - info.t1);
+}
+
+void CBVH::collide(RayCollisionTest& info)
+{
+ info.collide = false;
+ info.t = info.t_max;
+ info.visits = 0;
+ if(root_child == 0xFFFFFFFFul) return;
+ info.collide = intersect(info.origin.v, info.direction.v, info.t, info.visits);
+}
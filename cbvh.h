@@ -0,0 +1,100 @@
+#ifndef __CS_CBVH_H
+#define __CS_CBVH_H
+
+#include "bvh.h"
+
+class CBVH {
+ private :
+  // each node stores the bounds of its two children quantized to 16 bits relative to its own
+  // (decoded) bounds: minimums count steps up from the node minimum and maximums count steps
+  // down from the node maximum, where a step is 1/65535 of the node size along that axis
+  // rounding always moves child bounds outward, so decoded boxes contain the original boxes
+  // and queries hit the same triangles as the uncompressed tree
+  // child: node index, or leaf (index of first face | 0x80000000)
+  // count: number of faces if leaf
+  struct CBVH_node {
+   uint16 bounds[2][6]; // [child][min x, y, z, max x, y, z]
+   uint32 child[2];
+   uint16 count[2];
+  };
+  std::vector<CBVH_node> tree;
+  real32 root_bounds[2][3]; // [min/max][x/y/z]
+  uint32 root_child;        // root node or leaf
+  uint32 root_count;        // number of faces if root is a leaf
+  uint32 depth;             // number of node levels (sizes the traversal stack)
+  const vector3D* verts;
+  const uint32* faces;
+ private :
+  bool intersect(const real32* O, const real32* V, real32& t, uint32& visits)const;
+ public :
+  bool construct(const BVH& bvh);
+  void clear();
+  size_t nodes(void)const { return tree.size(); }
+  uint32 levels(void)const { return depth; }
+  size_t bytes(void)const { return tree.size()*sizeof(CBVH_node) + sizeof(root_bounds) + sizeof(root_child) + sizeof(root_count); }
+ public :
+  void collide(PointLinearCollisionTest& info);
+  void collide(RayCollisionTest& info);
+ public :
+  CBVH& operator =(const CBVH& other) = delete;
+  CBVH& operator =(CBVH&& other);
+ public :
+  CBVH();
+  CBVH(const CBVH& other) = delete;
+  CBVH(CBVH&& other);
+ ~CBVH();
+};
+
+inline CBVH::CBVH() : root_child(0xFFFFFFFFul), root_count(0), depth(0), verts(nullptr), faces(nullptr)
+{
+}
+
+inline CBVH::CBVH(CBVH&& other)
+{
+ this->tree = std::move(other.tree);
+ std::copy(&other.root_bounds[0][0], &other.root_bounds[0][0] + 6, &this->root_bounds[0][0]);
+ this->root_child = other.root_child;
+ this->root_count = other.root_count;
+ this->depth = other.depth;
+ this->verts = other.verts;
+ this->faces = other.faces;
+ other.root_child = 0xFFFFFFFFul;
+ other.root_count = 0;
+ other.depth = 0;
+ other.verts = nullptr;
+ other.faces = nullptr;
+}
+
+inline CBVH::~CBVH()
+{
+}
+
+inline CBVH& CBVH::operator =(CBVH&& other)
+{
+ if(this == &other) return *this;
+ this->tree = std::move(other.tree);
+ std::copy(&other.root_bounds[0][0], &other.root_bounds[0][0] + 6, &this->root_bounds[0][0]);
+ this->root_child = other.root_child;
+ this->root_count = other.root_count;
+ this->depth = other.depth;
+ this->verts = other.verts;
+ this->faces = other.faces;
+ other.root_child = 0xFFFFFFFFul;
+ other.root_count = 0;
+ other.depth = 0;
+ other.verts = nullptr;
+ other.faces = nullptr;
+ return *this;
+}
+
+inline void CBVH::clear()
+{
+ this->tree.clear();
+ this->root_child = 0xFFFFFFFFul;
+ this->root_count = 0;
+ this->depth = 0;
+ this->verts = nullptr;
+ this->faces = nullptr;
+}
+
+#endif
@@ -1,3 +1,182 @@
 #include "stdafx.h"
 #include "collision.h"
 
+// boxes per packed group
+static const uint32 BATCH_GROUP = 8;
+
+// SIMD width (a packed group is one AVX register or two SSE registers)
+#ifdef __AVX__
+typedef __m256 batch_t;
+static const uint32 BATCH_WIDTH = 8;
+static inline batch_t batch_load(const float* p) { return _mm256_loadu_ps(p); }
+static inline batch_t batch_set1(float x) { return _mm256_set1_ps(x); }
+static inline batch_t batch_add(batch_t a, batch_t b) { return _mm256_add_ps(a, b); }
+static inline batch_t batch_sub(batch_t a, batch_t b) { return _mm256_sub_ps(a, b); }
+static inline batch_t batch_mul(batch_t a, batch_t b) { return _mm256_mul_ps(a, b); }
+static inline batch_t batch_min(batch_t a, batch_t b) { return _mm256_min_ps(a, b); }
+static inline batch_t batch_max(batch_t a, batch_t b) { return _mm256_max_ps(a, b); }
+static inline batch_t batch_and(batch_t a, batch_t b) { return _mm256_and_ps(a, b); }
+static inline batch_t batch_cmple(batch_t a, batch_t b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline uint32 batch_mask(batch_t a) { return static_cast<uint32>(_mm256_movemask_ps(a)); }
+#else
+typedef __m128 batch_t;
+static const uint32 BATCH_WIDTH = 4;
+static inline batch_t batch_load(const float* p) { return _mm_loadu_ps(p); }
+static inline batch_t batch_set1(float x) { return _mm_set1_ps(x); }
+static inline batch_t batch_add(batch_t a, batch_t b) { return _mm_add_ps(a, b); }
+static inline batch_t batch_sub(batch_t a, batch_t b) { return _mm_sub_ps(a, b); }
+static inline batch_t batch_mul(batch_t a, batch_t b) { return _mm_mul_ps(a, b); }
+static inline batch_t batch_min(batch_t a, batch_t b) { return _mm_min_ps(a, b); }
+static inline batch_t batch_max(batch_t a, batch_t b) { return _mm_max_ps(a, b); }
+static inline batch_t batch_and(batch_t a, batch_t b) { return _mm_and_ps(a, b); }
+static inline batch_t batch_cmple(batch_t a, batch_t b) { return _mm_cmple_ps(a, b); }
+static inline uint32 batch_mask(batch_t a) { return static_cast<uint32>(_mm_movemask_ps(a)); }
+#endif
+
+// sets bit j of the masks of boxes in lanes, ignoring padding past the last box
+static inline void batch_report(uint32 lanes, uint32 first, uint32 n_boxes, uint32 j, uint32 words, uint32* masks)
+{
+ while(lanes) {
+       uint32 lane = 0;
+       while(!(lanes & (1u << lane))) lane++;
+       lanes &= ~(1u << lane);
+       uint32 box = first + lane;
+       if(box < n_boxes) masks[box*words + (j >> 5)] |= (1u << (j & 31));
+      }
+}
+
+void OBB_batch_pack(OBB_batch& batch, const OBB* boxes, uint32 n)
+{
+ // padding boxes have zero axes and widths
+ uint32 n_groups = (n + BATCH_GROUP - 1)/BATCH_GROUP;
+ batch.n = n;
+ batch.data.assign(n_groups*15*BATCH_GROUP, 0.0f);
+ for(uint32 i = 0; i < n; i++) {
+     float* dst = &batch.data[(i/BATCH_GROUP)*15*BATCH_GROUP + (i % BATCH_GROUP)];
+     const float* src[5] = { boxes[i].center, boxes[i].x, boxes[i].y, boxes[i].z, boxes[i].widths };
+     for(uint32 j = 0; j < 5; j++)
+         for(uint32 k = 0; k < 3; k++)
+             dst[(3*j + k)*BATCH_GROUP] = src[j][k];
+    }
+}
+
+void AABB_batch_pack(AABB_batch& batch, const AABB_halfdim* boxes, uint32 n)
+{
+ uint32 n_groups = (n + BATCH_GROUP - 1)/BATCH_GROUP;
+ batch.n = n;
+ batch.data.assign(n_groups*6*BATCH_GROUP, 0.0f);
+ for(uint32 i = 0; i < n; i++) {
+     float* dst = &batch.data[(i/BATCH_GROUP)*6*BATCH_GROUP + (i % BATCH_GROUP)];
+     for(uint32 k = 0; k < 3; k++) {
+         dst[k*BATCH_GROUP] = boxes[i].center[k];
+         dst[(3 + k)*BATCH_GROUP] = boxes[i].widths[k];
+        }
+    }
+}
+
+void OBB_batch_intersect(const OBB_batch& batch, const float (*points)[3], uint32 n, uint32* masks)
+{
+ // clear masks
+ uint32 words = BATCH_MASK_WORDS(n);
+ std::fill(masks, masks + batch.n*words, 0u);
+
+ // for each SIMD register of boxes
+ for(uint32 first = 0; first < batch.n; first += BATCH_WIDTH)
+    {
+     const float* data = &batch.data[(first/BATCH_GROUP)*15*BATCH_GROUP + (first % BATCH_GROUP)];
+     batch_t C[3], X[3], Y[3], Z[3], W[3], NW[3];
+     for(uint32 k = 0; k < 3; k++) {
+         C[k] = batch_load(data + (0 + k)*BATCH_GROUP);
+         X[k] = batch_load(data + (3 + k)*BATCH_GROUP);
+         Y[k] = batch_load(data + (6 + k)*BATCH_GROUP);
+         Z[k] = batch_load(data + (9 + k)*BATCH_GROUP);
+         W[k] = batch_load(data + (12 + k)*BATCH_GROUP);
+         NW[k] = batch_sub(batch_set1(0.0f), W[k]);
+        }
+
+     // same operations as OBB_intersect (point inside if -w <= q <= +w on each axis)
+     for(uint32 j = 0; j < n; j++) {
+         batch_t p0 = batch_sub(batch_set1(points[j][0]), C[0]);
+         batch_t p1 = batch_sub(batch_set1(points[j][1]), C[1]);
+         batch_t p2 = batch_sub(batch_set1(points[j][2]), C[2]);
+         batch_t qx = batch_add(batch_add(batch_mul(X[0], p0), batch_mul(X[1], p1)), batch_mul(X[2], p2));
+         batch_t qy = batch_add(batch_add(batch_mul(Y[0], p0), batch_mul(Y[1], p1)), batch_mul(Y[2], p2));
+         batch_t qz = batch_add(batch_add(batch_mul(Z[0], p0), batch_mul(Z[1], p1)), batch_mul(Z[2], p2));
+         batch_t inside = batch_and(batch_cmple(NW[0], qx), batch_cmple(qx, W[0]));
+         inside = batch_and(inside, batch_and(batch_cmple(NW[1], qy), batch_cmple(qy, W[1])));
+         inside = batch_and(inside, batch_and(batch_cmple(NW[2], qz), batch_cmple(qz, W[2])));
+         batch_report(batch_mask(inside), first, batch.n, j, words, masks);
+        }
+    }
+}
+
+void OBB_batch_intersect(const OBB_batch& batch, const BV_sphere* spheres, uint32 n, uint32* masks)
+{
+ // clear masks
+ uint32 words = BATCH_MASK_WORDS(n);
+ std::fill(masks, masks + batch.n*words, 0u);
+
+ // for each SIMD register of boxes
+ const batch_t zero = batch_set1(0.0f);
+ for(uint32 first = 0; first < batch.n; first += BATCH_WIDTH)
+    {
+     const float* data = &batch.data[(first/BATCH_GROUP)*15*BATCH_GROUP + (first % BATCH_GROUP)];
+     batch_t C[3], A[3][3], W[3];
+     for(uint32 k = 0; k < 3; k++) {
+         C[k] = batch_load(data + (0 + k)*BATCH_GROUP);
+         A[0][k] = batch_load(data + (3 + k)*BATCH_GROUP);
+         A[1][k] = batch_load(data + (6 + k)*BATCH_GROUP);
+         A[2][k] = batch_load(data + (9 + k)*BATCH_GROUP);
+         W[k] = batch_load(data + (12 + k)*BATCH_GROUP);
+        }
+
+     // same operations as OBB_intersect (only one of the distances below and above the box
+     // along an axis is nonzero, so their sum is exactly the one the scalar test uses)
+     for(uint32 j = 0; j < n; j++) {
+         batch_t s0 = batch_sub(batch_set1(spheres[j].center[0]), C[0]);
+         batch_t s1 = batch_sub(batch_set1(spheres[j].center[1]), C[1]);
+         batch_t s2 = batch_sub(batch_set1(spheres[j].center[2]), C[2]);
+         batch_t distance = zero;
+         for(uint32 k = 0; k < 3; k++) {
+             batch_t sp = batch_add(batch_add(batch_mul(A[k][0], s0), batch_mul(A[k][1], s1)), batch_mul(A[k][2], s2));
+             batch_t d = batch_add(batch_min(batch_add(sp, W[k]), zero), batch_max(batch_sub(sp, W[k]), zero));
+             distance = batch_add(distance, batch_mul(d, d));
+            }
+         batch_t inside = batch_cmple(distance, batch_set1(spheres[j].radius*spheres[j].radius));
+         batch_report(batch_mask(inside), first, batch.n, j, words, masks);
+        }
+    }
+}
+
+void AABB_batch_intersect(const AABB_batch& batch, const BV_sphere* spheres, uint32 n, uint32* masks)
+{
+ // clear masks
+ uint32 words = BATCH_MASK_WORDS(n);
+ std::fill(masks, masks + batch.n*words, 0u);
+
+ // for each SIMD register of boxes
+ const batch_t zero = batch_set1(0.0f);
+ for(uint32 first = 0; first < batch.n; first += BATCH_WIDTH)
+    {
+     const float* data = &batch.data[(first/BATCH_GROUP)*6*BATCH_GROUP + (first % BATCH_GROUP)];
+     batch_t B0[3], B1[3];
+     for(uint32 k = 0; k < 3; k++) {
+         batch_t C = batch_load(data + k*BATCH_GROUP);
+         batch_t W = batch_load(data + (3 + k)*BATCH_GROUP);
+         B0[k] = batch_sub(C, W);
+         B1[k] = batch_add(C, W);
+        }
+
+     // same operations as AABB_intersect
+     for(uint32 j = 0; j < n; j++) {
+         batch_t distance = zero;
+         for(uint32 k = 0; k < 3; k++) {
+             batch_t s = batch_set1(spheres[j].center[k]);
+             batch_t d = batch_add(batch_min(batch_sub(s, B0[k]), zero), batch_max(batch_sub(s, B1[k]), zero));
+             distance = batch_add(distance, batch_mul(d, d));
+            }
+         batch_t inside = batch_cmple(distance, batch_set1(spheres[j].radius*spheres[j].radius));
+         batch_report(batch_mask(inside), first, batch.n, j, words, masks);
+        }
+    }
+}
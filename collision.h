@@ -343,4 +343,31 @@ inline bool OBB_intersect(const OBB& obb, const BV_sphere& s)
 
 #pragma endregion OBB_INTERSECTION
 
+// BATCHED INTERSECTION TESTS
+#pragma region BATCHED_INTERSECTION
+
+// Boxes are packed in groups of eight (structure of arrays within each group), so that one
+// test runs on four (SSE) or eight (AVX) boxes at once. Results are bit masks: bit j of
+// masks[i*words + j/32] is set if box i intersects point or sphere j, where words is
+// BATCH_MASK_WORDS(n). Batched tests give exactly the same results as the scalar tests.
+inline uint32 BATCH_MASK_WORDS(uint32 n) { return (n + 31)/32; }
+
+struct OBB_batch {
+ uint32 n;               // number of boxes
+ std::vector<float> data; // per group: center, x, y, z, widths (15 arrays of 8 floats)
+};
+
+struct AABB_batch {
+ uint32 n;               // number of boxes
+ std::vector<float> data; // per group: center, widths (6 arrays of 8 floats)
+};
+
+void OBB_batch_pack(OBB_batch& batch, const OBB* boxes, uint32 n);
+void AABB_batch_pack(AABB_batch& batch, const AABB_halfdim* boxes, uint32 n);
+void OBB_batch_intersect(const OBB_batch& batch, const float (*points)[3], uint32 n, uint32* masks);
+void OBB_batch_intersect(const OBB_batch& batch, const BV_sphere* spheres, uint32 n, uint32* masks);
+void AABB_batch_intersect(const AABB_batch& batch, const BV_sphere* spheres, uint32 n, uint32* masks);
+
+#pragma endregion BATCHED_INTERSECTION
+
 #endif
@@ -102,23 +102,18 @@ real32 DoorController::GetClosingTime(void)const
 {
  return close_time;
 }
-#include "viewport.h"
-void DoorController::Poll(real32 dt)
+void DoorController::Poll(real32 dt, const real32 (*points)[3], uint32 n_points)
 {
  // nothing to do, door is disabled
  if(!GetActiveFlag()) return;
 
- // are any viewport cameras inside?
+ // are any viewport cameras inside? (points are the orbit points of viewport cameras that
+ // the broadphase found within the bounds of this OBB)
  bool intersect = false;
- for(uint32 i = 0; i < GetCanvasViewportNumber(); i++) {
-     if(IsViewportEnabled(i)) {
-        auto camera = GetViewportCamera(i);
-        real32 orbit[3];
-        camera->GetOrbitPoint(orbit);
-        if(OBB_intersect(this->box, orbit)) {
-           intersect = true;
-           break;
-          }
+ for(uint32 i = 0; i < n_points; i++) {
+     if(OBB_intersect(this->box, points[i])) {
+        intersect = true;
+        break;
        }
     }
 
@@ -29,7 +29,7 @@ class DoorController : public Entity {
   const uint32* GetSounds(void)const;
   void SetClosingTime(real32 dt);
   real32 GetClosingTime(void)const;
-  void Poll(real32 dt);
+  void Poll(real32 dt, const real32 (*points)[3], uint32 n_points);
 
  // Events
  public :
@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "jobs.h"
+
+JobSystem::JobSystem() : job(nullptr), n_items(0), grain(1), next(0), n_busy(0), generation(0), quit(false)
+{
+}
+
+JobSystem::~JobSystem()
+{
+ stop();
+}
+
+/** start
+ *  Starts n_threads - 1 worker threads (the thread that calls run is the other one). If n_threads
+ *  is zero, one thread per hardware thread is used.
+ */
+void JobSystem::start(uint32 n_threads)
+{
+ stop();
+ if(!n_threads) n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+ for(uint32 i = 1; i < n_threads; i++) threads.push_back(std::thread(&JobSystem::worker, this));
+}
+
+void JobSystem::stop(void)
+{
+ // wake workers and wait for them to quit
+ if(threads.empty()) return;
+ {
+  std::lock_guard<std::mutex> lock(mutex);
+  quit = true;
+ }
+ wake.notify_all();
+ for(auto& thread : threads) thread.join();
+ threads.clear();
+ quit = false;
+}
+
+/** run
+ *  Calls func(first, last) for chunks [first, last) of [0, n) on all threads. Loops that are not
+ *  bigger than one chunk run on the calling thread only.
+ */
+void JobSystem::run(uint32 n, uint32 grain, const std::function<void(uint32, uint32)>& func)
+{
+ // nothing to share
+ if(!n) return;
+ if(!grain) grain = 1;
+ if(threads.empty() || n <= grain) {
+    func(0, n);
+    return;
+   }
+
+ // start loop
+ {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->job = &func;
+  this->n_items = n;
+  this->grain = grain;
+  this->next = 0;
+  this->n_busy = static_cast<uint32>(threads.size());
+  this->generation++;
+ }
+ wake.notify_all();
+
+ // help, then wait for workers
+ work();
+ std::unique_lock<std::mutex> lock(mutex);
+ done.wait(lock, [this]() { return n_busy == 0; });
+ job = nullptr;
+}
+
+void JobSystem::worker(void)
+{
+ uint64 seen = 0;
+ for(;;) {
+     // wait for next loop
+     {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this, seen]() { return quit || generation != seen; });
+      if(quit) return;
+      seen = generation;
+     }
+
+     // run chunks until none are left
+     work();
+     std::lock_guard<std::mutex> lock(mutex);
+     if(--n_busy == 0) done.notify_one();
+    }
+}
+
+void JobSystem::work(void)
+{
+ for(;;) {
+     uint32 a = next.fetch_add(grain);
+     if(!(a < n_items)) return;
+     (*job)(a, std::min(a + grain, n_items));
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef __CS489_JOBS_H
+#define __CS489_JOBS_H
+
+// Job system
+// A fixed set of worker threads that run parallel loops, so that work done every frame (such as
+// animating all moving instances) does not pay for creating threads. A loop is split into chunks
+// of grain items that the workers and the calling thread take from a shared counter until none
+// are left, so chunks that take longer than others balance out. Workers sleep between loops. One
+// loop runs at a time, and run returns once the whole loop is done.
+class JobSystem {
+ private :
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;  // signaled when a loop starts (or workers must quit)
+  std::condition_variable done;  // signaled when the last worker finishes a loop
+  const std::function<void(uint32, uint32)>* job;
+  uint32 n_items;
+  uint32 grain;
+  std::atomic<uint32> next;      // first item of the next chunk
+  uint32 n_busy;                 // number of workers still in the current loop
+  uint64 generation;             // number of loops started
+  bool quit;
+ private :
+  void worker(void);
+  void work(void);
+ public :
+  void start(uint32 n_threads);
+  void stop(void);
+  void run(uint32 n, uint32 grain, const std::function<void(uint32, uint32)>& func);
+  uint32 size(void)const { return static_cast<uint32>(threads.size()) + 1; }
+ public :
+  JobSystem();
+  JobSystem(const JobSystem&) = delete;
+  void operator =(const JobSystem&) = delete;
+ ~JobSystem();
+};
+
+#endif
@@ -26,6 +26,11 @@
 
 #include "viewport.h"
 
+// broadphase groups (cameras pair with doors and triggers, which do not pair with each other)
+static const uint32 BROADPHASE_CAMERA = 0x1ul;
+static const uint32 BROADPHASE_DOOR = 0x2ul;
+static const uint32 BROADPHASE_TRIGGER = 0x4ul;
+
 #pragma region SPECIAL_MEMBER_FUNCTIONS
 
 Map::Map()
@@ -783,6 +788,95 @@ ErrorCode Map::LoadCells(std::deque<std::string>& linelist)
  return EC_SUCCESS;
 }
 
+ErrorCode Map::BuildScene(void)
+{
+ // add collision meshes (one bottom level tree per collision mesh, mapped from the cache
+ // folder when the collision mesh has not changed since the last time the map was loaded)
+ auto ADD_MESHES = [this](const MeshData* data, uint32 n, std::vector<std::vector<uint32>>& list) {
+  list.resize(n);
+  for(uint32 i = 0; i < n; i++) {
+      for(uint32 j = 0; j < data[i].GetCollisionMeshCount(); j++) {
+          uint32 index = scene.add_mesh(data[i].GetCollisionVertices(j), data[i].GetCollisionVertexCount(j), data[i].GetCollisionFaces(j), data[i].GetCollisionFaceCount(j), L"cache");
+          if(index != 0xFFFFFFFFul) list[i].push_back(index);
+         }
+     }
+ };
+ ADD_MESHES(static_models.get(), n_static, static_scene_meshes);
+ ADD_MESHES(moving_models.get(), n_moving, moving_scene_meshes);
+
+ // add static instances (id is instance index)
+ for(uint32 i = 0; i < n_static_instances; i++) {
+     size_t reference = static_instances[i].GetMeshData() - static_models.get();
+     if(!(reference < n_static)) return DebugErrorCode(EC_LOAD_LEVEL, __LINE__, __FILE__);
+     for(uint32 mesh : static_scene_meshes[reference])
+         scene.add_instance(mesh, static_instances[i].GetMatrix(), i);
+    }
+
+ // add moving instances (id is instance index with high bit set)
+ moving_scene_instances.resize(n_moving_instances + 1);
+ for(uint32 i = 0; i < n_moving_instances; i++) {
+     size_t reference = moving_instances[i].GetMeshData() - moving_models.get();
+     if(!(reference < n_moving)) return DebugErrorCode(EC_LOAD_LEVEL, __LINE__, __FILE__);
+     moving_scene_instances[i] = scene.n_instances();
+     for(uint32 mesh : moving_scene_meshes[reference])
+         scene.add_instance(mesh, moving_instances[i].GetMatrix(), i | 0x80000000ul);
+    }
+ moving_scene_instances[n_moving_instances] = scene.n_instances();
+
+ // build top level
+ scene.update();
+ return EC_SUCCESS;
+}
+
+ErrorCode Map::BuildOctree(void)
+{
+ // world space bounds of static instances (bounds of the model space box under the instance
+ // matrix, whose translation is in m[3], m[7], and m[11])
+ if(!n_static_instances) return EC_SUCCESS;
+ std::unique_ptr<AABB_minmax[]> bounds(new AABB_minmax[n_static_instances]);
+ for(uint32 i = 0; i < n_static_instances; i++) {
+     real32 a[3] = { 0.0f, 0.0f, 0.0f };
+     real32 b[3] = { 0.0f, 0.0f, 0.0f };
+     static_instances[i].GetMeshData()->GetBounds(a, b);
+     const real32* M = static_instances[i].GetMatrix();
+     for(uint32 j = 0; j < 3; j++) {
+         real32 center = M[4*j + 3];
+         real32 extent = 0.0f;
+         for(uint32 k = 0; k < 3; k++) {
+             center += M[4*j + k]*(a[k] + b[k])*0.5f;
+             extent += std::abs(M[4*j + k])*(b[k] - a[k])*0.5f;
+            }
+         bounds[i].a[j] = center - extent;
+         bounds[i].b[j] = center + extent;
+        }
+    }
+
+ // construct octree (ids are instance indices)
+ static_octree.construct(bounds.get(), nullptr, n_static_instances);
+ visible_instances.reset(new uint32[n_static_instances]);
+ return EC_SUCCESS;
+}
+
+ErrorCode Map::BuildBroadphase(void)
+{
+ // add door controller OBB bounds (id is door controller index)
+ door_contacts.resize(dcd.size, 0);
+ for(uint32 i = 0; i < dcd.size; i++) {
+     const OBB& box = dcd.data[i].GetOBB();
+     AABB_minmax aabb;
+     for(uint32 j = 0; j < 3; j++) {
+         real32 extent = std::abs(box.x[j])*box.widths[0] + std::abs(box.y[j])*box.widths[1] + std::abs(box.z[j])*box.widths[2];
+         aabb.a[j] = box.center[j] - extent;
+         aabb.b[j] = box.center[j] + extent;
+        }
+     broadphase.insert(aabb, BROADPHASE_DOOR, 0, i);
+    }
+
+ // viewport cameras are added on update
+ camera_proxies.clear();
+ return EC_SUCCESS;
+}
+
 #pragma endregion PRIVATE_LOADING_FUNCTIONS
 
 #pragma region PRIVATE_UNLOADING_FUNCTIONS
@@ -859,6 +953,27 @@ void Map::FreeCells(void)
  cells.size = 0;
 }
 
+void Map::FreeScene(void)
+{
+ scene.clear();
+ static_scene_meshes.clear();
+ moving_scene_meshes.clear();
+ moving_scene_instances.clear();
+}
+
+void Map::FreeOctree(void)
+{
+ static_octree.clear();
+ visible_instances.reset();
+}
+
+void Map::FreeBroadphase(void)
+{
+ broadphase.clear();
+ camera_proxies.clear();
+ door_contacts.clear();
+}
+
 #pragma endregion PRIVATE_UNLOADING_FUNCTIONS
 
 ErrorCode Map::LoadMap(LPCWSTR filename)
@@ -915,6 +1030,21 @@ ErrorCode Map::LoadMap(LPCWSTR filename)
  code = LoadCells(linelist);
  if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
 
+ // build collision scene
+ code = BuildScene();
+ if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
+
+ // build static instance octree
+ code = BuildOctree();
+ if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
+
+ // build broadphase
+ code = BuildBroadphase();
+ if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
+
+ // start threads that animate moving instances
+ animation_jobs.start(0);
+
  //
  // PHASE FINAL:
  // READ STARTING PROPERTIES
@@ -939,6 +1069,10 @@ void Map::FreeMap(void)
  sound_start = 0xFFFFFFFFul;
 
  // free data
+ animation_jobs.stop();
+ FreeBroadphase();
+ FreeOctree();
+ FreeScene();
  FreeCells();
  FreePortals();
  FreeDoorControllers();
@@ -956,22 +1090,74 @@ void Map::FreeMap(void)
 
 void Map::Update(real32 dt)
 {
- // INEFFICIENT!!! Poll all door controllers with orbit point
- for(uint32 i = 0; i < dcd.size; i++)
-     dcd.data[i].Poll(dt);
+ // move viewport camera orbit points in the broadphase
+ uint32 n_viewports = std::min(GetCanvasViewportNumber(), 32u);
+ if(camera_proxies.size() < n_viewports) camera_proxies.resize(n_viewports, 0xFFFFFFFFul);
+ for(uint32 i = 0; i < camera_proxies.size(); i++) {
+     if(i < n_viewports && IsViewportEnabled(i)) {
+        real32 orbit[3];
+        GetViewportCamera(i)->GetOrbitPoint(orbit);
+        AABB_minmax aabb(orbit[0], orbit[1], orbit[2], orbit[0], orbit[1], orbit[2]);
+        if(camera_proxies[i] == 0xFFFFFFFFul) camera_proxies[i] = broadphase.insert(aabb, BROADPHASE_CAMERA, BROADPHASE_DOOR | BROADPHASE_TRIGGER, i);
+        else broadphase.move(camera_proxies[i], aabb);
+       }
+     else if(camera_proxies[i] != 0xFFFFFFFFul) {
+        broadphase.remove(camera_proxies[i]);
+        camera_proxies[i] = 0xFFFFFFFFul;
+       }
+    }
 
- // INEFFICIENT!!!
- // RENDER ALL MOVING MODEL INSTANCES
+ // door controllers keep track of which viewport cameras are within their bounds
+ for(auto& event : broadphase.events()) {
+     uint32 a = event.proxy[0];
+     uint32 b = event.proxy[1];
+     if(broadphase.group(a) == BROADPHASE_CAMERA) std::swap(a, b);
+     if(broadphase.group(a) != BROADPHASE_DOOR) continue;
+     uint32 bit = (1ul << broadphase.id(b));
+     if(event.type == SAP_BEGIN_OVERLAP) door_contacts[broadphase.id(a)] |= bit;
+     else door_contacts[broadphase.id(a)] &= ~bit;
+    }
+ broadphase.clear_events();
+
+ // poll door controllers (OBB tests only against cameras within their bounds)
+ for(uint32 i = 0; i < dcd.size; i++) {
+     real32 points[32][3];
+     uint32 n_points = 0;
+     for(uint32 j = 0; j < camera_proxies.size(); j++)
+         if(door_contacts[i] & (1ul << j)) GetViewportCamera(j)->GetOrbitPoint(points[n_points++]);
+     dcd.data[i].Poll(dt, points, n_points);
+    }
+
+ // animate moving instances on all threads, then copy their palettes to Direct3D on this one
+ animation_jobs.run(n_moving_instances, 16, [&](uint32 first, uint32 last) {
+  for(uint32 i = first; i < last; i++) moving_instances[i].Animate(dt);
+ });
  for(uint32 i = 0; i < n_moving_instances; i++)
-     moving_instances[i].Update(dt);
+     moving_instances[i].Upload();
+
+ // moving instances only refit the top level of the collision scene, and only when their
+ // matrix changed (animation does not change the collision mesh, which stays in bind pose)
+ for(uint32 i = 0; i < n_moving_instances; i++) {
+     if(!moving_instances[i].IsMoved()) continue;
+     for(uint32 j = moving_scene_instances[i]; j < moving_scene_instances[i + 1]; j++)
+         scene.move_instance(j, moving_instances[i].GetMatrix());
+     moving_instances[i].ClearMoved();
+    }
 }
 
 void Map::Render(void)
 {
- // INEFFICIENT!!!
- // RENDER ALL STATIC MODEL INSTANCES
- for(uint32 i = 0; i < n_static_instances; i++)
-     static_instances[i].RenderModel();
+ // render static model instances in the view frustum of the current camera
+ real32 planes[6][4];
+ auto camera = GetRenderCamera();
+ if(camera && camera->GetFrustum(planes) && visible_instances) {
+    uint32 n = static_octree.query(planes, 6, visible_instances.get(), n_static_instances);
+    for(uint32 i = 0; i < n; i++) static_instances[visible_instances[i]].RenderModel();
+   }
+ else {
+    for(uint32 i = 0; i < n_static_instances; i++)
+        static_instances[i].RenderModel();
+   }
 
  // INEFFICIENT!!!
  // RENDER ALL MOVING MODEL INSTANCES
@@ -26,6 +26,10 @@
 #include "xaudio.h"
 #include "model_v2.h"
 #include "meshinst.h"
+#include "scene.h"
+#include "broadphase.h"
+#include "octree.h"
+#include "jobs.h"
 
 // Entity Headers
 #include "en_camanim.h"
@@ -102,6 +106,22 @@ class Map {
   std::map<STDSTRINGW, uint32> moving_instance_map;
   std::unique_ptr<MeshInstance[]> static_instances;
   std::unique_ptr<MeshInstance[]> moving_instances;
+  JobSystem animation_jobs;
+ // collision
+ private :
+  SceneBVH scene;
+  std::vector<std::vector<uint32>> static_scene_meshes;
+  std::vector<std::vector<uint32>> moving_scene_meshes;
+  std::vector<uint32> moving_scene_instances;
+ // static instance culling
+ private :
+  LooseOctree static_octree;
+  std::unique_ptr<uint32[]> visible_instances;
+ // broadphase
+ private :
+  SweepAndPrune broadphase;
+  std::vector<uint32> camera_proxies; // per viewport (0xFFFFFFFF if viewport is disabled)
+  std::vector<uint32> door_contacts;  // per door controller, bit mask of overlapping viewports
  // file data
  private :
   DoorControllerData dcd;
@@ -123,6 +143,9 @@ class Map {
   ErrorCode LoadDoorControllers(std::deque<std::string>& linelist);
   ErrorCode LoadPortals(std::deque<std::string>& linelist);
   ErrorCode LoadCells(std::deque<std::string>& linelist);
+  ErrorCode BuildScene(void);
+  ErrorCode BuildBroadphase(void);
+  ErrorCode BuildOctree(void);
  // Private Unloading Functions
  private :
   void FreeStaticModels(void);
@@ -135,6 +158,9 @@ class Map {
   void FreeDoorControllers(void);
   void FreePortals(void);
   void FreeCells(void);
+  void FreeScene(void);
+  void FreeBroadphase(void);
+  void FreeOctree(void);
  public :
   ErrorCode LoadMap(LPCWSTR filename);
   void FreeMap(void);
@@ -146,6 +172,8 @@ class Map {
   MeshInstance* GetDynamicMeshInstance(const STDSTRINGW& name)const;
   MeshInstance* GetDynamicMeshInstance(uint32 index)const;
   SoundData* GetSoundData(uint32 index)const;
+  SceneBVH& GetScene(void) { return scene; }
+  const LooseOctree& GetStaticOctree(void)const { return static_octree; }
  public :
   Map();
   virtual ~Map();
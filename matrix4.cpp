@@ -1,2 +1,596 @@
 #include "stdafx.h"
-#include "matrix4.h"
\ No newline at end of file
+#include "matrix4.h"
+#ifdef _MSC_VER
+#include<intrin.h>
+#else
+#include<cpuid.h>
+#endif
+
+// AVX and FMA kernels are compiled for those instruction sets without changing the build flags
+// of the rest of the program, so they must only be called when the CPU supports them
+#if defined(__GNUC__) || defined(__clang__)
+#define MATRIX4D_TARGET(x) __attribute__((target(x)))
+#else
+#define MATRIX4D_TARGET(x)
+#endif
+
+#pragma region SCALAR_KERNELS
+
+static void matrix4D_mul_scalar(real32* X, const real32* A, const real32* B)
+{
+ real32 T[16] = {
+  A[0x0]*B[0x0] + A[0x1]*B[0x4] + A[0x2]*B[0x8] + A[0x3]*B[0xC],
+  A[0x0]*B[0x1] + A[0x1]*B[0x5] + A[0x2]*B[0x9] + A[0x3]*B[0xD],
+  A[0x0]*B[0x2] + A[0x1]*B[0x6] + A[0x2]*B[0xA] + A[0x3]*B[0xE],
+  A[0x0]*B[0x3] + A[0x1]*B[0x7] + A[0x2]*B[0xB] + A[0x3]*B[0xF],
+  A[0x4]*B[0x0] + A[0x5]*B[0x4] + A[0x6]*B[0x8] + A[0x7]*B[0xC],
+  A[0x4]*B[0x1] + A[0x5]*B[0x5] + A[0x6]*B[0x9] + A[0x7]*B[0xD],
+  A[0x4]*B[0x2] + A[0x5]*B[0x6] + A[0x6]*B[0xA] + A[0x7]*B[0xE],
+  A[0x4]*B[0x3] + A[0x5]*B[0x7] + A[0x6]*B[0xB] + A[0x7]*B[0xF],
+  A[0x8]*B[0x0] + A[0x9]*B[0x4] + A[0xA]*B[0x8] + A[0xB]*B[0xC],
+  A[0x8]*B[0x1] + A[0x9]*B[0x5] + A[0xA]*B[0x9] + A[0xB]*B[0xD],
+  A[0x8]*B[0x2] + A[0x9]*B[0x6] + A[0xA]*B[0xA] + A[0xB]*B[0xE],
+  A[0x8]*B[0x3] + A[0x9]*B[0x7] + A[0xA]*B[0xB] + A[0xB]*B[0xF],
+  A[0xC]*B[0x0] + A[0xD]*B[0x4] + A[0xE]*B[0x8] + A[0xF]*B[0xC],
+  A[0xC]*B[0x1] + A[0xD]*B[0x5] + A[0xE]*B[0x9] + A[0xF]*B[0xD],
+  A[0xC]*B[0x2] + A[0xD]*B[0x6] + A[0xE]*B[0xA] + A[0xF]*B[0xE],
+  A[0xC]*B[0x3] + A[0xD]*B[0x7] + A[0xE]*B[0xB] + A[0xF]*B[0xF]
+ };
+ matrix4D_copy(X, T);
+}
+
+static real32 matrix4D_inverse_scalar(real32* X, const real32* A)
+{
+ // cache 2x2 determinants
+ real32 D[12] = {
+  A[0xA]*A[0xF] - A[0xB]*A[0xE],
+  A[0x9]*A[0xF] - A[0xB]*A[0xD],
+  A[0x9]*A[0xE] - A[0xA]*A[0xD],
+  A[0x8]*A[0xF] - A[0xB]*A[0xC],
+  A[0x8]*A[0xE] - A[0xA]*A[0xC],
+  A[0x8]*A[0xD] - A[0x9]*A[0xC],
+  A[0x2]*A[0x7] - A[0x3]*A[0x6],
+  A[0x1]*A[0x7] - A[0x3]*A[0x5],
+  A[0x1]*A[0x6] - A[0x2]*A[0x5],
+  A[0x0]*A[0x7] - A[0x3]*A[0x4],
+  A[0x0]*A[0x6] - A[0x2]*A[0x4],
+  A[0x0]*A[0x5] - A[0x1]*A[0x4]
+ };
+
+ // compute determinant
+ real32 det = D[0x5]*D[0x6] - D[0x4]*D[0x7] + D[0x3]*D[0x8] + D[0x2]*D[0x9] - D[0x1]*D[0xA] + D[0x0]*D[0xB];
+ if(det == 0.0f) return det;
+
+ // inv(M) = inv(det(M)) * transpose(C)
+ real32 invdet = inv(det);
+ real32 T[16];
+ T[0x0] = +(A[0x5]*D[0x0] - A[0x6]*D[0x1] + A[0x7]*D[0x2])*invdet;
+ T[0x4] = -(A[0x4]*D[0x0] - A[0x6]*D[0x3] + A[0x7]*D[0x4])*invdet;
+ T[0x8] = +(A[0x4]*D[0x1] - A[0x5]*D[0x3] + A[0x7]*D[0x5])*invdet;
+ T[0xC] = -(A[0x4]*D[0x2] - A[0x5]*D[0x4] + A[0x6]*D[0x5])*invdet;
+ T[0x1] = -(A[0x1]*D[0x0] - A[0x2]*D[0x1] + A[0x3]*D[0x2])*invdet;
+ T[0x5] = +(A[0x0]*D[0x0] - A[0x2]*D[0x3] + A[0x3]*D[0x4])*invdet;
+ T[0x9] = -(A[0x0]*D[0x1] - A[0x1]*D[0x3] + A[0x3]*D[0x5])*invdet;
+ T[0xD] = +(A[0x0]*D[0x2] - A[0x1]*D[0x4] + A[0x2]*D[0x5])*invdet;
+ T[0x2] = +(A[0xD]*D[0x6] - A[0xE]*D[0x7] + A[0xF]*D[0x8])*invdet;
+ T[0x6] = -(A[0xC]*D[0x6] - A[0xE]*D[0x9] + A[0xF]*D[0xA])*invdet;
+ T[0xA] = +(A[0xC]*D[0x7] - A[0xD]*D[0x9] + A[0xF]*D[0xB])*invdet;
+ T[0xE] = -(A[0xC]*D[0x8] - A[0xD]*D[0xA] + A[0xE]*D[0xB])*invdet;
+ T[0x3] = -(A[0x9]*D[0x6] - A[0xA]*D[0x7] + A[0xB]*D[0x8])*invdet;
+ T[0x7] = +(A[0x8]*D[0x6] - A[0xA]*D[0x9] + A[0xB]*D[0xA])*invdet;
+ T[0xB] = -(A[0x8]*D[0x7] - A[0x9]*D[0x9] + A[0xB]*D[0xB])*invdet;
+ T[0xF] = +(A[0x8]*D[0x8] - A[0x9]*D[0xA] + A[0xA]*D[0xB])*invdet;
+ matrix4D_copy(X, T);
+
+ // return determinant
+ return det;
+}
+
+static void matrix4D_vector4_mul_scalar(real32* X, const real32* A, const real32* B, uint32 n)
+{
+ for(uint32 i = 0; i < n; i++) matrix4D_vector4_mul(X + 4*i, A, B + 4*i);
+}
+
+static inline void matrix4D_transform_point(real32* X, const real32* A, real32 x, real32 y, real32 z, matrix4D_transform_type type)
+{
+ // same operations as matrix4D_vector3_mul (normals) and matrix4D * vector3D (points)
+ if(type == MATRIX4D_TRANSFORM_NORMALS) {
+    X[0] = A[0x0]*x + A[0x1]*y + A[0x2]*z;
+    X[1] = A[0x4]*x + A[0x5]*y + A[0x6]*z;
+    X[2] = A[0x8]*x + A[0x9]*y + A[0xA]*z;
+    return;
+   }
+ X[0] = A[0x0]*x + A[0x1]*y + A[0x2]*z + A[0x3];
+ X[1] = A[0x4]*x + A[0x5]*y + A[0x6]*z + A[0x7];
+ X[2] = A[0x8]*x + A[0x9]*y + A[0xA]*z + A[0xB];
+ if(type == MATRIX4D_TRANSFORM_PROJECTIVE) {
+    real32 w = A[0xC]*x + A[0xD]*y + A[0xE]*z + A[0xF];
+    X[0] /= w;
+    X[1] /= w;
+    X[2] /= w;
+   }
+}
+
+static void matrix4D_transform_aos_scalar(real32* X, const real32* A, const real32* P, uint32 n, matrix4D_transform_type type)
+{
+ for(uint32 i = 0; i < n; i++) matrix4D_transform_point(X + 3*i, A, P[3*i + 0], P[3*i + 1], P[3*i + 2], type);
+}
+
+static void matrix4D_transform_soa_scalar(real32* const* X, const real32* A, const real32* const* P, uint32 n, matrix4D_transform_type type)
+{
+ for(uint32 i = 0; i < n; i++) {
+     real32 T[3];
+     matrix4D_transform_point(T, A, P[0][i], P[1][i], P[2][i], type);
+     X[0][i] = T[0];
+     X[1][i] = T[1];
+     X[2][i] = T[2];
+    }
+}
+
+#pragma endregion SCALAR_KERNELS
+
+#pragma region SSE2_KERNELS
+
+// SSE2 kernels do the same operations in the same order as the scalar kernels, so they give
+// exactly the same results
+
+#define MATRIX4D_SHUFFLE(v, a, b, c, d) _mm_shuffle_ps(v, v, _MM_SHUFFLE(d, c, b, a))
+
+static void matrix4D_mul_sse2(real32* X, const real32* A, const real32* B)
+{
+ // row i of X = A[i][0]*B[0] + A[i][1]*B[1] + A[i][2]*B[2] + A[i][3]*B[3]
+ __m128 b0 = _mm_loadu_ps(&B[0x0]);
+ __m128 b1 = _mm_loadu_ps(&B[0x4]);
+ __m128 b2 = _mm_loadu_ps(&B[0x8]);
+ __m128 b3 = _mm_loadu_ps(&B[0xC]);
+ __m128 a0 = _mm_loadu_ps(&A[0x0]);
+ __m128 a1 = _mm_loadu_ps(&A[0x4]);
+ __m128 a2 = _mm_loadu_ps(&A[0x8]);
+ __m128 a3 = _mm_loadu_ps(&A[0xC]);
+ __m128 x0 = _mm_mul_ps(MATRIX4D_SHUFFLE(a0, 0, 0, 0, 0), b0);
+ __m128 x1 = _mm_mul_ps(MATRIX4D_SHUFFLE(a1, 0, 0, 0, 0), b0);
+ __m128 x2 = _mm_mul_ps(MATRIX4D_SHUFFLE(a2, 0, 0, 0, 0), b0);
+ __m128 x3 = _mm_mul_ps(MATRIX4D_SHUFFLE(a3, 0, 0, 0, 0), b0);
+ x0 = _mm_add_ps(x0, _mm_mul_ps(MATRIX4D_SHUFFLE(a0, 1, 1, 1, 1), b1));
+ x1 = _mm_add_ps(x1, _mm_mul_ps(MATRIX4D_SHUFFLE(a1, 1, 1, 1, 1), b1));
+ x2 = _mm_add_ps(x2, _mm_mul_ps(MATRIX4D_SHUFFLE(a2, 1, 1, 1, 1), b1));
+ x3 = _mm_add_ps(x3, _mm_mul_ps(MATRIX4D_SHUFFLE(a3, 1, 1, 1, 1), b1));
+ x0 = _mm_add_ps(x0, _mm_mul_ps(MATRIX4D_SHUFFLE(a0, 2, 2, 2, 2), b2));
+ x1 = _mm_add_ps(x1, _mm_mul_ps(MATRIX4D_SHUFFLE(a1, 2, 2, 2, 2), b2));
+ x2 = _mm_add_ps(x2, _mm_mul_ps(MATRIX4D_SHUFFLE(a2, 2, 2, 2, 2), b2));
+ x3 = _mm_add_ps(x3, _mm_mul_ps(MATRIX4D_SHUFFLE(a3, 2, 2, 2, 2), b2));
+ x0 = _mm_add_ps(x0, _mm_mul_ps(MATRIX4D_SHUFFLE(a0, 3, 3, 3, 3), b3));
+ x1 = _mm_add_ps(x1, _mm_mul_ps(MATRIX4D_SHUFFLE(a1, 3, 3, 3, 3), b3));
+ x2 = _mm_add_ps(x2, _mm_mul_ps(MATRIX4D_SHUFFLE(a2, 3, 3, 3, 3), b3));
+ x3 = _mm_add_ps(x3, _mm_mul_ps(MATRIX4D_SHUFFLE(a3, 3, 3, 3, 3), b3));
+
+ // store after all loads (X can be A or B)
+ _mm_storeu_ps(&X[0x0], x0);
+ _mm_storeu_ps(&X[0x4], x1);
+ _mm_storeu_ps(&X[0x8], x2);
+ _mm_storeu_ps(&X[0xC], x3);
+}
+
+static real32 matrix4D_inverse_sse2(real32* X, const real32* A)
+{
+ __m128 r0 = _mm_loadu_ps(&A[0x0]);
+ __m128 r1 = _mm_loadu_ps(&A[0x4]);
+ __m128 r2 = _mm_loadu_ps(&A[0x8]);
+ __m128 r3 = _mm_loadu_ps(&A[0xC]);
+
+ // 2x2 determinants of rows 2 and 3 in the order each column of cofactors uses them
+ // P[0] = (D0, D0, D1, D2), P[1] = (D1, D3, D3, D4), P[2] = (D2, D4, D5, D5)
+ __m128 P[3], Q[3];
+ P[0] = _mm_sub_ps(_mm_mul_ps(MATRIX4D_SHUFFLE(r2, 2, 2, 1, 1), MATRIX4D_SHUFFLE(r3, 3, 3, 3, 2)), _mm_mul_ps(MATRIX4D_SHUFFLE(r2, 3, 3, 3, 2), MATRIX4D_SHUFFLE(r3, 2, 2, 1, 1)));
+ P[1] = _mm_sub_ps(_mm_mul_ps(MATRIX4D_SHUFFLE(r2, 1, 0, 0, 0), MATRIX4D_SHUFFLE(r3, 3, 3, 3, 2)), _mm_mul_ps(MATRIX4D_SHUFFLE(r2, 3, 3, 3, 2), MATRIX4D_SHUFFLE(r3, 1, 0, 0, 0)));
+ P[2] = _mm_sub_ps(_mm_mul_ps(MATRIX4D_SHUFFLE(r2, 1, 0, 0, 0), MATRIX4D_SHUFFLE(r3, 2, 2, 1, 1)), _mm_mul_ps(MATRIX4D_SHUFFLE(r2, 2, 2, 1, 1), MATRIX4D_SHUFFLE(r3, 1, 0, 0, 0)));
+
+ // same for rows 0 and 1 (D6 to D11)
+ Q[0] = _mm_sub_ps(_mm_mul_ps(MATRIX4D_SHUFFLE(r0, 2, 2, 1, 1), MATRIX4D_SHUFFLE(r1, 3, 3, 3, 2)), _mm_mul_ps(MATRIX4D_SHUFFLE(r0, 3, 3, 3, 2), MATRIX4D_SHUFFLE(r1, 2, 2, 1, 1)));
+ Q[1] = _mm_sub_ps(_mm_mul_ps(MATRIX4D_SHUFFLE(r0, 1, 0, 0, 0), MATRIX4D_SHUFFLE(r1, 3, 3, 3, 2)), _mm_mul_ps(MATRIX4D_SHUFFLE(r0, 3, 3, 3, 2), MATRIX4D_SHUFFLE(r1, 1, 0, 0, 0)));
+ Q[2] = _mm_sub_ps(_mm_mul_ps(MATRIX4D_SHUFFLE(r0, 1, 0, 0, 0), MATRIX4D_SHUFFLE(r1, 2, 2, 1, 1)), _mm_mul_ps(MATRIX4D_SHUFFLE(r0, 2, 2, 1, 1), MATRIX4D_SHUFFLE(r1, 1, 0, 0, 0)));
+
+ // determinant (summed in the same order as the scalar kernel, where D0 = p[0][0],
+ // D1 = p[0][2], D2 = p[0][3], D3 = p[1][1], D4 = p[1][3], D5 = p[2][2], and D6 to D11 are
+ // at the same places in q)
+ alignas(16) real32 p[3][4];
+ alignas(16) real32 q[3][4];
+ for(int i = 0; i < 3; i++) {
+     _mm_store_ps(p[i], P[i]);
+     _mm_store_ps(q[i], Q[i]);
+    }
+ real32 det = p[2][2]*q[0][0] - p[1][3]*q[0][2] + p[1][1]*q[0][3] + p[0][3]*q[1][1] - p[0][2]*q[1][3] + p[0][0]*q[2][2];
+ if(det == 0.0f) return det;
+
+ // columns of inverse are rows of cofactors
+ // column 0 = (+, -, +, -)(A5*P0 - A6*P1 + A7*P2) using (A5, A4, A4, A4), (A6, A6, A5, A5), (A7, A7, A7, A6)
+ __m128 invdet = _mm_set1_ps(inv(det));
+ __m128 sign0 = _mm_set_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+ __m128 sign1 = _mm_set_ps(1.0f, -1.0f, 1.0f, -1.0f);
+ auto COFACTORS = [](__m128 r, const __m128* D) {
+  __m128 c = _mm_mul_ps(MATRIX4D_SHUFFLE(r, 1, 0, 0, 0), D[0]);
+  c = _mm_sub_ps(c, _mm_mul_ps(MATRIX4D_SHUFFLE(r, 2, 2, 1, 1), D[1]));
+  return _mm_add_ps(c, _mm_mul_ps(MATRIX4D_SHUFFLE(r, 3, 3, 3, 2), D[2]));
+ };
+ __m128 c0 = _mm_mul_ps(_mm_mul_ps(COFACTORS(r1, P), sign0), invdet);
+ __m128 c1 = _mm_mul_ps(_mm_mul_ps(COFACTORS(r0, P), sign1), invdet);
+ __m128 c2 = _mm_mul_ps(_mm_mul_ps(COFACTORS(r3, Q), sign0), invdet);
+ __m128 c3 = _mm_mul_ps(_mm_mul_ps(COFACTORS(r2, Q), sign1), invdet);
+
+ // transpose columns into rows
+ _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+ _mm_storeu_ps(&X[0x0], c0);
+ _mm_storeu_ps(&X[0x4], c1);
+ _mm_storeu_ps(&X[0x8], c2);
+ _mm_storeu_ps(&X[0xC], c3);
+ return det;
+}
+
+static void matrix4D_vector4_mul_sse2(real32* X, const real32* A, const real32* B, uint32 n)
+{
+ // X = A[0][j]*B[0] + A[1][j]*B[1] + A[2][j]*B[2] + A[3][j]*B[3] using columns of A
+ __m128 c0 = _mm_loadu_ps(&A[0x0]);
+ __m128 c1 = _mm_loadu_ps(&A[0x4]);
+ __m128 c2 = _mm_loadu_ps(&A[0x8]);
+ __m128 c3 = _mm_loadu_ps(&A[0xC]);
+ _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+ for(uint32 i = 0; i < n; i++) {
+     __m128 b = _mm_loadu_ps(B + 4*i);
+     __m128 r = _mm_mul_ps(c0, MATRIX4D_SHUFFLE(b, 0, 0, 0, 0));
+     r = _mm_add_ps(r, _mm_mul_ps(c1, MATRIX4D_SHUFFLE(b, 1, 1, 1, 1)));
+     r = _mm_add_ps(r, _mm_mul_ps(c2, MATRIX4D_SHUFFLE(b, 2, 2, 2, 2)));
+     r = _mm_add_ps(r, _mm_mul_ps(c3, MATRIX4D_SHUFFLE(b, 3, 3, 3, 3)));
+     _mm_storeu_ps(X + 4*i, r);
+    }
+}
+
+// four packed x, y, z points (a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3) to x, y, and z
+// and back; the 256-bit shuffles do the same thing in each 128-bit lane, so AVX uses these too
+#define MATRIX4D_AOS_TO_SOA(shuffle, a, b, c, x, y, z) { \
+ auto x2y2x3y3 = shuffle(b, c, _MM_SHUFFLE(2, 1, 3, 2)); \
+ auto y0z0y1z1 = shuffle(a, b, _MM_SHUFFLE(1, 0, 2, 1)); \
+ x = shuffle(a, x2y2x3y3, _MM_SHUFFLE(2, 0, 3, 0)); \
+ y = shuffle(y0z0y1z1, x2y2x3y3, _MM_SHUFFLE(3, 1, 2, 0)); \
+ z = shuffle(y0z0y1z1, c, _MM_SHUFFLE(3, 0, 3, 1)); \
+}
+#define MATRIX4D_SOA_TO_AOS(shuffle, x, y, z, a, b, c) { \
+ a = shuffle(shuffle(x, y, _MM_SHUFFLE(1, 0, 1, 0)), shuffle(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)); \
+ b = shuffle(shuffle(y, z, _MM_SHUFFLE(1, 1, 1, 1)), shuffle(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)); \
+ c = shuffle(shuffle(z, x, _MM_SHUFFLE(3, 3, 2, 2)), shuffle(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)); \
+}
+
+static inline void matrix4D_transform4_sse2(__m128& x, __m128& y, __m128& z, const __m128* M, matrix4D_transform_type type)
+{
+ // M holds each element of A in all four lanes
+ __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(M[0x0], x), _mm_mul_ps(M[0x1], y)), _mm_mul_ps(M[0x2], z));
+ __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(M[0x4], x), _mm_mul_ps(M[0x5], y)), _mm_mul_ps(M[0x6], z));
+ __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(M[0x8], x), _mm_mul_ps(M[0x9], y)), _mm_mul_ps(M[0xA], z));
+ if(type != MATRIX4D_TRANSFORM_NORMALS) {
+    rx = _mm_add_ps(rx, M[0x3]);
+    ry = _mm_add_ps(ry, M[0x7]);
+    rz = _mm_add_ps(rz, M[0xB]);
+   }
+ if(type == MATRIX4D_TRANSFORM_PROJECTIVE) {
+    __m128 w = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(M[0xC], x), _mm_mul_ps(M[0xD], y)), _mm_mul_ps(M[0xE], z)), M[0xF]);
+    rx = _mm_div_ps(rx, w);
+    ry = _mm_div_ps(ry, w);
+    rz = _mm_div_ps(rz, w);
+   }
+ x = rx;
+ y = ry;
+ z = rz;
+}
+
+static void matrix4D_transform_aos_sse2(real32* X, const real32* A, const real32* P, uint32 n, matrix4D_transform_type type)
+{
+ __m128 M[16];
+ for(int j = 0; j < 16; j++) M[j] = _mm_set1_ps(A[j]);
+
+ // four points (12 floats) at a time, all loaded before any are stored
+ uint32 i = 0;
+ for(; i + 3 < n; i += 4) {
+     __m128 a = _mm_loadu_ps(P + 3*i + 0);
+     __m128 b = _mm_loadu_ps(P + 3*i + 4);
+     __m128 c = _mm_loadu_ps(P + 3*i + 8);
+     __m128 x, y, z;
+     MATRIX4D_AOS_TO_SOA(_mm_shuffle_ps, a, b, c, x, y, z);
+     matrix4D_transform4_sse2(x, y, z, M, type);
+     MATRIX4D_SOA_TO_AOS(_mm_shuffle_ps, x, y, z, a, b, c);
+     _mm_storeu_ps(X + 3*i + 0, a);
+     _mm_storeu_ps(X + 3*i + 4, b);
+     _mm_storeu_ps(X + 3*i + 8, c);
+    }
+
+ // last points
+ matrix4D_transform_aos_scalar(X + 3*i, A, P + 3*i, n - i, type);
+}
+
+static void matrix4D_transform_soa_sse2(real32* const* X, const real32* A, const real32* const* P, uint32 n, matrix4D_transform_type type)
+{
+ __m128 M[16];
+ for(int j = 0; j < 16; j++) M[j] = _mm_set1_ps(A[j]);
+
+ // four points at a time
+ uint32 i = 0;
+ for(; i + 3 < n; i += 4) {
+     __m128 x = _mm_loadu_ps(P[0] + i);
+     __m128 y = _mm_loadu_ps(P[1] + i);
+     __m128 z = _mm_loadu_ps(P[2] + i);
+     matrix4D_transform4_sse2(x, y, z, M, type);
+     _mm_storeu_ps(X[0] + i, x);
+     _mm_storeu_ps(X[1] + i, y);
+     _mm_storeu_ps(X[2] + i, z);
+    }
+
+ // last points
+ real32* const x[3] = { X[0] + i, X[1] + i, X[2] + i };
+ const real32* const p[3] = { P[0] + i, P[1] + i, P[2] + i };
+ matrix4D_transform_soa_scalar(x, A, p, n - i, type);
+}
+
+#pragma endregion SSE2_KERNELS
+
+#pragma region AVX_KERNELS
+
+// AVX kernels work on two rows (or two vectors) at a time, each in its own 128-bit lane, or on
+// eight points at a time, and give the same results as the SSE2 kernels; the FMA kernels fuse
+// each multiply with its add, so their results can differ from the others in the last bit or so
+
+MATRIX4D_TARGET("avx") static void matrix4D_mul_avx(real32* X, const real32* A, const real32* B)
+{
+ __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&B[0x0]));
+ __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&B[0x4]));
+ __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&B[0x8]));
+ __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&B[0xC]));
+ __m256 a01 = _mm256_loadu_ps(&A[0x0]);
+ __m256 a23 = _mm256_loadu_ps(&A[0x8]);
+ __m256 x01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+ __m256 x23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+ x01 = _mm256_add_ps(x01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1));
+ x23 = _mm256_add_ps(x23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1));
+ x01 = _mm256_add_ps(x01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xAA), b2));
+ x23 = _mm256_add_ps(x23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xAA), b2));
+ x01 = _mm256_add_ps(x01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xFF), b3));
+ x23 = _mm256_add_ps(x23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xFF), b3));
+ _mm256_storeu_ps(&X[0x0], x01);
+ _mm256_storeu_ps(&X[0x8], x23);
+}
+
+MATRIX4D_TARGET("avx") static void matrix4D_vector4_mul_avx(real32* X, const real32* A, const real32* B, uint32 n)
+{
+ // columns of A in both lanes
+ __m128 c[4] = { _mm_loadu_ps(&A[0x0]), _mm_loadu_ps(&A[0x4]), _mm_loadu_ps(&A[0x8]), _mm_loadu_ps(&A[0xC]) };
+ _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+ __m256 C[4];
+ for(int j = 0; j < 4; j++) C[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(c[j]), c[j], 1);
+
+ // two vectors at a time
+ uint32 i = 0;
+ for(; i + 1 < n; i += 2) {
+     __m256 b = _mm256_loadu_ps(B + 4*i);
+     __m256 r = _mm256_mul_ps(C[0], _mm256_shuffle_ps(b, b, 0x00));
+     r = _mm256_add_ps(r, _mm256_mul_ps(C[1], _mm256_shuffle_ps(b, b, 0x55)));
+     r = _mm256_add_ps(r, _mm256_mul_ps(C[2], _mm256_shuffle_ps(b, b, 0xAA)));
+     r = _mm256_add_ps(r, _mm256_mul_ps(C[3], _mm256_shuffle_ps(b, b, 0xFF)));
+     _mm256_storeu_ps(X + 4*i, r);
+    }
+
+ // last vector
+ if(i < n) {
+    __m128 b = _mm_loadu_ps(B + 4*i);
+    __m128 r = _mm_mul_ps(c[0], _mm_shuffle_ps(b, b, 0x00));
+    r = _mm_add_ps(r, _mm_mul_ps(c[1], _mm_shuffle_ps(b, b, 0x55)));
+    r = _mm_add_ps(r, _mm_mul_ps(c[2], _mm_shuffle_ps(b, b, 0xAA)));
+    r = _mm_add_ps(r, _mm_mul_ps(c[3], _mm_shuffle_ps(b, b, 0xFF)));
+    _mm_storeu_ps(X + 4*i, r);
+   }
+}
+
+MATRIX4D_TARGET("avx,fma") static void matrix4D_vector4_mul_fma(real32* X, const real32* A, const real32* B, uint32 n)
+{
+ // columns of A in both lanes
+ __m128 c[4] = { _mm_loadu_ps(&A[0x0]), _mm_loadu_ps(&A[0x4]), _mm_loadu_ps(&A[0x8]), _mm_loadu_ps(&A[0xC]) };
+ _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+ __m256 C[4];
+ for(int j = 0; j < 4; j++) C[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(c[j]), c[j], 1);
+
+ // two vectors at a time
+ uint32 i = 0;
+ for(; i + 1 < n; i += 2) {
+     __m256 b = _mm256_loadu_ps(B + 4*i);
+     __m256 r = _mm256_mul_ps(C[0], _mm256_shuffle_ps(b, b, 0x00));
+     r = _mm256_fmadd_ps(C[1], _mm256_shuffle_ps(b, b, 0x55), r);
+     r = _mm256_fmadd_ps(C[2], _mm256_shuffle_ps(b, b, 0xAA), r);
+     r = _mm256_fmadd_ps(C[3], _mm256_shuffle_ps(b, b, 0xFF), r);
+     _mm256_storeu_ps(X + 4*i, r);
+    }
+
+ // last vector
+ if(i < n) {
+    __m128 b = _mm_loadu_ps(B + 4*i);
+    __m128 r = _mm_mul_ps(c[0], _mm_shuffle_ps(b, b, 0x00));
+    r = _mm_fmadd_ps(c[1], _mm_shuffle_ps(b, b, 0x55), r);
+    r = _mm_fmadd_ps(c[2], _mm_shuffle_ps(b, b, 0xAA), r);
+    r = _mm_fmadd_ps(c[3], _mm_shuffle_ps(b, b, 0xFF), r);
+    _mm_storeu_ps(X + 4*i, r);
+   }
+}
+
+MATRIX4D_TARGET("avx") static inline __m256 matrix4D_load8_avx(const real32* lo, const real32* hi)
+{
+ return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1);
+}
+
+MATRIX4D_TARGET("avx") static inline void matrix4D_store8_avx(real32* lo, real32* hi, __m256 v)
+{
+ _mm_storeu_ps(lo, _mm256_castps256_ps128(v));
+ _mm_storeu_ps(hi, _mm256_extractf128_ps(v, 1));
+}
+
+MATRIX4D_TARGET("avx") static inline void matrix4D_transform8_avx(__m256& x, __m256& y, __m256& z, const __m256* M, matrix4D_transform_type type)
+{
+ __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(M[0x0], x), _mm256_mul_ps(M[0x1], y)), _mm256_mul_ps(M[0x2], z));
+ __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(M[0x4], x), _mm256_mul_ps(M[0x5], y)), _mm256_mul_ps(M[0x6], z));
+ __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(M[0x8], x), _mm256_mul_ps(M[0x9], y)), _mm256_mul_ps(M[0xA], z));
+ if(type != MATRIX4D_TRANSFORM_NORMALS) {
+    rx = _mm256_add_ps(rx, M[0x3]);
+    ry = _mm256_add_ps(ry, M[0x7]);
+    rz = _mm256_add_ps(rz, M[0xB]);
+   }
+ if(type == MATRIX4D_TRANSFORM_PROJECTIVE) {
+    __m256 w = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(M[0xC], x), _mm256_mul_ps(M[0xD], y)), _mm256_mul_ps(M[0xE], z)), M[0xF]);
+    rx = _mm256_div_ps(rx, w);
+    ry = _mm256_div_ps(ry, w);
+    rz = _mm256_div_ps(rz, w);
+   }
+ x = rx;
+ y = ry;
+ z = rz;
+}
+
+MATRIX4D_TARGET("avx,fma") static inline void matrix4D_transform8_fma(__m256& x, __m256& y, __m256& z, const __m256* M, matrix4D_transform_type type)
+{
+ __m256 rx = _mm256_fmadd_ps(M[0x2], z, _mm256_fmadd_ps(M[0x1], y, _mm256_mul_ps(M[0x0], x)));
+ __m256 ry = _mm256_fmadd_ps(M[0x6], z, _mm256_fmadd_ps(M[0x5], y, _mm256_mul_ps(M[0x4], x)));
+ __m256 rz = _mm256_fmadd_ps(M[0xA], z, _mm256_fmadd_ps(M[0x9], y, _mm256_mul_ps(M[0x8], x)));
+ if(type != MATRIX4D_TRANSFORM_NORMALS) {
+    rx = _mm256_add_ps(rx, M[0x3]);
+    ry = _mm256_add_ps(ry, M[0x7]);
+    rz = _mm256_add_ps(rz, M[0xB]);
+   }
+ if(type == MATRIX4D_TRANSFORM_PROJECTIVE) {
+    __m256 w = _mm256_add_ps(_mm256_fmadd_ps(M[0xE], z, _mm256_fmadd_ps(M[0xD], y, _mm256_mul_ps(M[0xC], x))), M[0xF]);
+    rx = _mm256_div_ps(rx, w);
+    ry = _mm256_div_ps(ry, w);
+    rz = _mm256_div_ps(rz, w);
+   }
+ x = rx;
+ y = ry;
+ z = rz;
+}
+
+// eight points at a time (points 0-3 in the low lanes and points 4-7 in the high lanes), with
+// the remaining points done by the SSE2 kernels
+#define MATRIX4D_TRANSFORM_AOS_AVX(transform8) { \
+ __m256 M[16]; \
+ for(int j = 0; j < 16; j++) M[j] = _mm256_set1_ps(A[j]); \
+ uint32 i = 0; \
+ for(; i + 7 < n; i += 8) { \
+     const real32* p = P + 3*i; \
+     real32* q = X + 3*i; \
+     __m256 a = matrix4D_load8_avx(p + 0, p + 12); \
+     __m256 b = matrix4D_load8_avx(p + 4, p + 16); \
+     __m256 c = matrix4D_load8_avx(p + 8, p + 20); \
+     __m256 x, y, z; \
+     MATRIX4D_AOS_TO_SOA(_mm256_shuffle_ps, a, b, c, x, y, z); \
+     transform8(x, y, z, M, type); \
+     MATRIX4D_SOA_TO_AOS(_mm256_shuffle_ps, x, y, z, a, b, c); \
+     matrix4D_store8_avx(q + 0, q + 12, a); \
+     matrix4D_store8_avx(q + 4, q + 16, b); \
+     matrix4D_store8_avx(q + 8, q + 20, c); \
+    } \
+ matrix4D_transform_aos_sse2(X + 3*i, A, P + 3*i, n - i, type); \
+}
+#define MATRIX4D_TRANSFORM_SOA_AVX(transform8) { \
+ __m256 M[16]; \
+ for(int j = 0; j < 16; j++) M[j] = _mm256_set1_ps(A[j]); \
+ uint32 i = 0; \
+ for(; i + 7 < n; i += 8) { \
+     __m256 x = _mm256_loadu_ps(P[0] + i); \
+     __m256 y = _mm256_loadu_ps(P[1] + i); \
+     __m256 z = _mm256_loadu_ps(P[2] + i); \
+     transform8(x, y, z, M, type); \
+     _mm256_storeu_ps(X[0] + i, x); \
+     _mm256_storeu_ps(X[1] + i, y); \
+     _mm256_storeu_ps(X[2] + i, z); \
+    } \
+ real32* const x[3] = { X[0] + i, X[1] + i, X[2] + i }; \
+ const real32* const p[3] = { P[0] + i, P[1] + i, P[2] + i }; \
+ matrix4D_transform_soa_sse2(x, A, p, n - i, type); \
+}
+
+MATRIX4D_TARGET("avx") static void matrix4D_transform_aos_avx(real32* X, const real32* A, const real32* P, uint32 n, matrix4D_transform_type type)
+{
+ MATRIX4D_TRANSFORM_AOS_AVX(matrix4D_transform8_avx);
+}
+
+MATRIX4D_TARGET("avx") static void matrix4D_transform_soa_avx(real32* const* X, const real32* A, const real32* const* P, uint32 n, matrix4D_transform_type type)
+{
+ MATRIX4D_TRANSFORM_SOA_AVX(matrix4D_transform8_avx);
+}
+
+MATRIX4D_TARGET("avx,fma") static void matrix4D_transform_aos_fma(real32* X, const real32* A, const real32* P, uint32 n, matrix4D_transform_type type)
+{
+ MATRIX4D_TRANSFORM_AOS_AVX(matrix4D_transform8_fma);
+}
+
+MATRIX4D_TARGET("avx,fma") static void matrix4D_transform_soa_fma(real32* const* X, const real32* A, const real32* const* P, uint32 n, matrix4D_transform_type type)
+{
+ MATRIX4D_TRANSFORM_SOA_AVX(matrix4D_transform8_fma);
+}
+
+#pragma endregion AVX_KERNELS
+
+#pragma region KERNEL_SELECTION
+
+// kernel sets by instruction set (a single inverse gains nothing from 256-bit registers, so all
+// SIMD sets share the SSE2 inverse, and fusing the short dependency chains of a multiply was no
+// faster than AVX in the matrix benchmark, so products stay the same on every CPU)
+static const matrix4D_kernel_table kernel_sets[4] = {
+ { matrix4D_mul_scalar, matrix4D_inverse_scalar, matrix4D_vector4_mul_scalar, matrix4D_transform_aos_scalar, matrix4D_transform_soa_scalar },
+ { matrix4D_mul_sse2, matrix4D_inverse_sse2, matrix4D_vector4_mul_sse2, matrix4D_transform_aos_sse2, matrix4D_transform_soa_sse2 },
+ { matrix4D_mul_avx, matrix4D_inverse_sse2, matrix4D_vector4_mul_avx, matrix4D_transform_aos_avx, matrix4D_transform_soa_avx },
+ { matrix4D_mul_avx, matrix4D_inverse_sse2, matrix4D_vector4_mul_fma, matrix4D_transform_aos_fma, matrix4D_transform_soa_fma },
+};
+
+// SSE2 until the CPU has been checked (so kernels work even in static initializers)
+matrix4D_kernel_table matrix4D_kernels = {
+ matrix4D_mul_sse2, matrix4D_inverse_sse2, matrix4D_vector4_mul_sse2, matrix4D_transform_aos_sse2, matrix4D_transform_soa_sse2
+};
+static matrix4D_simd_type kernel_type = MATRIX4D_SSE2;
+
+matrix4D_simd_type matrix4D_simd_support(void)
+{
+ // CPUID leaf 1 (ECX bit 12 = FMA, bit 27 = OSXSAVE, bit 28 = AVX)
+ uint32 info[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+ int regs[4];
+ __cpuid(regs, 1);
+ for(int i = 0; i < 4; i++) info[i] = static_cast<uint32>(regs[i]);
+#else
+ if(!__get_cpuid(1, &info[0], &info[1], &info[2], &info[3])) return MATRIX4D_SSE2;
+#endif
+ bool osxsave = ((info[2] & (1ul << 27)) != 0);
+ bool avx = ((info[2] & (1ul << 28)) != 0);
+ bool fma = ((info[2] & (1ul << 12)) != 0);
+ if(!osxsave || !avx) return MATRIX4D_SSE2;
+
+ // operating system must save YMM registers (XCR0 bits 1 and 2)
+#ifdef _MSC_VER
+ uint64 xcr0 = _xgetbv(0);
+#else
+ uint32 lo, hi;
+ __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+ uint64 xcr0 = (static_cast<uint64>(hi) << 32) | lo;
+#endif
+ if((xcr0 & 0x6) != 0x6) return MATRIX4D_SSE2;
+ return (fma ? MATRIX4D_FMA : MATRIX4D_AVX);
+}
+
+matrix4D_simd_type matrix4D_simd_level(void)
+{
+ return kernel_type;
+}
+
+bool matrix4D_select_simd(matrix4D_simd_type type)
+{
+ if(type < MATRIX4D_SCALAR || type > matrix4D_simd_support()) return false;
+ matrix4D_kernels = kernel_sets[type];
+ kernel_type = type;
+ return true;
+}
+
+// select best kernels at startup
+static const bool kernels_selected = matrix4D_select_simd(matrix4D_simd_support());
+
+#pragma endregion KERNEL_SELECTION
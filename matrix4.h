@@ -6,6 +6,40 @@
 
 class matrix4D;
 
+#pragma region MATRIX4D_KERNELS
+
+// instruction sets for multiply, inverse, and transform kernels (the best one the CPU supports is
+// selected at startup, and SSE2 is always available on the platforms we build for)
+enum matrix4D_simd_type {
+ MATRIX4D_SCALAR = 0,
+ MATRIX4D_SSE2 = 1,
+ MATRIX4D_AVX = 2,
+ MATRIX4D_FMA = 3,
+};
+
+// how batch transforms treat each point (see matrix4D_transform_aos and matrix4D_transform_soa)
+enum matrix4D_transform_type {
+ MATRIX4D_TRANSFORM_AFFINE = 0,     // points with translation (bottom row of A assumed to be 0, 0, 0, 1)
+ MATRIX4D_TRANSFORM_PROJECTIVE = 1, // points with translation divided by w
+ MATRIX4D_TRANSFORM_NORMALS = 2,    // normals and directions (upper 3x3 of A only)
+};
+
+// kernels are safe to call with X equal to A or B
+struct matrix4D_kernel_table {
+ void (*mul)(real32* X, const real32* A, const real32* B);              // X = A*B
+ real32 (*inverse)(real32* X, const real32* A);                         // X = inv(A) (if det != 0), returns det
+ void (*vector4_mul)(real32* X, const real32* A, const real32* B, uint32 n); // X[i] = A*B[i] for n 4D vectors
+ void (*transform_aos)(real32* X, const real32* A, const real32* P, uint32 n, matrix4D_transform_type type); // n packed x, y, z
+ void (*transform_soa)(real32* const* X, const real32* A, const real32* const* P, uint32 n, matrix4D_transform_type type); // x, y, z arrays
+};
+extern matrix4D_kernel_table matrix4D_kernels;
+
+matrix4D_simd_type matrix4D_simd_support(void);
+matrix4D_simd_type matrix4D_simd_level(void);
+bool matrix4D_select_simd(matrix4D_simd_type type);
+
+#pragma endregion MATRIX4D_KERNELS
+
 #pragma region MATRIX4D_CLASS_DEFINITIONS
 
 typedef struct _c_smatrix4D { real32 m[16]; } c_smatrix4D;
@@ -161,66 +195,11 @@ inline real32 matrix4D::determinant(void)const
 
 inline real32 matrix4D::invert(void)
 {
- // cache 2x2 determinants
- real32 D[12] = {
-  sarrus_2x2(this->m[m33], this->m[m34], this->m[m43], this->m[m44]),
-  sarrus_2x2(this->m[m32], this->m[m34], this->m[m42], this->m[m44]),
-  sarrus_2x2(this->m[m32], this->m[m33], this->m[m42], this->m[m43]),
-  sarrus_2x2(this->m[m31], this->m[m34], this->m[m41], this->m[m44]),
-  sarrus_2x2(this->m[m31], this->m[m33], this->m[m41], this->m[m43]),
-  sarrus_2x2(this->m[m31], this->m[m32], this->m[m41], this->m[m42]),
-  sarrus_2x2(this->m[m13], this->m[m14], this->m[m23], this->m[m24]),
-  sarrus_2x2(this->m[m12], this->m[m14], this->m[m22], this->m[m24]),
-  sarrus_2x2(this->m[m12], this->m[m13], this->m[m22], this->m[m23]),
-  sarrus_2x2(this->m[m11], this->m[m14], this->m[m21], this->m[m24]),
-  sarrus_2x2(this->m[m11], this->m[m13], this->m[m21], this->m[m23]),
-  sarrus_2x2(this->m[m11], this->m[m12], this->m[m21], this->m[m22])
- };
-
- // compute determinant
- real32 det = D[0x5]*D[0x6] - D[0x4]*D[0x7] + D[0x3]*D[0x8] + D[0x2]*D[0x9] - D[0x1]*D[0xA] + D[0x0]*D[0xB];
+ // inverse is only kept if the determinant is not zero
+ real32 X[16];
+ real32 det = matrix4D_kernels.inverse(X, this->m);
  if(is_zero(det)) return det;
-
- // compute cofactor matrix
- real32 C[16] = {
-  +(this->m[m22]*D[0x0] - this->m[m23]*D[0x1] + this->m[m24]*D[0x2]),
-  -(this->m[m21]*D[0x0] - this->m[m23]*D[0x3] + this->m[m24]*D[0x4]),
-  +(this->m[m21]*D[0x1] - this->m[m22]*D[0x3] + this->m[m24]*D[0x5]),
-  -(this->m[m21]*D[0x2] - this->m[m22]*D[0x4] + this->m[m23]*D[0x5]),
-  -(this->m[m12]*D[0x0] - this->m[m13]*D[0x1] + this->m[m14]*D[0x2]),
-  +(this->m[m11]*D[0x0] - this->m[m13]*D[0x3] + this->m[m14]*D[0x4]),
-  -(this->m[m11]*D[0x1] - this->m[m12]*D[0x3] + this->m[m14]*D[0x5]),
-  +(this->m[m11]*D[0x2] - this->m[m12]*D[0x4] + this->m[m13]*D[0x5]),
-  +(this->m[m42]*D[0x6] - this->m[m43]*D[0x7] + this->m[m44]*D[0x8]),
-  -(this->m[m41]*D[0x6] - this->m[m43]*D[0x9] + this->m[m44]*D[0xA]),
-  +(this->m[m41]*D[0x7] - this->m[m42]*D[0x9] + this->m[m44]*D[0xB]),
-  -(this->m[m41]*D[0x8] - this->m[m42]*D[0xA] + this->m[m43]*D[0xB]),
-  -(this->m[m32]*D[0x6] - this->m[m33]*D[0x7] + this->m[m34]*D[0x8]),
-  +(this->m[m31]*D[0x6] - this->m[m33]*D[0x9] + this->m[m34]*D[0xA]),
-  -(this->m[m31]*D[0x7] - this->m[m32]*D[0x9] + this->m[m34]*D[0xB]),
-  +(this->m[m31]*D[0x8] - this->m[m32]*D[0xA] + this->m[m33]*D[0xB]) 
- };
-
- // compute inverse matrix inv(M) = inv(det(M)) * transpose(C)
- real32 invdet = inv(det);
- this->m[m11] = C[m11]*invdet;
- this->m[m21] = C[m12]*invdet;
- this->m[m31] = C[m13]*invdet;
- this->m[m41] = C[m14]*invdet;
- this->m[m12] = C[m21]*invdet;
- this->m[m22] = C[m22]*invdet;
- this->m[m32] = C[m23]*invdet;
- this->m[m42] = C[m24]*invdet;
- this->m[m13] = C[m31]*invdet;
- this->m[m23] = C[m32]*invdet;
- this->m[m33] = C[m33]*invdet;
- this->m[m43] = C[m34]*invdet;
- this->m[m14] = C[m41]*invdet;
- this->m[m24] = C[m42]*invdet;
- this->m[m34] = C[m43]*invdet;
- this->m[m44] = C[m44]*invdet;
-
- // return determinant
+ load(X);
  return det;
 }
 
@@ -366,41 +345,7 @@ inline void matrix4D::load_quaternion(const real32* q)
 inline matrix4D& matrix4D::premul(const matrix4D& A)
 {
  // computes (*this) = A x (*this)
- real32 X[16] = {
-  A[0x0]*this->m[0x0] + A[0x1]*this->m[0x4] + A[0x2]*this->m[0x8] + A[0x3]*this->m[0xC],
-  A[0x0]*this->m[0x1] + A[0x1]*this->m[0x5] + A[0x2]*this->m[0x9] + A[0x3]*this->m[0xD],
-  A[0x0]*this->m[0x2] + A[0x1]*this->m[0x6] + A[0x2]*this->m[0xA] + A[0x3]*this->m[0xE],
-  A[0x0]*this->m[0x3] + A[0x1]*this->m[0x7] + A[0x2]*this->m[0xB] + A[0x3]*this->m[0xF],
-  A[0x4]*this->m[0x0] + A[0x5]*this->m[0x4] + A[0x6]*this->m[0x8] + A[0x7]*this->m[0xC],
-  A[0x4]*this->m[0x1] + A[0x5]*this->m[0x5] + A[0x6]*this->m[0x9] + A[0x7]*this->m[0xD],
-  A[0x4]*this->m[0x2] + A[0x5]*this->m[0x6] + A[0x6]*this->m[0xA] + A[0x7]*this->m[0xE],
-  A[0x4]*this->m[0x3] + A[0x5]*this->m[0x7] + A[0x6]*this->m[0xB] + A[0x7]*this->m[0xF],
-  A[0x8]*this->m[0x0] + A[0x9]*this->m[0x4] + A[0xA]*this->m[0x8] + A[0xB]*this->m[0xC],
-  A[0x8]*this->m[0x1] + A[0x9]*this->m[0x5] + A[0xA]*this->m[0x9] + A[0xB]*this->m[0xD],
-  A[0x8]*this->m[0x2] + A[0x9]*this->m[0x6] + A[0xA]*this->m[0xA] + A[0xB]*this->m[0xE],
-  A[0x8]*this->m[0x3] + A[0x9]*this->m[0x7] + A[0xA]*this->m[0xB] + A[0xB]*this->m[0xF],
-  A[0xC]*this->m[0x0] + A[0xD]*this->m[0x4] + A[0xE]*this->m[0x8] + A[0xF]*this->m[0xC],
-  A[0xC]*this->m[0x1] + A[0xD]*this->m[0x5] + A[0xE]*this->m[0x9] + A[0xF]*this->m[0xD],
-  A[0xC]*this->m[0x2] + A[0xD]*this->m[0x6] + A[0xE]*this->m[0xA] + A[0xF]*this->m[0xE],
-  A[0xC]*this->m[0x3] + A[0xD]*this->m[0x7] + A[0xE]*this->m[0xB] + A[0xF]*this->m[0xF]
- };
- this->m[0x0] = X[0x0];
- this->m[0x1] = X[0x1];
- this->m[0x2] = X[0x2];
- this->m[0x3] = X[0x3];
- this->m[0x4] = X[0x4];
- this->m[0x5] = X[0x5];
- this->m[0x6] = X[0x6];
- this->m[0x7] = X[0x7];
- this->m[0x8] = X[0x8];
- this->m[0x9] = X[0x9];
- this->m[0xA] = X[0xA];
- this->m[0xB] = X[0xB];
- this->m[0xC] = X[0xC];
- this->m[0xD] = X[0xD];
- this->m[0xE] = X[0xE];
- this->m[0xF] = X[0xF];
-
+ matrix4D_kernels.mul(this->m, A.m, this->m);
  return *this;
 }
 
@@ -538,40 +483,7 @@ inline matrix4D& matrix4D::operator -=(const matrix4D& other)
 
 inline matrix4D& matrix4D::operator *=(const matrix4D& other)
 {
- real32 temp[16] = {
-  this->m[ 0]*other.m[ 0] + this->m[ 1]*other.m[ 4] + this->m[ 2]*other.m[ 8] + this->m[ 3]*other.m[12],
-  this->m[ 0]*other.m[ 1] + this->m[ 1]*other.m[ 5] + this->m[ 2]*other.m[ 9] + this->m[ 3]*other.m[13],
-  this->m[ 0]*other.m[ 2] + this->m[ 1]*other.m[ 6] + this->m[ 2]*other.m[10] + this->m[ 3]*other.m[14],
-  this->m[ 0]*other.m[ 3] + this->m[ 1]*other.m[ 7] + this->m[ 2]*other.m[11] + this->m[ 3]*other.m[15],
-  this->m[ 4]*other.m[ 0] + this->m[ 5]*other.m[ 4] + this->m[ 6]*other.m[ 8] + this->m[ 7]*other.m[12],
-  this->m[ 4]*other.m[ 1] + this->m[ 5]*other.m[ 5] + this->m[ 6]*other.m[ 9] + this->m[ 7]*other.m[13],
-  this->m[ 4]*other.m[ 2] + this->m[ 5]*other.m[ 6] + this->m[ 6]*other.m[10] + this->m[ 7]*other.m[14],
-  this->m[ 4]*other.m[ 3] + this->m[ 5]*other.m[ 7] + this->m[ 6]*other.m[11] + this->m[ 7]*other.m[15],
-  this->m[ 8]*other.m[ 0] + this->m[ 9]*other.m[ 4] + this->m[10]*other.m[ 8] + this->m[11]*other.m[12],
-  this->m[ 8]*other.m[ 1] + this->m[ 9]*other.m[ 5] + this->m[10]*other.m[ 9] + this->m[11]*other.m[13],
-  this->m[ 8]*other.m[ 2] + this->m[ 9]*other.m[ 6] + this->m[10]*other.m[10] + this->m[11]*other.m[14],
-  this->m[ 8]*other.m[ 3] + this->m[ 9]*other.m[ 7] + this->m[10]*other.m[11] + this->m[11]*other.m[15],
-  this->m[12]*other.m[ 0] + this->m[13]*other.m[ 4] + this->m[14]*other.m[ 8] + this->m[15]*other.m[12],
-  this->m[12]*other.m[ 1] + this->m[13]*other.m[ 5] + this->m[14]*other.m[ 9] + this->m[15]*other.m[13],
-  this->m[12]*other.m[ 2] + this->m[13]*other.m[ 6] + this->m[14]*other.m[10] + this->m[15]*other.m[14],
-  this->m[12]*other.m[ 3] + this->m[13]*other.m[ 7] + this->m[14]*other.m[11] + this->m[15]*other.m[15]
- };
- this->m[ 0] = temp[ 0];
- this->m[ 1] = temp[ 1];
- this->m[ 2] = temp[ 2];
- this->m[ 3] = temp[ 3];
- this->m[ 4] = temp[ 4];
- this->m[ 5] = temp[ 5];
- this->m[ 6] = temp[ 6];
- this->m[ 7] = temp[ 7];
- this->m[ 8] = temp[ 8];
- this->m[ 9] = temp[ 9];
- this->m[10] = temp[10];
- this->m[11] = temp[11];
- this->m[12] = temp[12];
- this->m[13] = temp[13];
- this->m[14] = temp[14];
- this->m[15] = temp[15];
+ matrix4D_kernels.mul(this->m, this->m, other.m);
  return *this;
 }
 
@@ -625,41 +537,8 @@ inline matrix4D operator -(const matrix4D& lhs, const matrix4D& rhs)
 
 inline matrix4D operator *(const matrix4D& lhs, const matrix4D& rhs)
 {
- real32 T[16] = {
-  lhs[0x0]*rhs[0x0] + lhs[0x1]*rhs[0x4] + lhs[0x2]*rhs[0x8] + lhs[0x3]*rhs[0xC],
-  lhs[0x0]*rhs[0x1] + lhs[0x1]*rhs[0x5] + lhs[0x2]*rhs[0x9] + lhs[0x3]*rhs[0xD],
-  lhs[0x0]*rhs[0x2] + lhs[0x1]*rhs[0x6] + lhs[0x2]*rhs[0xA] + lhs[0x3]*rhs[0xE],
-  lhs[0x0]*rhs[0x3] + lhs[0x1]*rhs[0x7] + lhs[0x2]*rhs[0xB] + lhs[0x3]*rhs[0xF],
-  lhs[0x4]*rhs[0x0] + lhs[0x5]*rhs[0x4] + lhs[0x6]*rhs[0x8] + lhs[0x7]*rhs[0xC],
-  lhs[0x4]*rhs[0x1] + lhs[0x5]*rhs[0x5] + lhs[0x6]*rhs[0x9] + lhs[0x7]*rhs[0xD],
-  lhs[0x4]*rhs[0x2] + lhs[0x5]*rhs[0x6] + lhs[0x6]*rhs[0xA] + lhs[0x7]*rhs[0xE],
-  lhs[0x4]*rhs[0x3] + lhs[0x5]*rhs[0x7] + lhs[0x6]*rhs[0xB] + lhs[0x7]*rhs[0xF],
-  lhs[0x8]*rhs[0x0] + lhs[0x9]*rhs[0x4] + lhs[0xA]*rhs[0x8] + lhs[0xB]*rhs[0xC],
-  lhs[0x8]*rhs[0x1] + lhs[0x9]*rhs[0x5] + lhs[0xA]*rhs[0x9] + lhs[0xB]*rhs[0xD],
-  lhs[0x8]*rhs[0x2] + lhs[0x9]*rhs[0x6] + lhs[0xA]*rhs[0xA] + lhs[0xB]*rhs[0xE],
-  lhs[0x8]*rhs[0x3] + lhs[0x9]*rhs[0x7] + lhs[0xA]*rhs[0xB] + lhs[0xB]*rhs[0xF],
-  lhs[0xC]*rhs[0x0] + lhs[0xD]*rhs[0x4] + lhs[0xE]*rhs[0x8] + lhs[0xF]*rhs[0xC],
-  lhs[0xC]*rhs[0x1] + lhs[0xD]*rhs[0x5] + lhs[0xE]*rhs[0x9] + lhs[0xF]*rhs[0xD],
-  lhs[0xC]*rhs[0x2] + lhs[0xD]*rhs[0x6] + lhs[0xE]*rhs[0xA] + lhs[0xF]*rhs[0xE],
-  lhs[0xC]*rhs[0x3] + lhs[0xD]*rhs[0x7] + lhs[0xE]*rhs[0xB] + lhs[0xF]*rhs[0xF]
- };
  matrix4D r;
- r.m[0x0] = T[0x0];
- r.m[0x1] = T[0x1];
- r.m[0x2] = T[0x2];
- r.m[0x3] = T[0x3];
- r.m[0x4] = T[0x4];
- r.m[0x5] = T[0x5];
- r.m[0x6] = T[0x6];
- r.m[0x7] = T[0x7];
- r.m[0x8] = T[0x8];
- r.m[0x9] = T[0x9];
- r.m[0xA] = T[0xA];
- r.m[0xB] = T[0xB];
- r.m[0xC] = T[0xC];
- r.m[0xD] = T[0xD];
- r.m[0xE] = T[0xE];
- r.m[0xF] = T[0xF];
+ matrix4D_kernels.mul(r.m, lhs.m, rhs.m);
  return r;
 }
 
@@ -841,79 +720,13 @@ inline void matrix4D_sub(real32* A, const real32* B)
 inline void matrix4D_mul(real32* X, const real32* A, const real32* B)
 {
  // safe to call mul(X, A, X);
- float T[16] = {
-  A[0x0]*B[0x0] + A[0x1]*B[0x4] + A[0x2]*B[0x8] + A[0x3]*B[0xC],
-  A[0x0]*B[0x1] + A[0x1]*B[0x5] + A[0x2]*B[0x9] + A[0x3]*B[0xD],
-  A[0x0]*B[0x2] + A[0x1]*B[0x6] + A[0x2]*B[0xA] + A[0x3]*B[0xE],
-  A[0x0]*B[0x3] + A[0x1]*B[0x7] + A[0x2]*B[0xB] + A[0x3]*B[0xF],
-  A[0x4]*B[0x0] + A[0x5]*B[0x4] + A[0x6]*B[0x8] + A[0x7]*B[0xC],
-  A[0x4]*B[0x1] + A[0x5]*B[0x5] + A[0x6]*B[0x9] + A[0x7]*B[0xD],
-  A[0x4]*B[0x2] + A[0x5]*B[0x6] + A[0x6]*B[0xA] + A[0x7]*B[0xE],
-  A[0x4]*B[0x3] + A[0x5]*B[0x7] + A[0x6]*B[0xB] + A[0x7]*B[0xF],
-  A[0x8]*B[0x0] + A[0x9]*B[0x4] + A[0xA]*B[0x8] + A[0xB]*B[0xC],
-  A[0x8]*B[0x1] + A[0x9]*B[0x5] + A[0xA]*B[0x9] + A[0xB]*B[0xD],
-  A[0x8]*B[0x2] + A[0x9]*B[0x6] + A[0xA]*B[0xA] + A[0xB]*B[0xE],
-  A[0x8]*B[0x3] + A[0x9]*B[0x7] + A[0xA]*B[0xB] + A[0xB]*B[0xF],
-  A[0xC]*B[0x0] + A[0xD]*B[0x4] + A[0xE]*B[0x8] + A[0xF]*B[0xC],
-  A[0xC]*B[0x1] + A[0xD]*B[0x5] + A[0xE]*B[0x9] + A[0xF]*B[0xD],
-  A[0xC]*B[0x2] + A[0xD]*B[0x6] + A[0xE]*B[0xA] + A[0xF]*B[0xE],
-  A[0xC]*B[0x3] + A[0xD]*B[0x7] + A[0xE]*B[0xB] + A[0xF]*B[0xF],
- };
- X[0x0] = T[0x0];
- X[0x1] = T[0x1];
- X[0x2] = T[0x2];
- X[0x3] = T[0x3];
- X[0x4] = T[0x4];
- X[0x5] = T[0x5];
- X[0x6] = T[0x6];
- X[0x7] = T[0x7];
- X[0x8] = T[0x8];
- X[0x9] = T[0x9];
- X[0xA] = T[0xA];
- X[0xB] = T[0xB];
- X[0xC] = T[0xC];
- X[0xD] = T[0xD];
- X[0xE] = T[0xE];
- X[0xF] = T[0xF];
+ matrix4D_kernels.mul(X, A, B);
 }
 
 inline void matrix4D_mul(real32* A, const real32* B)
 {
  // safe to call mul(X, X);
- real32 X[16] = {
-  A[0x0]*B[0x0] + A[0x1]*B[0x4] + A[0x2]*B[0x8] + A[0x3]*B[0xC],
-  A[0x0]*B[0x1] + A[0x1]*B[0x5] + A[0x2]*B[0x9] + A[0x3]*B[0xD],
-  A[0x0]*B[0x2] + A[0x1]*B[0x6] + A[0x2]*B[0xA] + A[0x3]*B[0xE],
-  A[0x0]*B[0x3] + A[0x1]*B[0x7] + A[0x2]*B[0xB] + A[0x3]*B[0xF],
-  A[0x4]*B[0x0] + A[0x5]*B[0x4] + A[0x6]*B[0x8] + A[0x7]*B[0xC],
-  A[0x4]*B[0x1] + A[0x5]*B[0x5] + A[0x6]*B[0x9] + A[0x7]*B[0xD],
-  A[0x4]*B[0x2] + A[0x5]*B[0x6] + A[0x6]*B[0xA] + A[0x7]*B[0xE],
-  A[0x4]*B[0x3] + A[0x5]*B[0x7] + A[0x6]*B[0xB] + A[0x7]*B[0xF],
-  A[0x8]*B[0x0] + A[0x9]*B[0x4] + A[0xA]*B[0x8] + A[0xB]*B[0xC],
-  A[0x8]*B[0x1] + A[0x9]*B[0x5] + A[0xA]*B[0x9] + A[0xB]*B[0xD],
-  A[0x8]*B[0x2] + A[0x9]*B[0x6] + A[0xA]*B[0xA] + A[0xB]*B[0xE],
-  A[0x8]*B[0x3] + A[0x9]*B[0x7] + A[0xA]*B[0xB] + A[0xB]*B[0xF],
-  A[0xC]*B[0x0] + A[0xD]*B[0x4] + A[0xE]*B[0x8] + A[0xF]*B[0xC],
-  A[0xC]*B[0x1] + A[0xD]*B[0x5] + A[0xE]*B[0x9] + A[0xF]*B[0xD],
-  A[0xC]*B[0x2] + A[0xD]*B[0x6] + A[0xE]*B[0xA] + A[0xF]*B[0xE],
-  A[0xC]*B[0x3] + A[0xD]*B[0x7] + A[0xE]*B[0xB] + A[0xF]*B[0xF]
- };
- A[0x0] = X[0x0];
- A[0x1] = X[0x1];
- A[0x2] = X[0x2];
- A[0x3] = X[0x3];
- A[0x4] = X[0x4];
- A[0x5] = X[0x5];
- A[0x6] = X[0x6];
- A[0x7] = X[0x7];
- A[0x8] = X[0x8];
- A[0x9] = X[0x9];
- A[0xA] = X[0xA];
- A[0xB] = X[0xB];
- A[0xC] = X[0xC];
- A[0xD] = X[0xD];
- A[0xE] = X[0xE];
- A[0xF] = X[0xF];
+ matrix4D_kernels.mul(A, A, B);
 }
 
 inline void matrix4D_vector3_mul(real32* X, const real32* A, const real32* B)
@@ -944,48 +757,33 @@ inline void matrix4D_vector4_mul(real32* X, const real32* A, const real32* B)
  X[3] = T[3];
 }
 
-inline real32 matrix4D_inverse(real32* X, const real32* A)
+inline void matrix4D_vector4_mul(real32* X, const real32* A, const real32* B, uint32 n)
 {
- // cache 2x2 determinants
- real32 D[12] = {
-  A[0xA]*A[0xF] - A[0xB]*A[0xE],
-  A[0x9]*A[0xF] - A[0xB]*A[0xD],
-  A[0x9]*A[0xE] - A[0xA]*A[0xD],
-  A[0x8]*A[0xF] - A[0xB]*A[0xC],
-  A[0x8]*A[0xE] - A[0xA]*A[0xC],
-  A[0x8]*A[0xD] - A[0x9]*A[0xC],
-  A[0x2]*A[0x7] - A[0x3]*A[0x6],
-  A[0x1]*A[0x7] - A[0x3]*A[0x5],
-  A[0x1]*A[0x6] - A[0x2]*A[0x5],
-  A[0x0]*A[0x7] - A[0x3]*A[0x4],
-  A[0x0]*A[0x6] - A[0x2]*A[0x4],
-  A[0x0]*A[0x5] - A[0x1]*A[0x4]
- };
+ // transforms n 4D vectors (safe to call mul(X, A, X, n))
+ matrix4D_kernels.vector4_mul(X, A, B, n);
+}
 
- // compute determinant
- real32 det = D[0x5]*D[0x6] - D[0x4]*D[0x7] + D[0x3]*D[0x8] + D[0x2]*D[0x9] - D[0x1]*D[0xA] + D[0x0]*D[0xB];
- if(det < 1.0e-7f) return det;
+inline void matrix4D_transform_aos(real32* X, const real32* A, const real32* P, uint32 n, matrix4D_transform_type type = MATRIX4D_TRANSFORM_AFFINE)
+{
+ // transforms n points stored as packed x, y, z triples (arrays of vector3D or mesh vertices)
+ // normals of non-uniformly scaled meshes need the inverse transpose of A (safe to call with X = P)
+ matrix4D_kernels.transform_aos(X, A, P, n, type);
+}
 
- // inv(M) = inv(det(M)) * transpose(C)
- real32 invdet = inv(det);
- X[0x0] = +(A[0x5]*D[0x0] - A[0x6]*D[0x1] + A[0x7]*D[0x2])*invdet;
- X[0x4] = -(A[0x4]*D[0x0] - A[0x6]*D[0x3] + A[0x7]*D[0x4])*invdet;
- X[0x8] = +(A[0x4]*D[0x1] - A[0x5]*D[0x3] + A[0x7]*D[0x5])*invdet;
- X[0xC] = -(A[0x4]*D[0x2] - A[0x5]*D[0x4] + A[0x6]*D[0x5])*invdet;
- X[0x1] = -(A[0x1]*D[0x0] - A[0x2]*D[0x1] + A[0x3]*D[0x2])*invdet;
- X[0x5] = +(A[0x0]*D[0x0] - A[0x2]*D[0x3] + A[0x3]*D[0x4])*invdet;
- X[0x9] = -(A[0x0]*D[0x1] - A[0x1]*D[0x3] + A[0x3]*D[0x5])*invdet;
- X[0xD] = +(A[0x0]*D[0x2] - A[0x1]*D[0x4] + A[0x2]*D[0x5])*invdet;
- X[0x2] = +(A[0xD]*D[0x6] - A[0xE]*D[0x7] + A[0xF]*D[0x8])*invdet;
- X[0x6] = -(A[0xC]*D[0x6] - A[0xE]*D[0x9] + A[0xF]*D[0xA])*invdet;
- X[0xA] = +(A[0xC]*D[0x7] - A[0xD]*D[0x9] + A[0xF]*D[0xB])*invdet;
- X[0xE] = -(A[0xC]*D[0x8] - A[0xD]*D[0xA] + A[0xE]*D[0xB])*invdet;
- X[0x3] = -(A[0x9]*D[0x6] - A[0xA]*D[0x7] + A[0xB]*D[0x8])*invdet;
- X[0x7] = +(A[0x8]*D[0x6] - A[0xA]*D[0x9] + A[0xB]*D[0xA])*invdet;
- X[0xB] = -(A[0x8]*D[0x7] - A[0x9]*D[0x9] + A[0xB]*D[0xB])*invdet;
- X[0xF] = +(A[0x8]*D[0x8] - A[0x9]*D[0xA] + A[0xA]*D[0xB])*invdet;
-
- // return determinant
+inline void matrix4D_transform_soa(real32* const* X, const real32* A, const real32* const* P, uint32 n, matrix4D_transform_type type = MATRIX4D_TRANSFORM_AFFINE)
+{
+ // transforms n points stored as separate x, y, and z arrays (X[0..2] and P[0..2])
+ // SoA needs no shuffling, so it is the faster layout when data can be kept that way
+ matrix4D_kernels.transform_soa(X, A, P, n, type);
+}
+
+inline real32 matrix4D_inverse(real32* X, const real32* A)
+{
+ // X is left unchanged if the determinant is too small
+ real32 T[16];
+ real32 det = matrix4D_kernels.inverse(T, A);
+ if(det < 1.0e-7f) return det;
+ matrix4D_copy(X, T);
  return det;
 }
 
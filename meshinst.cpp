@@ -14,9 +14,12 @@ MeshInstance::MeshInstance() : mesh(nullptr)
  // initialize animation data
  time = 0.0f;
  anim = 0xFFFFFFFFul;
+ cursor = 0;
+ palette = nullptr;
 
  // initialize position/orientation data
  mv.load_identity();
+ moved = false;
 
  // initialize buffers
  permodel = nullptr;
@@ -28,12 +31,15 @@ MeshInstance::MeshInstance(const real32* P, const real32* M) : mesh(nullptr)
  // initialize animation data
  time = 0.0f;
  anim = 0xFFFFFFFFul;
+ cursor = 0;
+ palette = nullptr;
 
  // initialize position/orientation data
  mv.load(M);
  mv[0x3] = P[0];
  mv[0x7] = P[1];
  mv[0xB] = P[2];
+ moved = false;
 
  // initialize buffers
  permodel = nullptr;
@@ -63,13 +69,13 @@ ErrorCode MeshInstance::InitInstance(MeshData* ptr)
  if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
 
  // create per-frame matrix
- jm.reset(new matrix4D[mesh->bones.size()]);
+ jm.reset(new affine3D[mesh->bones.size()]);
  for(size_t bi = 0; bi < mesh->bones.size(); bi++) jm[bi].load_identity();
 
  // set per-frame matrix
  perframe = nullptr;
  if(mesh->bones.size()) {
-    UINT size = (UINT)(mesh->bones.size()*sizeof(matrix4D));
+    UINT size = (UINT)(mesh->bones.size()*sizeof(affine3D));
     code = CreateDynamicConstBuffer(&perframe, size, jm.get());
     if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
    }
@@ -88,6 +94,7 @@ ErrorCode MeshInstance::InitInstance(MeshData* ptr, const real32* P, const real3
  mv[0x3] = P[0];
  mv[0x7] = P[1];
  mv[0xB] = P[2];
+ moved = false;
 
  // create per-model matrix
  permodel = nullptr;
@@ -101,13 +108,13 @@ ErrorCode MeshInstance::InitInstance(MeshData* ptr, const real32* P, const real3
  if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
 
  // create per-frame matrix
- jm.reset(new matrix4D[mesh->bones.size()]);
+ jm.reset(new affine3D[mesh->bones.size()]);
  for(size_t bi = 0; bi < mesh->bones.size(); bi++) jm[bi].load_identity();
 
  // set per-frame matrix
  perframe = nullptr;
  if(mesh->bones.size()) {
-    UINT size = (UINT)(mesh->bones.size()*sizeof(matrix4D));
+    UINT size = (UINT)(mesh->bones.size()*sizeof(affine3D));
     code = CreateDynamicConstBuffer(&perframe, size, jm.get());
     if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
    }
@@ -121,9 +128,12 @@ void MeshInstance::FreeInstance(void)
  mesh = nullptr;
  time = 0.0f;
  anim = 0xFFFFFFFFul;
+ cursor = 0;
+ palette = nullptr;
 
  // reset position/orientation data
  mv.load_identity();
+ moved = false;
 
  // reset skeleton buffer
  jm.reset();
@@ -142,6 +152,7 @@ ErrorCode MeshInstance::SetMatrix(const real32* P, const real32* M)
  mv[0x3] = P[0];
  mv[0x7] = P[1];
  mv[0xB] = P[2];
+ moved = true;
 
  // update matrix
  DirectX::XMMATRIX m(&mv[0]);
@@ -155,6 +166,7 @@ ErrorCode MeshInstance::SetMatrix(const real32* M)
 {
  // set matrix
  mv.load(M);
+ moved = true;
 
  // update matrix
  DirectX::XMMATRIX m(&mv[0]);
@@ -176,10 +188,11 @@ ErrorCode MeshInstance::SetAnimation(uint32 index, bool repeat)
     // reset animation
     anim = 0xFFFFFFFFul;
     loop = false;
+    palette = nullptr;
     // restore bone matrices
     for(size_t bi = 0; bi < mesh->bones.size(); bi++) jm[bi].load_identity();
     // copy matrices to Direct3D
-    UINT size = (UINT)(mesh->bones.size()*sizeof(matrix4D));
+    UINT size = (UINT)(mesh->bones.size()*sizeof(affine3D));
     ErrorCode code = UpdateDynamicConstBuffer(perframe, size, (const void*)jm.get());
     if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
     return ResetAnimation();
@@ -192,6 +205,8 @@ ErrorCode MeshInstance::SetAnimation(uint32 index, bool repeat)
  if(!(index < mesh->animations.size())) return DebugErrorCode(EC_ANIM_INDEX, __LINE__, __FILE__);
  anim = index;
  time = 0.0f;
+ cursor = 0;
+ palette = nullptr;
  loop = repeat;
  return Update();
 }
@@ -203,21 +218,8 @@ ErrorCode MeshInstance::SetTime(real32 value)
  if(value == time) return EC_SUCCESS; // no need to update 
 
  // update time, looping animation if necessary
- real32 duration = mesh->animations[anim].duration;
- time = value;
- if(time < 0.0f) {
-    if(loop) // mesh->animations[anim].loop)
-       while(time < 0.0f) time += duration;
-    else
-       time = 0.0f;
-   }
- else if(time > duration) {
-    if(loop) // mesh->animations[anim].loop)
-       while(!(time < duration)) time -= duration;
-    else
-       time = duration;
-   }
- 
+ time = WrapAnimationTime(value, mesh->animations[anim].duration, loop);
+
  // update model
  return Update();
 }
@@ -243,109 +245,55 @@ ErrorCode MeshInstance::Update(void)
  // validate
  if(anim == 0xFFFFFFFFul) return EC_SUCCESS; // no animation set
 
- const auto& animation = mesh->animations[anim];
- const auto& bones = mesh->bones;
+ // use palette shared by all instances of mesh, or compute skinning palette
+ palette = ComputeInstancePose(mesh->bones, mesh->animations[anim], mesh->palettes, anim, time, cursor, jm.get());
+ return Upload();
+}
 
- // for each bone that is animated
- matrix4D m;
- for(size_t bi = 0; bi < bones.size(); bi++)
-    {
-     size_t n_keys = animation.keyset.size();
-     if(time <= animation.animdata[0].delta) {
-        auto& kf = animation.animdata[0];
-        m.load_scaling(kf.slist[bi][0], kf.slist[bi][1], kf.slist[bi][2]);
-        matrix4D R;
-        R.load_quaternion(&kf.qlist[bi][0]);
-        m = m * R;
-        m[0x3] += kf.tlist[bi][0];
-        m[0x7] += kf.tlist[bi][1];
-        m[0xB] += kf.tlist[bi][2];
-        jm[bi] = bones[bi].m_abs * m;
-       }
-     else if(time >= animation.animdata[n_keys - 1].delta) {
-        auto& kf = animation.animdata[n_keys - 1];
-        m.load_scaling(kf.slist[bi][0], kf.slist[bi][1], kf.slist[bi][2]);
-        matrix4D R;
-        R.load_quaternion(&kf.qlist[bi][0]);
-        m = m * R;
-        m[0x3] += kf.tlist[bi][0];
-        m[0x7] += kf.tlist[bi][1];
-        m[0xB] += kf.tlist[bi][2];
-        jm[bi] = bones[bi].m_abs * m;
-       }
-     else
-       {
-        // using current time, find keyframes [a, b] that time is inbetween
-        for(size_t ki = 0; ki < (n_keys - 1); ki++)
-           {
-            // find [a, b] such that [a, time, b]
-            auto& kf1 = animation.animdata[ki];
-            auto& kf2 = animation.animdata[ki + 1];
-
-            if((time >= kf1.delta) && (time < kf2.delta))
-              {
-               // compute ratio between kf1 (0.0) and kf2 (1.0)
-               real32 ratio = (time - kf1.delta)/(kf2.delta - kf1.delta);
-
-               // interpolate scale
-               real32 S[3];
-               lerp3D(S, &kf1.slist[bi][0], &kf2.slist[bi][0], ratio);
-
-               // interpolate translation
-               real32 T[3];
-               lerp3D(T, &kf1.tlist[bi][0], &kf2.tlist[bi][0], ratio);
-
-               // interpolate quaternion
-               real32 Q[4];
-               qslerp(Q, &kf1.qlist[bi][0], &kf2.qlist[bi][0], ratio);
-               qnormalize(Q);
- 
-               // load scaling matrix
-               m.load_scaling(S[0], S[1], S[2]);
-
-               matrix4D Tc;
-               Tc.load_translation(T[0], T[1], T[2]);
-
-               // rotate, then scale
-               matrix4D R;
-               R.load_quaternion(Q);
-               m = m * Tc * R;
-
-               // set matrix
-               jm[bi] = bones[bi].m_abs * m;
-               break;
-              }
-           }
-       }
-    }
+ErrorCode MeshInstance::Update(real32 dt)
+{
+ return SetTime(time + dt);
+}
 
- // for each bone that is animated
- // these transformation matrices are interpolated in relative space
- for(size_t bi = 1; bi < bones.size(); bi++) {
-     uint32 parent = bones[bi].parent;
-     jm[bi] = (jm[parent] * bones[parent].m_inv) * jm[bi];
-    }
- for(size_t bi = 0; bi < bones.size(); bi++) {
-     // the transpose is necessary if in shader you use: mul(mskin[input.bi[i]], input.position)
-     // the transpose is NOT necessary if in shader you use: mul(input.position, mskin[input.bi[i]])
-     jm[bi] = jm[bi] * bones[bi].m_inv;
-     jm[bi].transpose();
-    }
+/** Animate
+ *  Advances time and computes the skinning palette like Update(dt) does, but does not copy it to
+ *  Direct3D (see Upload). Animate makes no graphics calls and does not change the mesh, so all
+ *  instances can be animated by different threads at once.
+ */
+void MeshInstance::Animate(real32 dt)
+{
+ // validate
+ if(anim == 0xFFFFFFFFul) return; // no animation set
+ real32 value = time + dt;
+ if(value == time) return; // no need to update
+
+ // update time and compute skinning palette
+ time = WrapAnimationTime(value, mesh->animations[anim].duration, loop);
+ palette = ComputeInstancePose(mesh->bones, mesh->animations[anim], mesh->palettes, anim, time, cursor, jm.get());
+}
+
+/** Upload
+ *  Copies the skinning palette computed by Animate to Direct3D. This also caches the animation if
+ *  the mesh caches palettes lazily, so it must be called from one thread.
+ */
+ErrorCode MeshInstance::Upload(void)
+{
+ // nothing to upload
+ if(!palette) return EC_SUCCESS;
 
  // copy matrices to Direct3D
- UINT size = (UINT)(bones.size()*sizeof(matrix4D));
- ErrorCode code = UpdateDynamicConstBuffer(perframe, size, (const void*)jm.get());
+ UINT size = (UINT)(mesh->bones.size()*sizeof(affine3D));
+ ErrorCode code = UpdateDynamicConstBuffer(perframe, size, (const void*)palette);
+ palette = nullptr;
  if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
 
+ // share palettes with other instances from the next update on
+ mesh->CacheAnimation(anim);
+
  // success
  return EC_SUCCESS;
 }
 
-ErrorCode MeshInstance::Update(real32 dt)
-{
- return SetTime(time + dt);
-}
-
 ErrorCode MeshInstance::RenderSkeleton(void)
 {
  return EC_SUCCESS;
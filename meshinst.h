@@ -9,10 +9,13 @@ class MeshInstance {
   MeshData* mesh;
   real32 time;
   uint32 anim;
+  uint32 cursor;
   bool loop;
  private :
   matrix4D mv;
-  std::unique_ptr<matrix4D[]> jm;
+  bool moved; // matrix changed since ClearMoved (see Map::Update)
+  std::unique_ptr<affine3D[]> jm;
+  const affine3D* palette; // computed by Animate, not yet uploaded
  private :
   ID3D11Buffer* permodel;
   ID3D11Buffer* perframe;
@@ -24,6 +27,9 @@ class MeshInstance {
   ErrorCode SetMatrix(const real32* P, const real32* M);
   ErrorCode SetMatrix(const real32* M);
   const real32* GetMatrix(void)const;
+  const MeshData* GetMeshData(void)const { return mesh; }
+  bool IsMoved(void)const { return moved; }
+  void ClearMoved(void) { moved = false; }
  public :
   uint32 GetAnimation(void)const { return anim; }
   real32 GetTime(void)const { return time; }
@@ -33,6 +39,8 @@ class MeshInstance {
   ErrorCode ResetAnimation(void);
   ErrorCode Update(void);
   ErrorCode Update(real32 dt);
+  void Animate(real32 dt);
+  ErrorCode Upload(void);
  public :
   ErrorCode RenderSkeleton(void);
   ErrorCode RenderModel(void);
@@ -812,7 +812,7 @@ MeshUTFInstance::MeshUTFInstance(const MeshUTF& ptr)
  mv.load_identity();
 
  // initialize joint matrix data
- jm.reset(new matrix4D[mesh->joints.size()]);
+ jm.reset(new affine3D[mesh->joints.size()]);
  for(size_t bi = 0; bi < mesh->joints.size(); bi++) jm[bi].load_identity();
 
  // initialize buffers
@@ -834,7 +834,7 @@ MeshUTFInstance::MeshUTFInstance(const MeshUTF& ptr, const real32* P, const real
  mv[0xB] = P[2];
 
  // initialize skinning matrices
- jm.reset(new matrix4D[mesh->joints.size()]);
+ jm.reset(new affine3D[mesh->joints.size()]);
  for(size_t bi = 0; bi < mesh->joints.size(); bi++) jm[bi].load_identity();
 
  // initialize buffers
@@ -863,7 +863,7 @@ ErrorCode MeshUTFInstance::InitInstance(void)
  // create skinning matrices
  perframe = nullptr;
  if(mesh->joints.size()) {
-    UINT size = (UINT)(mesh->joints.size()*sizeof(matrix4D));
+    UINT size = (UINT)(mesh->joints.size()*sizeof(affine3D));
     code = CreateDynamicConstBuffer(&perframe, size, jm.get());
     if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
    }
@@ -957,7 +957,7 @@ ErrorCode MeshUTFInstance::Update(void)
         m[0x3] += kf.tlist[bi][0];
         m[0x7] += kf.tlist[bi][1];
         m[0xB] += kf.tlist[bi][2];
-        jm[bi] = m * mesh->joints[bi].m_rel;
+        jm[bi] = affine3D(m * mesh->joints[bi].m_rel);
        }
      else if(time >= animation.animdata[n_keys - 1].delta) {
         auto& kf = animation.animdata[n_keys - 1];
@@ -968,7 +968,7 @@ ErrorCode MeshUTFInstance::Update(void)
         m[0x3] += kf.tlist[bi][0];
         m[0x7] += kf.tlist[bi][1];
         m[0xB] += kf.tlist[bi][2];
-        jm[bi] = m * mesh->joints[bi].m_rel;
+        jm[bi] = affine3D(m * mesh->joints[bi].m_rel);
        }
      else
        {
@@ -1011,7 +1011,7 @@ ErrorCode MeshUTFInstance::Update(void)
                m = V * m;
 
                // set matrix
-               jm[bi] = m;
+               jm[bi] = affine3D(m);
                break;
               }
            }
@@ -1022,15 +1022,16 @@ ErrorCode MeshUTFInstance::Update(void)
  // these transformation matrices are interpolated in relative space
  for(size_t bi = 1; bi < joints.size(); bi++) {
      uint32 parent = mesh->joints[bi].parent;
-     jm[bi] = jm[bi] * mesh->joints[bi].m_rel * jm[parent];
+     jm[bi] = jm[bi] * affine3D(mesh->joints[bi].m_rel) * jm[parent];
     }
  for(size_t bi = 0; bi < joints.size(); bi++) {
-     jm[bi] = jm[bi] * mesh->joints[bi].m_inv;
-     jm[bi].transpose();
+     jm[bi] = jm[bi] * affine3D(mesh->joints[bi].m_inv);
     }
 
  // copy matrices to Direct3D
- UINT size = (UINT)(mesh->joints.size()*sizeof(matrix4D));
+ // no transpose is necessary, since the shader declares mskin as row_major float3x4 and uses:
+ // mul(mskin[input.bi[i]], input.position)
+ UINT size = (UINT)(mesh->joints.size()*sizeof(affine3D));
  ErrorCode code = UpdateDynamicConstBuffer(perframe, size, (const void*)jm.get());
  if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
 
@@ -2,6 +2,7 @@
 #define __CPSC489_MODEL_H
 
 #include "matrix4.h"
+#include "affine3.h"
 
 struct MeshUTFJoint {
  STDSTRINGW name;
@@ -113,7 +114,7 @@ class MeshUTFInstance {
   bool loop;
  private :
   matrix4D mv;
-  std::unique_ptr<matrix4D[]> jm;
+  std::unique_ptr<affine3D[]> jm;
  private :
   ID3D11Buffer* permodel;
   ID3D11Buffer* perframe;
@@ -8,9 +8,6 @@
 #include "fileio.h"
 #include "bstream.h"
 
-static const uint32 FRAMES_PER_SECOND = 30ul;
-static const real32 SECONDS_PER_FRAME = 1.0f/30.0f;
-
 MeshData::MeshData() : skeletal(false)
 {
  graphics.vbuffer = nullptr;
@@ -32,6 +29,7 @@ MeshData::MeshData(MeshData&& other)
  bonemap = std::move(other.bonemap);
  bones = std::move(other.bones);
  animations = std::move(other.animations);
+ palettes = std::move(other.palettes);
  collisions = std::move(other.collisions);
  materials = std::move(other.materials);
  meshes = std::move(other.meshes);
@@ -60,6 +58,7 @@ MeshData& MeshData::operator =(MeshData&& other)
  bonemap = std::move(other.bonemap);
  bones = std::move(other.bones);
  animations = std::move(other.animations);
+ palettes = std::move(other.palettes);
  collisions = std::move(other.collisions);
  materials = std::move(other.materials);
  meshes = std::move(other.meshes);
@@ -78,160 +77,64 @@ MeshData& MeshData::operator =(MeshData&& other)
  return *this;
 }
 
-/** ConstructAnimationData
- *  -# For each animation, this function collects all the keyframes and orders them. For example, if
- *     one bone has keyframes at {0, 10}, and another bone has keyframes at {10, 20}, the keyframes
- *     are collected into one collective and ordered set {0, 10, 20}.
- *  -# Then for each bone that has a keyframe defined already, those keyframes are assigned to this
- *     new collective set. For example:
- *     For b1: {0, 10, 20} = {set, set, unset}
- *     For b2: {0, 10, 20} = {unset, set, set}
- *  -# Once the known keyframes are set, the missing keyframes must be set. In these cases, we may
- *     or may not have to interpolate between known keyframes to compute keyframes for bones that
- *     did not originally have keyframes. For example:
- *     b1 has unset keyframe at 20. Since there is a keyframe before 20 but none after, we simply
- *     just reuse the keyframe at 10.
- *     For b1: {0, 10, 20} = {kf1, kf2, kf2} (reuse kf2 to set missing keyframe at 20)
- *     For b2: {0, 10, 20} = {kf1, kf1, kf2} (reuse kf1 to set missing keyframe at 0}
- *  -# The transforms that are computed are defined as follows:
- *     - animations[anim index].animdata[key index].slist[bone index] (Scale Transform)
- *     - animations[anim index].animdata[key index].tlist[bone index] (Translation Transform)
- *     - animations[anim index].animdata[key index].qlist[bone index] (Quaternion Transform)
- *  -# Once done, every bone will have a keyframe for all keyframes.
- */
 void MeshData::ConstructAnimationData(void)
 {
- // for each animation
+ // fill in missing keyframes (see animation.cpp)
  for(size_t anim = 0; anim < animations.size(); anim++)
-    {
-     // 
-     size_t n_keys = animations[anim].keymap.size();
-     animations[anim].animdata.reset(new MeshAnimationData[n_keys]);
-
-     // compute frame times
-     // remember, minframe does not have to start at zero!
-     // you have to subtract minframe from frame to get zero offset
-     for(auto iter = animations[anim].keymap.begin(); iter != animations[anim].keymap.end(); iter++) {
-         uint32 frame = iter->first;
-         size_t index = iter->second;
-         animations[anim].animdata[index].frame = frame;
-         animations[anim].animdata[index].delta = SECONDS_PER_FRAME*(frame - animations[anim].minframe);
-        }
+     ::ConstructAnimationData(animations[anim], bones);
+}
 
-     // create keyframe data
-     for(size_t i = 0; i < n_keys; i++)
-        {
-         // create bone data
-         animations[anim].animdata[i].keyed.reset(new bool[bones.size()]);
-         for(size_t j = 0; j < bones.size(); j++) animations[anim].animdata[i].keyed[j] = false;
-
-         // create bone transform data
-         animations[anim].animdata[i].slist.reset(new std::array<real32, 3>[bones.size()]);
-         animations[anim].animdata[i].tlist.reset(new std::array<real32, 3>[bones.size()]);
-         animations[anim].animdata[i].qlist.reset(new std::array<real32, 4>[bones.size()]);
-         animations[anim].animdata[i].mlist.reset(new matrix4D[bones.size()]);
-        }
+/** BakeAnimations
+ *  Samples every animation at a fixed rate (see BakeAnimationPoses), so that instances blend two
+ *  baked poses instead of interpolating keyframes. A rate of zero goes back to keyframes.
+ */
+void MeshData::BakeAnimations(real32 rate)
+{
+ for(size_t anim = 0; anim < animations.size(); anim++)
+     BakeAnimationPoses(animations[anim], bones, rate);
 
-     // for each bone that IS keyframed
-     for(size_t i = 0; i < animations[anim].bonelist.size(); i++)
-        {
-         // for each keyframe
-         for(size_t j = 0; j < animations[anim].bonelist[i].keyframes.size(); j++)
-            {
-             // find keyframe index from frame
-             auto iter = animations[anim].keymap.find(animations[anim].bonelist[i].keyframes[j].frame);
-             if(iter == animations[anim].keymap.end()) continue;
-
-             size_t b_index = animations[anim].bonelist[i].bone_index;
-             size_t k_index = iter->second;
-             auto& kf = animations[anim].bonelist[i].keyframes[j];
-
-             // mark as keyed
-             animations[anim].animdata[k_index].keyed[b_index] = true;
-
-             // set scale
-             animations[anim].animdata[k_index].slist[b_index][0] = kf.scale[0];
-             animations[anim].animdata[k_index].slist[b_index][1] = kf.scale[1];
-             animations[anim].animdata[k_index].slist[b_index][2] = kf.scale[2];
-
-             // set translation
-             animations[anim].animdata[k_index].tlist[b_index][0] = kf.translation[0];
-             animations[anim].animdata[k_index].tlist[b_index][1] = kf.translation[1];
-             animations[anim].animdata[k_index].tlist[b_index][2] = kf.translation[2];
-
-             // set quaternion
-             animations[anim].animdata[k_index].qlist[b_index][0] = kf.quaternion[0];
-             animations[anim].animdata[k_index].qlist[b_index][1] = kf.quaternion[1];
-             animations[anim].animdata[k_index].qlist[b_index][2] = kf.quaternion[2];
-             animations[anim].animdata[k_index].qlist[b_index][3] = kf.quaternion[3];
-            }
-        }
+ // cached palettes are out of date
+ palettes.refresh(bones, animations);
+}
 
-     // for each bone that IS NOT keyframed
-     for(size_t i = 0; i < n_keys; i++)
-        {
-         for(size_t j = 0; j < bones.size(); j++)
-            {
-             if(animations[anim].animdata[i].keyed[j]) continue;
-
-             // look for previous key (for this bone j)
-             size_t prev_key = 0xFFFFFFFFul;
-             for(size_t k = 0; k < i; k++) {
-                 size_t k_rev = (i - 1) - k;
-                 if(animations[anim].animdata[k_rev].keyed[j]) {
-                    prev_key = k_rev;
-                    break;
-                   }
-                }
-
-             // look for following key (for this bone j)
-             size_t next_key = 0xFFFFFFFFul;
-             for(size_t k = i + 1; k < n_keys; k++) {
-                 if(animations[anim].animdata[k].keyed[j]) {
-                    next_key = k;
-                    break;
-                   }
-                }
-
-             // no previous key
-             if(prev_key == 0xFFFFFFFFul) {
-                animations[anim].animdata[i].keyed[j] = true;
-                animations[anim].animdata[i].slist[j][0] = 1.0f;
-                animations[anim].animdata[i].slist[j][1] = 1.0f;
-                animations[anim].animdata[i].slist[j][2] = 1.0f;
-                animations[anim].animdata[i].tlist[j][0] = 0.0f;
-                animations[anim].animdata[i].tlist[j][1] = 0.0f;
-                animations[anim].animdata[i].tlist[j][2] = 0.0f;
-                animations[anim].animdata[i].qlist[j][0] = 1.0f;
-                animations[anim].animdata[i].qlist[j][1] = 0.0f;
-                animations[anim].animdata[i].qlist[j][2] = 0.0f;
-                animations[anim].animdata[i].qlist[j][3] = 0.0f;
-               }
-             // no next key
-             else if(next_key == 0xFFFFFFFFul) {
-                animations[anim].animdata[i].keyed[j] = true;
-                animations[anim].animdata[i].slist[j][0] = animations[anim].animdata[prev_key].slist[j][0];
-                animations[anim].animdata[i].slist[j][1] = animations[anim].animdata[prev_key].slist[j][1];
-                animations[anim].animdata[i].slist[j][2] = animations[anim].animdata[prev_key].slist[j][2];
-                animations[anim].animdata[i].tlist[j][0] = animations[anim].animdata[prev_key].tlist[j][0];
-                animations[anim].animdata[i].tlist[j][1] = animations[anim].animdata[prev_key].tlist[j][1];
-                animations[anim].animdata[i].tlist[j][2] = animations[anim].animdata[prev_key].tlist[j][2];
-                animations[anim].animdata[i].qlist[j][0] = animations[anim].animdata[prev_key].qlist[j][0];
-                animations[anim].animdata[i].qlist[j][1] = animations[anim].animdata[prev_key].qlist[j][1];
-                animations[anim].animdata[i].qlist[j][2] = animations[anim].animdata[prev_key].qlist[j][2];
-                animations[anim].animdata[i].qlist[j][3] = animations[anim].animdata[prev_key].qlist[j][3];
-               }
-             // prev and next keys
-             else {
-                animations[anim].animdata[i].keyed[j] = true;
-                real32 ratio = (animations[anim].animdata[i].delta - animations[anim].animdata[prev_key].delta)/(animations[anim].animdata[next_key].delta - animations[anim].animdata[prev_key].delta);
-                lerp3D(animations[anim].animdata[i].slist[j].data(), animations[anim].animdata[prev_key].slist[j].data(), animations[anim].animdata[next_key].slist[j].data(), ratio);
-                lerp3D(animations[anim].animdata[i].tlist[j].data(), animations[anim].animdata[prev_key].tlist[j].data(), animations[anim].animdata[next_key].tlist[j].data(), ratio);
-                qslerp(animations[anim].animdata[i].qlist[j].data(), animations[anim].animdata[prev_key].qlist[j].data(), animations[anim].animdata[next_key].qlist[j].data(), ratio);
-               }
-            }
-        }
-    }
+/** CompressAnimations
+ *  Replaces the keyframes of every animation with compressed tracks (see CompressAnimation), which
+ *  take less memory but are not faster to evaluate. The keyframes are freed, so this cannot be
+ *  undone.
+ */
+void MeshData::CompressAnimations(const AnimationCompressionOptions& options)
+{
+ for(size_t anim = 0; anim < animations.size(); anim++)
+     CompressAnimation(animations[anim], bones, options);
+
+ // cached palettes are out of date
+ palettes.refresh(bones, animations);
+}
+
+/** EnablePaletteCache
+ *  Shares skinning palettes sampled at a fixed rate by all instances of this mesh (see
+ *  AnimationCache). Instances that play animations that are not cached evaluate them live.
+ */
+void MeshData::EnablePaletteCache(const AnimationCacheOptions& options)
+{
+ palettes.construct(bones, animations, options);
+}
+
+void MeshData::DisablePaletteCache(void)
+{
+ palettes.clear();
+}
+
+/** CacheAnimation
+ *  Caches the palettes of an animation when it is first played if the palette cache is lazy (see
+ *  AnimationCache::cache). Not thread-safe, so this must not be called while instances of this
+ *  mesh are being animated.
+ */
+void MeshData::CacheAnimation(uint32 anim)
+{
+ if(!(anim < animations.size())) return;
+ if(palettes.enabled() && palettes.lazy() && !palettes.cached(anim) && !palettes.live(anim))
+    palettes.cache(bones, animations[anim], anim);
 }
 
 ErrorCode MeshData::ConstructGraphics(void)
@@ -353,10 +256,10 @@ ErrorCode MeshData::ConstructGraphics(void)
         data[i].m[0x9] = bones[i].m_abs[0x9];
         data[i].m[0xA] = bones[i].m_abs[0xA];
         data[i].m[0xB] = bones[i].m_abs[0xB];
-        data[i].m[0xC] = bones[i].m_abs[0xC];
-        data[i].m[0xD] = bones[i].m_abs[0xD];
-        data[i].m[0xE] = bones[i].m_abs[0xE];
-        data[i].m[0xF] = bones[i].m_abs[0xF];
+        data[i].m[0xC] = 0.0f;
+        data[i].m[0xD] = 0.0f;
+        data[i].m[0xE] = 0.0f;
+        data[i].m[0xF] = 1.0f;
         data[i].scale[0] = 1.0f;
         data[i].scale[1] = 1.0f;
         data[i].scale[2] = 1.0f;
@@ -461,7 +364,7 @@ ErrorCode MeshData::LoadMeshUTF(const wchar_t* filename)
         code = ASCIIReadMatrix4(linelist, &m[0], false);
         if(Fail(code)) return DebugErrorCode(code, __LINE__, __FILE__);
 
-        // save matrix to absolute format
+        // save matrix to absolute format (bone matrices are affine, so the bottom row is dropped)
         bones[i].m_abs[0x0] = m[0x0];
         bones[i].m_abs[0x1] = m[0x1];
         bones[i].m_abs[0x2] = m[0x2];
@@ -474,10 +377,6 @@ ErrorCode MeshData::LoadMeshUTF(const wchar_t* filename)
         bones[i].m_abs[0x9] = m[0x9];
         bones[i].m_abs[0xA] = m[0xA];
         bones[i].m_abs[0xB] = m[0xB];
-        bones[i].m_abs[0xC] = m[0xC];
-        bones[i].m_abs[0xD] = m[0xD];
-        bones[i].m_abs[0xE] = m[0xE];
-        bones[i].m_abs[0xF] = m[0xF];
 
         // save inverse
         bones[i].m_inv = bones[i].m_abs;
@@ -485,22 +384,7 @@ ErrorCode MeshData::LoadMeshUTF(const wchar_t* filename)
 
         // save matrix to relative format
         if(bones[i].parent == 0xFFFFFFFF) {
-           bones[i].m_rel[0x0] = bones[i].m_abs[0x0];
-           bones[i].m_rel[0x1] = bones[i].m_abs[0x1];
-           bones[i].m_rel[0x2] = bones[i].m_abs[0x2];
-           bones[i].m_rel[0x3] = bones[i].m_abs[0x3];
-           bones[i].m_rel[0x4] = bones[i].m_abs[0x4];
-           bones[i].m_rel[0x5] = bones[i].m_abs[0x5];
-           bones[i].m_rel[0x6] = bones[i].m_abs[0x6];
-           bones[i].m_rel[0x7] = bones[i].m_abs[0x7];
-           bones[i].m_rel[0x8] = bones[i].m_abs[0x8];
-           bones[i].m_rel[0x9] = bones[i].m_abs[0x9];
-           bones[i].m_rel[0xA] = bones[i].m_abs[0xA];
-           bones[i].m_rel[0xB] = bones[i].m_abs[0xB];
-           bones[i].m_rel[0xC] = bones[i].m_abs[0xC];
-           bones[i].m_rel[0xD] = bones[i].m_abs[0xD];
-           bones[i].m_rel[0xE] = bones[i].m_abs[0xE];
-           bones[i].m_rel[0xF] = bones[i].m_abs[0xF];
+           bones[i].m_rel = bones[i].m_abs;
           }
         else {
            // R*P = A (relative * parent = absolute)
@@ -962,6 +846,7 @@ void MeshData::Free(void)
  collisions.clear();
 
  // delete animations
+ palettes.clear();
  animations.clear();
  bones.clear();
  bonemap.clear();
@@ -970,6 +855,23 @@ void MeshData::Free(void)
  skeletal = false;
 }
 
+bool MeshData::GetBounds(real32* a, real32* b)const
+{
+ // min-max bounds of all mesh vertices (in model space)
+ bool valid = false;
+ for(size_t i = 0; i < meshes.size(); i++) {
+     for(uint32 j = 0; j < meshes[i].n_verts; j++) {
+         const real32* v = meshes[i].position[j].v;
+         for(uint32 k = 0; k < 3; k++) {
+             if(!valid || v[k] < a[k]) a[k] = v[k];
+             if(!valid || b[k] < v[k]) b[k] = v[k];
+            }
+         valid = true;
+        }
+    }
+ return valid;
+}
+
 ErrorCode MeshData::SaveMeshUTF(const wchar_t* filename)
 {
  // create output file
@@ -990,7 +892,7 @@ ErrorCode MeshData::SaveMeshUTF(const wchar_t* filename)
         ofile << bones[i].m_abs[0x0] << " " << bones[i].m_abs[0x1] << " " << bones[i].m_abs[0x2] << " " << bones[i].m_abs[0x3] << " ";
         ofile << bones[i].m_abs[0x4] << " " << bones[i].m_abs[0x5] << " " << bones[i].m_abs[0x6] << " " << bones[i].m_abs[0x7] << " ";
         ofile << bones[i].m_abs[0x8] << " " << bones[i].m_abs[0x9] << " " << bones[i].m_abs[0xA] << " " << bones[i].m_abs[0xB] << " ";
-        ofile << bones[i].m_abs[0xC] << " " << bones[i].m_abs[0xD] << " " << bones[i].m_abs[0xE] << " " << bones[i].m_abs[0xF] << endl;
+        ofile << "0 0 0 1" << endl;
         if(ofile.fail()) return DebugErrorCode(EC_FILE_WRITE, __LINE__, __FILE__);
        }
    }
@@ -3,6 +3,8 @@
 
 #include "errors.h"
 #include "matrix4.h"
+#include "affine3.h"
+#include "animation.h"
 
 class MeshData {
   friend class MeshInstance;
@@ -16,46 +18,6 @@ class MeshData {
   static const uint16 SPECULAR_MAP = 1;
   static const uint16 NORMAL_MAP   = 2;
  private :
-  struct MeshBone {
-   STDSTRINGW name;
-   uint32 parent;
-   real32 position[3];
-   matrix4D m_abs;
-   matrix4D m_inv;
-   matrix4D m_rel;
-  };
-  struct MeshKeyFrame {
-   uint32 frame;
-   real32 translation[3];
-   real32 quaternion[4];
-   real32 scale[3];
-  };
-  struct MeshAnimatedBoneKeys {
-   uint32 bone_index;
-   uint32 minframe;
-   uint32 maxframe;
-   std::vector<MeshKeyFrame> keyframes;
-  };
-  struct MeshAnimationData {
-   uint32 frame;
-   real32 delta;
-   std::unique_ptr<bool[]> keyed;
-   std::unique_ptr<std::array<real32, 3>[]> slist;
-   std::unique_ptr<std::array<real32, 3>[]> tlist;
-   std::unique_ptr<std::array<real32, 4>[]> qlist;
-   std::unique_ptr<matrix4D[]> mlist;
-  };
-  struct MeshAnimation {
-   STDSTRINGW name;
-   bool loop;
-   uint32 minframe;
-   uint32 maxframe;
-   real32 duration;
-   std::set<uint32> keyset;
-   std::map<uint32, size_t> keymap;
-   std::vector<MeshAnimatedBoneKeys> bonelist;
-   std::unique_ptr<MeshAnimationData[]> animdata;
-  };
   struct MeshTexture {
    STDSTRINGW filename;
    STDSTRINGW name;
@@ -106,6 +68,7 @@ class MeshData {
   std::map<STDSTRINGW, uint32> bonemap;
   std::vector<MeshBone> bones;
   std::vector<MeshAnimation> animations;
+  AnimationCache palettes;
   std::vector<MeshCollision> collisions;
   std::vector<MeshMaterial> materials;
   std::vector<MeshBuffers> meshes;
@@ -121,6 +84,20 @@ class MeshData {
  public :
   ErrorCode SaveMeshUTF(const wchar_t* filename);
   ErrorCode SaveMeshBIN(const wchar_t* filename);
+ public :
+  void BakeAnimations(real32 rate);
+  void CompressAnimations(const AnimationCompressionOptions& options);
+  void EnablePaletteCache(const AnimationCacheOptions& options);
+  void DisablePaletteCache(void);
+  void CacheAnimation(uint32 anim);
+  size_t GetPaletteCacheBytes(void)const { return palettes.bytes(); }
+ public :
+  uint32 GetCollisionMeshCount(void)const { return static_cast<uint32>(collisions.size()); }
+  uint32 GetCollisionVertexCount(uint32 index)const { return collisions[index].n_verts; }
+  uint32 GetCollisionFaceCount(uint32 index)const { return collisions[index].n_faces; }
+  const real32* GetCollisionVertices(uint32 index)const { return (collisions[index].n_verts ? &collisions[index].position[0].v[0] : nullptr); }
+  const uint32* GetCollisionFaces(uint32 index)const { return (collisions[index].n_faces ? &collisions[index].facelist[0].v[0] : nullptr); }
+  bool GetBounds(real32* a, real32* b)const;
  public : 
   MeshData();
   virtual ~MeshData();
@@ -0,0 +1,263 @@
+#include "stdafx.h"
+#include "octree.h"
+
+void LooseOctree::construct(const AABB_minmax* bounds, const uint32* ids, uint32 n, uint32 depth)
+{
+ // nothing to do
+ clear();
+ if(!bounds || !n) return;
+ max_depth = std::min(depth, 20u);
+
+ //
+ // PHASE #1
+ // ROOT CELL
+ // The root cell is the smallest cube around the bounds of all items.
+ //
+
+ AABB_minmax world = bounds[0];
+ for(uint32 i = 1; i < n; i++) world.grow(bounds[i]);
+ real32 root_center[3];
+ real32 root_width = 0.0f;
+ for(uint32 j = 0; j < 3; j++) {
+     root_center[j] = (world.a[j] + world.b[j])*0.5f;
+     root_width = std::max(root_width, (world.b[j] - world.a[j])*0.5f);
+    }
+ root_width = std::max(root_width*1.0001f, 1.0e-6f);
+ real32 root_min[3] = {
+  root_center[0] - root_width,
+  root_center[1] - root_width,
+  root_center[2] - root_width
+ };
+
+ //
+ // PHASE #2
+ // CELL OF EACH ITEM
+ // The path to a cell is stored as a 3-bit octant per level, starting from the most
+ // significant bits, so sorting by (path, depth) puts the items in depth-first order with
+ // the items of a node before the items of its children.
+ //
+
+ struct OctreeKey {
+  uint64 path;
+  uint32 depth;
+  uint32 index;
+ };
+ std::vector<OctreeKey> keys(n);
+ for(uint32 i = 0; i < n; i++)
+    {
+     // deepest level where cell half width is at least item half width
+     real32 radius = 0.0f;
+     real32 center[3];
+     for(uint32 j = 0; j < 3; j++) {
+         center[j] = (bounds[i].a[j] + bounds[i].b[j])*0.5f;
+         radius = std::max(radius, (bounds[i].b[j] - bounds[i].a[j])*0.5f);
+        }
+     uint32 d = 0;
+     real32 width = root_width;
+     while(d < max_depth && !(width*0.5f < radius)) {
+           width *= 0.5f;
+           d++;
+          }
+
+     // cell coordinates at this level
+     uint32 cell[3];
+     uint32 n_cells = (1u << d);
+     for(uint32 j = 0; j < 3; j++) {
+         real32 x = (center[j] - root_min[j])/(2.0f*width);
+         cell[j] = (x < 0.0f ? 0 : std::min(static_cast<uint32>(x), n_cells - 1));
+        }
+
+     // path
+     uint64 path = 0;
+     for(uint32 level = 0; level < d; level++) {
+         uint32 bit = d - level - 1;
+         uint64 octant = (((cell[0] >> bit) & 1) << 2) | (((cell[1] >> bit) & 1) << 1) | ((cell[2] >> bit) & 1);
+         path |= (octant << (61 - 3*level));
+        }
+     keys[i].path = path;
+     keys[i].depth = d;
+     keys[i].index = i;
+    }
+ std::sort(keys.begin(), keys.end(), [](const OctreeKey& k1, const OctreeKey& k2) {
+  if(k1.path != k2.path) return k1.path < k2.path;
+  if(k1.depth != k2.depth) return k1.depth < k2.depth;
+  return k1.index < k2.index;
+ });
+
+ //
+ // PHASE #3
+ // NODES
+ // Walk the sorted items keeping the path from the root to the current node on a stack. A
+ // node is finished when an item is not below it.
+ //
+
+ items.resize(n);
+ for(uint32 i = 0; i < n; i++) {
+     items[i].aabb.from(bounds[keys[i].index]);
+     items[i].id = (ids ? ids[keys[i].index] : keys[i].index);
+    }
+
+ struct OctreeStackItem {
+  uint32 node;
+  uint64 path;
+ };
+ OctreeStackItem stack[21];
+ uint32 size = 0;
+ auto CLOSE = [&](uint32 item_index) {
+  size--;
+  OctreeNode& node = nodes[stack[size].node];
+  node.escape = static_cast<uint32>(nodes.size());
+  node.subtree_last = item_index;
+  if(size) nodes[stack[size - 1].node].aabb.grow(node.aabb);
+ };
+ auto OPEN = [&](uint64 path, uint32 item_index) {
+  OctreeNode node;
+  node.aabb.from(std::numeric_limits<real32>::max(), -std::numeric_limits<real32>::max()); // empty
+  node.escape = 0xFFFFFFFFul;
+  node.item_first = item_index;
+  node.item_last = item_index;
+  node.subtree_last = item_index;
+  stack[size].node = static_cast<uint32>(nodes.size());
+  stack[size].path = path;
+  size++;
+  nodes.push_back(node);
+ };
+
+ nodes.reserve(n);
+ OPEN(0, 0);
+ for(uint32 i = 0; i < n; i++)
+    {
+     // close nodes that are not on the path to this item (node depth is stack size - 1)
+     uint64 path = keys[i].path;
+     uint32 d = keys[i].depth;
+     while(size > 1) {
+           uint32 depth = size - 1;
+           uint64 mask = (~0ull << (64 - 3*depth));
+           if(depth <= d && (path & mask) == stack[size - 1].path) break;
+           CLOSE(i);
+          }
+
+     // open nodes down to the item depth
+     while(size - 1 < d) {
+           uint32 depth = size;
+           OPEN(path & (~0ull << (64 - 3*depth)), i);
+          }
+
+     // add item to node (items of a node are contiguous and come before its children)
+     OctreeNode& node = nodes[stack[size - 1].node];
+     node.item_last = i + 1;
+     node.aabb.grow(items[i].aabb);
+    }
+ while(size) CLOSE(n);
+}
+
+void LooseOctree::clear(void)
+{
+ nodes.clear();
+ items.clear();
+ max_depth = 0;
+}
+
+// node_test returns 0 (outside), 1 (intersects) or 2 (inside)
+template<class T, class F>
+uint32 LooseOctree::traverse(uint32* result, uint32 max_results, T node_test, F item_test)const
+{
+ uint32 count = 0;
+ uint32 n = static_cast<uint32>(nodes.size());
+ uint32 index = 0;
+ while(index < n)
+      {
+       const OctreeNode& node = nodes[index];
+       int state = node_test(node.aabb);
+
+       // skip subtree
+       if(state == 0) {
+          index = node.escape;
+          continue;
+         }
+
+       // report subtree
+       if(state == 2) {
+          for(uint32 i = node.item_first; i < node.subtree_last; i++) {
+              if(count < max_results) result[count] = items[i].id;
+              count++;
+             }
+          index = node.escape;
+          continue;
+         }
+
+       // test items in node
+       for(uint32 i = node.item_first; i < node.item_last; i++) {
+           if(item_test(items[i].aabb)) {
+              if(count < max_results) result[count] = items[i].id;
+              count++;
+             }
+          }
+       index++;
+      }
+ return count;
+}
+
+uint32 LooseOctree::query(const AABB_minmax& aabb, uint32* result, uint32 max_results)const
+{
+ auto OVERLAP = [&aabb](const AABB_minmax& box) {
+  for(uint32 j = 0; j < 3; j++) if(box.b[j] < aabb.a[j] || aabb.b[j] < box.a[j]) return false;
+  return true;
+ };
+ auto INSIDE = [&aabb](const AABB_minmax& box) {
+  for(uint32 j = 0; j < 3; j++) if(box.a[j] < aabb.a[j] || aabb.b[j] < box.b[j]) return false;
+  return true;
+ };
+ return traverse(result, max_results, [&](const AABB_minmax& box) { return (OVERLAP(box) ? (INSIDE(box) ? 2 : 1) : 0); }, OVERLAP);
+}
+
+uint32 LooseOctree::query(const real32* center, real32 radius, uint32* result, uint32 max_results)const
+{
+ // squared distance from sphere center to closest and furthest points in box
+ real32 rr = radius*radius;
+ auto OVERLAP = [center, rr](const AABB_minmax& box) {
+  real32 d = 0.0f;
+  for(uint32 j = 0; j < 3; j++) {
+      if(center[j] < box.a[j]) d += (box.a[j] - center[j])*(box.a[j] - center[j]);
+      else if(box.b[j] < center[j]) d += (center[j] - box.b[j])*(center[j] - box.b[j]);
+     }
+  return !(rr < d);
+ };
+ auto INSIDE = [center, rr](const AABB_minmax& box) {
+  real32 d = 0.0f;
+  for(uint32 j = 0; j < 3; j++) {
+      real32 x = std::max(std::abs(center[j] - box.a[j]), std::abs(box.b[j] - center[j]));
+      d += x*x;
+     }
+  return !(rr < d);
+ };
+ return traverse(result, max_results, [&](const AABB_minmax& box) { return (OVERLAP(box) ? (INSIDE(box) ? 2 : 1) : 0); }, OVERLAP);
+}
+
+uint32 LooseOctree::query(const real32 (*planes)[4], uint32 n_planes, uint32* result, uint32 max_results)const
+{
+ // planes point inwards (inside is n*x + d >= 0), and a box is outside of a plane when its
+ // corner furthest along the normal is outside, and inside when its nearest corner is inside
+ auto CLASSIFY = [planes, n_planes](const AABB_minmax& box) {
+  int state = 2;
+  for(uint32 i = 0; i < n_planes; i++) {
+      const real32* p = planes[i];
+      real32 far_d = p[3];
+      real32 near_d = p[3];
+      for(uint32 j = 0; j < 3; j++) {
+          if(p[j] < 0.0f) {
+             far_d += p[j]*box.a[j];
+             near_d += p[j]*box.b[j];
+            }
+          else {
+             far_d += p[j]*box.b[j];
+             near_d += p[j]*box.a[j];
+            }
+         }
+      if(far_d < 0.0f) return 0;
+      if(near_d < 0.0f) state = 1;
+     }
+  return state;
+ };
+ return traverse(result, max_results, CLASSIFY, [&](const AABB_minmax& box) { return CLASSIFY(box) != 0; });
+}
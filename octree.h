@@ -0,0 +1,52 @@
+#ifndef __CS489_OCTREE_H
+#define __CS489_OCTREE_H
+
+#include "aabb.h"
+
+// Loose octree over static bounding boxes
+// Each item is stored in the cell that contains its center, at the deepest level where the
+// cell is at least as wide as the item. Loose cells are twice the size of their cell, so they
+// always contain their items, but nodes store the tight bounds of everything below them
+// instead, which cull better.
+// Nodes are stored in depth-first order and items are sorted the same way, so the items of a
+// whole subtree are a contiguous range. Queries are stackless (like the BVH) and write item
+// ids to a caller buffer, so they never allocate. A node entirely inside the query region
+// reports its whole subtree range without further tests.
+class LooseOctree {
+ private :
+  struct OctreeNode {
+   AABB_minmax aabb;     // tight bounds of items in subtree
+   uint32 escape;        // next node when skipping subtree
+   uint32 item_first;    // first item in this node
+   uint32 item_last;     // one past last item in this node
+   uint32 subtree_last;  // one past last item in subtree
+  };
+  struct OctreeItem {
+   AABB_minmax aabb;
+   uint32 id;
+  };
+ private :
+  std::vector<OctreeNode> nodes;
+  std::vector<OctreeItem> items;
+  uint32 max_depth;
+ private :
+  template<class T, class F>
+  uint32 traverse(uint32* result, uint32 max_results, T node_test, F item_test)const;
+ public :
+  void construct(const AABB_minmax* bounds, const uint32* ids, uint32 n, uint32 depth = 10);
+  void clear(void);
+ public :
+  // each query returns the number of items found, but writes at most max_results ids
+  uint32 query(const AABB_minmax& aabb, uint32* result, uint32 max_results)const;
+  uint32 query(const real32* center, real32 radius, uint32* result, uint32 max_results)const;
+  uint32 query(const real32 (*planes)[4], uint32 n_planes, uint32* result, uint32 max_results)const;
+ public :
+  uint32 n_nodes(void)const { return static_cast<uint32>(nodes.size()); }
+  uint32 n_items(void)const { return static_cast<uint32>(items.size()); }
+ public :
+  LooseOctree() : max_depth(0) {}
+  LooseOctree(const LooseOctree&) = delete;
+  void operator =(const LooseOctree&) = delete;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include "stdafx.h"
+#include "ray.h"
+#include "qbvh.h"
+
+void QBVH::construct(const BVH& bvh)
+{
+ // remove previous tree
+ clear();
+ if(!bvh.view_size) return;
+
+ // share vertices and sorted faces with binary tree
+ this->verts = bvh.verts;
+ this->faces = bvh.faces;
+ this->bounds.from(bvh.view[0].aabb);
+
+ // lambdas
+ auto IS_LEAF = [&](unsigned int index) { return (bvh.view[index].params[0] & 0x80000000ul) != 0; };
+ auto L_CHILD = [&](unsigned int index) { return index + 1; };
+ auto R_CHILD = [&](unsigned int index) { return bvh.view[index].params[1]; };
+
+ // process stack (binary node index, 4-ary node index, level)
+ struct QBVHSTACKITEM {
+  unsigned int binary_index;
+  unsigned int tree_index;
+  unsigned int level;
+ };
+ std::vector<QBVHSTACKITEM> stack;
+ tree.push_back(QBVH_node());
+ stack.push_back(QBVHSTACKITEM());
+ stack.back().binary_index = 0;
+ stack.back().tree_index = 0;
+ stack.back().level = 1;
+
+ // collapse binary tree
+ while(stack.size())
+      {
+       QBVHSTACKITEM item = stack.back();
+       stack.pop_back();
+       depth = std::max(depth, item.level);
+
+       // gather up to four children by opening the largest non-leaf candidate
+       unsigned int list[4];
+       unsigned int n = 0;
+       if(IS_LEAF(item.binary_index)) list[n++] = item.binary_index;
+       else {
+          list[n++] = L_CHILD(item.binary_index);
+          list[n++] = R_CHILD(item.binary_index);
+         }
+       while(n < 4) {
+             unsigned int best = 4;
+             real32 best_area = -1.0f;
+             for(unsigned int i = 0; i < n; i++) {
+                 if(IS_LEAF(list[i])) continue;
+                 real32 area = half_surface_area(bvh.view[list[i]].aabb);
+                 if(best_area < area) { best = i; best_area = area; }
+                }
+             if(best == 4) break;
+             unsigned int index = list[best];
+             list[best] = L_CHILD(index);
+             list[n++] = R_CHILD(index);
+            }
+
+       // set children
+       for(unsigned int i = 0; i < 4; i++)
+          {
+           QBVH_node& node = tree[item.tree_index];
+           // empty
+           if(!(i < n)) {
+              for(int j = 0; j < 3; j++) {
+                  node.bounds[0][j][i] = std::numeric_limits<real32>::max();
+                  node.bounds[1][j][i] = std::numeric_limits<real32>::lowest();
+                 }
+              node.child[i] = 0xFFFFFFFFul;
+              node.count[i] = 0;
+              continue;
+             }
+           // bounds
+           const BVH::AABB_node& src = bvh.view[list[i]];
+           for(int j = 0; j < 3; j++) {
+               node.bounds[0][j][i] = src.aabb.a[j];
+               node.bounds[1][j][i] = src.aabb.b[j];
+              }
+           // leaf
+           if(IS_LEAF(list[i])) {
+              node.child[i] = src.params[0];
+              node.count[i] = src.params[1];
+             }
+           // node
+           else {
+              unsigned int tree_index = static_cast<unsigned int>(tree.size());
+              node.child[i] = tree_index;
+              node.count[i] = 0;
+              tree.push_back(QBVH_node()); // node reference is invalid after this
+              stack.push_back(QBVHSTACKITEM());
+              stack.back().binary_index = list[i];
+              stack.back().tree_index = tree_index;
+              stack.back().level = item.level + 1;
+             }
+          }
+      }
+}
+
+bool QBVH::intersect(const real32* O, const real32* V, real32& t, uint32& visits)const
+{
+ // reciprocal of segment vector (see BVH::intersect)
+ real32 inv_V[3];
+ for(int i = 0; i < 3; i++) inv_V[i] = (V[i] != 0.0f ? inv(V[i]) : std::numeric_limits<real32>::max());
+
+ // near and far planes are chosen from the sign of the segment vector, so no min/max swapping
+ // is needed and empty children (inverted bounds) are always rejected
+ const int near_x = (inv_V[0] < 0.0f ? 1 : 0);
+ const int near_y = (inv_V[1] < 0.0f ? 1 : 0);
+ const int near_z = (inv_V[2] < 0.0f ? 1 : 0);
+
+ // splat segment
+ const __m128 Ox = _mm_set1_ps(O[0]);
+ const __m128 Oy = _mm_set1_ps(O[1]);
+ const __m128 Oz = _mm_set1_ps(O[2]);
+ const __m128 Ix = _mm_set1_ps(inv_V[0]);
+ const __m128 Iy = _mm_set1_ps(inv_V[1]);
+ const __m128 Iz = _mm_set1_ps(inv_V[2]);
+ const __m128 zero = _mm_setzero_ps();
+
+ // box padding and exit distance scale (see segment_AABB_test)
+ const real32 pad = segment_AABB_padding(bounds, O, V);
+ const __m128 pad_x = _mm_set1_ps(near_x ? pad : -pad);
+ const __m128 pad_y = _mm_set1_ps(near_y ? pad : -pad);
+ const __m128 pad_z = _mm_set1_ps(near_z ? pad : -pad);
+ const __m128 robust = _mm_set1_ps(AABB_SLAB_ROBUST);
+
+ // traversal stack (node, entry distance), where each level holds at most three siblings
+ // waiting to be popped plus the four children of the last node popped
+ struct QBVHTRAVERSAL { unsigned int index; real32 t; };
+ QBVHTRAVERSAL local[256];
+ std::unique_ptr<QBVHTRAVERSAL[]> heap;
+ QBVHTRAVERSAL* stack = local;
+ if(4*depth > 256) {
+    heap.reset(new QBVHTRAVERSAL[4*depth]);
+    stack = heap.get();
+   }
+ int size = 0;
+ stack[size].index = 0;
+ stack[size].t = 0.0f;
+ size++;
+
+ bool hit = false;
+ while(size)
+      {
+       // pop node, skipping it if it starts beyond closest hit
+       size--;
+       if(t < stack[size].t) continue;
+       const QBVH_node& node = tree[stack[size].index];
+       visits++;
+
+       // slab test all four children
+       __m128 t_min = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(node.bounds[near_x][0]), pad_x), Ox), Ix);
+       __m128 t_max = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(node.bounds[1 - near_x][0]), pad_x), Ox), Ix);
+       t_min = _mm_max_ps(t_min, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(node.bounds[near_y][1]), pad_y), Oy), Iy));
+       t_max = _mm_min_ps(t_max, _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(node.bounds[1 - near_y][1]), pad_y), Oy), Iy));
+       t_min = _mm_max_ps(t_min, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(node.bounds[near_z][2]), pad_z), Oz), Iz));
+       t_max = _mm_min_ps(t_max, _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(node.bounds[1 - near_z][2]), pad_z), Oz), Iz));
+       t_min = _mm_max_ps(t_min, zero);
+       t_max = _mm_min_ps(_mm_mul_ps(t_max, robust), _mm_set1_ps(t));
+       int mask = _mm_movemask_ps(_mm_cmple_ps(t_min, t_max));
+       if(!mask) continue;
+
+       // entry distances
+       alignas(16) real32 entry[4];
+       _mm_store_ps(entry, t_min);
+
+       // test leaves now and collect nodes
+       unsigned int list[4];
+       unsigned int n = 0;
+       for(unsigned int i = 0; i < 4; i++)
+          {
+           if(!(mask & (1 << i))) continue;
+           if(node.child[i] & 0x80000000ul) {
+              unsigned int face = (node.child[i] & 0x7FFFFFFFul);
+              unsigned int last = face + node.count[i];
+              for(; face < last; face++) {
+                  const uint32* f = &faces[3*face];
+                  real32 distance;
+                  if(ray3D_triangle_intersect(&distance, O, V, verts[f[0]].v, verts[f[1]].v, verts[f[2]].v) && !(t < distance)) {
+                     t = distance;
+                     hit = true;
+                    }
+                 }
+             }
+           else
+              list[n++] = i;
+          }
+
+       // push far to near so that nearest child is popped first
+       for(unsigned int i = 1; i < n; i++)
+           for(unsigned int j = i; j > 0 && entry[list[j - 1]] < entry[list[j]]; j--)
+               std::swap(list[j - 1], list[j]);
+       for(unsigned int i = 0; i < n; i++) {
+           stack[size].index = node.child[list[i]];
+           stack[size].t = entry[list[i]];
+           size++;
+          }
+      }
+
+ return hit;
+}
+
+void QBVH::collide(PointLinearCollisionTest& info)
+{
+ // initialize results
+ info.collide = false;
+ info.t = info.t2;
+ info.visits = 0;
+ if(tree.empty()) return;
+
+ // compute segment from timeline
+ vector3D V = (info.t2 - info.t1)*info.D;
+
+ // convert segment ratio to time
+ real32 ratio = 1.0f;
+ info.collide = intersect(info.point.v, V.v, ratio, info.visits);
+ if(info.collide) info.t = info.t1 + ratio*(info.t2 - info.t1);
+}
+
+void QBVH::collide(RayCollisionTest& info)
+{
+ info.collide = false;
+ info.t = info.t_max;
+ info.visits = 0;
+ if(tree.empty()) return;
+ info.collide = intersect(info.origin.v, info.direction.v, info.t, info.visits);
+}
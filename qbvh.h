@@ -0,0 +1,86 @@
+#ifndef __CS_QBVH_H
+#define __CS_QBVH_H
+
+#include "bvh.h"
+
+class QBVH {
+ private :
+  // four children per node with child bounds stored as SoA, so that one set of SSE slab ops
+  // tests all four children at once (two cache lines per node)
+  // child: node index, leaf (index of first face | 0x80000000), or 0xFFFFFFFF if empty
+  // count: number of faces if leaf
+  // empty children have inverted bounds so that they always fail the slab test
+  struct alignas(16) QBVH_node {
+   real32 bounds[2][3][4]; // [min/max][x/y/z][child]
+   uint32 child[4];
+   uint32 count[4];
+  };
+  std::vector<QBVH_node> tree;
+  AABB_minmax bounds; // root bounds (see segment_AABB_padding)
+  uint32 depth;       // number of node levels (sizes the traversal stack)
+  const vector3D* verts;
+  const uint32* faces;
+ private :
+  bool intersect(const real32* O, const real32* V, real32& t, uint32& visits)const;
+ public :
+  void construct(const BVH& bvh);
+  void clear();
+  size_t nodes(void)const { return tree.size(); }
+  size_t bytes(void)const { return tree.size()*sizeof(QBVH_node); }
+  uint32 levels(void)const { return depth; }
+ public :
+  void collide(PointLinearCollisionTest& info);
+  void collide(RayCollisionTest& info);
+ public :
+  QBVH& operator =(const QBVH& other) = delete;
+  QBVH& operator =(QBVH&& other);
+ public :
+  QBVH();
+  QBVH(const QBVH& other) = delete;
+  QBVH(QBVH&& other);
+ ~QBVH();
+};
+
+inline QBVH::QBVH() : depth(0), verts(nullptr), faces(nullptr)
+{
+}
+
+inline QBVH::QBVH(QBVH&& other)
+{
+ this->tree = std::move(other.tree);
+ this->bounds.from(other.bounds);
+ this->depth = other.depth;
+ this->verts = other.verts;
+ this->faces = other.faces;
+ other.depth = 0;
+ other.verts = nullptr;
+ other.faces = nullptr;
+}
+
+inline QBVH::~QBVH()
+{
+}
+
+inline QBVH& QBVH::operator =(QBVH&& other)
+{
+ if(this == &other) return *this;
+ this->tree = std::move(other.tree);
+ this->bounds.from(other.bounds);
+ this->depth = other.depth;
+ this->verts = other.verts;
+ this->faces = other.faces;
+ other.depth = 0;
+ other.verts = nullptr;
+ other.faces = nullptr;
+ return *this;
+}
+
+inline void QBVH::clear()
+{
+ this->tree.clear();
+ this->depth = 0;
+ this->verts = nullptr;
+ this->faces = nullptr;
+}
+
+#endif
@@ -24,6 +24,43 @@ inline real32 ray3D_plane_intersect_distance(real32* X, const real32* O, const r
  return -distance;
 }
 
+/** \brief   Ray-Triangle Intersection Distance.
+ *  \details Moller-Trumbore test of a ray from a point (O) along a ray vector (V) against the
+ *           two-sided triangle (A, B, C). Returns true and sets the distance (t) along V when the
+ *           ray hits the triangle in front of O. V does not have to be normalized, so if V is the
+ *           vector from one end of a line segment to the other, the segment hits when t <= 1.
+ */
+inline bool ray3D_triangle_intersect(real32* t, const real32* O, const real32* V, const real32* A, const real32* B, const real32* C)
+{
+ // triangle edges
+ real32 e1[3] = { B[0] - A[0], B[1] - A[1], B[2] - A[2] };
+ real32 e2[3] = { C[0] - A[0], C[1] - A[1], C[2] - A[2] };
+
+ // determinant is zero when ray is parallel to triangle plane
+ real32 p[3];
+ vector3D_vector_product(p, V, e2);
+ real32 det = vector3D_scalar_product(e1, p);
+ if(std::abs(det) < epsilon()) return false;
+ real32 inv_det = inv(det);
+
+ // first barycentric coordinate
+ real32 s[3] = { O[0] - A[0], O[1] - A[1], O[2] - A[2] };
+ real32 u = inv_det*vector3D_scalar_product(s, p);
+ if(u < 0.0f || u > 1.0f) return false;
+
+ // second barycentric coordinate
+ real32 q[3];
+ vector3D_vector_product(q, s, e1);
+ real32 v = inv_det*vector3D_scalar_product(V, q);
+ if(v < 0.0f || (u + v) > 1.0f) return false;
+
+ // distance along ray
+ real32 distance = inv_det*vector3D_scalar_product(e2, q);
+ if(distance < 0.0f) return false;
+ *t = distance;
+ return true;
+}
+
 #pragma endregion INTERSECTION_FUNCTIONS
 
 #endif
@@ -0,0 +1,342 @@
+#include "stdafx.h"
+#include "scene.h"
+
+uint32 SceneBVH::add_mesh(const real32* verts, uint32 n_verts, const uint32* faces, uint32 n_faces, const wchar_t* cache)
+{
+ // nothing to collide with
+ if(!verts || !n_verts) return 0xFFFFFFFFul;
+ if(!faces || !n_faces) return 0xFFFFFFFFul;
+
+ // copy vertices
+ std::unique_ptr<SceneMesh> mesh(new SceneMesh);
+ mesh->verts.resize(n_verts);
+ for(uint32 i = 0; i < n_verts; i++) mesh->verts[i].reset(verts[3*i + 0], verts[3*i + 1], verts[3*i + 2]);
+
+ // map bottom level from cache (the tree then uses the sorted faces in the cache file)
+ uint64 key = 0;
+ if(cache) {
+    key = BVHCache::hash(mesh->verts.data(), n_verts, faces, 3*n_faces);
+    if(mesh->cache.load(cache, key, mesh->tree, mesh->verts.data(), n_verts)) {
+       meshes.push_back(std::move(mesh));
+       return static_cast<uint32>(meshes.size() - 1);
+      }
+   }
+
+ // construct bottom level (construct sorts faces and the tree keeps pointers to both arrays)
+ mesh->faces.assign(faces, faces + 3*n_faces);
+ mesh->tree.construct(mesh->verts.data(), n_verts, mesh->faces.data(), 3*n_faces);
+ if(cache) BVHCache::save(cache, key, mesh->tree, n_verts);
+ meshes.push_back(std::move(mesh));
+ return static_cast<uint32>(meshes.size() - 1);
+}
+
+uint32 SceneBVH::add_instance(uint32 mesh, const real32* M, uint32 id)
+{
+ if(!(mesh < meshes.size())) return 0xFFFFFFFFul;
+ SceneInstance instance;
+ instance.id = id;
+ instance.mesh = mesh;
+ transform(instance, M);
+ instances.push_back(instance);
+ rebuild = true;
+ return static_cast<uint32>(instances.size() - 1);
+}
+
+void SceneBVH::move_instance(uint32 instance, const real32* M)
+{
+ // moving an instance only changes the top level
+ if(!(instance < instances.size())) return;
+ bool valid = instances[instance].valid;
+ transform(instances[instance], M);
+ if(valid != instances[instance].valid) rebuild = true;
+ else refit = true;
+}
+
+void SceneBVH::transform(SceneInstance& instance, const real32* M)
+{
+ // model to world and world to model (M is a row-major matrix4D, only its top three rows are used)
+ instance.mv.load(M);
+ instance.inv = instance.mv;
+ real32 det = instance.inv.invert();
+ instance.valid = (std::abs(det) > std::numeric_limits<real32>::min());
+ if(!instance.valid) return;
+
+ // sphere radius in model space (exact for rigid and uniformly scaled instances)
+ instance.inv_scale = 0.0f;
+ for(int i = 0; i < 3; i++) {
+     real32 column[3] = { instance.inv.m[i], instance.inv.m[i + 4], instance.inv.m[i + 8] };
+     instance.inv_scale = std::max(instance.inv_scale, vector3D_norm(column));
+    }
+
+ // world space bounds of model space bounds
+ const AABB_minmax& aabb = meshes[instance.mesh]->tree.view[0].aabb;
+ for(int i = 0; i < 8; i++) {
+     real32 P[3] = { (i & 1) ? aabb.b[0] : aabb.a[0], (i & 2) ? aabb.b[1] : aabb.a[1], (i & 4) ? aabb.b[2] : aabb.a[2] };
+     real32 X[3];
+     affine3D_transform_point(X, instance.mv.m, P);
+     if(i == 0) instance.aabb.from(X);
+     else instance.aabb.grow(X);
+    }
+}
+
+void SceneBVH::construct(void)
+{
+ // remove previous tree
+ tree.clear();
+
+ // instances that can be queried
+ std::vector<uint32> list;
+ list.reserve(instances.size());
+ for(uint32 i = 0; i < instances.size(); i++) if(instances[i].valid) list.push_back(i);
+ if(list.empty()) return;
+ tree.reserve(2*list.size() - 1);
+
+ // per-instance centroids
+ std::vector<vector3D> clist(instances.size());
+ for(uint32 i : list) centroid(instances[i].aabb, clist[i].v);
+
+ // median split along longest axis of centroid bounds
+ // nodes are created in depth-first order, so the left child of a node is the next node and
+ // only the right child index has to be set later
+ struct SCENESTACKITEM {
+  uint32 first;
+  uint32 last;
+  uint32 parent;
+ };
+ std::vector<SCENESTACKITEM> stack;
+ stack.push_back({ 0, static_cast<uint32>(list.size()), 0xFFFFFFFFul });
+ while(stack.size())
+      {
+       SCENESTACKITEM item = stack.back();
+       stack.pop_back();
+       uint32 index = static_cast<uint32>(tree.size());
+       tree.emplace_back();
+       if(item.parent != 0xFFFFFFFFul && index != item.parent + 1) tree[item.parent].params[1] = index;
+
+       // leaf
+       if(item.last - item.first == 1) {
+          tree[index].aabb.from(instances[list[item.first]].aabb);
+          tree[index].params[0] = list[item.first] | 0x80000000ul;
+          tree[index].params[1] = 1;
+          continue;
+         }
+
+       // bounds
+       AABB_minmax bounds(instances[list[item.first]].aabb);
+       AABB_minmax cbounds(clist[list[item.first]]);
+       for(uint32 i = item.first + 1; i < item.last; i++) {
+           bounds.grow(instances[list[i]].aabb);
+           cbounds.grow(clist[list[i]]);
+          }
+       float dv[3];
+       unsigned int axis = cbounds.dominator(dv);
+
+       // split
+       uint32 mid = (item.first + item.last)/2;
+       std::nth_element(list.begin() + item.first, list.begin() + mid, list.begin() + item.last, [&](uint32 a, uint32 b) {
+        return clist[a][axis] < clist[b][axis];
+       });
+       tree[index].aabb.from(bounds);
+       stack.push_back({ mid, item.last, index });
+       stack.push_back({ item.first, mid, index });
+      }
+
+ // escape indices (in reverse order so that right children are done first)
+ for(size_t i = tree.size(); i > 0; i--) {
+     SceneNode& node = tree[i - 1];
+     if(node.params[0] & 0x80000000ul) continue;
+     unsigned int R = node.params[1];
+     node.params[0] = ((tree[R].params[0] & 0x80000000ul) ? (R + 1) : tree[R].params[0]);
+    }
+ build_cost = cost();
+}
+
+real32 SceneBVH::cost(void)const
+{
+ // sum of interior node areas relative to root area
+ if(tree.empty()) return 0.0f;
+ real32 area = 0.0f;
+ for(size_t i = 0; i < tree.size(); i++) if(!(tree[i].params[0] & 0x80000000ul)) area += surface_area(tree[i].aabb);
+ real32 root = surface_area(tree[0].aabb);
+ return (root > 0.0f ? area/root : 0.0f);
+}
+
+void SceneBVH::update(void)
+{
+ // instances added or removed from the tree
+ if(rebuild) construct();
+
+ // instances moved (children always come after their parent, so refit in reverse order)
+ else if(refit) {
+    for(size_t i = tree.size(); i > 0; i--) {
+        SceneNode& node = tree[i - 1];
+        if(node.params[0] & 0x80000000ul) node.aabb.from(instances[node.params[0] & 0x7FFFFFFFul].aabb);
+        else node.aabb.from(tree[i].aabb, tree[node.params[1]].aabb);
+       }
+    // instances that moved far apart make refit boxes overlap, so rebuild when the tree is
+    // much worse than when it was built (top level rebuilds are cheap)
+    if(cost() > 1.5f*build_cost) construct();
+   }
+
+ rebuild = false;
+ refit = false;
+}
+
+void SceneBVH::clear(void)
+{
+ meshes.clear();
+ instances.clear();
+ tree.clear();
+ build_cost = 0.0f;
+ rebuild = false;
+ refit = false;
+}
+
+template<class F>
+void SceneBVH::traverse(const real32* O, const real32* V, real32 radius, const real32& t, uint32& visits, F leaf)const
+{
+ // reciprocal of segment vector
+ real32 inv_V[3];
+ for(int i = 0; i < 3; i++) inv_V[i] = (V[i] != 0.0f ? inv(V[i]) : std::numeric_limits<real32>::max());
+
+ // stackless traversal of instance bounds (inflated by radius for spheres), where t is the
+ // closest hit so far and is updated by the leaf function
+ const real32 pad = segment_AABB_padding(tree[0].aabb, O, V);
+ unsigned int index = 0;
+ const unsigned int n_nodes = static_cast<unsigned int>(tree.size());
+ while(index < n_nodes)
+      {
+       const SceneNode& node = tree[index];
+       bool is_leaf = ((node.params[0] & 0x80000000ul) != 0);
+       visits++;
+       AABB_minmax aabb(node.aabb);
+       for(int i = 0; i < 3; i++) {
+           aabb.a[i] -= radius;
+           aabb.b[i] += radius;
+          }
+       if(!segment_AABB_test(aabb, O, inv_V, t, pad)) {
+          index = (is_leaf ? index + 1 : node.params[0]);
+          continue;
+         }
+       if(is_leaf) leaf(node.params[0] & 0x7FFFFFFFul);
+       index++;
+      }
+}
+
+void SceneBVH::collide(PointLinearCollisionTest& info, uint32* id)
+{
+ // initialize results
+ info.collide = false;
+ info.t = info.t2;
+ info.visits = 0;
+ update();
+ if(tree.empty()) return;
+
+ // segment
+ const real32* O = info.point.v;
+ vector3D V = (info.t2 - info.t1)*info.D;
+
+ // segment ratio is the same in model space
+ real32 ratio = 1.0f;
+ uint32 hit = 0xFFFFFFFFul;
+ traverse(O, V.v, 0.0f, ratio, info.visits, [&](uint32 k) {
+  const SceneInstance& instance = instances[k];
+  real32 local_O[3];
+  real32 local_V[3];
+  affine3D_transform_point(local_O, instance.inv.m, O);
+  affine3D_transform_vector(local_V, instance.inv.m, V.v);
+  if(meshes[instance.mesh]->tree.intersect(local_O, local_V, ratio, info.visits)) hit = k;
+ });
+
+ // convert segment ratio to time
+ if(hit == 0xFFFFFFFFul) return;
+ info.collide = true;
+ info.t = info.t1 + ratio*(info.t2 - info.t1);
+ if(id) *id = instances[hit].id;
+}
+
+void SceneBVH::collide(RayCollisionTest& info, uint32* id)
+{
+ // initialize results
+ info.collide = false;
+ info.t = info.t_max;
+ info.visits = 0;
+ update();
+ if(tree.empty()) return;
+
+ // distance along direction is the same in model space
+ const real32* O = info.origin.v;
+ const real32* V = info.direction.v;
+ uint32 hit = 0xFFFFFFFFul;
+ traverse(O, V, 0.0f, info.t, info.visits, [&](uint32 k) {
+  const SceneInstance& instance = instances[k];
+  real32 local_O[3];
+  real32 local_V[3];
+  affine3D_transform_point(local_O, instance.inv.m, O);
+  affine3D_transform_vector(local_V, instance.inv.m, V);
+  if(meshes[instance.mesh]->tree.intersect(local_O, local_V, info.t, info.visits)) hit = k;
+ });
+
+ if(hit == 0xFFFFFFFFul) return;
+ info.collide = true;
+ if(id) *id = instances[hit].id;
+}
+
+void SceneBVH::collide(SphereLinearCollisionTest& info, uint32* id)
+{
+ // initialize results
+ info.collide = false;
+ info.t = info.t2;
+ info.visits = 0;
+ update();
+ if(tree.empty()) return;
+
+ // sweep vector over time interval
+ const real32* O = info.S.center;
+ vector3D V = (info.t2 - info.t1)*info.D;
+
+ // sweep in model space (sweep ratio is the same in model space)
+ real32 ratio = 1.0f;
+ uint32 hit = 0xFFFFFFFFul;
+ uint32 triangle = 0;
+ real32 contact[3];
+ traverse(O, V.v, info.S.radius, ratio, info.visits, [&](uint32 k) {
+  const SceneInstance& instance = instances[k];
+  real32 local_O[3];
+  real32 local_V[3];
+  affine3D_transform_point(local_O, instance.inv.m, O);
+  affine3D_transform_vector(local_V, instance.inv.m, V.v);
+  real32 radius = info.S.radius*instance.inv_scale;
+  if(meshes[instance.mesh]->tree.sweep(local_O, radius, local_V, ratio, contact, triangle, info.visits)) hit = k;
+ });
+
+ // convert sweep ratio to time
+ if(hit == 0xFFFFFFFFul) return;
+ const SceneInstance& instance = instances[hit];
+ info.collide = true;
+ info.t = info.t1 + ratio*(info.t2 - info.t1);
+ affine3D_transform_point(info.contact.v, instance.mv.m, contact);
+ if(id) *id = instance.id;
+
+ // normal points from contact point to sphere center at time of impact
+ vector3D center(O[0] + ratio*V[0], O[1] + ratio*V[1], O[2] + ratio*V[2]);
+ info.normal = center - info.contact;
+ real32 norm = length(info.normal);
+ if(norm > epsilon()) {
+    info.normal *= inv(norm);
+    return;
+   }
+
+ // center is on the triangle, so use the triangle normal facing against the motion
+ const SceneMesh& mesh = *meshes[instance.mesh];
+ const uint32* f = &mesh.tree.faces[3*triangle];
+ vector3D N = vector_product(mesh.verts[f[1]] - mesh.verts[f[0]], mesh.verts[f[2]] - mesh.verts[f[0]]);
+ affine3D_transform_normal(info.normal.v, instance.inv.m, N.v);
+ if(squared_norm(info.normal) < epsilon()) info.normal = -V;
+ if(squared_norm(info.normal) < epsilon()) {
+    info.normal.reset(0.0f, 0.0f, 0.0f);
+    return;
+   }
+ info.normal = unit(info.normal);
+ if(scalar_product(info.normal, V) > 0.0f) info.normal = -info.normal;
+}
@@ -0,0 +1,73 @@
+#ifndef __CS489_SCENE_H
+#define __CS489_SCENE_H
+
+#include "affine3.h"
+#include "bvh.h"
+#include "bvhcache.h"
+
+// Two-level collision structure
+// bottom level: one BVH per collision mesh (in model space), shared by all of its instances
+// top level: one BVH over the world space bounds of all instances
+// queries are transformed into model space by the inverse instance matrix, and since segment
+// and ray parameters do not change under affine transforms, times of impact do not either
+class SceneBVH {
+ private :
+  struct SceneMesh {
+   std::vector<vector3D> verts;
+   std::vector<uint32> faces; // sorted faces (empty if tree is mapped from cache)
+   BVH tree;
+   BVHCache cache;
+  };
+  struct SceneInstance {
+   uint32 id;         // user data returned by queries
+   uint32 mesh;       // index of collision mesh
+   affine3D mv;       // model to world
+   affine3D inv;      // world to model
+   real32 inv_scale;  // largest scale of world to model (for sphere radius)
+   bool valid;        // false if matrix is not invertible
+   AABB_minmax aabb;  // world space bounds
+  };
+  // same layout as BVH nodes (leaf: params[0] = instance | 0x80000000, params[1] = 1)
+  struct SceneNode {
+   AABB_minmax aabb;
+   unsigned int params[2];
+  };
+ private :
+  std::vector<std::unique_ptr<SceneMesh>> meshes;
+  std::vector<SceneInstance> instances;
+  std::vector<SceneNode> tree;
+  real32 build_cost;
+  bool rebuild;
+  bool refit;
+ private :
+  void transform(SceneInstance& instance, const real32* M);
+  void construct(void);
+  real32 cost(void)const;
+  template<class F>
+  void traverse(const real32* O, const real32* V, real32 radius, const real32& t, uint32& visits, F leaf)const;
+ public :
+  uint32 add_mesh(const real32* verts, uint32 n_verts, const uint32* faces, uint32 n_faces, const wchar_t* cache = nullptr);
+  uint32 add_instance(uint32 mesh, const real32* M, uint32 id);
+  void move_instance(uint32 instance, const real32* M);
+  void update(void);
+  void clear(void);
+ public :
+  uint32 n_meshes(void)const { return static_cast<uint32>(meshes.size()); }
+  uint32 n_instances(void)const { return static_cast<uint32>(instances.size()); }
+  size_t nodes(void)const { return tree.size(); }
+  uint32 instance_id(uint32 instance)const { return instances[instance].id; }
+ public :
+  void collide(PointLinearCollisionTest& info, uint32* id = nullptr);
+  void collide(RayCollisionTest& info, uint32* id = nullptr);
+  void collide(SphereLinearCollisionTest& info, uint32* id = nullptr);
+ public :
+  SceneBVH();
+  SceneBVH(const SceneBVH&) = delete;
+  void operator =(const SceneBVH&) = delete;
+};
+
+inline SceneBVH::SceneBVH() : build_cost(0.0f), rebuild(false), refit(false)
+{
+}
+
+#endif
@@ -35,7 +35,7 @@ cbuffer permdl : register(b1)
 
 cbuffer perfrm : register(b2)
 {
- matrix mskin[512];
+ row_major float3x4 mskin[512]; // affine bone matrices (three rows of four, 48 bytes each)
 };
  
 PShaderInput VS(VShaderInput input)
@@ -48,7 +48,7 @@ PShaderInput VS(VShaderInput input)
 
  float3 pos = float3(0.0f, 0.0f, 0.0f);
  for(int i = 0; i < 4; ++i)	{
-     pos += weights[i]*mul(mskin[input.bi[i]], input.position).xyz;
+     pos += weights[i]*mul(mskin[input.bi[i]], input.position);
     }
 
  PShaderInput psi;
@@ -24,6 +24,15 @@
 #ifndef __STDAFX_H
 #define __STDAFX_H
 
+//
+// Headless Builds
+//
+// Tools that only use the math and collision code (such as testing/Benchmark on Linux) define
+// CS489_HEADLESS to build without Windows, Direct3D, or Boost.
+//
+
+#ifdef _WIN32
+
 //
 // Windows Version
 //
@@ -59,6 +68,8 @@
 #pragma comment(lib, "xaudio2.lib")
 #pragma comment(lib, "xinput9_1_0.lib")
 
+#endif
+
 //
 // Standard Headers
 //
@@ -72,6 +83,7 @@
 #include<algorithm>
 #include<limits>
 #include<string>
+#include<cstring>
 #include<vector>
 #include<array>
 #include<deque>
@@ -81,13 +93,26 @@
 #include<map>
 #include<set>
 #include<regex>
+#include<functional>
+#include<thread>
+#include<atomic>
+#include<mutex>
+#include<condition_variable>
 #endif
 
 //
-// Boost Headers
+// SIMD Headers
 //
 
 #ifndef RC_INVOKED
+#include<immintrin.h>
+#endif
+
+//
+// Boost Headers
+//
+
+#if !defined(RC_INVOKED) && !defined(CS489_HEADLESS)
 #define BOOST_CONFIG_SUPPRESS_OUTDATED_MESSAGE 
 #include<boost/algorithm/string.hpp>
 #include<boost/algorithm/string/classification.hpp>
@@ -104,7 +129,7 @@
 /// \headerfile d3d11.h <d3d11.h>
 /// \headerfile dxgi.h <dxgi.h>
 /// \headerfile DirectXMath.h <DirectXMath.h>
-#ifndef RC_INVOKED
+#if !defined(RC_INVOKED) && !defined(CS489_HEADLESS)
 #include<d3d11.h>
 #include<dxgi.h>
 #include<DirectXMath.h>
@@ -134,14 +159,24 @@ typedef char16_t char16;
 typedef char32_t char32;
 
 // string types
+#ifdef _WIN32
 typedef std::basic_string<TCHAR> STDTSTRING;
 typedef std::basic_string<CHAR>  STDSTRINGA;
 typedef std::basic_string<WCHAR> STDSTRINGW;
+#else
+typedef std::basic_string<char>    STDSTRINGA;
+typedef std::basic_string<wchar_t> STDSTRINGW;
+#endif
 
 // stringstream types
+#ifdef _WIN32
 typedef std::basic_stringstream<TCHAR> STDTSTRINGSTREAM;
 typedef std::basic_stringstream<CHAR>  STDSTRINGSTREAMA;
 typedef std::basic_stringstream<WCHAR> STDSTRINGSTREAMW;
+#else
+typedef std::basic_stringstream<char>    STDSTRINGSTREAMA;
+typedef std::basic_stringstream<wchar_t> STDSTRINGSTREAMW;
+#endif
 
 //
 // BYTE ORDER FUNCTIONS
@@ -190,11 +225,13 @@ struct WideStringHash {
  *           string sorting so we have to provide function objects (or lambdas)
  *           to do it ourselves.
  */
+#ifdef _WIN32
 struct WideStringInsensitiveEqual {
  bool operator ()(const std::wstring& s1, const std::wstring& s2)const {
   return _wcsicmp(s1.c_str(), s2.c_str()) == 0;
  }
 };
+#endif
 
 STDSTRINGA ConvertUTF16ToUTF8(const wchar_t* str);
 STDSTRINGW ConvertUTF8ToUTF16(const char* str);
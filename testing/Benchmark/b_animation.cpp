@@ -0,0 +1,180 @@
+#include "../../stdafx.h"
+#include "../../animation.h"
+#include "bench.h"
+
+// skinning palette as computed before keyframe lookup was shared by all bones (every bone scans
+// the keyframes from the start to find the interval that contains time)
+static void ScanAnimationPose(const std::vector<MeshBone>& bones, const MeshAnimation& animation, real32 time, affine3D* palette)
+{
+ affine3D m;
+ size_t n_keys = animation.keyset.size();
+ for(size_t bi = 0; bi < bones.size(); bi++)
+    {
+     if(time <= animation.animdata[0].delta) {
+        auto& kf = animation.animdata[0];
+        m.load_transform(&kf.slist[bi][0], &kf.qlist[bi][0], &kf.tlist[bi][0]);
+        palette[bi] = bones[bi].m_abs * m;
+       }
+     else if(time >= animation.animdata[n_keys - 1].delta) {
+        auto& kf = animation.animdata[n_keys - 1];
+        m.load_transform(&kf.slist[bi][0], &kf.qlist[bi][0], &kf.tlist[bi][0]);
+        palette[bi] = bones[bi].m_abs * m;
+       }
+     else {
+        for(size_t ki = 0; ki < (n_keys - 1); ki++) {
+            auto& kf1 = animation.animdata[ki];
+            auto& kf2 = animation.animdata[ki + 1];
+            if((time >= kf1.delta) && (time < kf2.delta)) {
+               real32 ratio = (time - kf1.delta)/(kf2.delta - kf1.delta);
+               real32 S[3], T[3], Q[4];
+               lerp3D(S, &kf1.slist[bi][0], &kf2.slist[bi][0], ratio);
+               lerp3D(T, &kf1.tlist[bi][0], &kf2.tlist[bi][0], ratio);
+               qslerp(Q, &kf1.qlist[bi][0], &kf2.qlist[bi][0], ratio);
+               qnormalize(Q);
+               real32 ST[3] = { S[0]*T[0], S[1]*T[1], S[2]*T[2] };
+               m.load_transform(S, Q, ST);
+               palette[bi] = bones[bi].m_abs * m;
+               break;
+              }
+           }
+       }
+    }
+ for(size_t bi = 1; bi < bones.size(); bi++) {
+     uint32 parent = bones[bi].parent;
+     palette[bi] = (palette[parent] * bones[parent].m_inv) * palette[bi];
+    }
+ for(size_t bi = 0; bi < bones.size(); bi++) palette[bi] = palette[bi] * bones[bi].m_inv;
+}
+
+// largest difference relative to the size of the reference value
+static real32 MaxPoseError(const affine3D* x, const affine3D* ref, uint32 n_bones)
+{
+ real32 error = 0.0f;
+ for(uint32 bi = 0; bi < n_bones; bi++)
+     for(uint32 i = 0; i < 12; i++) error = std::max(error, std::abs(x[bi][i] - ref[bi][i])/std::max(1.0f, std::abs(ref[bi][i])));
+ return error;
+}
+
+// advance time like MeshInstance::SetTime does for looping animations
+static real32 AdvanceAnimationTime(real32 time, real32 dt, real32 duration)
+{
+ time += dt;
+ if(time > duration) while(!(time < duration)) time -= duration;
+ return time;
+}
+
+// instances of one animation updated at 60 Hz, each starting at a different time
+static bool AnimationTest(const BenchSkeleton& skeleton, const MeshAnimation& animation, uint32 n_queries)
+{
+ const uint32 n_instances = 64;
+ const real32 dt = 1.0f/60.0f;
+ uint32 n_steps = std::max(16u, n_queries/10000);
+ uint32 n_bones = static_cast<uint32>(skeleton.bones.size());
+ uint32 n_keys = static_cast<uint32>(animation.keymap.size());
+ if(!n_keys) return true;
+
+ std::vector<real32> start(n_instances);
+ for(uint32 i = 0; i < n_instances; i++) start[i] = BenchRandom(0.0f, animation.duration);
+ std::vector<affine3D> palette(n_bones);
+ std::vector<affine3D> reference(n_bones);
+
+ // verify that shared lookups give the same palettes as the per-bone scan (up to rounding, since
+ // keyframe hits and bones that do not move use the bone matrices baked at load)
+ uint32 mismatches = 0;
+ real32 max_error = 0.0f;
+ for(uint32 i = 0; i < n_instances; i++) {
+     real32 time = start[i];
+     uint32 cursor = 0;
+     for(uint32 step = 0; step < n_steps; step++) {
+         ScanAnimationPose(skeleton.bones, animation, time, reference.data());
+         ComputeAnimationPose(skeleton.bones, animation, time, cursor, palette.data());
+         real32 error = MaxPoseError(palette.data(), reference.data(), n_bones);
+         uint32 search = n_keys; // out of range cursor forces a binary search
+         ComputeAnimationPose(skeleton.bones, animation, time, search, palette.data());
+         error = std::max(error, MaxPoseError(palette.data(), reference.data(), n_bones));
+         if(error > 1.0e-4f) mismatches++;
+         max_error = std::max(max_error, error);
+         time = AdvanceAnimationTime(time, dt, animation.duration);
+        }
+    }
+
+ // per-bone scan
+ real32 checksum = 0.0f;
+ double t0 = BenchTime();
+ for(uint32 i = 0; i < n_instances; i++) {
+     real32 time = start[i];
+     for(uint32 step = 0; step < n_steps; step++) {
+         ScanAnimationPose(skeleton.bones, animation, time, palette.data());
+         checksum += palette[n_bones - 1][0x3];
+         time = AdvanceAnimationTime(time, dt, animation.duration);
+        }
+    }
+ double scan_time = BenchTime() - t0;
+
+ // binary search every update
+ t0 = BenchTime();
+ for(uint32 i = 0; i < n_instances; i++) {
+     real32 time = start[i];
+     for(uint32 step = 0; step < n_steps; step++) {
+         uint32 search = n_keys;
+         ComputeAnimationPose(skeleton.bones, animation, time, search, palette.data());
+         checksum += palette[n_bones - 1][0x3];
+         time = AdvanceAnimationTime(time, dt, animation.duration);
+        }
+    }
+ double search_time = BenchTime() - t0;
+
+ // cursor kept by each instance
+ t0 = BenchTime();
+ for(uint32 i = 0; i < n_instances; i++) {
+     real32 time = start[i];
+     uint32 cursor = 0;
+     for(uint32 step = 0; step < n_steps; step++) {
+         ComputeAnimationPose(skeleton.bones, animation, time, cursor, palette.data());
+         checksum += palette[n_bones - 1][0x3];
+         time = AdvanceAnimationTime(time, dt, animation.duration);
+        }
+    }
+ double cursor_time = BenchTime() - t0;
+
+ // microseconds per instance update
+ double n_updates = static_cast<double>(n_instances)*n_steps;
+ std::string name(animation.name.begin(), animation.name.end());
+ std::cout << " " << name << ": " << n_bones << " bones, " << n_keys << " keys" << std::endl;
+ std::cout << "  scan = " << (1.0e6*scan_time/n_updates) << " us/update, ";
+ std::cout << "binary search = " << (1.0e6*search_time/n_updates) << " us/update (speedup = " << (scan_time/search_time) << "), ";
+ std::cout << "cursor = " << (1.0e6*cursor_time/n_updates) << " us/update (speedup = " << (scan_time/cursor_time) << ")" << std::endl;
+ std::cout << "  max error = " << max_error << ", mismatches = " << mismatches << " (checksum = " << checksum << ")" << std::endl;
+ return (mismatches == 0);
+}
+
+bool AnimationBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries)
+{
+ // skeletons of models that have bones
+ std::vector<BenchSkeleton> skeletons;
+ LoadBenchSkeletons(meshes, skeletons);
+ if(skeletons.empty()) {
+    std::cout << "animation: no models with bones" << std::endl;
+    return true;
+   }
+
+ // animations from model files
+ bool passed = true;
+ BenchSeed(0x489ul);
+ for(auto& skeleton : skeletons) {
+     std::cout << "animation: " << skeleton.name << std::endl;
+     for(auto& animation : skeleton.animations) passed &= AnimationTest(skeleton, animation, n_queries);
+    }
+
+ // long animations on the largest skeleton
+ size_t largest = 0;
+ for(size_t i = 1; i < skeletons.size(); i++) if(skeletons[largest].bones.size() < skeletons[i].bones.size()) largest = i;
+ std::cout << "animation: " << skeletons[largest].name << " (generated)" << std::endl;
+ const uint32 n_keys[] = { 100, 400, 1600 };
+ for(uint32 keys : n_keys) {
+     MeshAnimation animation;
+     MakeBenchAnimation(skeletons[largest], keys, animation);
+     passed &= AnimationTest(skeletons[largest], animation, n_queries);
+    }
+ return passed;
+}
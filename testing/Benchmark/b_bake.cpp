@@ -0,0 +1,176 @@
+#include "../../stdafx.h"
+#include "../../animation.h"
+#include "bench.h"
+
+// skinning palette as computed before bone matrices were baked (every bone is interpolated from
+// scale, quaternion, and translation keys on every update)
+static void InterpolateAnimationPose(const std::vector<MeshBone>& bones, const MeshAnimation& animation, real32 time, uint32& cursor, affine3D* palette)
+{
+ affine3D m;
+ size_t n_keys = animation.keymap.size();
+ if(time <= animation.animdata[0].delta || time >= animation.animdata[n_keys - 1].delta) {
+    cursor = (time <= animation.animdata[0].delta ? 0 : static_cast<uint32>(n_keys - 1));
+    auto& kf = animation.animdata[cursor];
+    for(size_t bi = 0; bi < bones.size(); bi++) {
+        m.load_transform(&kf.slist[bi][0], &kf.qlist[bi][0], &kf.tlist[bi][0]);
+        palette[bi] = bones[bi].m_abs * m;
+       }
+   }
+ else {
+    cursor = FindAnimationKey(animation, time, cursor);
+    auto& kf1 = animation.animdata[cursor];
+    auto& kf2 = animation.animdata[cursor + 1];
+    real32 ratio = (time - kf1.delta)/(kf2.delta - kf1.delta);
+    for(size_t bi = 0; bi < bones.size(); bi++) {
+        real32 S[3], T[3], Q[4];
+        lerp3D(S, &kf1.slist[bi][0], &kf2.slist[bi][0], ratio);
+        lerp3D(T, &kf1.tlist[bi][0], &kf2.tlist[bi][0], ratio);
+        qslerp(Q, &kf1.qlist[bi][0], &kf2.qlist[bi][0], ratio);
+        qnormalize(Q);
+        real32 ST[3] = { S[0]*T[0], S[1]*T[1], S[2]*T[2] };
+        m.load_transform(S, Q, ST);
+        palette[bi] = bones[bi].m_abs * m;
+       }
+   }
+ for(size_t bi = 1; bi < bones.size(); bi++) {
+     uint32 parent = bones[bi].parent;
+     palette[bi] = (palette[parent] * bones[parent].m_inv) * palette[bi];
+    }
+ for(size_t bi = 0; bi < bones.size(); bi++) palette[bi] = palette[bi] * bones[bi].m_inv;
+}
+
+// instances playing one animation at 60 Hz (or every keyframe time in turn if keys is set)
+struct BakePlayback {
+ std::vector<real32> start;
+ uint32 n_steps;
+ bool keys;
+};
+
+static real32 NextBakeTime(const MeshAnimation& animation, const BakePlayback& playback, uint32 instance, uint32 step)
+{
+ if(playback.keys) return animation.animdata[(instance + step) % animation.keymap.size()].delta;
+ real32 time = playback.start[instance] + static_cast<real32>(step)/60.0f;
+ return std::fmod(time, animation.duration);
+}
+
+// seconds per pose, and largest palette difference from InterpolateAnimationPose
+static double PlayBakeTest(const BenchSkeleton& skeleton, const MeshAnimation& animation, const BakePlayback& playback, bool reference, real32& error, real32& checksum)
+{
+ uint32 n_bones = static_cast<uint32>(skeleton.bones.size());
+ std::vector<affine3D> palette(n_bones);
+ std::vector<affine3D> expected(n_bones);
+ uint32 n_instances = static_cast<uint32>(playback.start.size());
+
+ // compare
+ error = 0.0f;
+ for(uint32 i = 0; i < n_instances; i++) {
+     uint32 cursor1 = 0;
+     uint32 cursor2 = 0;
+     for(uint32 step = 0; step < playback.n_steps; step++) {
+         real32 time = NextBakeTime(animation, playback, i, step);
+         InterpolateAnimationPose(skeleton.bones, animation, time, cursor1, expected.data());
+         if(reference) InterpolateAnimationPose(skeleton.bones, animation, time, cursor2, palette.data());
+         else ComputeAnimationPose(skeleton.bones, animation, time, cursor2, palette.data());
+         for(uint32 bi = 0; bi < n_bones; bi++)
+             for(uint32 j = 0; j < 12; j++) error = std::max(error, std::abs(palette[bi][j] - expected[bi][j])/std::max(1.0f, std::abs(expected[bi][j])));
+        }
+    }
+
+ // time
+ double t0 = BenchTime();
+ for(uint32 i = 0; i < n_instances; i++) {
+     uint32 cursor = 0;
+     for(uint32 step = 0; step < playback.n_steps; step++) {
+         real32 time = NextBakeTime(animation, playback, i, step);
+         if(reference) InterpolateAnimationPose(skeleton.bones, animation, time, cursor, palette.data());
+         else ComputeAnimationPose(skeleton.bones, animation, time, cursor, palette.data());
+         checksum += palette[n_bones - 1][0x3];
+        }
+    }
+ double dt = BenchTime() - t0;
+ return dt/(static_cast<double>(n_instances)*playback.n_steps);
+}
+
+static bool BakeTest(const BenchSkeleton& skeleton, MeshAnimation& animation, uint32 n_queries)
+{
+ // playback
+ BakePlayback playback;
+ playback.start.resize(64);
+ for(auto& t : playback.start) t = BenchRandom(0.0f, animation.duration);
+ playback.n_steps = std::max(16u, n_queries/10000);
+ playback.keys = false;
+ double ns = 1.0e9/skeleton.bones.size();
+
+ // count bones that are held between keys
+ size_t n_held = 0;
+ size_t n_keys = animation.keymap.size();
+ for(size_t k = 0; k + 1 < n_keys; k++)
+     for(size_t bi = 0; bi < skeleton.bones.size(); bi++) if(animation.animdata[k].held[bi]) n_held++;
+ double held = (n_keys > 1 ? 100.0*n_held/((n_keys - 1)*skeleton.bones.size()) : 0.0);
+
+ std::string name(animation.name.begin(), animation.name.end());
+ std::cout << " " << name << ": " << skeleton.bones.size() << " bones, " << n_keys << " keys, " << held << "% held" << std::endl;
+
+ // interpolated (before baking) and with baked keyframes
+ real32 error = 0.0f;
+ real32 checksum = 0.0f;
+ double ref_time = PlayBakeTest(skeleton, animation, playback, true, error, checksum);
+ double key_time = PlayBakeTest(skeleton, animation, playback, false, error, checksum);
+ std::cout << "  interpolated = " << (ns*ref_time) << " ns/bone, baked keys = " << (ns*key_time) << " ns/bone (speedup = " << (ref_time/key_time) << ", error = " << error << ")" << std::endl;
+ bool passed = (error < 1.0e-4f);
+
+ // keyframe hits
+ playback.keys = true;
+ double ref_hits = PlayBakeTest(skeleton, animation, playback, true, error, checksum);
+ double key_hits = PlayBakeTest(skeleton, animation, playback, false, error, checksum);
+ std::cout << "  keyframe hits: interpolated = " << (ns*ref_hits) << " ns/bone, baked keys = " << (ns*key_hits) << " ns/bone (speedup = " << (ref_hits/key_hits) << ", error = " << error << ")" << std::endl;
+ passed &= (error < 1.0e-4f);
+ playback.keys = false;
+
+ // stepped
+ animation.stepped = true;
+ double step_time = PlayBakeTest(skeleton, animation, playback, false, error, checksum);
+ std::cout << "  stepped = " << (ns*step_time) << " ns/bone (speedup = " << (ref_time/step_time) << ")" << std::endl;
+ animation.stepped = false;
+
+ // baked poses
+ const real32 rates[] = { 30.0f, 60.0f, 120.0f };
+ for(real32 rate : rates) {
+     BakeAnimationPoses(animation, skeleton.bones, rate);
+     double pose_time = PlayBakeTest(skeleton, animation, playback, false, error, checksum);
+     size_t bytes = animation.n_poses*skeleton.bones.size()*sizeof(affine3D);
+     std::cout << "  " << rate << " poses/sec = " << (ns*pose_time) << " ns/bone (speedup = " << (ref_time/pose_time) << ", error = " << error << ", " << (bytes/1024) << " KB)" << std::endl;
+     BakeAnimationPoses(animation, skeleton.bones, 0.0f);
+    }
+ std::cout << "  checksum = " << checksum << std::endl;
+
+ return passed;
+}
+
+bool BakeBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries)
+{
+ // skeletons of models that have bones
+ std::vector<BenchSkeleton> skeletons;
+ LoadBenchSkeletons(meshes, skeletons);
+ if(skeletons.empty()) {
+    std::cout << "bake: no models with bones" << std::endl;
+    return true;
+   }
+
+ // animations from model files
+ bool passed = true;
+ BenchSeed(0x489ul);
+ for(auto& skeleton : skeletons) {
+     std::cout << "bake: " << skeleton.name << std::endl;
+     for(auto& animation : skeleton.animations) passed &= BakeTest(skeleton, animation, n_queries);
+    }
+
+ // long animation on the largest skeleton
+ size_t largest = 0;
+ for(size_t i = 1; i < skeletons.size(); i++) if(skeletons[largest].bones.size() < skeletons[i].bones.size()) largest = i;
+ std::cout << "bake: " << skeletons[largest].name << " (generated)" << std::endl;
+ MeshAnimation animation;
+ MakeBenchAnimation(skeletons[largest], 100, animation);
+ passed &= BakeTest(skeletons[largest], animation, n_queries);
+ return passed;
+}
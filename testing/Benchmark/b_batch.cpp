@@ -0,0 +1,168 @@
+#include "../../stdafx.h"
+#include "../../collision.h"
+#include "bench.h"
+
+// random OBB (orthonormal axes from a random quaternion)
+static void RandomOBB(OBB& box, real32 size)
+{
+ real32 q[4] = { BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f) };
+ real32 norm = std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+ if(norm < 1.0e-3f) { q[0] = 1.0f; q[1] = q[2] = q[3] = 0.0f; norm = 1.0f; }
+ for(int i = 0; i < 4; i++) q[i] /= norm;
+ real32 w = q[0], x = q[1], y = q[2], z = q[3];
+ box.x[0] = 1.0f - 2.0f*(y*y + z*z); box.x[1] = 2.0f*(x*y + w*z); box.x[2] = 2.0f*(x*z - w*y);
+ box.y[0] = 2.0f*(x*y - w*z); box.y[1] = 1.0f - 2.0f*(x*x + z*z); box.y[2] = 2.0f*(y*z + w*x);
+ box.z[0] = 2.0f*(x*z + w*y); box.z[1] = 2.0f*(y*z - w*x); box.z[2] = 1.0f - 2.0f*(x*x + y*y);
+ for(int i = 0; i < 3; i++) {
+     box.center[i] = BenchRandom(-size, size);
+     box.widths[i] = BenchRandom(0.0f, 0.25f*size);
+    }
+ box.center[3] = box.x[3] = box.y[3] = box.z[3] = box.widths[3] = 0.0f;
+}
+
+// points and spheres near boxes, including points exactly on box faces, edges and corners
+static void RandomPoint(const OBB& box, real32 size, real32* p)
+{
+ uint32 type = static_cast<uint32>(BenchRandom(0.0f, 3.0f));
+ if(type == 0) {
+    for(int i = 0; i < 3; i++) p[i] = BenchRandom(-size, size);
+    return;
+   }
+ real32 s[3];
+ for(int i = 0; i < 3; i++) {
+     if(type == 1) s[i] = BenchRandom(-1.5f, 1.5f);
+     else s[i] = static_cast<real32>(static_cast<int>(BenchRandom(-1.0f, 2.0f)));
+     s[i] = std::max(-1.0f, std::min(1.0f, s[i]))*box.widths[i];
+    }
+ for(int i = 0; i < 3; i++) p[i] = box.center[i] + s[0]*box.x[i] + s[1]*box.y[i] + s[2]*box.z[i];
+}
+
+bool BatchBenchmark(const std::vector<BenchMesh>&, uint32 n_queries)
+{
+ //
+ // EQUIVALENCE TEST
+ // Every point and sphere is tested against every box, both ways.
+ //
+
+ const real32 size = 10.0f;
+ const uint32 n_boxes = 1001;
+ const uint32 n_points = 517;
+ BenchSeed(0x489ul);
+ std::vector<OBB> obbs(n_boxes);
+ std::vector<AABB_halfdim> aabbs(n_boxes);
+ for(uint32 i = 0; i < n_boxes; i++) {
+     RandomOBB(obbs[i], size);
+     for(int j = 0; j < 3; j++) {
+         aabbs[i].center[j] = obbs[i].center[j];
+         aabbs[i].widths[j] = obbs[i].widths[j];
+        }
+    }
+ std::vector<std::array<real32, 3>> points(n_points);
+ std::vector<BV_sphere> spheres(n_points);
+ for(uint32 i = 0; i < n_points; i++) {
+     RandomPoint(obbs[i % n_boxes], size, points[i].data());
+     RandomPoint(obbs[(7*i) % n_boxes], size, spheres[i].center);
+     spheres[i].radius = (i % 5 == 0 ? 0.0f : BenchRandom(0.0f, 0.2f*size));
+    }
+ const float (*P)[3] = reinterpret_cast<const float (*)[3]>(points.data());
+
+ OBB_batch obb_batch;
+ AABB_batch aabb_batch;
+ OBB_batch_pack(obb_batch, obbs.data(), n_boxes);
+ AABB_batch_pack(aabb_batch, aabbs.data(), n_boxes);
+ uint32 words = BATCH_MASK_WORDS(n_points);
+ std::vector<uint32> masks(n_boxes*words);
+
+ uint32 mismatches[3] = { 0, 0, 0 };
+ uint32 hits[3] = { 0, 0, 0 };
+ OBB_batch_intersect(obb_batch, P, n_points, masks.data());
+ for(uint32 i = 0; i < n_boxes; i++) {
+     for(uint32 j = 0; j < n_points; j++) {
+         bool a = OBB_intersect(obbs[i], P[j]);
+         bool b = ((masks[i*words + j/32] >> (j % 32)) & 1) != 0;
+         if(a != b) mismatches[0]++;
+         if(a) hits[0]++;
+        }
+    }
+ OBB_batch_intersect(obb_batch, spheres.data(), n_points, masks.data());
+ for(uint32 i = 0; i < n_boxes; i++) {
+     for(uint32 j = 0; j < n_points; j++) {
+         bool a = OBB_intersect(obbs[i], spheres[j]);
+         bool b = ((masks[i*words + j/32] >> (j % 32)) & 1) != 0;
+         if(a != b) mismatches[1]++;
+         if(a) hits[1]++;
+        }
+    }
+ AABB_batch_intersect(aabb_batch, spheres.data(), n_points, masks.data());
+ for(uint32 i = 0; i < n_boxes; i++) {
+     for(uint32 j = 0; j < n_points; j++) {
+         bool a = AABB_intersect(aabbs[i], spheres[j]);
+         bool b = ((masks[i*words + j/32] >> (j % 32)) & 1) != 0;
+         if(a != b) mismatches[2]++;
+         if(a) hits[2]++;
+        }
+    }
+ std::cout << "batch: " << n_boxes << " boxes x " << n_points << " points/spheres" << std::endl;
+ std::cout << " OBB-point: " << hits[0] << " hits, " << mismatches[0] << " mismatches" << std::endl;
+ std::cout << " OBB-sphere: " << hits[1] << " hits, " << mismatches[1] << " mismatches" << std::endl;
+ std::cout << " AABB-sphere: " << hits[2] << " hits, " << mismatches[2] << " mismatches" << std::endl;
+
+ //
+ // MICROBENCHMARK
+ // Many boxes (doors and triggers) against a few points (cameras and players).
+ //
+
+ uint32 n_tests[] = { 1, 4, 32 };
+ uint32 repeat = std::max(n_queries/10000u, 10u);
+ volatile uint32 sink = 0;
+ for(uint32 n : n_tests)
+    {
+     uint32 w = BATCH_MASK_WORDS(n);
+     double t0 = BenchTime();
+     for(uint32 r = 0; r < repeat; r++) {
+         std::fill(masks.begin(), masks.begin() + n_boxes*w, 0u);
+         for(uint32 i = 0; i < n_boxes; i++)
+             for(uint32 j = 0; j < n; j++)
+                 if(OBB_intersect(obbs[i], P[j])) masks[i*w + j/32] |= (1u << (j % 32));
+         sink = sink + masks[r % n_boxes];
+        }
+     double t1 = BenchTime();
+     for(uint32 r = 0; r < repeat; r++) {
+         OBB_batch_intersect(obb_batch, P, n, masks.data());
+         sink = sink + masks[r % n_boxes];
+        }
+     double t2 = BenchTime();
+     for(uint32 r = 0; r < repeat; r++) {
+         std::fill(masks.begin(), masks.begin() + n_boxes*w, 0u);
+         for(uint32 i = 0; i < n_boxes; i++)
+             for(uint32 j = 0; j < n; j++)
+                 if(OBB_intersect(obbs[i], spheres[j])) masks[i*w + j/32] |= (1u << (j % 32));
+         sink = sink + masks[r % n_boxes];
+        }
+     double t3 = BenchTime();
+     for(uint32 r = 0; r < repeat; r++) {
+         OBB_batch_intersect(obb_batch, spheres.data(), n, masks.data());
+         sink = sink + masks[r % n_boxes];
+        }
+     double t4 = BenchTime();
+     for(uint32 r = 0; r < repeat; r++) {
+         std::fill(masks.begin(), masks.begin() + n_boxes*w, 0u);
+         for(uint32 i = 0; i < n_boxes; i++)
+             for(uint32 j = 0; j < n; j++)
+                 if(AABB_intersect(aabbs[i], spheres[j])) masks[i*w + j/32] |= (1u << (j % 32));
+         sink = sink + masks[r % n_boxes];
+        }
+     double t5 = BenchTime();
+     for(uint32 r = 0; r < repeat; r++) {
+         AABB_batch_intersect(aabb_batch, spheres.data(), n, masks.data());
+         sink = sink + masks[r % n_boxes];
+        }
+     double t6 = BenchTime();
+     double tests = static_cast<double>(repeat)*n_boxes*n;
+     std::cout << " " << n << " points/spheres (million tests/sec, scalar -> batch):" << std::endl;
+     std::cout << "  OBB-point: " << (tests/(t1 - t0)*1.0e-6) << " -> " << (tests/(t2 - t1)*1.0e-6) << std::endl;
+     std::cout << "  OBB-sphere: " << (tests/(t3 - t2)*1.0e-6) << " -> " << (tests/(t4 - t3)*1.0e-6) << std::endl;
+     std::cout << "  AABB-sphere: " << (tests/(t5 - t4)*1.0e-6) << " -> " << (tests/(t6 - t5)*1.0e-6) << std::endl;
+    }
+ return (mismatches[0] + mismatches[1] + mismatches[2]) == 0;
+}
@@ -0,0 +1,113 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// compares leaf triangles gathered through faces against baked SoA triangle blocks
+bool BlocksBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // builder configurations (larger leaves fill more of each block)
+ struct {
+  const char* name;
+  bool sah;
+  uint32 max_leaf_size;
+  float intersect_cost;
+ } configs[] = {
+  { "default build", false, 4, 1.0f },
+  { "SAH termination, 4 triangle leaves", true, 4, 1.0f },
+  { "SAH termination, 8 triangle leaves, 1/4 intersect cost", true, 8, 0.25f },
+ };
+
+ // query bounds are the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // generate segments of a quarter of the mesh diagonal in random directions
+ real32 distance = 0.25f*length(diagonal);
+ std::vector<PointLinearCollisionTest> queries(n_queries);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     PointLinearCollisionTest& q = queries[i];
+     q.point.reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+     q.D = distance*unit(D);
+     q.t1 = 0.0f;
+     q.t2 = 1.0f;
+    }
+
+ // vertices moved a little for the refit test
+ std::vector<vector3D> moved(mesh.verts);
+ for(auto& v : moved) v += 0.001f*vector3D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f))*length(diagonal);
+
+ std::cout << "blocks: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (mesh.faces.size()/3) << std::endl;
+ uint32 mismatches = 0;
+ for(auto& config : configs)
+    {
+     // construct BVH (construct sorts the index buffer, so use a copy)
+     uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+     uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+     std::vector<uint32> faces(mesh.faces);
+     BVHBuildOptions options;
+     options.sah_termination = config.sah;
+     options.max_leaf_size = config.max_leaf_size;
+     options.intersect_cost = config.intersect_cost;
+     BVH bvh;
+     bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices, options);
+
+     // gathered leaf triangles
+     std::vector<PointLinearCollisionTest> gathered(queries);
+     double gathered_time = BenchTime();
+     for(auto& q : gathered) bvh.collide(q);
+     gathered_time = BenchTime() - gathered_time;
+
+     // baked leaf triangles
+     double bake_time = BenchTime();
+     bvh.bake();
+     bake_time = BenchTime() - bake_time;
+     std::vector<PointLinearCollisionTest> baked(queries);
+     double baked_time = BenchTime();
+     for(auto& q : baked) bvh.collide(q);
+     baked_time = BenchTime() - baked_time;
+
+     // blocks give exactly the same answers
+     uint32 hits = 0;
+     uint32 n_mismatches = 0;
+     for(uint32 i = 0; i < n_queries; i++) {
+         if(gathered[i].collide) hits++;
+         if(gathered[i].collide != baked[i].collide || gathered[i].t != baked[i].t) n_mismatches++;
+        }
+
+     // blocks follow a refit
+     BVH reference;
+     std::vector<uint32> reference_faces(mesh.faces);
+     reference.construct(mesh.verts.data(), n_verts, reference_faces.data(), n_indices, options);
+     reference.refit(moved.data());
+     bvh.refit(moved.data());
+     for(uint32 i = 0; i < std::min(n_queries, 10000u); i++) {
+         PointLinearCollisionTest q1 = queries[i];
+         PointLinearCollisionTest q2 = queries[i];
+         reference.collide(q1);
+         bvh.collide(q2);
+         if(q1.collide != q2.collide || q1.t != q2.t) n_mismatches++;
+        }
+     mismatches += n_mismatches;
+
+     // leaf fill
+     BVHQualityReport report;
+     bvh.quality(report);
+     size_t index_bytes = n_indices*sizeof(uint32);
+     std::cout << " " << config.name << ": " << report.n_leaves << " leaves, " << report.avg_leaf_size << " triangles/leaf" << std::endl;
+     std::cout << "  gathered: " << (bvh.bytes() + index_bytes)/1024.0 << " KB (nodes + faces), " << (n_queries/gathered_time) << " queries/sec" << std::endl;
+     std::cout << "  blocks: " << (bvh.bytes() + index_bytes + bvh.block_bytes())/1024.0 << " KB (nodes + faces + " << bvh.block_bytes()/1024.0 << " KB blocks), " << (n_queries/baked_time) << " queries/sec, bake = " << 1000.0*bake_time << " ms" << std::endl;
+     std::cout << "  speedup = " << (gathered_time/baked_time) << ", " << hits << " hits, " << n_mismatches << " mismatches" << std::endl;
+    }
+
+ return (mismatches == 0);
+}
@@ -0,0 +1,106 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// synthetic terrain of about one million triangles (708 x 708 quads)
+static void SyntheticMesh(BenchMesh& mesh)
+{
+ const uint32 n = 709;
+ mesh.name = "synthetic terrain";
+ mesh.verts.resize(n*n);
+ mesh.faces.resize(6*(n - 1)*(n - 1));
+
+ // vertices (rolling hills with a little noise)
+ BenchSeed(0x489ul);
+ for(uint32 r = 0; r < n; r++) {
+     for(uint32 c = 0; c < n; c++) {
+         real32 x = static_cast<real32>(c);
+         real32 z = static_cast<real32>(r);
+         real32 y = 8.0f*std::sin(0.05f*x)*std::cos(0.03f*z) + BenchRandom(-0.25f, 0.25f);
+         mesh.verts[r*n + c].reset(x, y, z);
+        }
+    }
+
+ // two triangles per quad
+ size_t index = 0;
+ for(uint32 r = 0; r < (n - 1); r++) {
+     for(uint32 c = 0; c < (n - 1); c++) {
+         uint32 v0 = r*n + c;
+         uint32 v1 = v0 + 1;
+         uint32 v2 = v0 + n;
+         uint32 v3 = v2 + 1;
+         mesh.faces[index++] = v0;
+         mesh.faces[index++] = v2;
+         mesh.faces[index++] = v1;
+         mesh.faces[index++] = v1;
+         mesh.faces[index++] = v2;
+         mesh.faces[index++] = v3;
+        }
+    }
+}
+
+bool BuildBenchmark(const std::vector<BenchMesh>&, uint32)
+{
+ BenchMesh mesh;
+ SyntheticMesh(mesh);
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+
+ // single-threaded reference (construct sorts the index buffer, so use a copy)
+ std::vector<uint32> reference_faces(mesh.faces);
+ BVH reference;
+ double reference_time = BenchTime();
+ reference.construct(mesh.verts.data(), n_verts, reference_faces.data(), n_indices);
+ reference_time = BenchTime() - reference_time;
+
+ // report
+ std::cout << "build: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (n_indices/3) << std::endl;
+ std::cout << " nodes = " << reference.nodes() << std::endl;
+ std::cout << " hardware threads = " << std::thread::hardware_concurrency() << std::endl;
+ std::cout << " serial: " << 1000.0*reference_time << " ms" << std::endl;
+
+ // multithreaded builds must produce the same tree and face order
+ bool passed = true;
+ const uint32 threads[] = { 1, 2, 4, 8, 16 };
+ for(uint32 n_threads : threads) {
+     std::vector<uint32> faces(mesh.faces);
+     BVH bvh;
+     double dt = BenchTime();
+     bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices, n_threads);
+     dt = BenchTime() - dt;
+     bool same = bvh.identical(reference) && (faces == reference_faces);
+     if(!same) passed = false;
+     std::cout << " threads = " << std::setw(2) << n_threads << ": ";
+     std::cout << 1000.0*dt << " ms, ";
+     std::cout << "speedup = " << (reference_time/dt) << ", ";
+     std::cout << (same ? "identical" : "DIFFERENT") << std::endl;
+    }
+ // SAH builder
+ BVHBuildOptions options;
+ options.n_bins = 16;
+ options.all_axes = true;
+ options.sah_termination = true;
+ std::vector<uint32> sah_faces(mesh.faces);
+ BVH sah;
+ double sah_time = BenchTime();
+ sah.construct(mesh.verts.data(), n_verts, sah_faces.data(), n_indices, options);
+ sah_time = BenchTime() - sah_time;
+ std::cout << " SAH (16 bins), serial: " << 1000.0*sah_time << " ms" << std::endl;
+ for(uint32 n_threads : threads) {
+     std::vector<uint32> faces(mesh.faces);
+     BVH bvh;
+     options.n_threads = n_threads;
+     double dt = BenchTime();
+     bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices, options);
+     dt = BenchTime() - dt;
+     bool same = bvh.identical(sah) && (faces == sah_faces);
+     if(!same) passed = false;
+     std::cout << " SAH (16 bins), threads = " << std::setw(2) << n_threads << ": ";
+     std::cout << 1000.0*dt << " ms, ";
+     std::cout << "speedup = " << (sah_time/dt) << ", ";
+     std::cout << (same ? "identical" : "DIFFERENT") << std::endl;
+    }
+
+ return passed;
+}
@@ -0,0 +1,120 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "../../bvhcache.h"
+#include "bench.h"
+
+bool CacheBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // cache files are written to this folder
+ const wchar_t* path = L"bvhcache";
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ const uint32 n_loads = 10;
+
+ // content hash
+ double hash_time = BenchTime();
+ uint64 key = BVHCache::hash(mesh.verts.data(), n_verts, mesh.faces.data(), n_indices);
+ hash_time = BenchTime() - hash_time;
+
+ // rebuild (construct sorts the index buffer, so use a copy)
+ std::vector<uint32> faces;
+ BVH built;
+ double build_time = BenchTime();
+ for(uint32 i = 0; i < n_loads; i++) {
+     faces = mesh.faces;
+     built.construct(mesh.verts.data(), n_verts, faces.data(), n_indices);
+    }
+ build_time = (BenchTime() - build_time)/n_loads;
+
+ // save
+ double save_time = BenchTime();
+ bool saved = BVHCache::save(path, key, built, n_verts);
+ save_time = BenchTime() - save_time;
+ if(!saved) {
+    std::cout << "cache: could not write cache file" << std::endl;
+    return false;
+   }
+
+ // load (includes hashing the source mesh, which is needed to find the file)
+ BVHCache cache;
+ BVH cached;
+ bool loaded = true;
+ double load_time = BenchTime();
+ for(uint32 i = 0; i < n_loads; i++) {
+     uint64 k = BVHCache::hash(mesh.verts.data(), n_verts, mesh.faces.data(), n_indices);
+     loaded = cache.load(path, k, cached, mesh.verts.data(), n_verts) && loaded;
+    }
+ load_time = (BenchTime() - load_time)/n_loads;
+
+ // mapped tree must be the same and give the same answers
+ uint32 mismatches = 0;
+ if(!loaded || !built.identical(cached)) mismatches++;
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries && loaded; i++) {
+     PointLinearCollisionTest query;
+     query.point.reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     query.D.reset(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     query.D *= 0.5f*length(diagonal);
+     query.t1 = 0.0f;
+     query.t2 = 1.0f;
+     PointLinearCollisionTest copy = query;
+     built.collide(query);
+     cached.collide(copy);
+     if(query.collide != copy.collide || query.t != copy.t) mismatches++;
+    }
+
+ // changing the source mesh changes the key, so the old file is not used
+ std::vector<vector3D> moved(mesh.verts);
+ moved[0][0] += 1.0f;
+ uint64 moved_key = BVHCache::hash(moved.data(), n_verts, mesh.faces.data(), n_indices);
+ BVHCache stale;
+ BVH stale_tree;
+ bool invalidated = (moved_key != key) && !stale.load(path, moved_key, stale_tree, moved.data(), n_verts);
+
+ // changing the build options also changes the key
+ BVHBuildOptions options;
+ options.sah_termination = true;
+ uint64 options_key = BVHCache::hash(mesh.verts.data(), n_verts, mesh.faces.data(), n_indices, options);
+ invalidated = invalidated && (options_key != key) && !stale.load(path, options_key, stale_tree, mesh.verts.data(), n_verts);
+
+ // a file with the right name but wrong contents is rejected
+ bool rejected = !stale.load(path, key, stale_tree, mesh.verts.data(), n_verts + 1);
+
+ // a file with an out of range escape index is rejected (the root escape index follows the
+ // 64-byte header and the root bounds; restore the file afterwards)
+ const size_t escape_offset = 64 + sizeof(AABB_minmax);
+ std::wstring wname = BVHCache::filename(path, key);
+ std::string name(wname.begin(), wname.end());
+ std::vector<char> original;
+ std::ifstream ifile(name.c_str(), std::ios::binary);
+ original.assign(std::istreambuf_iterator<char>(ifile), std::istreambuf_iterator<char>());
+ ifile.close();
+ if(built.nodes() > 1 && original.size() > escape_offset + sizeof(uint32)) {
+    std::vector<char> tampered(original);
+    uint32 escape = built.nodes() + 1;
+    std::memcpy(&tampered[escape_offset], &escape, sizeof(escape));
+    std::ofstream ofile(name.c_str(), std::ios::binary);
+    ofile.write(tampered.data(), tampered.size());
+    ofile.close();
+    rejected = rejected && !stale.load(path, key, stale_tree, mesh.verts.data(), n_verts);
+    ofile.open(name.c_str(), std::ios::binary);
+    ofile.write(original.data(), original.size());
+   }
+ if(!invalidated || !rejected) mismatches++;
+
+ // report
+ std::cout << "cache: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (n_indices/3) << ", nodes = " << built.nodes() << std::endl;
+ std::cout << " file = " << cache.bytes()/1024.0 << " KB" << std::endl;
+ std::cout << " hash time = " << 1000.0*hash_time << " ms" << std::endl;
+ std::cout << " save time = " << 1000.0*save_time << " ms" << std::endl;
+ std::cout << " rebuild time = " << 1000.0*build_time << " ms" << std::endl;
+ std::cout << " cached load time = " << 1000.0*load_time << " ms (" << (load_time > 0.0 ? build_time/load_time : 0.0) << "x faster)" << std::endl;
+ std::cout << " invalidated = " << (invalidated ? "yes" : "no") << ", rejected = " << (rejected ? "yes" : "no") << std::endl;
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
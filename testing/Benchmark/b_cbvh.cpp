@@ -0,0 +1,156 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "../../ray.h"
+#include "../../cbvh.h"
+#include "bench.h"
+
+template<class Tree, class Test>
+static double RunQueries(Tree& tree, std::vector<Test>& queries, uint64& visits, uint32& hits)
+{
+ visits = 0;
+ hits = 0;
+ double dt = BenchTime();
+ for(size_t i = 0; i < queries.size(); i++) {
+     tree.collide(queries[i]);
+     visits += queries[i].visits;
+     if(queries[i].collide) hits++;
+    }
+ return BenchTime() - dt;
+}
+
+// brute force closest hit along O + t*V
+static bool BruteForce(const BenchMesh& mesh, const real32* O, const real32* V, real32& t)
+{
+ bool hit = false;
+ for(size_t i = 0; i < mesh.faces.size(); i += 3) {
+     real32 distance;
+     const uint32* f = &mesh.faces[i];
+     if(ray3D_triangle_intersect(&distance, O, V, mesh.verts[f[0]].v, mesh.verts[f[1]].v, mesh.verts[f[2]].v) && !(t < distance)) {
+        t = distance;
+        hit = true;
+       }
+    }
+ return hit;
+}
+
+// number of brute force hits that were missed or found further away (hits on triangles that
+// share an edge or vertex can differ by a few ulps, which is not a miss)
+static uint32 CountMisses(const BenchMesh& mesh, const std::vector<PointLinearCollisionTest>& queries, uint32 n)
+{
+ uint32 misses = 0;
+ for(uint32 i = 0; i < n; i++) {
+     const PointLinearCollisionTest& query = queries[i];
+     vector3D V = (query.t2 - query.t1)*query.D;
+     real32 ratio = 1.0f;
+     if(!BruteForce(mesh, query.point.v, V.v, ratio)) continue;
+     real32 t = query.t1 + ratio*(query.t2 - query.t1);
+     if(!query.collide || t + 1.0e-5f*std::max(std::abs(t), 1.0f) < query.t) misses++;
+    }
+ return misses;
+}
+
+static uint32 CountMisses(const BenchMesh& mesh, const std::vector<RayCollisionTest>& queries, uint32 n)
+{
+ uint32 misses = 0;
+ for(uint32 i = 0; i < n; i++) {
+     const RayCollisionTest& query = queries[i];
+     real32 t = query.t_max;
+     if(!BruteForce(mesh, query.origin.v, query.direction.v, t)) continue;
+     if(!query.collide || t + 1.0e-5f*std::max(std::abs(t), 1.0f) < query.t) misses++;
+    }
+ return misses;
+}
+
+bool CBVHBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // construct binary tree (construct sorts the index buffer, so use a copy)
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ std::vector<uint32> faces(mesh.faces);
+ BVH bvh;
+ bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices);
+
+ // compress
+ CBVH cbvh;
+ double compress_time = BenchTime();
+ bool compressed = cbvh.construct(bvh);
+ compress_time = BenchTime() - compress_time;
+ if(!compressed) {
+    std::cout << "cbvh: " << mesh.name << " could not be compressed" << std::endl;
+    return false;
+   }
+
+ // query bounds are the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // segments of a quarter of the mesh diagonal, unbounded rays, and rays that graze triangle
+ // edges (aimed at vertices, where rounding bounds inward would lose hits)
+ real32 distance = 0.25f*length(diagonal);
+ std::vector<PointLinearCollisionTest> segments(n_queries);
+ std::vector<RayCollisionTest> rays(n_queries);
+ std::vector<RayCollisionTest> grazing(n_queries);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     vector3D O(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+     D = unit(D);
+     segments[i].point = O;
+     segments[i].D = distance*D;
+     segments[i].t1 = 0.0f;
+     segments[i].t2 = 1.0f;
+     rays[i].origin = O;
+     rays[i].direction = D;
+     rays[i].t_max = std::numeric_limits<real32>::max();
+     const vector3D& target = mesh.verts[static_cast<uint32>(BenchRandom(0.0f, 1.0f)*(n_verts - 1))];
+     grazing[i].origin = O;
+     grazing[i].direction = target - O;
+     grazing[i].t_max = std::numeric_limits<real32>::max();
+    }
+
+ // report
+ std::cout << "cbvh: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (n_indices/3) << std::endl;
+ std::cout << " compress time = " << 1000.0*compress_time << " ms" << std::endl;
+ std::cout << " uncompressed: " << bvh.nodes() << " nodes, " << bvh.bytes()/1024.0 << " KB" << std::endl;
+ std::cout << " compressed: " << cbvh.nodes() << " nodes, " << cbvh.levels() << " levels, " << cbvh.bytes()/1024.0 << " KB (" << 100.0*cbvh.bytes()/bvh.bytes() << "%)" << std::endl;
+
+ // run all workloads on both layouts and compare some of them against brute force
+ uint32 n_brute = std::min(n_queries, 2000u);
+ uint32 mismatches = 0;
+ for(int workload = 0; workload < 3; workload++)
+    {
+     uint64 visits[2];
+     uint32 hits[2];
+     uint32 misses[2];
+     double dt[2];
+     if(workload == 0) {
+        std::vector<PointLinearCollisionTest> copy(segments);
+        dt[0] = RunQueries(bvh, segments, visits[0], hits[0]);
+        dt[1] = RunQueries(cbvh, copy, visits[1], hits[1]);
+        misses[0] = CountMisses(mesh, segments, n_brute);
+        misses[1] = CountMisses(mesh, copy, n_brute);
+       }
+     else {
+        std::vector<RayCollisionTest>& queries = (workload == 1 ? rays : grazing);
+        std::vector<RayCollisionTest> copy(queries);
+        dt[0] = RunQueries(bvh, queries, visits[0], hits[0]);
+        dt[1] = RunQueries(cbvh, copy, visits[1], hits[1]);
+        misses[0] = CountMisses(mesh, queries, n_brute);
+        misses[1] = CountMisses(mesh, copy, n_brute);
+       }
+     const char* name = (workload == 0 ? "segment" : (workload == 1 ? "ray" : "grazing ray"));
+     std::cout << " " << name << " uncompressed: " << hits[0] << " hits, " << (double)visits[0]/n_queries << " nodes/query, " << (n_queries/dt[0]) << " queries/sec, " << misses[0] << " missed" << std::endl;
+     std::cout << " " << name << " compressed: " << hits[1] << " hits, " << (double)visits[1]/n_queries << " nodes/query, " << (n_queries/dt[1]) << " queries/sec, " << misses[1] << " missed" << std::endl;
+     mismatches += misses[0] + misses[1];
+    }
+ std::cout << " missed hits (both layouts, first " << n_brute << " queries of each workload) = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
@@ -0,0 +1,192 @@
+#include "../../stdafx.h"
+#include "../../triangle.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// reference result, tests point against every triangle
+static void BruteForceClosest(const BenchMesh& mesh, const vector3D& P, real32 radius, bool& found, real32& distance)
+{
+ real32 best = radius*radius;
+ found = false;
+ for(size_t i = 0; i < mesh.faces.size(); i += 3) {
+     const vector3D& A = mesh.verts[mesh.faces[i + 0]];
+     const vector3D& B = mesh.verts[mesh.faces[i + 1]];
+     const vector3D& C = mesh.verts[mesh.faces[i + 2]];
+     real32 X[3];
+     real32 d = triangle3D_closest_point(X, P.v, A.v, B.v, C.v);
+     if(d < best || (!found && d <= best)) {
+        best = d;
+        found = true;
+       }
+    }
+ distance = (found ? std::sqrt(best) : radius);
+}
+
+// reference result, counts triangles that touch sphere
+static uint32 BruteForceOverlap(const BenchMesh& mesh, const sphere3D& S)
+{
+ uint32 count = 0;
+ real32 rr = S.radius*S.radius;
+ for(size_t i = 0; i < mesh.faces.size(); i += 3) {
+     const vector3D& A = mesh.verts[mesh.faces[i + 0]];
+     const vector3D& B = mesh.verts[mesh.faces[i + 1]];
+     const vector3D& C = mesh.verts[mesh.faces[i + 2]];
+     real32 X[3];
+     if(!(triangle3D_closest_point(X, S.center, A.v, B.v, C.v) > rr)) count++;
+    }
+ return count;
+}
+
+bool ClosestBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // construct BVH (construct sorts the index buffer, so use a copy)
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ uint32 n_faces = n_indices/3;
+ std::vector<uint32> faces(mesh.faces);
+ BVH bvh;
+ bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices);
+
+ // query bounds are the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ real32 scale = length(diagonal);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // closest point queries of 1% to 10% of the mesh diagonal (push-out), overlap queries of 0.5%
+ // to 5% of the mesh diagonal (decals)
+ std::vector<vector3D> points(n_queries);
+ std::vector<real32> radii(n_queries);
+ std::vector<sphere3D> spheres(n_queries);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     points[i].reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     radii[i] = BenchRandom(0.01f, 0.1f)*scale;
+     spheres[i].center[0] = BenchRandom(a[0], b[0]);
+     spheres[i].center[1] = BenchRandom(a[1], b[1]);
+     spheres[i].center[2] = BenchRandom(a[2], b[2]);
+     spheres[i].radius = BenchRandom(0.005f, 0.05f)*scale;
+    }
+
+ // closest point queries with plenty of scratch space and with almost none (the depth-first
+ // fallback must give the same answer)
+ BVHScratchItem scratch[64];
+ struct {
+  const char* name;
+  uint32 scratch_size;
+  std::vector<ClosestPointTest> results;
+  uint32 hits;
+  uint64 visits;
+  double time;
+ } runs[] = {
+  { "closest (64 item scratch)", 64, {}, 0, 0, 0.0 },
+  { "closest (2 item scratch)", 2, {}, 0, 0, 0.0 },
+  { "closest (no scratch)", 0, {}, 0, 0, 0.0 },
+ };
+ for(auto& run : runs) {
+     run.results.resize(n_queries);
+     run.hits = 0;
+     run.visits = 0;
+     run.time = BenchTime();
+     for(uint32 i = 0; i < n_queries; i++) {
+         ClosestPointTest& q = run.results[i];
+         q.point = points[i];
+         q.radius = radii[i];
+         q.scratch = scratch;
+         q.scratch_size = run.scratch_size;
+         bvh.collide(q);
+         run.visits += q.visits;
+         if(q.found) run.hits++;
+        }
+     run.time = BenchTime() - run.time;
+    }
+
+ // closest points must be on the reported triangle at the reported distance
+ const real32 tolerance = 1.0e-5f*scale;
+ uint32 bad_points = 0;
+ uint32 scratch_mismatches = 0;
+ for(uint32 i = 0; i < n_queries; i++) {
+     const ClosestPointTest& q = runs[0].results[i];
+     for(size_t j = 1; j < sizeof(runs)/sizeof(runs[0]); j++) {
+         const ClosestPointTest& r = runs[j].results[i];
+         if(r.found != q.found || r.distance != q.distance) scratch_mismatches++;
+        }
+     if(!q.found) continue;
+     const uint32* f = bvh.face(q.triangle);
+     real32 X[3];
+     real32 d = std::sqrt(triangle3D_closest_point(X, q.point.v, mesh.verts[f[0]].v, mesh.verts[f[1]].v, mesh.verts[f[2]].v));
+     if(std::abs(d - q.distance) > tolerance) bad_points++;
+     else if(std::abs(length(q.point - q.closest) - q.distance) > tolerance) bad_points++;
+    }
+
+ // overlap queries (storage for every triangle so counts can be checked)
+ std::vector<uint32> triangles(n_faces);
+ uint32 overlaps = 0;
+ uint32 bad_overlaps = 0;
+ uint64 overlap_visits = 0;
+ std::vector<uint32> overlap_counts(n_queries);
+ double overlap_time = BenchTime();
+ for(uint32 i = 0; i < n_queries; i++) {
+     SphereOverlapTest q;
+     q.S = spheres[i];
+     q.triangles = triangles.data();
+     q.max_triangles = n_faces;
+     bvh.collide(q);
+     overlap_visits += q.visits;
+     overlap_counts[i] = q.n_triangles;
+     overlaps += q.n_triangles;
+    }
+ overlap_time = BenchTime() - overlap_time;
+
+ // overlapping triangles must touch the sphere and must not repeat
+ std::vector<uint32> marks(n_faces, 0xFFFFFFFFul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     SphereOverlapTest q;
+     q.S = spheres[i];
+     q.triangles = triangles.data();
+     q.max_triangles = n_faces;
+     bvh.collide(q);
+     for(uint32 j = 0; j < q.n_triangles; j++) {
+         uint32 index = q.triangles[j];
+         const uint32* f = bvh.face(index);
+         real32 X[3];
+         real32 d = triangle3D_closest_point(X, q.S.center, mesh.verts[f[0]].v, mesh.verts[f[1]].v, mesh.verts[f[2]].v);
+         if(marks[index] == i || d > q.S.radius*q.S.radius) bad_overlaps++;
+         marks[index] = i;
+        }
+    }
+
+ // brute force queries (limited to about 2^26 triangle tests)
+ uint32 n_brute = std::min(n_queries, std::max(500u, 0x4000000u/std::max(n_faces, 1u)));
+ uint32 mismatches = 0;
+ double brute_time = BenchTime();
+ for(uint32 i = 0; i < n_brute; i++) {
+     bool found;
+     real32 distance;
+     BruteForceClosest(mesh, points[i], radii[i], found, distance);
+     const ClosestPointTest& q = runs[0].results[i];
+     if(found != q.found) mismatches++;
+     else if(found && std::abs(distance - q.distance) > tolerance) mismatches++;
+    }
+ brute_time = BenchTime() - brute_time;
+ uint32 overlap_mismatches = 0;
+ for(uint32 i = 0; i < n_brute; i++)
+     if(BruteForceOverlap(mesh, spheres[i]) != overlap_counts[i]) overlap_mismatches++;
+
+ // report
+ std::cout << "closest: " << mesh.name << std::endl;
+ std::cout << " triangles = " << n_faces << std::endl;
+ for(auto& run : runs) std::cout << " " << run.name << ": " << n_queries << " queries, " << run.hits << " hits, " << (static_cast<double>(run.visits)/n_queries) << " nodes/query, " << (n_queries/run.time) << " queries/sec" << std::endl;
+ std::cout << " overlap: " << n_queries << " queries, " << (static_cast<double>(overlaps)/n_queries) << " triangles/query, " << (static_cast<double>(overlap_visits)/n_queries) << " nodes/query, " << (n_queries/overlap_time) << " queries/sec" << std::endl;
+ std::cout << " brute force: " << n_brute << " queries, " << (n_brute/brute_time) << " queries/sec" << std::endl;
+ std::cout << " brute force mismatches = " << mismatches << " closest, " << overlap_mismatches << " overlap" << std::endl;
+ std::cout << " scratch mismatches = " << scratch_mismatches << std::endl;
+ std::cout << " bad closest points = " << bad_points << std::endl;
+ std::cout << " bad overlaps = " << bad_overlaps << std::endl;
+ return (mismatches == 0 && overlap_mismatches == 0 && scratch_mismatches == 0 && bad_points == 0 && bad_overlaps == 0);
+}
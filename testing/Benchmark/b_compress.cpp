@@ -0,0 +1,176 @@
+#include "../../stdafx.h"
+#include "../../animation.h"
+#include "bench.h"
+
+// keys of an animation resampled at every frame for n_frames frames (looping the source), like
+// animations exported from motion capture
+static void ResampleBenchAnimation(const BenchSkeleton& skeleton, const MeshAnimation& source, uint32 n_frames, MeshAnimation& animation)
+{
+ animation.name = source.name + L" (every frame)";
+ animation.loop = true;
+ animation.minframe = 0;
+ animation.maxframe = n_frames - 1;
+ animation.bonelist.resize(skeleton.bones.size());
+ uint32 n_keys = static_cast<uint32>(source.keymap.size());
+ for(size_t bi = 0; bi < skeleton.bones.size(); bi++) {
+     MeshAnimatedBoneKeys& keys = animation.bonelist[bi];
+     keys.bone_index = static_cast<uint32>(bi);
+     keys.minframe = animation.minframe;
+     keys.maxframe = animation.maxframe;
+     keys.keyframes.resize(n_frames);
+     for(uint32 f = 0; f < n_frames; f++) {
+         // interpolate source keyframes like ComputeAnimationPose does
+         real32 time = std::fmod(SECONDS_PER_FRAME*f, source.duration);
+         uint32 k = FindAnimationKey(source, time);
+         const MeshAnimationData& kf1 = source.animdata[k];
+         const MeshAnimationData& kf2 = source.animdata[std::min(k + 1, n_keys - 1)];
+         real32 ratio = (k + 1 < n_keys ? std::min(std::max((time - kf1.delta)/(kf2.delta - kf1.delta), 0.0f), 1.0f) : 0.0f);
+         MeshKeyFrame& kf = keys.keyframes[f];
+         kf.frame = f;
+         lerp3D(kf.scale, kf1.slist[bi].data(), kf2.slist[bi].data(), ratio);
+         lerp3D(kf.translation, kf1.tlist[bi].data(), kf2.tlist[bi].data(), ratio);
+         qslerp(kf.quaternion, kf1.qlist[bi].data(), kf2.qlist[bi].data(), ratio);
+         qnormalize(kf.quaternion);
+         animation.keyset.insert(f);
+        }
+    }
+ size_t index = 0;
+ for(auto iter = animation.keyset.begin(); iter != animation.keyset.end(); iter++) animation.keymap[*iter] = index++;
+ animation.duration = SECONDS_PER_FRAME*static_cast<real32>(animation.maxframe - animation.minframe + 1);
+ ConstructAnimationData(animation, skeleton.bones);
+}
+
+// times at which palettes are compared: every keyframe, then 60 Hz from time zero
+static void CompressSampleTimes(const MeshAnimation& animation, std::vector<real32>& times)
+{
+ times.clear();
+ for(size_t k = 0; k < animation.keymap.size(); k++) times.push_back(animation.animdata[k].delta);
+ for(real32 time = 0.0f; time < animation.duration; time += 1.0f/60.0f) times.push_back(time);
+}
+
+// largest difference relative to the size of the reference value
+static real32 MaxCompressError(const affine3D* x, const affine3D* ref, uint32 n_bones)
+{
+ real32 error = 0.0f;
+ for(uint32 bi = 0; bi < n_bones; bi++)
+     for(uint32 i = 0; i < 12; i++) error = std::max(error, std::abs(x[bi][i] - ref[bi][i])/std::max(1.0f, std::abs(ref[bi][i])));
+ return error;
+}
+
+static bool CompressTest(const BenchSkeleton& skeleton, MeshAnimation& animation)
+{
+ uint32 n_bones = static_cast<uint32>(skeleton.bones.size());
+ uint32 n_keys = static_cast<uint32>(animation.keymap.size());
+ if(!n_keys) return true;
+ std::string name(animation.name.begin(), animation.name.end());
+ size_t dense_bytes = AnimationKeyBytes(animation, n_bones);
+ std::cout << " " << name << ": " << n_bones << " bones, " << n_keys << " keys, " << (dense_bytes/1024.0) << " KB" << std::endl;
+
+ // reference palettes
+ std::vector<real32> times;
+ CompressSampleTimes(animation, times);
+ std::vector<affine3D> reference(times.size()*n_bones);
+ uint32 cursor = 0;
+ for(size_t i = 0; i < times.size(); i++) ComputeAnimationPose(skeleton.bones, animation, times[i], cursor, &reference[i*n_bones]);
+
+ // compressed tracks (only memory and error are measured, since decoding tracks is not faster
+ // than interpolating keyframes)
+ bool passed = true;
+ const real32 tolerances[] = { 1.0e-4f, 1.0e-3f, 1.0e-2f };
+ for(real32 tolerance : tolerances) {
+     AnimationCompressionOptions options;
+     options.local_rotation = tolerance;
+     options.local_translation = tolerance;
+     options.local_scale = tolerance;
+     double t0 = BenchTime();
+     bool compressed = CompressAnimation(animation, skeleton.bones, options);
+     double build_time = BenchTime() - t0;
+     if(!compressed) {
+        std::cout << "  local tolerance " << tolerance << ": not compressed (keyframes are smaller)" << std::endl;
+        continue;
+       }
+
+     // palette differences at keyframes, and at 60 Hz (between keyframes, keyframes closer than
+     // qslerp interpolates snap to the first one, so some of the difference is the reference)
+     std::vector<affine3D> palette(n_bones);
+     real32 key_error = 0.0f;
+     real32 error = 0.0f;
+     cursor = 0;
+     for(size_t i = 0; i < times.size(); i++) {
+         ComputeAnimationPose(skeleton.bones, animation, times[i], cursor, palette.data());
+         real32 e = MaxCompressError(palette.data(), &reference[i*n_bones], n_bones);
+         if(i < n_keys) key_error = std::max(key_error, e);
+         else error = std::max(error, e);
+        }
+
+     // stored keys per track and bones that do not move
+     const MeshCompressedAnimation& data = animation.compressed;
+     size_t n_tracks[3] = { 0, 0, 0 };
+     for(const auto& bone : data.bones) {
+         n_tracks[0] += bone.rotation.n_keys;
+         n_tracks[1] += bone.translation.n_keys;
+         n_tracks[2] += bone.scale.n_keys;
+        }
+     double dense_keys = static_cast<double>(n_keys)*n_bones;
+     size_t bytes = AnimationKeyBytes(animation, n_bones);
+     std::cout << "  local tolerance " << tolerance << ": " << (bytes/1024.0) << " KB (" << (static_cast<double>(dense_bytes)/bytes) << "x smaller), ";
+     std::cout << "keys kept = " << (100.0*n_tracks[0]/dense_keys) << "% rotation, " << (100.0*n_tracks[1]/dense_keys) << "% translation, " << (100.0*n_tracks[2]/dense_keys) << "% scale, ";
+     std::cout << data.mlist.size() << " bones held" << std::endl;
+     std::cout << "   palette error = " << key_error << " at keyframes, " << error << " at 60 Hz, compressed in " << (1.0e3*build_time) << " ms" << std::endl;
+     if(tolerance == tolerances[0] && !(key_error < 1.0e-2f)) passed = false;
+
+     // back to keyframes
+     ConstructAnimationData(animation, skeleton.bones);
+    }
+ return passed;
+}
+
+bool CompressBenchmark(const std::vector<BenchMesh>& meshes, uint32)
+{
+ // skeletons of models that have bones
+ std::vector<BenchSkeleton> skeletons;
+ LoadBenchSkeletons(meshes, skeletons);
+ if(skeletons.empty()) {
+    std::cout << "compress: no models with bones" << std::endl;
+    return true;
+   }
+
+ // animations from model files
+ bool passed = true;
+ BenchSeed(0x489ul);
+ for(auto& skeleton : skeletons) {
+     std::cout << "compress: " << skeleton.name << std::endl;
+     size_t dense = 0;
+     for(auto& animation : skeleton.animations) {
+         dense += AnimationKeyBytes(animation, skeleton.bones.size());
+         passed &= CompressTest(skeleton, animation);
+        }
+
+     // all animations at the default tolerance
+     size_t bytes = 0;
+     for(auto& animation : skeleton.animations) {
+         CompressAnimation(animation, skeleton.bones, AnimationCompressionOptions());
+         bytes += AnimationKeyBytes(animation, skeleton.bones.size());
+         ConstructAnimationData(animation, skeleton.bones);
+        }
+     std::cout << " all animations: " << (dense/1024.0) << " KB keyframes, " << (bytes/1024.0) << " KB compressed (" << (static_cast<double>(dense)/bytes) << "x smaller)" << std::endl;
+    }
+
+ // longest animation of the largest skeleton keyed at every frame for 30 seconds
+ size_t largest = 0;
+ for(size_t i = 1; i < skeletons.size(); i++) if(skeletons[largest].bones.size() < skeletons[i].bones.size()) largest = i;
+ BenchSkeleton& skeleton = skeletons[largest];
+ size_t longest = 0;
+ for(size_t i = 1; i < skeleton.animations.size(); i++) if(skeleton.animations[longest].keymap.size() < skeleton.animations[i].keymap.size()) longest = i;
+ std::cout << "compress: " << skeleton.name << " (resampled)" << std::endl;
+ MeshAnimation resampled;
+ ResampleBenchAnimation(skeleton, skeleton.animations[longest], 30*FRAMES_PER_SECOND, resampled);
+ passed &= CompressTest(skeleton, resampled);
+
+ // long animation with random keys (nothing to remove)
+ std::cout << "compress: " << skeleton.name << " (generated)" << std::endl;
+ MeshAnimation animation;
+ MakeBenchAnimation(skeleton, 400, animation);
+ passed &= CompressTest(skeleton, animation);
+ return passed;
+}
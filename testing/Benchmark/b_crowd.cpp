@@ -0,0 +1,141 @@
+#include "../../stdafx.h"
+#include "../../animation.h"
+#include "bench.h"
+
+// animation state of an instance (like MeshInstance)
+struct CrowdInstance {
+ uint32 anim;
+ real32 time;
+ uint32 cursor;
+};
+
+// updates every instance for a number of 60 Hz frames and copies each palette to an upload buffer
+// (like MeshInstance::Update does), using the cache when the animation is cached
+static double UpdateCrowd(const BenchSkeleton& skeleton, const AnimationCache* cache, std::vector<CrowdInstance>& instances, uint32 n_frames, std::vector<affine3D>& upload)
+{
+ uint32 n_bones = static_cast<uint32>(skeleton.bones.size());
+ std::vector<affine3D> scratch(n_bones);
+ double t0 = BenchTime();
+ for(uint32 frame = 0; frame < n_frames; frame++) {
+     for(size_t i = 0; i < instances.size(); i++) {
+         CrowdInstance& instance = instances[i];
+         const MeshAnimation& animation = skeleton.animations[instance.anim];
+         instance.time += 1.0f/60.0f;
+         if(instance.time > animation.duration) while(!(instance.time < animation.duration)) instance.time -= animation.duration;
+         const affine3D* palette = (cache ? cache->lookup(instance.anim, instance.time, scratch.data()) : nullptr);
+         if(!palette) {
+            ComputeAnimationPose(skeleton.bones, animation, instance.time, instance.cursor, scratch.data());
+            palette = scratch.data();
+           }
+         std::copy(palette, palette + n_bones, &upload[i*n_bones]);
+        }
+    }
+ return BenchTime() - t0;
+}
+
+// largest difference between uploaded palettes relative to the size of the reference value
+static real32 MaxCrowdError(const std::vector<affine3D>& x, const std::vector<affine3D>& ref)
+{
+ real32 error = 0.0f;
+ for(size_t i = 0; i < x.size(); i++)
+     for(uint32 j = 0; j < 12; j++) error = std::max(error, std::abs(x[i][j] - ref[i][j])/std::max(1.0f, std::abs(ref[i][j])));
+ return error;
+}
+
+static void CrowdTest(const BenchSkeleton& skeleton, uint32 n_instances, uint32 n_frames)
+{
+ // instances play random animations from random times
+ uint32 n_bones = static_cast<uint32>(skeleton.bones.size());
+ std::vector<CrowdInstance> instances(n_instances);
+ for(auto& instance : instances) {
+     instance.anim = static_cast<uint32>(BenchRandom(0.0f, 0.999f)*skeleton.animations.size());
+     instance.time = BenchRandom(0.0f, skeleton.animations[instance.anim].duration);
+     instance.cursor = 0;
+    }
+
+ // live evaluation
+ std::vector<affine3D> reference(n_instances*n_bones);
+ std::vector<CrowdInstance> temp = instances;
+ double live_time = UpdateCrowd(skeleton, nullptr, temp, n_frames, reference);
+ double scale = 1.0e6/(static_cast<double>(n_frames)*n_instances);
+ std::cout << "  live = " << (1.0e3*live_time/n_frames) << " ms/frame (" << (scale*live_time) << " us/instance)" << std::endl;
+
+ // cached palettes
+ const real32 rates[] = { 30.0f, 60.0f };
+ for(real32 rate : rates) {
+     for(int blend = 0; blend < 2; blend++) {
+         AnimationCacheOptions options;
+         options.rate = rate;
+         options.blend = (blend != 0);
+         options.lazy = false;
+         AnimationCache cache;
+         double t0 = BenchTime();
+         cache.construct(skeleton.bones, skeleton.animations, options);
+         double build_time = BenchTime() - t0;
+         std::vector<affine3D> upload(n_instances*n_bones);
+         temp = instances;
+         double cache_time = UpdateCrowd(skeleton, &cache, temp, n_frames, upload);
+         std::cout << "  " << rate << " Hz " << (blend ? "blended" : "nearest") << " = " << (1.0e3*cache_time/n_frames) << " ms/frame (" << (scale*cache_time) << " us/instance, speedup = " << (live_time/cache_time) << "), ";
+         uint32 n_cached = 0;
+         for(uint32 i = 0; i < skeleton.animations.size(); i++) if(cache.cached(i)) n_cached++;
+         std::cout << "error = " << MaxCrowdError(upload, reference) << ", " << n_cached << " of " << skeleton.animations.size() << " animations cached, " << (cache.bytes()/1024) << " KB, built in " << (1.0e3*build_time) << " ms" << std::endl;
+        }
+    }
+
+ // budget that holds about half of the animations (the others are evaluated live)
+ AnimationCacheOptions options;
+ options.rate = 30.0f;
+ AnimationCache probe;
+ probe.construct(skeleton.bones, skeleton.animations, options);
+ for(uint32 i = 0; i < skeleton.animations.size(); i++) probe.cache(skeleton.bones, skeleton.animations[i], i);
+ options.budget = probe.bytes()/2;
+ AnimationCache cache;
+ cache.construct(skeleton.bones, skeleton.animations, options);
+ std::vector<affine3D> upload(n_instances*n_bones);
+ temp = instances;
+ double budget_time = 0.0;
+ for(uint32 frame = 0; frame < n_frames; frame++) {
+     // lazy caching (instances cache animations the first time they are played)
+     double t0 = BenchTime();
+     for(auto& instance : temp) if(!cache.cached(instance.anim) && !cache.live(instance.anim)) cache.cache(skeleton.bones, skeleton.animations[instance.anim], instance.anim);
+     budget_time += BenchTime() - t0;
+     budget_time += UpdateCrowd(skeleton, &cache, temp, 1, upload);
+    }
+ uint32 n_cached = 0;
+ for(uint32 i = 0; i < skeleton.animations.size(); i++) if(cache.cached(i)) n_cached++;
+ std::cout << "  30 Hz blended, " << (options.budget/1024) << " KB budget = " << (1.0e3*budget_time/n_frames) << " ms/frame (" << (scale*budget_time) << " us/instance, speedup = " << (live_time/budget_time) << "), ";
+ std::cout << n_cached << " of " << skeleton.animations.size() << " animations cached, " << (cache.bytes()/1024) << " KB" << std::endl;
+}
+
+bool CrowdBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries)
+{
+ // skeletons of models that have bones
+ std::vector<BenchSkeleton> skeletons;
+ LoadBenchSkeletons(meshes, skeletons);
+ if(skeletons.empty()) {
+    std::cout << "crowd: no models with bones" << std::endl;
+    return true;
+   }
+
+ // 1000 instances of the largest skeleton
+ size_t largest = 0;
+ for(size_t i = 1; i < skeletons.size(); i++) if(skeletons[largest].bones.size() < skeletons[i].bones.size()) largest = i;
+ BenchSkeleton& skeleton = skeletons[largest];
+ const uint32 n_instances = 1000;
+ uint32 n_frames = std::max(4u, n_queries/100000);
+ BenchSeed(0x489ul);
+ std::cout << "crowd: " << skeleton.name << ", " << n_instances << " instances, " << skeleton.bones.size() << " bones" << std::endl;
+ CrowdTest(skeleton, n_instances, n_frames);
+
+ // same with long animations added
+ const uint32 n_keys[] = { 100, 400 };
+ for(uint32 keys : n_keys) {
+     MeshAnimation animation;
+     MakeBenchAnimation(skeleton, keys, animation);
+     skeleton.animations.push_back(std::move(animation));
+    }
+ BenchSeed(0x489ul);
+ std::cout << "crowd: " << skeleton.name << " with generated animations, " << n_instances << " instances" << std::endl;
+ CrowdTest(skeleton, n_instances, n_frames);
+ return true;
+}
@@ -0,0 +1,121 @@
+#include "../../stdafx.h"
+#include "../../animation.h"
+#include "../../jobs.h"
+#include "bench.h"
+
+// animation state of an instance (like MeshInstance)
+struct JobsInstance {
+ uint32 anim;
+ real32 time;
+ uint32 cursor;
+ const affine3D* palette;
+ std::vector<affine3D> jm;
+};
+
+// updates every instance for a number of 60 Hz frames like Map::Update does: palettes are computed
+// on all threads (like MeshInstance::Animate), then copied to an upload buffer by this thread (like
+// MeshInstance::Upload)
+static double UpdateJobs(const BenchSkeleton& skeleton, const AnimationCache& cache, JobSystem& jobs, std::vector<JobsInstance>& instances, uint32 n_frames, std::vector<affine3D>& upload, double& upload_time)
+{
+ uint32 n_bones = static_cast<uint32>(skeleton.bones.size());
+ uint32 n_instances = static_cast<uint32>(instances.size());
+ auto animate = [&](uint32 first, uint32 last) {
+  for(uint32 i = first; i < last; i++) {
+      JobsInstance& instance = instances[i];
+      const MeshAnimation& animation = skeleton.animations[instance.anim];
+      instance.time = WrapAnimationTime(instance.time + 1.0f/60.0f, animation.duration, true);
+      instance.palette = ComputeInstancePose(skeleton.bones, animation, cache, instance.anim, instance.time, instance.cursor, instance.jm.data());
+     }
+ };
+ std::function<void(uint32, uint32)> func(animate);
+
+ upload_time = 0.0;
+ double t0 = BenchTime();
+ for(uint32 frame = 0; frame < n_frames; frame++) {
+     jobs.run(n_instances, 16, func);
+     double t1 = BenchTime();
+     for(uint32 i = 0; i < n_instances; i++) {
+         std::copy(instances[i].palette, instances[i].palette + n_bones, &upload[i*n_bones]);
+         instances[i].palette = nullptr;
+        }
+     upload_time += BenchTime() - t1;
+    }
+ return BenchTime() - t0;
+}
+
+static bool JobsTest(const BenchSkeleton& skeleton, const AnimationCache& cache, uint32 n_instances, uint32 n_frames)
+{
+ // instances play random animations from random times
+ uint32 n_bones = static_cast<uint32>(skeleton.bones.size());
+ std::vector<JobsInstance> instances(n_instances);
+ for(auto& instance : instances) {
+     instance.anim = static_cast<uint32>(BenchRandom(0.0f, 0.999f)*skeleton.animations.size());
+     instance.time = BenchRandom(0.0f, skeleton.animations[instance.anim].duration);
+     instance.cursor = 0;
+     instance.palette = nullptr;
+     instance.jm.resize(n_bones);
+    }
+
+ // one thread is the reference, other thread counts must upload the same palettes
+ uint32 n_cores = std::max(std::thread::hardware_concurrency(), 1u);
+ uint32 max_threads = std::max(n_cores, 4u);
+ std::vector<affine3D> reference(n_instances*n_bones);
+ std::vector<affine3D> upload(n_instances*n_bones);
+ double serial_time = 0.0;
+ uint32 mismatches = 0;
+ for(uint32 n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+     JobSystem jobs;
+     jobs.start(n_threads);
+     std::vector<JobsInstance> temp = instances;
+     double upload_time = 0.0;
+     double time = UpdateJobs(skeleton, cache, jobs, temp, n_frames, (n_threads == 1 ? reference : upload), upload_time);
+     if(n_threads == 1) serial_time = time;
+     else if(std::memcmp(upload.data(), reference.data(), upload.size()*sizeof(affine3D)) != 0) mismatches++;
+     std::cout << "  " << n_threads << " thread" << (n_threads == 1 ? "" : "s") << " = " << (1.0e3*time/n_frames) << " ms/frame (upload = " << (1.0e3*upload_time/n_frames) << " ms/frame, speedup = " << (serial_time/time) << ")" << std::endl;
+    }
+ std::cout << "  mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
+
+bool JobsBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries)
+{
+ // skeletons of models that have bones
+ std::vector<BenchSkeleton> skeletons;
+ LoadBenchSkeletons(meshes, skeletons);
+ if(skeletons.empty()) {
+    std::cout << "jobs: no models with bones" << std::endl;
+    return true;
+   }
+
+ // largest skeleton with long animations added
+ size_t largest = 0;
+ for(size_t i = 1; i < skeletons.size(); i++) if(skeletons[largest].bones.size() < skeletons[i].bones.size()) largest = i;
+ BenchSkeleton& skeleton = skeletons[largest];
+ const uint32 n_keys[] = { 100, 400 };
+ for(uint32 keys : n_keys) {
+     MeshAnimation animation;
+     MakeBenchAnimation(skeleton, keys, animation);
+     skeleton.animations.push_back(std::move(animation));
+    }
+
+ // live evaluation and shared palettes (cached up front, since caching is not thread-safe)
+ AnimationCache live;
+ AnimationCacheOptions options;
+ options.lazy = false;
+ AnimationCache cached;
+ cached.construct(skeleton.bones, skeleton.animations, options);
+
+ bool passed = true;
+ uint32 n_frames = std::max(4u, n_queries/100000);
+ const uint32 n_instances[] = { 256, 1024 };
+ for(uint32 n : n_instances) {
+     BenchSeed(0x489ul);
+     std::cout << "jobs: " << skeleton.name << ", " << n << " instances, " << skeleton.bones.size() << " bones, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+     std::cout << " live:" << std::endl;
+     passed &= JobsTest(skeleton, live, n, n_frames);
+     BenchSeed(0x489ul);
+     std::cout << " 30 Hz cache:" << std::endl;
+     passed &= JobsTest(skeleton, cached, n, n_frames);
+    }
+ return passed;
+}
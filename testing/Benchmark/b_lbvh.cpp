@@ -0,0 +1,150 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// builds a mesh of n*n*n copies of a mesh laid out on a grid
+static void ReplicateBenchMesh(const BenchMesh& mesh, uint32 n, BenchMesh& result)
+{
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ real32 dv[3];
+ for(int i = 0; i < 3; i++) dv[i] = 1.1f*(b[i] - a[i]) + 1.0e-3f;
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ result.name = mesh.name + " x" + std::to_string(n*n*n);
+ result.verts.clear();
+ result.faces.clear();
+ result.verts.reserve(n*n*n*mesh.verts.size());
+ result.faces.reserve(n*n*n*mesh.faces.size());
+ uint32 offset = 0;
+ for(uint32 i = 0; i < n; i++) {
+     for(uint32 j = 0; j < n; j++) {
+         for(uint32 k = 0; k < n; k++) {
+             for(auto& v : mesh.verts) result.verts.push_back(vector3D(v[0] + i*dv[0], v[1] + j*dv[1], v[2] + k*dv[2]));
+             for(auto& f : mesh.faces) result.faces.push_back(f + offset);
+             offset += n_verts;
+            }
+        }
+    }
+}
+
+// compares Morton code (LBVH) builds against binned SAH builds
+static bool LBVHBenchmark(const BenchMesh& mesh, uint32 n_queries, uint32& mismatches)
+{
+ // builder configurations
+ struct {
+  const char* name;
+  uint32 n_bins;
+  bool sah;
+  bool morton;
+  bool treelets;
+ } configs[] = {
+  { "binned, dominant axis, 8 bins", 8, false, false, false },
+  { "binned SAH, 16 bins", 16, true, false, false },
+  { "LBVH", 8, false, true, false },
+  { "LBVH + treelets", 8, false, true, true },
+ };
+
+ // query bounds are the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // generate segments of a quarter of the smallest mesh dimension in random directions
+ real32 distance = 0.25f*std::min(std::min(diagonal[0], diagonal[1]), diagonal[2]) + 1.0e-3f;
+ std::vector<PointLinearCollisionTest> queries(n_queries);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     PointLinearCollisionTest& q = queries[i];
+     q.point.reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+     q.D = distance*unit(D);
+     q.t1 = 0.0f;
+     q.t2 = 1.0f;
+    }
+
+ // report
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ std::cout << "lbvh: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (n_indices/3) << std::endl;
+
+ // results of first configuration are the reference
+ std::vector<PointLinearCollisionTest> reference;
+ for(auto& config : configs)
+    {
+     // construct BVH (construct sorts the index buffer, so use a copy)
+     BVHBuildOptions options;
+     options.n_bins = config.n_bins;
+     options.all_axes = config.sah;
+     options.sah_termination = config.sah;
+     options.morton = config.morton;
+     options.treelets = config.treelets;
+     std::vector<uint32> faces(mesh.faces);
+     BVH bvh;
+     double build_time = BenchTime();
+     bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices, options);
+     build_time = BenchTime() - build_time;
+
+     // queries
+     std::vector<PointLinearCollisionTest> results(queries);
+     uint32 hits = 0;
+     uint64 visits = 0;
+     double query_time = BenchTime();
+     for(uint32 i = 0; i < n_queries; i++) {
+         bvh.collide(results[i]);
+         visits += results[i].visits;
+         if(results[i].collide) hits++;
+        }
+     query_time = BenchTime() - query_time;
+
+     // compare against reference
+     uint32 errors = 0;
+     if(reference.empty()) reference = results;
+     else {
+        for(uint32 i = 0; i < n_queries; i++) {
+            const PointLinearCollisionTest& p = reference[i];
+            const PointLinearCollisionTest& q = results[i];
+            if(p.collide != q.collide) errors++;
+            else if(p.collide && std::abs(p.t - q.t)*length(q.D) > 1.0e-3f) errors++;
+           }
+       }
+     mismatches += errors;
+
+     // tree quality
+     BVHQualityReport report;
+     bvh.quality(report);
+     std::cout << " " << config.name << std::endl;
+     std::cout << "  build time = " << 1000.0*build_time << " ms" << std::endl;
+     std::cout << "  SAH cost = " << report.sah_cost << std::endl;
+     std::cout << "  nodes = " << report.n_nodes << ", leaves = " << report.n_leaves << std::endl;
+     std::cout << "  average depth = " << report.avg_depth << ", max depth = " << report.max_depth << std::endl;
+     std::cout << "  queries: " << hits << " hits, " << (static_cast<double>(visits)/n_queries) << " nodes/query, " << (n_queries/query_time) << " queries/sec, " << errors << " mismatches" << std::endl;
+    }
+ return true;
+}
+
+bool LBVHBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // mesh as loaded
+ uint32 mismatches = 0;
+ LBVHBenchmark(mesh, n_queries, mismatches);
+
+ // build times are more telling on large meshes, so also test about a million triangles
+ uint32 n_faces = static_cast<uint32>(mesh.faces.size()/3);
+ if(n_faces && n_faces < 0x100000ul) {
+    BenchMesh large;
+    uint32 n = 1;
+    while(n*n*n*n_faces < 0x100000ul) n++;
+    ReplicateBenchMesh(mesh, n, large);
+    LBVHBenchmark(large, n_queries, mismatches);
+   }
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
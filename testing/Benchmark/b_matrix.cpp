@@ -0,0 +1,170 @@
+#include "../../stdafx.h"
+#include "../../matrix4.h"
+#include "../../affine3.h"
+#include "bench.h"
+
+// random bone-like transform (rotation, scale, translation)
+static void RandomBoneMatrix(matrix4D& m)
+{
+ real32 q[4] = { BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f) };
+ real32 norm = std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+ if(norm < 1.0e-3f) q[0] = norm = 1.0f;
+ for(int i = 0; i < 4; i++) q[i] /= norm;
+ matrix4D R;
+ R.load_quaternion(q);
+ m.load_scaling(BenchRandom(0.5f, 2.0f), BenchRandom(0.5f, 2.0f), BenchRandom(0.5f, 2.0f));
+ m = m * R;
+ m[0x3] += BenchRandom(-10.0f, 10.0f);
+ m[0x7] += BenchRandom(-10.0f, 10.0f);
+ m[0xB] += BenchRandom(-10.0f, 10.0f);
+}
+
+// largest difference relative to the size of the reference value
+static real32 MaxError(const real32* x, const real32* ref, size_t n)
+{
+ real32 error = 0.0f;
+ for(size_t i = 0; i < n; i++) error = std::max(error, std::abs(x[i] - ref[i])/std::max(1.0f, std::abs(ref[i])));
+ return error;
+}
+
+bool MatrixBenchmark(const std::vector<BenchMesh>&, uint32 n_queries)
+{
+ // data sets small enough to stay in cache
+ const uint32 n_matrices = 1024;
+ const uint32 n_vectors = 4096;
+ std::vector<matrix4D> A(n_matrices);
+ std::vector<matrix4D> B(n_matrices);
+ std::vector<real32> V(4*n_vectors);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_matrices; i++) {
+     RandomBoneMatrix(A[i]);
+     RandomBoneMatrix(B[i]);
+    }
+ for(uint32 i = 0; i < n_vectors; i++) {
+     V[4*i + 0] = BenchRandom(-10.0f, 10.0f);
+     V[4*i + 1] = BenchRandom(-10.0f, 10.0f);
+     V[4*i + 2] = BenchRandom(-10.0f, 10.0f);
+     V[4*i + 3] = (i & 1 ? 1.0f : 0.0f);
+    }
+
+ // each operation runs about n_queries times
+ uint32 mul_passes = std::max(1u, n_queries/n_matrices);
+ uint32 vector_passes = std::max(1u, n_queries/n_vectors);
+ static const char* names[] = { "scalar", "SSE2", "AVX", "AVX + FMA" };
+
+ // results
+ std::vector<matrix4D> X(n_matrices);
+ std::vector<matrix4D> Y(n_matrices);
+ std::vector<real32> W(4*n_vectors);
+ std::vector<matrix4D> ref_mul(n_matrices);
+ std::vector<matrix4D> ref_inv(n_matrices);
+ std::vector<real32> ref_vec(4*n_vectors);
+ double ref_time[3] = { 0.0, 0.0, 0.0 };
+ double best_time[2] = { 0.0, 0.0 };
+
+ // run every instruction set the CPU supports (scalar first for reference results)
+ matrix4D_simd_type best = matrix4D_simd_support();
+ uint32 mismatches = 0;
+ std::cout << "matrix: " << names[best] << " supported" << std::endl;
+ for(int type = MATRIX4D_SCALAR; type <= best; type++)
+    {
+     matrix4D_select_simd(static_cast<matrix4D_simd_type>(type));
+
+     // multiply (same products the bone palette computes)
+     double mul_time = BenchTime();
+     for(uint32 j = 0; j < mul_passes; j++)
+         for(uint32 i = 0; i < n_matrices; i++) X[i] = A[i] * B[(i + j) & (n_matrices - 1)];
+     mul_time = BenchTime() - mul_time;
+     for(uint32 i = 0; i < n_matrices; i++) X[i] = A[i] * B[i];
+
+     // invert
+     double inv_time = BenchTime();
+     for(uint32 j = 0; j < mul_passes; j++) {
+         for(uint32 i = 0; i < n_matrices; i++) {
+             Y[i] = X[i];
+             Y[i].invert();
+            }
+        }
+     inv_time = BenchTime() - inv_time;
+
+     // transform vectors
+     double vec_time = BenchTime();
+     for(uint32 j = 0; j < vector_passes; j++) matrix4D_vector4_mul(W.data(), A[j & (n_matrices - 1)].m, V.data(), n_vectors);
+     vec_time = BenchTime() - vec_time;
+     matrix4D_vector4_mul(W.data(), A[0].m, V.data(), n_vectors);
+
+     // compare against scalar results
+     if(type == MATRIX4D_SCALAR) {
+        ref_mul = X;
+        ref_inv = Y;
+        ref_vec = W;
+        ref_time[0] = mul_time;
+        ref_time[1] = inv_time;
+        ref_time[2] = vec_time;
+       }
+     real32 mul_error = MaxError(X[0].m, ref_mul[0].m, 16*n_matrices);
+     real32 inv_error = MaxError(Y[0].m, ref_inv[0].m, 16*n_matrices);
+     real32 vec_error = MaxError(W.data(), ref_vec.data(), 4*n_vectors);
+     if(mul_error > 1.0e-5f || inv_error > 1.0e-5f || vec_error > 1.0e-5f) mismatches++;
+
+     // inverse must undo the product
+     real32 identity_error = 0.0f;
+     for(uint32 i = 0; i < n_matrices; i++) {
+         matrix4D I = X[i] * Y[i];
+         matrix4D ref;
+         ref.load_identity();
+         identity_error = std::max(identity_error, MaxError(I.m, ref.m, 16));
+        }
+     if(identity_error > 1.0e-4f) mismatches++;
+
+     // report
+     std::cout << " " << names[type] << ":" << std::endl;
+     std::cout << "  mul: " << (1.0e9*mul_time/(mul_passes*n_matrices)) << " ns, speedup = " << (ref_time[0]/mul_time) << ", max error = " << mul_error << std::endl;
+     std::cout << "  invert: " << (1.0e9*inv_time/(mul_passes*n_matrices)) << " ns, speedup = " << (ref_time[1]/inv_time) << ", max error = " << inv_error << ", max |A*inv(A) - I| = " << identity_error << std::endl;
+     std::cout << "  vector4: " << (1.0e9*vec_time/(vector_passes*n_vectors)) << " ns, speedup = " << (ref_time[2]/vec_time) << ", max error = " << vec_error << std::endl;
+     best_time[0] = mul_time;
+     best_time[1] = inv_time;
+    }
+
+ // same products and inverses with 3x4 affine matrices (speedups relative to the fastest matrix4D kernels)
+ std::vector<affine3D> AA(n_matrices);
+ std::vector<affine3D> AB(n_matrices);
+ std::vector<affine3D> AX(n_matrices);
+ std::vector<affine3D> AY(n_matrices);
+ for(uint32 i = 0; i < n_matrices; i++) {
+     AA[i] = affine3D(A[i]);
+     AB[i] = affine3D(B[i]);
+    }
+ double affine_mul_time = BenchTime();
+ for(uint32 j = 0; j < mul_passes; j++)
+     for(uint32 i = 0; i < n_matrices; i++) AX[i] = AA[i] * AB[(i + j) & (n_matrices - 1)];
+ affine_mul_time = BenchTime() - affine_mul_time;
+ for(uint32 i = 0; i < n_matrices; i++) AX[i] = AA[i] * AB[i];
+ double affine_inv_time = BenchTime();
+ for(uint32 j = 0; j < mul_passes; j++) {
+     for(uint32 i = 0; i < n_matrices; i++) {
+         AY[i] = AX[i];
+         AY[i].invert();
+        }
+    }
+ affine_inv_time = BenchTime() - affine_inv_time;
+
+ // compare against matrix4D results (converted back, so the bottom row is checked too)
+ real32 affine_mul_error = 0.0f;
+ real32 affine_inv_error = 0.0f;
+ for(uint32 i = 0; i < n_matrices; i++) {
+     matrix4D X4 = static_cast<matrix4D>(AX[i]);
+     matrix4D Y4 = static_cast<matrix4D>(AY[i]);
+     affine_mul_error = std::max(affine_mul_error, MaxError(X4.m, ref_mul[i].m, 16));
+     affine_inv_error = std::max(affine_inv_error, MaxError(Y4.m, ref_inv[i].m, 16));
+    }
+ if(affine_mul_error > 1.0e-5f || affine_inv_error > 1.0e-4f) mismatches++;
+ std::cout << " affine3D (" << sizeof(affine3D) << " bytes, matrix4D = " << sizeof(matrix4D) << " bytes):" << std::endl;
+ std::cout << "  mul: " << (1.0e9*affine_mul_time/(mul_passes*n_matrices)) << " ns, speedup = " << (best_time[0]/affine_mul_time) << ", max error = " << affine_mul_error << std::endl;
+ std::cout << "  invert: " << (1.0e9*affine_inv_time/(mul_passes*n_matrices)) << " ns, speedup = " << (best_time[1]/affine_inv_time) << ", max error = " << affine_inv_error << std::endl;
+
+ // keep the best kernels selected
+ matrix4D_select_simd(best);
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
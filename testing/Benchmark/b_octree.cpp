@@ -0,0 +1,152 @@
+#include "../../stdafx.h"
+#include "../../octree.h"
+#include "bench.h"
+
+// frustum planes (inward normals) of a perspective camera at E looking along F with up U
+static void BenchFrustum(const vector3D& E, const vector3D& F, const vector3D& U, real32 fovy, real32 aspect, real32 zn, real32 zf, real32 (*planes)[4])
+{
+ vector3D R = unit(vector_product(F, U));
+ vector3D Y = vector_product(R, F);
+ real32 hy = std::tan(0.5f*fovy*3.14159265f/180.0f);
+ real32 hx = hy*aspect;
+ vector3D normals[6] = {
+  unit(R + hx*F),  // left
+  unit(-R + hx*F), // right
+  unit(Y + hy*F),  // bottom
+  unit(-Y + hy*F), // top
+  F,               // near
+  -F,              // far
+ };
+ for(uint32 i = 0; i < 6; i++) {
+     planes[i][0] = normals[i][0];
+     planes[i][1] = normals[i][1];
+     planes[i][2] = normals[i][2];
+     planes[i][3] = -scalar_product(normals[i], E);
+    }
+ planes[4][3] -= zn;
+ planes[5][3] += zf;
+}
+
+bool OctreeBenchmark(const std::vector<BenchMesh>&, uint32 n_queries)
+{
+ // synthetic map: instances scattered over a large area, mostly small props with a few large
+ // buildings, on a mostly flat world
+ const uint32 n_instances = 50000;
+ const real32 size = 2000.0f;
+ std::vector<AABB_minmax> bounds(n_instances);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_instances; i++) {
+     real32 x = BenchRandom(0.0f, size);
+     real32 y = BenchRandom(0.0f, size);
+     real32 z = BenchRandom(0.0f, 50.0f);
+     real32 r = (i % 100 == 0 ? BenchRandom(10.0f, 40.0f) : BenchRandom(0.5f, 4.0f));
+     real32 h = r*BenchRandom(0.5f, 2.0f);
+     bounds[i].from(x - r, y - r, z, x + r, y + r, z + h);
+    }
+
+ // construct
+ LooseOctree octree;
+ double build_time = BenchTime();
+ octree.construct(bounds.data(), nullptr, n_instances);
+ build_time = BenchTime() - build_time;
+ std::cout << "octree: " << n_instances << " instances" << std::endl;
+ std::cout << " build time = " << 1000.0*build_time << " ms" << std::endl;
+ std::cout << " nodes = " << octree.n_nodes() << std::endl;
+
+ // result buffers (allocated once)
+ std::vector<uint32> result(n_instances);
+ std::vector<uint32> reference;
+ reference.reserve(n_instances);
+ uint32 mismatches = 0;
+
+ // compares octree results against testing every instance
+ auto COMPARE = [&](uint32 count, auto test) {
+  reference.clear();
+  for(uint32 i = 0; i < n_instances; i++) if(test(bounds[i])) reference.push_back(i);
+  std::sort(result.begin(), result.begin() + count);
+  if(count != reference.size() || !std::equal(reference.begin(), reference.end(), result.begin())) mismatches++;
+ };
+
+ // query types
+ n_queries = std::max(std::min(n_queries/100u, 100000u), 100u);
+ uint32 n_checks = std::min(n_queries, 200u);
+ for(uint32 type = 0; type < 3; type++)
+    {
+     // generate queries
+     struct BenchQuery {
+      AABB_minmax aabb;
+      real32 center[3];
+      real32 radius;
+      real32 planes[6][4];
+     };
+     std::vector<BenchQuery> queries(n_queries);
+     for(uint32 i = 0; i < n_queries; i++) {
+         BenchQuery& q = queries[i];
+         vector3D P(BenchRandom(0.0f, size), BenchRandom(0.0f, size), BenchRandom(0.0f, 50.0f));
+         real32 r = BenchRandom(5.0f, 50.0f);
+         q.aabb.from(P[0] - r, P[1] - r, P[2] - r, P[0] + r, P[1] + r, P[2] + r);
+         q.center[0] = P[0];
+         q.center[1] = P[1];
+         q.center[2] = P[2];
+         q.radius = r;
+         vector3D F(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-0.2f, 0.2f));
+         if(squared_norm(F) < 1.0e-6f) F.reset(1.0f, 0.0f, 0.0f);
+         BenchFrustum(P, unit(F), vector3D(0.0f, 0.0f, 1.0f), 60.0f, 16.0f/9.0f, 0.1f, 300.0f, q.planes);
+        }
+
+     // run queries
+     uint64 total = 0;
+     double query_time = BenchTime();
+     for(uint32 i = 0; i < n_queries; i++) {
+         const BenchQuery& q = queries[i];
+         if(type == 0) total += octree.query(q.aabb, result.data(), n_instances);
+         else if(type == 1) total += octree.query(q.center, q.radius, result.data(), n_instances);
+         else total += octree.query(q.planes, 6, result.data(), n_instances);
+        }
+     query_time = BenchTime() - query_time;
+
+     // run reference on a subset
+     double brute_time = BenchTime();
+     for(uint32 i = 0; i < n_checks; i++) {
+         const BenchQuery& q = queries[i];
+         if(type == 0) {
+            uint32 count = octree.query(q.aabb, result.data(), n_instances);
+            COMPARE(count, [&](const AABB_minmax& box) {
+             for(uint32 j = 0; j < 3; j++) if(box.b[j] < q.aabb.a[j] || q.aabb.b[j] < box.a[j]) return false;
+             return true;
+            });
+           }
+         else if(type == 1) {
+            uint32 count = octree.query(q.center, q.radius, result.data(), n_instances);
+            COMPARE(count, [&](const AABB_minmax& box) {
+             real32 d = 0.0f;
+             for(uint32 j = 0; j < 3; j++) {
+                 real32 x = std::max(std::max(box.a[j] - q.center[j], q.center[j] - box.b[j]), 0.0f);
+                 d += x*x;
+                }
+             return !(q.radius*q.radius < d);
+            });
+           }
+         else {
+            uint32 count = octree.query(q.planes, 6, result.data(), n_instances);
+            COMPARE(count, [&](const AABB_minmax& box) {
+             for(uint32 j = 0; j < 6; j++) {
+                 const real32* p = q.planes[j];
+                 real32 d = p[3];
+                 for(uint32 k = 0; k < 3; k++) d += p[k]*(p[k] < 0.0f ? box.a[k] : box.b[k]);
+                 if(d < 0.0f) return false;
+                }
+             return true;
+            });
+           }
+        }
+     brute_time = BenchTime() - brute_time;
+
+     // report
+     const char* names[3] = { "AABB", "sphere", "frustum" };
+     std::cout << " " << names[type] << " queries: " << (static_cast<double>(total)/n_queries) << " instances/query, ";
+     std::cout << (n_queries/query_time) << " queries/sec (octree), " << (n_checks/brute_time) << " queries/sec (all instances)" << std::endl;
+    }
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
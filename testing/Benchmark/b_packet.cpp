@@ -0,0 +1,138 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// random unit vector
+static vector3D RandomDirection(void)
+{
+ vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+ if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+ return unit(D);
+}
+
+bool PacketBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // construct tree (construct sorts the index buffer, so use a copy)
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ std::vector<uint32> faces(mesh.faces);
+ BVH bvh;
+ bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices);
+
+ // players stand inside the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // three workloads made of packets of four rays
+ // burst: each player fires four rays within a few degrees of where they aim (coherent)
+ // players: all four players fire one ray each at the same time (usually divergent)
+ // aimed: a player fires at the corners and an edge point of one triangle (grazes node bounds)
+ const uint32 n_players = 4;
+ uint32 n_packets = std::max(n_queries/4, 1u);
+ std::vector<RayPacketCollisionTest> workloads[3];
+ BenchSeed(0x489ul);
+ for(int workload = 0; workload < 2; workload++)
+    {
+     workloads[workload].resize(n_packets);
+     vector3D players[n_players];
+     vector3D aims[n_players];
+     for(uint32 i = 0; i < n_packets; i++)
+        {
+         // players move and pick new targets every few packets
+         if(i % 16 == 0) {
+            for(uint32 j = 0; j < n_players; j++) {
+                players[j].reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+                aims[j] = RandomDirection();
+               }
+           }
+         RayPacketCollisionTest& packet = workloads[workload][i];
+         packet.n_rays = 4;
+         for(uint32 j = 0; j < 4; j++) {
+             uint32 player = (workload == 0 ? (i % n_players) : j);
+             vector3D spread = 0.05f*RandomDirection();
+             packet.origin[j] = players[player];
+             packet.direction[j] = unit(aims[player] + spread);
+             packet.t_max[j] = std::numeric_limits<real32>::max();
+            }
+        }
+    }
+ workloads[2].resize(n_packets);
+ for(uint32 i = 0; i < n_packets; i++) {
+     vector3D player(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     const uint32* f = &mesh.faces[3*static_cast<uint32>(BenchRandom(0.0f, 0.999f)*(n_indices/3))];
+     const vector3D& A = mesh.verts[f[0]];
+     const vector3D& B = mesh.verts[f[1]];
+     const vector3D& C = mesh.verts[f[2]];
+     const vector3D targets[4] = { A, B, C, A + BenchRandom(0.0f, 1.0f)*(B - A) };
+     RayPacketCollisionTest& packet = workloads[2][i];
+     packet.n_rays = 4;
+     for(uint32 j = 0; j < 4; j++) {
+         packet.origin[j] = player;
+         packet.direction[j] = targets[j] - player;
+         packet.t_max[j] = std::numeric_limits<real32>::max();
+        }
+    }
+
+ // report
+ std::cout << "packet: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (n_indices/3) << std::endl;
+
+ uint32 mismatches = 0;
+ for(int workload = 0; workload < 3; workload++)
+    {
+     std::vector<RayPacketCollisionTest>& packets = workloads[workload];
+
+     // single rays
+     std::vector<RayCollisionTest> rays(4*n_packets);
+     for(uint32 i = 0; i < n_packets; i++) {
+         for(uint32 j = 0; j < 4; j++) {
+             rays[4*i + j].origin = packets[i].origin[j];
+             rays[4*i + j].direction = packets[i].direction[j];
+             rays[4*i + j].t_max = packets[i].t_max[j];
+            }
+        }
+     uint64 single_visits = 0;
+     double single_time = BenchTime();
+     for(size_t i = 0; i < rays.size(); i++) {
+         bvh.collide(rays[i]);
+         single_visits += rays[i].visits;
+        }
+     single_time = BenchTime() - single_time;
+
+     // packets
+     uint64 packet_visits = 0;
+     uint32 n_coherent = 0;
+     double packet_time = BenchTime();
+     for(size_t i = 0; i < packets.size(); i++) {
+         bvh.collide(packets[i]);
+         packet_visits += packets[i].visits;
+         if(packets[i].packet) n_coherent++;
+        }
+     packet_time = BenchTime() - packet_time;
+
+     // compare
+     uint32 hits = 0;
+     for(uint32 i = 0; i < n_packets; i++) {
+         for(uint32 j = 0; j < 4; j++) {
+             const RayCollisionTest& ray = rays[4*i + j];
+             if(ray.collide) hits++;
+             if(ray.collide != packets[i].collide[j]) mismatches++;
+             else if(ray.collide && std::abs(ray.t - packets[i].t[j]) > 1.0e-4f*std::max(ray.t, 1.0f)) mismatches++;
+            }
+        }
+
+     const char* name = (workload == 0 ? "burst" : (workload == 1 ? "players" : "aimed"));
+     uint32 n_rays = 4*n_packets;
+     std::cout << " " << name << ": " << hits << " hits, " << n_coherent << " of " << n_packets << " packets coherent" << std::endl;
+     std::cout << "  single: " << (double)single_visits/n_rays << " nodes/ray, " << (n_rays/single_time) << " rays/sec" << std::endl;
+     std::cout << "  packet: " << (double)packet_visits/n_packets << " nodes/packet, " << (n_rays/packet_time) << " rays/sec" << std::endl;
+    }
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
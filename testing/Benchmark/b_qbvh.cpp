@@ -0,0 +1,106 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "../../qbvh.h"
+#include "bench.h"
+
+template<class Tree, class Test>
+static double RunQueries(Tree& tree, std::vector<Test>& queries, uint64& visits, uint32& hits)
+{
+ visits = 0;
+ hits = 0;
+ double dt = BenchTime();
+ for(size_t i = 0; i < queries.size(); i++) {
+     tree.collide(queries[i]);
+     visits += queries[i].visits;
+     if(queries[i].collide) hits++;
+    }
+ return BenchTime() - dt;
+}
+
+template<class Test>
+static uint32 CountMismatches(const std::vector<Test>& A, const std::vector<Test>& B)
+{
+ uint32 mismatches = 0;
+ for(size_t i = 0; i < A.size(); i++) {
+     if(A[i].collide != B[i].collide) mismatches++;
+     else if(A[i].collide && std::abs(A[i].t - B[i].t) > 1.0e-4f) mismatches++;
+    }
+ return mismatches;
+}
+
+bool QBVHBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // construct binary tree (construct sorts the index buffer, so use a copy)
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ std::vector<uint32> faces(mesh.faces);
+ BVH bvh;
+ bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices);
+
+ // collapse to 4-ary tree
+ QBVH qbvh;
+ double collapse_time = BenchTime();
+ qbvh.construct(bvh);
+ collapse_time = BenchTime() - collapse_time;
+
+ // query bounds are the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // segments of a quarter of the mesh diagonal and unbounded rays
+ real32 distance = 0.25f*length(diagonal);
+ std::vector<PointLinearCollisionTest> segments(n_queries);
+ std::vector<RayCollisionTest> rays(n_queries);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     vector3D O(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+     D = unit(D);
+     segments[i].point = O;
+     segments[i].D = distance*D;
+     segments[i].t1 = 0.0f;
+     segments[i].t2 = 1.0f;
+     rays[i].origin = O;
+     rays[i].direction = D;
+     rays[i].t_max = std::numeric_limits<real32>::max();
+    }
+
+ // report
+ std::cout << "qbvh: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (n_indices/3) << std::endl;
+ std::cout << " collapse time = " << 1000.0*collapse_time << " ms" << std::endl;
+ std::cout << " nodes = " << qbvh.nodes() << ", depth = " << qbvh.levels() << std::endl;
+
+ // run both workloads on both layouts
+ uint32 mismatches = 0;
+ for(int workload = 0; workload < 2; workload++)
+    {
+     uint64 visits[2];
+     uint32 hits[2];
+     double dt[2];
+     if(workload == 0) {
+        std::vector<PointLinearCollisionTest> copy(segments);
+        dt[0] = RunQueries(bvh, segments, visits[0], hits[0]);
+        dt[1] = RunQueries(qbvh, copy, visits[1], hits[1]);
+        mismatches += CountMismatches(segments, copy);
+       }
+     else {
+        std::vector<RayCollisionTest> copy(rays);
+        dt[0] = RunQueries(bvh, rays, visits[0], hits[0]);
+        dt[1] = RunQueries(qbvh, copy, visits[1], hits[1]);
+        mismatches += CountMismatches(rays, copy);
+       }
+     const char* name = (workload == 0 ? "segment" : "ray");
+     std::cout << " " << name << " binary: " << hits[0] << " hits, " << (double)visits[0]/n_queries << " nodes/query, " << (n_queries/dt[0]) << " queries/sec" << std::endl;
+     std::cout << " " << name << " 4-wide: " << hits[1] << " hits, " << (double)visits[1]/n_queries << " nodes/query, " << (n_queries/dt[1]) << " queries/sec" << std::endl;
+    }
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
@@ -0,0 +1,146 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// bends the mesh around the vertical axis at its minimum x (like a door swinging open, but
+// with an angle that increases along x so that the tree degrades)
+static void BendMesh(const BenchMesh& mesh, const real32* a, const real32* b, real32 angle, std::vector<vector3D>& verts)
+{
+ real32 dx = std::max(b[0] - a[0], 1.0e-6f);
+ for(size_t i = 0; i < mesh.verts.size(); i++) {
+     const vector3D& v = mesh.verts[i];
+     real32 x = v[0] - a[0];
+     real32 theta = angle*(x/dx);
+     real32 c = std::cos(theta);
+     real32 s = std::sin(theta);
+     verts[i].reset(a[0] + c*x, v[1], a[2] + s*x + (v[2] - a[2]));
+    }
+}
+
+template<class Tree>
+static double RunQueries(Tree& tree, std::vector<PointLinearCollisionTest>& queries, uint64& visits)
+{
+ visits = 0;
+ double dt = BenchTime();
+ for(size_t i = 0; i < queries.size(); i++) {
+     tree.collide(queries[i]);
+     visits += queries[i].visits;
+    }
+ return BenchTime() - dt;
+}
+
+static uint32 CountMismatches(const std::vector<PointLinearCollisionTest>& A, const std::vector<PointLinearCollisionTest>& B)
+{
+ uint32 mismatches = 0;
+ for(size_t i = 0; i < A.size(); i++) {
+     if(A[i].collide != B[i].collide) mismatches++;
+     else if(A[i].collide && std::abs(A[i].t - B[i].t)*length(A[i].D) > 1.0e-3f) mismatches++;
+    }
+ return mismatches;
+}
+
+bool RefitBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // mesh bounds
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ real32 scale = length(diagonal);
+
+ // trees are built once from the rest pose
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ std::vector<vector3D> verts(mesh.verts);
+ std::vector<uint32> refit_faces(mesh.faces);
+ std::vector<uint32> rebalance_faces(mesh.faces);
+ BVH refit;
+ BVH rebalance;
+ refit.construct(verts.data(), n_verts, refit_faces.data(), n_indices);
+ rebalance.construct(verts.data(), n_verts, rebalance_faces.data(), n_indices);
+
+ // report
+ std::cout << "refit: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (n_indices/3) << std::endl;
+ std::cout << " angle   rebuild(ms)  refit(ms)  rebalance(ms)  SAH rebuild/refit/rebalance  nodes/query rebuild/refit/rebalance" << std::endl;
+
+ // animate
+ const uint32 n_frames = 10;
+ const real32 rebalance_threshold = 1.2f;
+ uint32 n_frame_queries = std::max(n_queries/n_frames, 1u);
+ uint32 mismatches = 0;
+ BenchSeed(0x489ul);
+ for(uint32 frame = 1; frame <= n_frames; frame++)
+    {
+     // move vertices
+     real32 angle = 1.5707963f*frame/n_frames;
+     BendMesh(mesh, a, b, angle, verts);
+
+     // rebuild
+     std::vector<uint32> faces(mesh.faces);
+     BVH rebuild;
+     double rebuild_time = BenchTime();
+     rebuild.construct(verts.data(), n_verts, faces.data(), n_indices);
+     rebuild_time = BenchTime() - rebuild_time;
+
+     // refit
+     double refit_time = BenchTime();
+     refit.refit(verts.data());
+     refit_time = BenchTime() - refit_time;
+
+     // refit and rebalance when SAH cost degrades
+     double rebalance_time = BenchTime();
+     rebalance.refit(verts.data());
+     rebalance.rebalance(rebalance_threshold);
+     rebalance_time = BenchTime() - rebalance_time;
+
+     // tree quality
+     BVHQualityReport q1, q2, q3;
+     rebuild.quality(q1);
+     refit.quality(q2);
+     rebalance.quality(q3);
+
+     // segments of a quarter of the mesh diagonal inside bounds of moved mesh
+     real32 qa[3] = { std::numeric_limits<real32>::max(), std::numeric_limits<real32>::max(), std::numeric_limits<real32>::max() };
+     real32 qb[3] = { std::numeric_limits<real32>::lowest(), std::numeric_limits<real32>::lowest(), std::numeric_limits<real32>::lowest() };
+     for(auto& v : verts) {
+         for(int i = 0; i < 3; i++) {
+             qa[i] = std::min(qa[i], v[i]);
+             qb[i] = std::max(qb[i], v[i]);
+            }
+        }
+     std::vector<PointLinearCollisionTest> queries(n_frame_queries);
+     for(uint32 i = 0; i < n_frame_queries; i++) {
+         PointLinearCollisionTest& q = queries[i];
+         q.point.reset(BenchRandom(qa[0], qb[0]), BenchRandom(qa[1], qb[1]), BenchRandom(qa[2], qb[2]));
+         vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+         if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+         q.D = 0.25f*scale*unit(D);
+         q.t1 = 0.0f;
+         q.t2 = 1.0f;
+        }
+
+     // queries must agree with rebuilt tree
+     std::vector<PointLinearCollisionTest> r1(queries), r2(queries), r3(queries);
+     uint64 v1, v2, v3;
+     RunQueries(rebuild, r1, v1);
+     RunQueries(refit, r2, v2);
+     RunQueries(rebalance, r3, v3);
+     mismatches += CountMismatches(r1, r2);
+     mismatches += CountMismatches(r1, r3);
+
+     std::cout << " " << std::setw(5) << std::fixed << std::setprecision(1) << (57.29578f*angle);
+     std::cout << std::setprecision(3);
+     std::cout << "  " << std::setw(11) << 1000.0*rebuild_time;
+     std::cout << "  " << std::setw(9) << 1000.0*refit_time;
+     std::cout << "  " << std::setw(13) << 1000.0*rebalance_time;
+     std::cout << "  " << std::setw(8) << q1.sah_cost << " " << std::setw(8) << q2.sah_cost << " " << std::setw(8) << q3.sah_cost;
+     std::cout << "     " << std::setw(7) << (static_cast<double>(v1)/n_frame_queries) << " " << std::setw(7) << (static_cast<double>(v2)/n_frame_queries) << " " << std::setw(7) << (static_cast<double>(v3)/n_frame_queries);
+     std::cout << std::endl;
+     std::cout.unsetf(std::ios::floatfield);
+     std::cout << std::setprecision(6);
+    }
+
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
@@ -0,0 +1,112 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// prints a histogram as "index:count" pairs, skipping empty entries
+static void PrintHistogram(const char* name, const std::vector<uint32>& histogram)
+{
+ std::cout << "  " << name << ":";
+ for(size_t i = 0; i < histogram.size(); i++)
+     if(histogram[i]) std::cout << " " << i << ":" << histogram[i];
+ std::cout << std::endl;
+}
+
+bool SAHBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // builder configurations
+ struct {
+  const char* name;
+  uint32 n_bins;
+  bool sah;
+ } configs[] = {
+  { "dominant axis, 8 bins", 8, false },
+  { "SAH, 8 bins", 8, true },
+  { "SAH, 16 bins", 16, true },
+  { "SAH, 32 bins", 32, true },
+ };
+
+ // query bounds are the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // generate segments of a quarter of the mesh diagonal in random directions
+ real32 distance = 0.25f*length(diagonal);
+ std::vector<PointLinearCollisionTest> queries(n_queries);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     PointLinearCollisionTest& q = queries[i];
+     q.point.reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+     q.D = distance*unit(D);
+     q.t1 = 0.0f;
+     q.t2 = 1.0f;
+    }
+
+ // report
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ std::cout << "sah: " << mesh.name << std::endl;
+ std::cout << " triangles = " << (n_indices/3) << std::endl;
+
+ // results of first configuration are the reference
+ std::vector<PointLinearCollisionTest> reference;
+ uint32 mismatches = 0;
+ for(auto& config : configs)
+    {
+     // construct BVH (construct sorts the index buffer, so use a copy)
+     BVHBuildOptions options;
+     options.n_bins = config.n_bins;
+     options.all_axes = config.sah;
+     options.sah_termination = config.sah;
+     std::vector<uint32> faces(mesh.faces);
+     BVH bvh;
+     double build_time = BenchTime();
+     bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices, options);
+     build_time = BenchTime() - build_time;
+
+     // queries
+     std::vector<PointLinearCollisionTest> results(queries);
+     uint32 hits = 0;
+     uint64 visits = 0;
+     double query_time = BenchTime();
+     for(uint32 i = 0; i < n_queries; i++) {
+         bvh.collide(results[i]);
+         visits += results[i].visits;
+         if(results[i].collide) hits++;
+        }
+     query_time = BenchTime() - query_time;
+
+     // compare against reference
+     if(reference.empty()) reference = results;
+     else {
+        for(uint32 i = 0; i < n_queries; i++) {
+            const PointLinearCollisionTest& p = reference[i];
+            const PointLinearCollisionTest& q = results[i];
+            if(p.collide != q.collide) mismatches++;
+            else if(p.collide && std::abs(p.t - q.t)*length(q.D) > 1.0e-3f) mismatches++;
+           }
+       }
+
+     // tree quality
+     BVHQualityReport report;
+     bvh.quality(report);
+     std::cout << " " << config.name << std::endl;
+     std::cout << "  build time = " << 1000.0*build_time << " ms" << std::endl;
+     std::cout << "  SAH cost = " << report.sah_cost << std::endl;
+     std::cout << "  nodes = " << report.n_nodes << ", leaves = " << report.n_leaves << std::endl;
+     std::cout << "  average leaf size = " << report.avg_leaf_size << std::endl;
+     std::cout << "  average depth = " << report.avg_depth << ", max depth = " << report.max_depth << std::endl;
+     PrintHistogram("leaf sizes", report.leaf_sizes);
+     PrintHistogram("depths", report.depths);
+     std::cout << "  queries: " << hits << " hits, " << (static_cast<double>(visits)/n_queries) << " nodes/query, " << (n_queries/query_time) << " queries/sec" << std::endl;
+    }
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
@@ -0,0 +1,223 @@
+#include "../../stdafx.h"
+#include "../../broadphase.h"
+#include "bench.h"
+
+// proxy groups (static boxes like doors and triggers only pair with movers)
+static const uint32 SAP_BENCH_STATIC = 0x1ul;
+static const uint32 SAP_BENCH_MOVER = 0x2ul;
+
+// benchmark proxy
+struct SAPBenchProxy {
+ uint32 proxy;
+ uint32 group;
+ uint32 mask;
+ real32 center[3];
+ real32 velocity[3];
+ real32 radius;
+ AABB_minmax aabb;
+};
+
+static void SAPBenchBounds(SAPBenchProxy& p)
+{
+ p.aabb.from(p.center[0] - p.radius, p.center[1] - p.radius, p.center[2] - p.radius, p.center[0] + p.radius, p.center[1] + p.radius, p.center[2] + p.radius);
+}
+
+// reference result, tests every pair
+static void BruteForcePairs(const std::vector<SAPBenchProxy>& list, std::set<std::pair<uint32, uint32>>& pairs)
+{
+ pairs.clear();
+ for(size_t i = 0; i < list.size(); i++) {
+     for(size_t j = i + 1; j < list.size(); j++) {
+         const SAPBenchProxy& A = list[i];
+         const SAPBenchProxy& B = list[j];
+         if(!((A.group & B.mask) || (B.group & A.mask))) continue;
+         bool overlap = true;
+         for(int k = 0; k < 3 && overlap; k++)
+             overlap = (A.aabb.a[k] < B.aabb.b[k]) && (B.aabb.a[k] < A.aabb.b[k]);
+         if(overlap) pairs.insert(std::make_pair(std::min(A.proxy, B.proxy), std::max(A.proxy, B.proxy)));
+        }
+    }
+}
+
+// proxies on a small integer grid, where many endpoints are equal, and point proxies (like
+// cameras) move, are removed, and are reinserted; returns number of mismatched frames
+static uint32 SAPGridTest(uint32 n_frames)
+{
+ const uint32 n_boxes = 40;
+ const uint32 n_points = 40;
+ const real32 size = 12.0f;
+ auto GRID = [](real32 lo, real32 hi) { return std::floor(BenchRandom(lo, hi)); };
+
+ // a door spanning 0 to 10 and a camera that moves from outside to inside it
+ uint32 mismatches = 0;
+ SweepAndPrune door_test;
+ AABB_minmax door(0.0f, 0.0f, 0.0f, 10.0f, 10.0f, 10.0f);
+ AABB_minmax camera(25.0f, 25.0f, 25.0f, 25.0f, 25.0f, 25.0f);
+ uint32 door_proxy = door_test.insert(door, SAP_BENCH_STATIC, 0, 0);
+ uint32 camera_proxy = door_test.insert(camera, SAP_BENCH_MOVER, SAP_BENCH_STATIC, 1);
+ camera.from(5.0f, 5.0f, 5.0f, 5.0f, 5.0f, 5.0f);
+ door_test.move(camera_proxy, camera);
+ if(!door_test.overlapping(door_proxy, camera_proxy)) mismatches++;
+ camera.from(10.0f, 5.0f, 5.0f, 10.0f, 5.0f, 5.0f);
+ door_test.move(camera_proxy, camera);
+ if(door_test.overlapping(door_proxy, camera_proxy)) mismatches++;
+ door_test.remove(camera_proxy);
+ camera.from(5.0f, 5.0f, 5.0f, 5.0f, 5.0f, 5.0f);
+ camera_proxy = door_test.insert(camera, SAP_BENCH_MOVER, SAP_BENCH_STATIC, 1);
+ if(!door_test.overlapping(door_proxy, camera_proxy)) mismatches++;
+
+ // boxes and points on a grid
+ SweepAndPrune sap;
+ std::vector<SAPBenchProxy> list(n_boxes + n_points);
+ for(uint32 i = 0; i < list.size(); i++) {
+     SAPBenchProxy& p = list[i];
+     bool point = !(i < n_boxes);
+     p.group = (point ? SAP_BENCH_MOVER : SAP_BENCH_STATIC);
+     p.mask = (point ? (SAP_BENCH_STATIC | SAP_BENCH_MOVER) : SAP_BENCH_MOVER);
+     for(int j = 0; j < 3; j++) p.center[j] = GRID(0.0f, size);
+     p.radius = (point ? 0.0f : GRID(1.0f, 4.0f));
+     SAPBenchBounds(p);
+     p.proxy = sap.insert(p.aabb, p.group, p.mask, i);
+    }
+
+ // move points and boxes by whole steps, and remove and reinsert some of them
+ std::set<std::pair<uint32, uint32>> reported;
+ std::set<std::pair<uint32, uint32>> reference;
+ for(uint32 frame = 0; frame < n_frames; frame++) {
+     for(uint32 i = 0; i < list.size(); i++) {
+         SAPBenchProxy& p = list[i];
+         uint32 action = static_cast<uint32>(BenchRandom(0.0f, 3.999f));
+         for(int j = 0; j < 3; j++) p.center[j] = std::min(std::max(p.center[j] + GRID(-1.0f, 1.999f), 0.0f), size);
+         SAPBenchBounds(p);
+         if(action == 0) {
+            sap.remove(p.proxy);
+            p.proxy = sap.insert(p.aabb, p.group, p.mask, i);
+           }
+         else
+            sap.move(p.proxy, p.aabb);
+        }
+     for(auto& event : sap.events()) {
+         auto pair = std::make_pair(sap.id(event.proxy[0]), sap.id(event.proxy[1]));
+         if(pair.second < pair.first) std::swap(pair.first, pair.second);
+         if(event.type == SAP_BEGIN_OVERLAP) reported.insert(pair);
+         else reported.erase(pair);
+        }
+     sap.clear_events();
+
+     // compare by index in list (proxies are reused after removal)
+     std::vector<SAPBenchProxy> indexed(list);
+     for(uint32 i = 0; i < indexed.size(); i++) indexed[i].proxy = i;
+     BruteForcePairs(indexed, reference);
+     if(reference != reported || reference.size() != sap.n_pairs()) mismatches++;
+    }
+ return mismatches;
+}
+
+bool SAPBenchmark(const std::vector<BenchMesh>&, uint32 n_queries)
+{
+ // world
+ const uint32 n_static = 2000;
+ const uint32 n_movers = 2000;
+ const real32 size = 200.0f;
+ uint32 n_frames = std::max(n_queries/10000u, 10u);
+
+ // proxies
+ SweepAndPrune sap;
+ std::vector<SAPBenchProxy> list(n_static + n_movers);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < list.size(); i++) {
+     SAPBenchProxy& p = list[i];
+     bool mover = !(i < n_static);
+     p.group = (mover ? SAP_BENCH_MOVER : SAP_BENCH_STATIC);
+     p.mask = (mover ? (SAP_BENCH_STATIC | SAP_BENCH_MOVER) : 0);
+     for(int j = 0; j < 3; j++) {
+         p.center[j] = BenchRandom(0.0f, size);
+         p.velocity[j] = (mover ? BenchRandom(-10.0f, 10.0f) : 0.0f);
+        }
+     p.radius = (mover ? BenchRandom(0.5f, 1.5f) : BenchRandom(1.0f, 4.0f));
+     SAPBenchBounds(p);
+    }
+
+ // insert
+ double insert_time = BenchTime();
+ for(uint32 i = 0; i < list.size(); i++) list[i].proxy = sap.insert(list[i].aabb, list[i].group, list[i].mask, i);
+ insert_time = BenchTime() - insert_time;
+
+ // pairs reported by events
+ std::set<std::pair<uint32, uint32>> reported;
+ auto PROCESS_EVENTS = [&](uint32& n_begin, uint32& n_end) {
+  for(auto& event : sap.events()) {
+      auto pair = std::make_pair(event.proxy[0], event.proxy[1]);
+      if(event.type == SAP_BEGIN_OVERLAP) {
+         reported.insert(pair);
+         n_begin++;
+        }
+      else {
+         reported.erase(pair);
+         n_end++;
+        }
+     }
+  sap.clear_events();
+ };
+ uint32 n_begin = 0;
+ uint32 n_end = 0;
+ PROCESS_EVENTS(n_begin, n_end);
+
+ // simulate
+ const real32 dt = 1.0f/60.0f;
+ double sap_time = 0.0;
+ double brute_time = 0.0;
+ uint32 mismatches = 0;
+ uint64 total_pairs = 0;
+ std::set<std::pair<uint32, uint32>> reference;
+ for(uint32 frame = 0; frame < n_frames; frame++)
+    {
+     // move (bounce off world bounds)
+     for(uint32 i = n_static; i < list.size(); i++) {
+         SAPBenchProxy& p = list[i];
+         for(int j = 0; j < 3; j++) {
+             p.center[j] += dt*p.velocity[j];
+             if(p.center[j] < 0.0f || p.center[j] > size) p.velocity[j] = -p.velocity[j];
+            }
+         SAPBenchBounds(p);
+        }
+
+     // every tenth frame, remove and reinsert a few movers somewhere else
+     double t0 = BenchTime();
+     if(frame % 10 == 9) {
+        for(uint32 i = 0; i < 10; i++) {
+            SAPBenchProxy& p = list[n_static + (frame*7 + i*131) % n_movers];
+            sap.remove(p.proxy);
+            for(int j = 0; j < 3; j++) p.center[j] = BenchRandom(0.0f, size);
+            SAPBenchBounds(p);
+            p.proxy = sap.insert(p.aabb, p.group, p.mask, static_cast<uint32>(&p - &list[0]));
+           }
+       }
+
+     // update broadphase
+     for(uint32 i = n_static; i < list.size(); i++) sap.move(list[i].proxy, list[i].aabb);
+     sap_time += BenchTime() - t0;
+     PROCESS_EVENTS(n_begin, n_end);
+
+     // compare against all pairs
+     double t1 = BenchTime();
+     BruteForcePairs(list, reference);
+     brute_time += BenchTime() - t1;
+     if(reference != reported || reference.size() != sap.n_pairs()) mismatches++;
+     total_pairs += reference.size();
+    }
+
+ // report
+ std::cout << "sap: " << n_static << " static boxes, " << n_movers << " moving boxes, " << n_frames << " frames" << std::endl;
+ std::cout << " insert time = " << 1000.0*insert_time << " ms" << std::endl;
+ std::cout << " average pairs = " << (static_cast<double>(total_pairs)/n_frames) << std::endl;
+ std::cout << " events: " << n_begin << " begin, " << n_end << " end" << std::endl;
+ std::cout << " sweep and prune = " << (1000.0*sap_time/n_frames) << " ms/frame" << std::endl;
+ std::cout << " all pairs = " << (1000.0*brute_time/n_frames) << " ms/frame" << std::endl;
+ std::cout << " mismatched frames = " << mismatches << std::endl;
+
+ // ties and point proxies
+ uint32 grid_mismatches = SAPGridTest(n_frames);
+ std::cout << " grid with point proxies: mismatched frames = " << grid_mismatches << std::endl;
+ return (mismatches == 0 && grid_mismatches == 0);
+}
@@ -0,0 +1,226 @@
+#include "../../stdafx.h"
+#include "../../matrix4.h"
+#include "../../bvh.h"
+#include "../../scene.h"
+#include "bench.h"
+
+// instance placed in the benchmark world
+struct BenchInstance {
+ uint32 mesh;
+ real32 scale;
+ matrix4D mv;
+ matrix4D inv;
+};
+
+// random rotation, uniform scale, and translation
+static void RandomInstance(BenchInstance& instance, real32 size, const real32* a, const real32* b)
+{
+ real32 q[4] = { BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f) };
+ real32 norm = std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+ if(norm < 1.0e-3f) { q[0] = 1.0f; q[1] = q[2] = q[3] = 0.0f; norm = 1.0f; }
+ instance.mv.load_quaternion(q[0]/norm, q[1]/norm, q[2]/norm, q[3]/norm);
+ instance.scale = BenchRandom(0.5f, 1.5f)*size;
+ for(int i = 0; i < 3; i++) {
+     instance.mv.m[4*i + 0] *= instance.scale;
+     instance.mv.m[4*i + 1] *= instance.scale;
+     instance.mv.m[4*i + 2] *= instance.scale;
+     instance.mv.m[4*i + 3] = BenchRandom(a[i], b[i]);
+    }
+ instance.inv = instance.mv;
+ instance.inv.invert();
+}
+
+// world space segment in model space
+static void LocalSegment(const BenchInstance& instance, const vector3D& O, const vector3D& V, vector3D& local_O, vector3D& local_V)
+{
+ local_O = instance.inv*O;
+ local_V = instance.inv*V;
+ local_V[0] -= instance.inv.m[0x3];
+ local_V[1] -= instance.inv.m[0x7];
+ local_V[2] -= instance.inv.m[0xB];
+}
+
+// reference result, tests every instance
+static void LoopCollide(std::vector<BVH>& trees, const std::vector<BenchInstance>& instances, PointLinearCollisionTest& info, uint32& id)
+{
+ vector3D V = (info.t2 - info.t1)*info.D;
+ real32 best = 1.0f;
+ info.collide = false;
+ for(uint32 i = 0; i < instances.size(); i++) {
+     PointLinearCollisionTest local;
+     LocalSegment(instances[i], info.point, V, local.point, local.D);
+     local.t1 = 0.0f;
+     local.t2 = best;
+     trees[instances[i].mesh].collide(local);
+     if(local.collide) {
+        best = local.t;
+        info.collide = true;
+        id = i;
+       }
+    }
+ info.t = (info.collide ? info.t1 + best*(info.t2 - info.t1) : info.t2);
+}
+
+static void LoopCollide(std::vector<BVH>& trees, const std::vector<BenchInstance>& instances, SphereLinearCollisionTest& info, uint32& id)
+{
+ vector3D O(info.S.center[0], info.S.center[1], info.S.center[2]);
+ vector3D V = (info.t2 - info.t1)*info.D;
+ real32 best = 1.0f;
+ info.collide = false;
+ for(uint32 i = 0; i < instances.size(); i++) {
+     SphereLinearCollisionTest local;
+     vector3D local_O;
+     LocalSegment(instances[i], O, V, local_O, local.D);
+     local.S.center[0] = local_O[0];
+     local.S.center[1] = local_O[1];
+     local.S.center[2] = local_O[2];
+     local.S.radius = info.S.radius/instances[i].scale;
+     local.t1 = 0.0f;
+     local.t2 = best;
+     trees[instances[i].mesh].collide(local);
+     if(local.collide) {
+        best = local.t;
+        info.collide = true;
+        id = i;
+       }
+    }
+ info.t = (info.collide ? info.t1 + best*(info.t2 - info.t1) : info.t2);
+}
+
+bool SceneBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries)
+{
+ if(meshes.empty()) return false;
+
+ // world of 10,000 instances about 10 units in size
+ const uint32 n_instances = 10000;
+ const real32 a[3] = { -300.0f, -50.0f, -300.0f };
+ const real32 b[3] = { +300.0f, +50.0f, +300.0f };
+
+ // bottom level (one tree per mesh)
+ SceneBVH scene;
+ std::vector<std::vector<uint32>> faces(meshes.size());
+ std::vector<BVH> trees(meshes.size());
+ std::vector<real32> sizes(meshes.size());
+ double bottom_time = BenchTime();
+ for(size_t i = 0; i < meshes.size(); i++) {
+     const BenchMesh& mesh = meshes[i];
+     scene.add_mesh(mesh.verts[0].v, static_cast<uint32>(mesh.verts.size()), mesh.faces.data(), static_cast<uint32>(mesh.faces.size()/3));
+    }
+ bottom_time = BenchTime() - bottom_time;
+ for(size_t i = 0; i < meshes.size(); i++) {
+     const BenchMesh& mesh = meshes[i];
+     faces[i] = mesh.faces;
+     trees[i].construct(mesh.verts.data(), static_cast<uint32>(mesh.verts.size()), faces[i].data(), static_cast<uint32>(faces[i].size()));
+     real32 lo[3];
+     real32 hi[3];
+     BoundsBenchMesh(mesh, lo, hi);
+     vector3D diagonal(hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]);
+     sizes[i] = 10.0f/std::max(length(diagonal), 1.0e-3f);
+    }
+
+ // instances
+ BenchSeed(0x489ul);
+ std::vector<BenchInstance> instances(n_instances);
+ for(uint32 i = 0; i < n_instances; i++) {
+     instances[i].mesh = i % meshes.size();
+     RandomInstance(instances[i], sizes[instances[i].mesh], a, b);
+     scene.add_instance(instances[i].mesh, instances[i].mv.m, i);
+    }
+
+ // top level
+ double top_time = BenchTime();
+ scene.update();
+ top_time = BenchTime() - top_time;
+
+ // queries (segments of length 100 and spheres of radius 0.5 to 2)
+ uint32 n_scene = std::min(n_queries, 200000u);
+ uint32 n_loop = std::min(n_scene, 1000u);
+ std::vector<PointLinearCollisionTest> segments(n_scene);
+ std::vector<SphereLinearCollisionTest> spheres(n_scene);
+ for(uint32 i = 0; i < n_scene; i++) {
+     vector3D O(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+     D = 100.0f*unit(D);
+     segments[i].point = O;
+     segments[i].D = D;
+     segments[i].t1 = 0.0f;
+     segments[i].t2 = 1.0f;
+     spheres[i].S.center[0] = O[0];
+     spheres[i].S.center[1] = O[1];
+     spheres[i].S.center[2] = O[2];
+     spheres[i].S.radius = BenchRandom(0.5f, 2.0f);
+     spheres[i].D = D;
+     spheres[i].t1 = 0.0f;
+     spheres[i].t2 = 1.0f;
+    }
+
+ std::cout << "scene: " << meshes.size() << " meshes, " << n_instances << " instances" << std::endl;
+ std::cout << " bottom level build = " << 1000.0*bottom_time << " ms" << std::endl;
+ std::cout << " top level build = " << 1000.0*top_time << " ms, " << scene.nodes() << " nodes" << std::endl;
+
+ // runs all queries against scene and compares some of them against testing every instance
+ // (times are compared with a tolerance since model space segments and radii are computed
+ // differently, and sphere times more loosely, since rounding in the sweep moves the time of
+ // impact of spheres that graze an edge far more than that of segments)
+ uint32 mismatches = 0;
+ auto RUN = [&](const char* name) {
+  uint32 hits = 0;
+  uint64 visits = 0;
+  std::vector<uint32> ids(n_scene, 0xFFFFFFFFul);
+  double scene_time = BenchTime();
+  for(uint32 i = 0; i < n_scene; i++) {
+      scene.collide(segments[i], &ids[i]);
+      visits += segments[i].visits;
+      if(segments[i].collide) hits++;
+     }
+  scene_time = BenchTime() - scene_time;
+  double loop_time = BenchTime();
+  for(uint32 i = 0; i < n_loop; i++) {
+      PointLinearCollisionTest q = segments[i];
+      uint32 id = 0xFFFFFFFFul;
+      LoopCollide(trees, instances, q, id);
+      if(q.collide != segments[i].collide) mismatches++;
+      else if(q.collide && std::abs(q.t - segments[i].t) > 1.0e-4f) mismatches++;
+     }
+  loop_time = BenchTime() - loop_time;
+  std::cout << " " << name << " segments: " << hits << " hits, " << (static_cast<double>(visits)/n_scene) << " nodes/query, ";
+  std::cout << (n_scene/scene_time) << " queries/sec (every instance: " << (n_loop/loop_time) << " queries/sec)" << std::endl;
+
+  hits = 0;
+  visits = 0;
+  scene_time = BenchTime();
+  for(uint32 i = 0; i < n_scene; i++) {
+      scene.collide(spheres[i], &ids[i]);
+      visits += spheres[i].visits;
+      if(spheres[i].collide) hits++;
+     }
+  scene_time = BenchTime() - scene_time;
+  loop_time = BenchTime();
+  for(uint32 i = 0; i < n_loop; i++) {
+      SphereLinearCollisionTest q = spheres[i];
+      uint32 id = 0xFFFFFFFFul;
+      LoopCollide(trees, instances, q, id);
+      if(q.collide != spheres[i].collide) mismatches++;
+      else if(q.collide && std::abs(q.t - spheres[i].t) > 1.0e-3f) mismatches++;
+     }
+  loop_time = BenchTime() - loop_time;
+  std::cout << " " << name << " spheres: " << hits << " hits, " << (static_cast<double>(visits)/n_scene) << " nodes/query, ";
+  std::cout << (n_scene/scene_time) << " queries/sec (every instance: " << (n_loop/loop_time) << " queries/sec)" << std::endl;
+ };
+ RUN("static");
+
+ // move 10% of the instances (only the top level is refit)
+ double move_time = BenchTime();
+ for(uint32 i = 0; i < n_instances; i += 10) {
+     RandomInstance(instances[i], sizes[instances[i].mesh], a, b);
+     scene.move_instance(i, instances[i].mv.m);
+    }
+ scene.update();
+ move_time = BenchTime() - move_time;
+ std::cout << " move " << (n_instances/10) << " instances = " << 1000.0*move_time << " ms" << std::endl;
+ RUN("moved");
+
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
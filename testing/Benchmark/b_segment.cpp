@@ -0,0 +1,124 @@
+#include "../../stdafx.h"
+#include "../../ray.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// reference result, tests every triangle
+static void BruteForceCollide(const BenchMesh& mesh, PointLinearCollisionTest& info)
+{
+ // segment (computed like BVH::collide does, since rays aimed at vertices and edges hit or miss
+ // with the last bit of the segment vector)
+ const vector3D& p1 = info.point;
+ vector3D p2 = p1 + (info.t2 - info.t1)*info.D;
+ vector3D V = p2 - p1;
+
+ // earliest hit
+ real32 best = 1.0f;
+ info.collide = false;
+ info.t = info.t2;
+ for(size_t i = 0; i < mesh.faces.size(); i += 3) {
+     const vector3D& A = mesh.verts[mesh.faces[i + 0]];
+     const vector3D& B = mesh.verts[mesh.faces[i + 1]];
+     const vector3D& C = mesh.verts[mesh.faces[i + 2]];
+     real32 t;
+     if(ray3D_triangle_intersect(&t, p1.v, V.v, A.v, B.v, C.v) && !(best < t)) {
+        best = t;
+        info.collide = true;
+       }
+    }
+ if(info.collide) info.t = info.t1 + best*(info.t2 - info.t1);
+}
+
+bool SegmentBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // construct BVH (construct sorts the index buffer, so use a copy)
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ std::vector<uint32> faces(mesh.faces);
+ BVH bvh;
+ double build_time = BenchTime();
+ bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices);
+ build_time = BenchTime() - build_time;
+
+ // query bounds are the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // generate segments of a quarter of the mesh diagonal in random directions, then segments that
+ // pass through a vertex or a point on a triangle edge (these graze the bounds of every node that
+ // holds the vertex or edge, so they catch slab tests that are not conservative)
+ real32 distance = 0.25f*length(diagonal);
+ std::vector<PointLinearCollisionTest> queries(n_queries);
+ std::vector<PointLinearCollisionTest> aimed(n_queries);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     PointLinearCollisionTest& q = queries[i];
+     q.point.reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+     q.D = distance*unit(D);
+     q.t1 = 0.0f;
+     q.t2 = 1.0f;
+    }
+ uint32 n_faces = n_indices/3;
+ for(uint32 i = 0; i < n_queries; i++) {
+     const uint32* f = &mesh.faces[3*static_cast<uint32>(BenchRandom(0.0f, 1.0f)*(n_faces - 1))];
+     const vector3D& A = mesh.verts[f[i % 3]];
+     const vector3D& B = mesh.verts[f[(i + 1) % 3]];
+     vector3D target = ((i & 1) ? A : A + BenchRandom(0.0f, 1.0f)*(B - A));
+     PointLinearCollisionTest& q = aimed[i];
+     q.point.reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+     q.D = 2.0f*(target - q.point);
+     q.t1 = 0.0f;
+     q.t2 = 1.0f;
+    }
+
+ // BVH queries
+ uint32 bvh_hits = 0;
+ double bvh_time = BenchTime();
+ for(uint32 i = 0; i < n_queries; i++) {
+     bvh.collide(queries[i]);
+     if(queries[i].collide) bvh_hits++;
+    }
+ bvh_time = BenchTime() - bvh_time;
+ uint32 aimed_hits = 0;
+ for(uint32 i = 0; i < n_queries; i++) {
+     bvh.collide(aimed[i]);
+     if(aimed[i].collide) aimed_hits++;
+    }
+
+ // brute force queries (limited to about 2^28 triangle tests)
+ uint32 n_brute = std::min(n_queries, std::max(1000u, 0x10000000u/std::max(n_faces, 1u)));
+ uint32 brute_hits = 0;
+ uint32 mismatches = 0;
+ auto COMPARE = [&](const PointLinearCollisionTest& query) {
+  PointLinearCollisionTest q = query;
+  BruteForceCollide(mesh, q);
+  // grazing hits can differ slightly, so compare hit points instead of times
+  if(q.collide != query.collide) { mismatches++; if(mismatches < 5) std::cout << "DBG miss " << q.collide << " " << query.collide << " t " << q.t << " " << query.t << std::endl; }
+  else if(q.collide && std::abs(q.t - query.t)*length(q.D) > 1.0e-3f) { mismatches++; if(mismatches < 5) std::cout << "DBG t " << q.t << " " << query.t << std::endl; }
+  return q.collide;
+ };
+ double brute_time = BenchTime();
+ for(uint32 i = 0; i < n_brute; i++) if(COMPARE(queries[i])) brute_hits++;
+ brute_time = BenchTime() - brute_time;
+ uint32 random_mismatches = mismatches;
+ uint32 aimed_brute_hits = 0;
+ for(uint32 i = 0; i < n_brute; i++) if(COMPARE(aimed[i])) aimed_brute_hits++;
+
+ // report
+ std::cout << "segment: " << mesh.name << std::endl;
+ std::cout << " triangles = " << n_faces << std::endl;
+ std::cout << " build time = " << 1000.0*build_time << " ms" << std::endl;
+ std::cout << " BVH: " << n_queries << " queries, " << bvh_hits << " hits, " << (n_queries/bvh_time) << " queries/sec" << std::endl;
+ std::cout << " brute force: " << n_brute << " queries, " << brute_hits << " hits, " << (n_brute/brute_time) << " queries/sec" << std::endl;
+ std::cout << " aimed at vertices and edges: " << n_queries << " queries, " << aimed_hits << " hits (brute force: " << aimed_brute_hits << " hits in " << n_brute << " queries)" << std::endl;
+ std::cout << " mismatches = " << random_mismatches << " random, " << (mismatches - random_mismatches) << " aimed" << std::endl;
+ return (mismatches == 0);
+}
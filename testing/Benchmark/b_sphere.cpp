@@ -0,0 +1,193 @@
+#include "../../stdafx.h"
+#include "../../triangle.h"
+#include "../../bvh.h"
+#include "bench.h"
+
+// reference result, sweeps sphere against every triangle
+static void BruteForceCollide(const BenchMesh& mesh, SphereLinearCollisionTest& info)
+{
+ vector3D V = (info.t2 - info.t1)*info.D;
+ real32 best = 1.0f;
+ info.collide = false;
+ info.t = info.t2;
+ for(size_t i = 0; i < mesh.faces.size(); i += 3) {
+     const vector3D& A = mesh.verts[mesh.faces[i + 0]];
+     const vector3D& B = mesh.verts[mesh.faces[i + 1]];
+     const vector3D& C = mesh.verts[mesh.faces[i + 2]];
+     real32 t = best;
+     real32 X[3];
+     if(sphere3D_triangle_sweep(&t, X, info.S.center, info.S.radius, V.v, A.v, B.v, C.v)) {
+        best = t;
+        info.contact.reset(X[0], X[1], X[2]);
+        info.collide = true;
+       }
+    }
+ if(info.collide) info.t = info.t1 + best*(info.t2 - info.t1);
+}
+
+// distance from point to mesh
+static real32 MeshDistance(const BenchMesh& mesh, const vector3D& P)
+{
+ real32 best = std::numeric_limits<real32>::max();
+ for(size_t i = 0; i < mesh.faces.size(); i += 3) {
+     const vector3D& A = mesh.verts[mesh.faces[i + 0]];
+     const vector3D& B = mesh.verts[mesh.faces[i + 1]];
+     const vector3D& C = mesh.verts[mesh.faces[i + 2]];
+     real32 X[3];
+     best = std::min(best, triangle3D_closest_point(X, P.v, A.v, B.v, C.v));
+    }
+ return std::sqrt(best);
+}
+
+// independent reference using conservative advancement (the sphere can always move by its
+// distance to the mesh without touching it), returns time ratio of first contact or 1 if none
+static real32 ConservativeAdvancement(const BenchMesh& mesh, const vector3D& O, real32 radius, const vector3D& V, real32 tolerance, real32& closest)
+{
+ real32 speed = length(V);
+ real32 t = 0.0f;
+ closest = std::numeric_limits<real32>::max();
+ for(int i = 0; i < 10000; i++) {
+     real32 d = MeshDistance(mesh, O + t*V) - radius;
+     closest = std::min(closest, d);
+     if(d < tolerance) return t;
+     t += d/speed;
+     if(t > 1.0f) break;
+    }
+ // check end point
+ closest = std::min(closest, MeshDistance(mesh, O + V) - radius);
+ return (closest < tolerance ? 1.0f : 2.0f);
+}
+
+bool SphereBenchmark(const BenchMesh& mesh, uint32 n_queries)
+{
+ // construct BVH (construct sorts the index buffer, so use a copy)
+ uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+ uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+ uint32 n_faces = n_indices/3;
+ std::vector<uint32> faces(mesh.faces);
+ BVH bvh;
+ bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices);
+
+ // query bounds are the mesh bounds plus 10%
+ real32 a[3];
+ real32 b[3];
+ BoundsBenchMesh(mesh, a, b);
+ vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+ real32 scale = length(diagonal);
+ for(int i = 0; i < 3; i++) {
+     a[i] -= 0.1f*diagonal[i];
+     b[i] += 0.1f*diagonal[i];
+    }
+
+ // spheres of 0.5% to 5% of the mesh diagonal swept a quarter of the mesh diagonal
+ real32 distance = 0.25f*scale;
+ std::vector<SphereLinearCollisionTest> queries(n_queries);
+ BenchSeed(0x489ul);
+ for(uint32 i = 0; i < n_queries; i++) {
+     SphereLinearCollisionTest& q = queries[i];
+     q.S.center[0] = BenchRandom(a[0], b[0]);
+     q.S.center[1] = BenchRandom(a[1], b[1]);
+     q.S.center[2] = BenchRandom(a[2], b[2]);
+     q.S.radius = BenchRandom(0.005f, 0.05f)*scale;
+     vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+     if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+     q.D = distance*unit(D);
+     q.t1 = 0.0f;
+     q.t2 = 1.0f;
+    }
+
+ // BVH queries
+ uint32 bvh_hits = 0;
+ uint64 visits = 0;
+ double bvh_time = BenchTime();
+ for(uint32 i = 0; i < n_queries; i++) {
+     bvh.collide(queries[i]);
+     visits += queries[i].visits;
+     if(queries[i].collide) bvh_hits++;
+    }
+ bvh_time = BenchTime() - bvh_time;
+
+ // contacts must be on the mesh, one radius from the center at the time of impact
+ const real32 tolerance = 1.0e-4f*scale;
+ uint32 bad_contacts = 0;
+ for(uint32 i = 0; i < n_queries; i++) {
+     const SphereLinearCollisionTest& q = queries[i];
+     if(!q.collide) continue;
+     vector3D center(q.S.center[0], q.S.center[1], q.S.center[2]);
+     center += (q.t - q.t1)*q.D;
+     vector3D R = center - q.contact;
+     bool embedded = (q.t == q.t1 && length(R) < q.S.radius);
+     if(!embedded && std::abs(length(R) - q.S.radius) > tolerance) bad_contacts++;
+     else if(std::abs(length(q.normal) - 1.0f) > 1.0e-3f) bad_contacts++;
+     else if(MeshDistance(mesh, q.contact) > tolerance) bad_contacts++;
+    }
+
+ // brute force queries (limited to about 2^26 triangle tests)
+ uint32 n_brute = std::min(n_queries, std::max(500u, 0x4000000u/std::max(n_faces, 1u)));
+ uint32 brute_hits = 0;
+ uint32 mismatches = 0;
+ double brute_time = BenchTime();
+ for(uint32 i = 0; i < n_brute; i++) {
+     SphereLinearCollisionTest q = queries[i];
+     BruteForceCollide(mesh, q);
+     if(q.collide) brute_hits++;
+     if(q.collide != queries[i].collide) mismatches++;
+     else if(q.collide && std::abs(q.t - queries[i].t)*length(q.D) > tolerance) mismatches++;
+    }
+ brute_time = BenchTime() - brute_time;
+
+ // conservative advancement (limited to about 2^24 closest point tests), queries that pass
+ // within the tolerance of the mesh are grazing and can go either way
+ uint32 n_advance = std::min(n_queries, std::max(100u, 0x1000000u/std::max(n_faces, 1u)/32));
+ uint32 advance_mismatches = 0;
+ uint32 grazing = 0;
+ for(uint32 i = 0; i < n_advance; i++) {
+     const SphereLinearCollisionTest& q = queries[i];
+     vector3D O(q.S.center[0], q.S.center[1], q.S.center[2]);
+     vector3D V = (q.t2 - q.t1)*q.D;
+     real32 closest;
+     real32 t = ConservativeAdvancement(mesh, O, q.S.radius, V, 0.1f*tolerance, closest);
+     bool collide = (t <= 1.0f);
+     real32 bvh_t = (q.t - q.t1)/(q.t2 - q.t1);
+     if(collide && q.collide) {
+        if(!(std::abs(bvh_t - t)*length(V) > 10.0f*tolerance)) continue;
+        // advancement stops just before contact, so it can't be after the BVH time of impact
+        if(bvh_t < t) {
+           advance_mismatches++;
+           continue;
+          }
+        // the sphere must not go into the mesh before the BVH time of impact (in shallow hits,
+        // advancement can stop well before contact)
+        bool penetrates = false;
+        for(int j = 1; j < 16 && !penetrates; j++) {
+            real32 tt = t + (bvh_t - t)*(j/16.0f);
+            if(MeshDistance(mesh, O + tt*V) - q.S.radius < -tolerance) penetrates = true;
+           }
+        if(penetrates) advance_mismatches++;
+       }
+     // missed hit is grazing if a slightly bigger sphere hits
+     else if(collide) {
+        SphereLinearCollisionTest r = q;
+        r.S.radius += tolerance;
+        bvh.collide(r);
+        if(r.collide) grazing++;
+        else advance_mismatches++;
+       }
+     // extra hit is grazing if the sphere passes within the tolerance of the mesh
+     else if(q.collide) {
+        if(closest < 10.0f*tolerance) grazing++;
+        else advance_mismatches++;
+       }
+    }
+
+ // report
+ std::cout << "sphere: " << mesh.name << std::endl;
+ std::cout << " triangles = " << n_faces << std::endl;
+ std::cout << " BVH: " << n_queries << " queries, " << bvh_hits << " hits, " << (static_cast<double>(visits)/n_queries) << " nodes/query, " << (n_queries/bvh_time) << " queries/sec" << std::endl;
+ std::cout << " BVH: 4 players per frame = " << (4.0e6*bvh_time/n_queries) << " us" << std::endl;
+ std::cout << " brute force: " << n_brute << " queries, " << brute_hits << " hits, " << (n_brute/brute_time) << " queries/sec" << std::endl;
+ std::cout << " brute force mismatches = " << mismatches << std::endl;
+ std::cout << " bad contacts = " << bad_contacts << std::endl;
+ std::cout << " conservative advancement: " << n_advance << " queries, " << grazing << " grazing, " << advance_mismatches << " mismatches" << std::endl;
+ return (mismatches == 0 && bad_contacts == 0 && advance_mismatches == 0);
+}
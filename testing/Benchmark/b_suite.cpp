@@ -0,0 +1,176 @@
+#include "../../stdafx.h"
+#include "../../bvh.h"
+#include "../../qbvh.h"
+#include "../../cbvh.h"
+#include "bench.h"
+
+// standardized workloads over every builder, printed as CSV so that runs can be compared across
+// changes (queries are generated from fixed seeds, so every run asks the same questions)
+
+static bool SuiteHit(const PointLinearCollisionTest& q) { return q.collide; }
+static bool SuiteHit(const SphereLinearCollisionTest& q) { return q.collide; }
+static bool SuiteHit(const SphereOverlapTest& q) { return q.n_triangles > 0; }
+static bool SuiteHit(const ClosestPointTest& q) { return q.found; }
+
+struct SuiteResult {
+ uint32 hits;
+ uint64 visits;
+ double time;
+};
+
+template<class T, class Q>
+static SuiteResult SuiteRun(T& tree, std::vector<Q>& queries)
+{
+ SuiteResult result;
+ result.hits = 0;
+ result.visits = 0;
+ result.time = BenchTime();
+ for(auto& q : queries) tree.collide(q);
+ result.time = BenchTime() - result.time;
+ for(auto& q : queries) {
+     if(SuiteHit(q)) result.hits++;
+     result.visits += q.visits;
+    }
+ return result;
+}
+
+// times a build several times (at least 3 times and 50 ms) and keeps the fastest
+template<class F>
+static double SuiteBuildTime(F build)
+{
+ double best = std::numeric_limits<double>::max();
+ double total = 0.0;
+ for(int i = 0; i < 3 || total < 0.05; i++) {
+     double t = BenchTime();
+     build();
+     t = BenchTime() - t;
+     best = std::min(best, t);
+     total += t;
+    }
+ return best;
+}
+
+static void SuiteRow(const BenchMesh& mesh, const char* builder, double build_time, size_t bytes, const char* workload, size_t n_queries, const SuiteResult& result)
+{
+ std::cout << mesh.name << "," << (mesh.faces.size()/3) << "," << builder << "," << (1000.0*build_time) << "," << bytes << ",";
+ std::cout << workload << "," << n_queries << "," << result.hits << "," << (static_cast<double>(result.visits)/n_queries) << "," << (n_queries/result.time) << std::endl;
+}
+
+bool SuiteBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries)
+{
+ // builders
+ struct {
+  const char* name;
+  BVHBuildOptions options;
+ } builders[5];
+ builders[0].name = "binned";
+ builders[1].name = "binned_sah";
+ builders[1].options.n_bins = 16;
+ builders[1].options.all_axes = true;
+ builders[1].options.sah_termination = true;
+ builders[2].name = "binned_threads";
+ builders[2].options.n_threads = 0;
+ builders[3].name = "lbvh";
+ builders[3].options.morton = true;
+ builders[4].name = "lbvh_treelets";
+ builders[4].options.morton = true;
+ builders[4].options.treelets = true;
+
+ // header (memory is bytes of nodes plus sorted faces plus any baked triangles)
+ std::cout << "mesh,triangles,builder,build_ms,bytes,workload,queries,hits,visits_per_query,queries_per_sec" << std::endl;
+
+ for(auto& mesh : meshes)
+    {
+     uint32 n_verts = static_cast<uint32>(mesh.verts.size());
+     uint32 n_indices = static_cast<uint32>(mesh.faces.size());
+     size_t face_bytes = n_indices*sizeof(uint32);
+
+     // query bounds are the mesh bounds plus 10%
+     real32 a[3];
+     real32 b[3];
+     BoundsBenchMesh(mesh, a, b);
+     vector3D diagonal(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+     real32 scale = length(diagonal);
+     for(int i = 0; i < 3; i++) {
+         a[i] -= 0.1f*diagonal[i];
+         b[i] += 0.1f*diagonal[i];
+        }
+
+     // segments and sphere sweeps of a quarter of the mesh diagonal in random directions
+     BenchSeed(0x489ul);
+     std::vector<PointLinearCollisionTest> segments(n_queries);
+     std::vector<SphereLinearCollisionTest> sweeps(n_queries);
+     for(uint32 i = 0; i < n_queries; i++) {
+         PointLinearCollisionTest& q = segments[i];
+         q.point.reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+         vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+         if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+         q.D = 0.25f*scale*unit(D);
+         q.t1 = 0.0f;
+         q.t2 = 1.0f;
+        }
+     for(uint32 i = 0; i < n_queries; i++) {
+         SphereLinearCollisionTest& q = sweeps[i];
+         q.S.center[0] = BenchRandom(a[0], b[0]);
+         q.S.center[1] = BenchRandom(a[1], b[1]);
+         q.S.center[2] = BenchRandom(a[2], b[2]);
+         q.S.radius = BenchRandom(0.005f, 0.05f)*scale;
+         vector3D D(BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f), BenchRandom(-1.0f, 1.0f));
+         if(squared_norm(D) < 1.0e-6f) D.reset(1.0f, 0.0f, 0.0f);
+         q.D = 0.25f*scale*unit(D);
+         q.t1 = 0.0f;
+         q.t2 = 1.0f;
+        }
+
+     // sphere overlaps of 0.5% to 5% and closest points within 1% to 10% of the mesh diagonal
+     std::vector<uint32> triangles(n_indices/3);
+     BVHScratchItem scratch[64];
+     std::vector<SphereOverlapTest> overlaps(n_queries);
+     std::vector<ClosestPointTest> closest(n_queries);
+     for(uint32 i = 0; i < n_queries; i++) {
+         SphereOverlapTest& q = overlaps[i];
+         q.S.center[0] = BenchRandom(a[0], b[0]);
+         q.S.center[1] = BenchRandom(a[1], b[1]);
+         q.S.center[2] = BenchRandom(a[2], b[2]);
+         q.S.radius = BenchRandom(0.005f, 0.05f)*scale;
+         q.triangles = triangles.data();
+         q.max_triangles = static_cast<uint32>(triangles.size());
+        }
+     for(uint32 i = 0; i < n_queries; i++) {
+         ClosestPointTest& q = closest[i];
+         q.point.reset(BenchRandom(a[0], b[0]), BenchRandom(a[1], b[1]), BenchRandom(a[2], b[2]));
+         q.radius = BenchRandom(0.01f, 0.1f)*scale;
+         q.scratch = scratch;
+         q.scratch_size = 64;
+        }
+
+     for(auto& builder : builders)
+        {
+         // construct BVH (construct sorts the index buffer, so use a copy)
+         std::vector<uint32> faces(mesh.faces);
+         BVH bvh;
+         double build_time = SuiteBuildTime([&]() {
+          faces = mesh.faces;
+          bvh.construct(mesh.verts.data(), n_verts, faces.data(), n_indices, builder.options);
+         });
+         size_t bytes = bvh.bytes() + face_bytes;
+         SuiteRow(mesh, builder.name, build_time, bytes, "segment", segments.size(), SuiteRun(bvh, segments));
+         SuiteRow(mesh, builder.name, build_time, bytes, "sphere_sweep", sweeps.size(), SuiteRun(bvh, sweeps));
+         SuiteRow(mesh, builder.name, build_time, bytes, "sphere_overlap", overlaps.size(), SuiteRun(bvh, overlaps));
+         SuiteRow(mesh, builder.name, build_time, bytes, "closest_point", closest.size(), SuiteRun(bvh, closest));
+
+         // alternate layouts of the default build (build time includes the BVH)
+         if(&builder != &builders[0]) continue;
+         QBVH qbvh;
+         double qbvh_time = build_time + SuiteBuildTime([&]() { qbvh.construct(bvh); });
+         SuiteRow(mesh, "qbvh", qbvh_time, qbvh.bytes() + face_bytes, "segment", segments.size(), SuiteRun(qbvh, segments));
+         CBVH cbvh;
+         double cbvh_time = build_time + SuiteBuildTime([&]() { cbvh.construct(bvh); });
+         SuiteRow(mesh, "cbvh", cbvh_time, cbvh.bytes() + face_bytes, "segment", segments.size(), SuiteRun(cbvh, segments));
+         double bake_time = build_time + SuiteBuildTime([&]() { bvh.bake(); });
+         SuiteRow(mesh, "binned_blocks", bake_time, bvh.bytes() + bvh.block_bytes() + face_bytes, "segment", segments.size(), SuiteRun(bvh, segments));
+        }
+    }
+
+ return true;
+}
@@ -0,0 +1,143 @@
+#include "../../stdafx.h"
+#include "../../matrix4.h"
+#include "bench.h"
+
+// largest difference relative to the size of the reference value
+static real32 MaxTransformError(const real32* x, const real32* ref, size_t n)
+{
+ real32 error = 0.0f;
+ for(size_t i = 0; i < n; i++) error = std::max(error, std::abs(x[i] - ref[i])/std::max(1.0f, std::abs(ref[i])));
+ return error;
+}
+
+bool TransformBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries)
+{
+ // vertices of all meshes (packed x, y, z like mesh vertex buffers)
+ static_assert(sizeof(vector3D) == 3*sizeof(real32), "vector3D must be packed");
+ std::vector<vector3D> points;
+ for(auto& mesh : meshes) points.insert(points.end(), mesh.verts.begin(), mesh.verts.end());
+ if(points.empty()) {
+    BenchSeed(0x489ul);
+    points.resize(100000);
+    for(auto& p : points) p.reset(BenchRandom(-10.0f, 10.0f), BenchRandom(-10.0f, 10.0f), BenchRandom(-10.0f, 10.0f));
+   }
+ uint32 n_points = static_cast<uint32>(points.size());
+ const real32* P = points[0].v;
+
+ // same points as separate x, y, and z arrays
+ std::vector<real32> soa(3*n_points);
+ for(uint32 i = 0; i < n_points; i++) {
+     soa[i] = points[i][0];
+     soa[i + n_points] = points[i][1];
+     soa[i + 2*n_points] = points[i][2];
+    }
+ const real32* const P_soa[3] = { soa.data(), soa.data() + n_points, soa.data() + 2*n_points };
+
+ // bounds (so that w stays well above zero for the projective transform)
+ real32 a[3] = { P[0], P[1], P[2] };
+ real32 b[3] = { P[0], P[1], P[2] };
+ for(uint32 i = 0; i < 3*n_points; i++) {
+     a[i % 3] = std::min(a[i % 3], P[i]);
+     b[i % 3] = std::max(b[i % 3], P[i]);
+    }
+ real32 extent = std::max(1.0f, b[2] - a[2]);
+
+ // bone-like affine transform, and the same with w = 1 + (z - min z)/extent
+ real32 q[4] = { 0.9f, 0.1f, -0.3f, 0.2f };
+ real32 norm = std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+ for(int i = 0; i < 4; i++) q[i] /= norm;
+ matrix4D R, M;
+ R.load_quaternion(q);
+ M.load_scaling(1.5f, 0.75f, 1.25f);
+ M = M * R;
+ M[0x3] = 3.0f;
+ M[0x7] = -2.0f;
+ M[0xB] = 5.0f;
+ matrix4D M_projective = M;
+ M_projective[0xE] = 1.0f/extent;
+ M_projective[0xF] = 1.0f - a[2]/extent;
+
+ // each transform runs about 16*n_queries points
+ uint32 passes = static_cast<uint32>(std::max(static_cast<uint64>(1), (16ull*n_queries)/n_points));
+ static const char* names[] = { "scalar", "SSE2", "AVX", "AVX + FMA" };
+ static const char* types[] = { "affine", "projective", "normals" };
+ const matrix4D* matrices[] = { &M, &M_projective, &M };
+
+ // results
+ std::vector<real32> X(3*n_points);
+ std::vector<real32> X_soa(3*n_points);
+ real32* const Q_soa[3] = { X_soa.data(), X_soa.data() + n_points, X_soa.data() + 2*n_points };
+ std::vector<real32> ref[3];
+ double ref_time[3][2];
+
+ // scalar kernels must match the single point functions exactly
+ uint32 mismatches = 0;
+ matrix4D_select_simd(MATRIX4D_SCALAR);
+ matrix4D_transform_aos(X.data(), M.m, P, n_points, MATRIX4D_TRANSFORM_AFFINE);
+ for(uint32 i = 0; i < n_points; i++) {
+     vector3D x = M * points[i];
+     if(x[0] != X[3*i + 0] || x[1] != X[3*i + 1] || x[2] != X[3*i + 2]) { mismatches++; break; }
+    }
+ matrix4D_transform_aos(X.data(), M.m, P, n_points, MATRIX4D_TRANSFORM_NORMALS);
+ for(uint32 i = 0; i < n_points; i++) {
+     real32 x[3];
+     matrix4D_vector3_mul(x, M.m, points[i].v);
+     if(x[0] != X[3*i + 0] || x[1] != X[3*i + 1] || x[2] != X[3*i + 2]) { mismatches++; break; }
+    }
+
+ // run every instruction set the CPU supports (scalar first for reference results)
+ matrix4D_simd_type best = matrix4D_simd_support();
+ std::cout << "transform: " << n_points << " points, " << names[best] << " supported" << std::endl;
+ for(int type = MATRIX4D_SCALAR; type <= best; type++)
+    {
+     matrix4D_select_simd(static_cast<matrix4D_simd_type>(type));
+     std::cout << " " << names[type] << ":" << std::endl;
+     for(int t = 0; t < 3; t++)
+        {
+         matrix4D_transform_type transform = static_cast<matrix4D_transform_type>(t);
+         const real32* A = matrices[t]->m;
+
+         // packed x, y, z
+         double aos_time = BenchTime();
+         for(uint32 j = 0; j < passes; j++) matrix4D_transform_aos(X.data(), A, P, n_points, transform);
+         aos_time = BenchTime() - aos_time;
+
+         // separate x, y, and z
+         double soa_time = BenchTime();
+         for(uint32 j = 0; j < passes; j++) matrix4D_transform_soa(Q_soa, A, P_soa, n_points, transform);
+         soa_time = BenchTime() - soa_time;
+
+         // both layouts give the same points
+         real32 layout_error = 0.0f;
+         for(uint32 i = 0; i < n_points; i++) {
+             real32 x[3] = { Q_soa[0][i], Q_soa[1][i], Q_soa[2][i] };
+             layout_error = std::max(layout_error, MaxTransformError(x, &X[3*i], 3));
+            }
+         if(layout_error != 0.0f) mismatches++;
+
+         // compare against scalar results
+         if(type == MATRIX4D_SCALAR) {
+            ref[t] = X;
+            ref_time[t][0] = aos_time;
+            ref_time[t][1] = soa_time;
+           }
+         real32 error = MaxTransformError(X.data(), ref[t].data(), 3*n_points);
+         if(error > 1.0e-5f) mismatches++;
+
+         // in place must give the same points
+         std::vector<real32> Y(P, P + 3*n_points);
+         matrix4D_transform_aos(Y.data(), A, Y.data(), n_points, transform);
+         if(Y != X) mismatches++;
+
+         // report
+         double points_per_pass = static_cast<double>(n_points)*passes;
+         std::cout << "  " << types[t] << ": AoS = " << (points_per_pass/aos_time/1.0e6) << " Mpoints/sec (speedup = " << (ref_time[t][0]/aos_time) << "), ";
+         std::cout << "SoA = " << (points_per_pass/soa_time/1.0e6) << " Mpoints/sec (speedup = " << (ref_time[t][1]/soa_time) << "), max error = " << error << std::endl;
+        }
+    }
+
+ // keep the best kernels selected
+ matrix4D_select_simd(best);
+ std::cout << " mismatches = " << mismatches << std::endl;
+ return (mismatches == 0);
+}
@@ -0,0 +1,359 @@
+#include "../../stdafx.h"
+#include<chrono>
+#include<random>
+#include "bench.h"
+
+#pragma region MESH_LOADING
+
+// reads the next line that is not empty after comments are removed
+static bool ReadLine(std::ifstream& ifile, std::string& line)
+{
+ while(std::getline(ifile, line)) {
+       size_t comment = line.find('#');
+       if(comment != std::string::npos) line.erase(comment);
+       size_t a = line.find_first_not_of(" \t\r");
+       if(a == std::string::npos) continue;
+       size_t b = line.find_last_not_of(" \t\r");
+       line = line.substr(a, b - a + 1);
+       return true;
+      }
+ return false;
+}
+
+static bool ReadUint32(std::ifstream& ifile, uint32& x)
+{
+ std::string line;
+ if(!ReadLine(ifile, line)) return false;
+ x = strtoul(line.c_str(), nullptr, 10);
+ return true;
+}
+
+static bool ReadVector3(std::ifstream& ifile, real32* v)
+{
+ std::string line;
+ if(!ReadLine(ifile, line)) return false;
+ std::istringstream iss(line);
+ v[0] = v[1] = v[2] = 0.0f;
+ iss >> v[0] >> v[1] >> v[2];
+ return true;
+}
+
+static bool ReadReals(std::ifstream& ifile, real32* v, uint32 n)
+{
+ std::string line;
+ if(!ReadLine(ifile, line)) return false;
+ std::istringstream iss(line);
+ for(uint32 i = 0; i < n; i++) v[i] = 0.0f;
+ for(uint32 i = 0; i < n; i++) iss >> v[i];
+ return true;
+}
+
+static bool SkipLines(std::ifstream& ifile, uint32 n)
+{
+ std::string line;
+ for(uint32 i = 0; i < n; i++) if(!ReadLine(ifile, line)) return false;
+ return true;
+}
+
+/** LoadBenchMesh
+ *  Reads a model in the same order as MeshData::LoadMeshUTF, but without creating any Direct3D
+ *  resources. If the model has collision meshes, the collision meshes are returned. Otherwise,
+ *  the triangles of the render meshes are returned so that models like boss.txt and map.txt can
+ *  still be used as collision geometry.
+ */
+bool LoadBenchMesh(const char* filename, BenchMesh& mesh)
+{
+ // open file
+ std::ifstream ifile(filename);
+ if(!ifile) return false;
+
+ // reset mesh
+ mesh.name = filename;
+ mesh.verts.clear();
+ mesh.faces.clear();
+
+ // skip bones (name, parent, position, matrix)
+ uint32 n_bones = 0;
+ if(!ReadUint32(ifile, n_bones)) return false;
+ if(!SkipLines(ifile, 4*n_bones)) return false;
+
+ // skip animations
+ uint32 n_anim = 0;
+ if(!ReadUint32(ifile, n_anim)) return false;
+ for(uint32 i = 0; i < n_anim; i++) {
+     uint32 n_keyframedbones = 0;
+     if(!SkipLines(ifile, 1)) return false;
+     if(!ReadUint32(ifile, n_keyframedbones)) return false;
+     for(uint32 j = 0; j < n_keyframedbones; j++) {
+         uint32 n_keys = 0;
+         if(!SkipLines(ifile, 1)) return false;
+         if(!ReadUint32(ifile, n_keys)) return false;
+         if(!SkipLines(ifile, 4*n_keys)) return false; // frame, translation, rotation, scale
+        }
+    }
+
+ // read collision meshes
+ uint32 n_collision = 0;
+ if(!ReadUint32(ifile, n_collision)) return false;
+ for(uint32 i = 0; i < n_collision; i++) {
+     uint32 base = static_cast<uint32>(mesh.verts.size());
+     uint32 n_verts = 0;
+     if(!ReadUint32(ifile, n_verts)) return false;
+     for(uint32 j = 0; j < n_verts; j++) {
+         vector3D v;
+         if(!ReadVector3(ifile, v.v)) return false;
+         mesh.verts.push_back(v);
+        }
+     uint32 n_faces = 0;
+     if(!ReadUint32(ifile, n_faces)) return false;
+     for(uint32 j = 0; j < n_faces; j++) {
+         real32 f[3];
+         if(!ReadVector3(ifile, f)) return false;
+         mesh.faces.push_back(base + static_cast<uint32>(f[0]));
+         mesh.faces.push_back(base + static_cast<uint32>(f[1]));
+         mesh.faces.push_back(base + static_cast<uint32>(f[2]));
+        }
+    }
+ if(n_collision) return true;
+
+ // skip materials (name, textures)
+ uint32 n_mats = 0;
+ if(!ReadUint32(ifile, n_mats)) return false;
+ for(uint32 i = 0; i < n_mats; i++) {
+     uint32 n_textures = 0;
+     if(!SkipLines(ifile, 1)) return false;
+     if(!ReadUint32(ifile, n_textures)) return false;
+     if(!SkipLines(ifile, 4*n_textures)) return false; // name, semantic, channel, filename
+    }
+
+ // read render meshes
+ uint32 n_mesh = 0;
+ if(!ReadUint32(ifile, n_mesh)) return false;
+ for(uint32 i = 0; i < n_mesh; i++)
+    {
+     // read mesh header
+     uint32 base = static_cast<uint32>(mesh.verts.size());
+     uint32 n_verts = 0;
+     uint32 n_uvs = 0;
+     uint32 n_colors = 0;
+     if(!SkipLines(ifile, 1)) return false;
+     if(!ReadUint32(ifile, n_verts)) return false;
+     if(!ReadUint32(ifile, n_uvs)) return false;
+     if(!ReadUint32(ifile, n_colors)) return false;
+
+     // read vertices (position, normal, UVs, blend indices and weights, colors)
+     uint32 n_skip = 1 + n_uvs + (n_bones ? 2 : 0) + n_colors;
+     for(uint32 j = 0; j < n_verts; j++) {
+         vector3D v;
+         if(!ReadVector3(ifile, v.v)) return false;
+         if(!SkipLines(ifile, n_skip)) return false;
+         mesh.verts.push_back(v);
+        }
+
+     // read surfaces
+     uint32 n_faces = 0;
+     uint32 n_surfaces = 0;
+     if(!ReadUint32(ifile, n_faces)) return false;
+     if(!ReadUint32(ifile, n_surfaces)) return false;
+     for(uint32 j = 0; j < n_surfaces; j++) {
+         uint32 n_surface_faces = 0;
+         if(!ReadUint32(ifile, n_surface_faces)) return false;
+         if(!SkipLines(ifile, 1)) return false;
+         for(uint32 k = 0; k < n_surface_faces; k++) {
+             real32 f[3];
+             if(!ReadVector3(ifile, f)) return false;
+             mesh.faces.push_back(base + static_cast<uint32>(f[0]));
+             mesh.faces.push_back(base + static_cast<uint32>(f[1]));
+             mesh.faces.push_back(base + static_cast<uint32>(f[2]));
+            }
+        }
+    }
+
+ return true;
+}
+
+/** LoadBenchSkeleton
+ *  Reads the bones and animations of a model in the same order as MeshData::LoadMeshUTF and
+ *  builds the animation data with ConstructAnimationData, so that animations can be evaluated
+ *  without a MeshData. Returns false if the model has no bones.
+ */
+bool LoadBenchSkeleton(const char* filename, BenchSkeleton& skeleton)
+{
+ // open file
+ std::ifstream ifile(filename);
+ if(!ifile) return false;
+
+ // reset skeleton
+ skeleton.name = filename;
+ skeleton.bones.clear();
+ skeleton.animations.clear();
+
+ // read bones (name, parent, position, matrix)
+ uint32 n_bones = 0;
+ if(!ReadUint32(ifile, n_bones) || !n_bones) return false;
+ std::map<std::string, uint32> bonemap;
+ skeleton.bones.resize(n_bones);
+ for(uint32 i = 0; i < n_bones; i++) {
+     MeshBone& bone = skeleton.bones[i];
+     std::string line;
+     if(!ReadLine(ifile, line)) return false;
+     bone.name.assign(line.begin(), line.end());
+     bonemap[line] = i;
+     if(!ReadLine(ifile, line)) return false;
+     bone.parent = static_cast<uint32>(strtol(line.c_str(), nullptr, 10));
+     if(!ReadVector3(ifile, bone.position)) return false;
+     real32 m[16];
+     if(!ReadReals(ifile, m, 16)) return false;
+     bone.m_abs.load(m);
+     bone.m_inv = bone.m_abs;
+     bone.m_inv.invert();
+     if(bone.parent == 0xFFFFFFFFul) bone.m_rel = bone.m_abs;
+     else bone.m_rel = bone.m_abs * skeleton.bones[bone.parent].m_inv;
+    }
+
+ // read animations
+ uint32 n_anim = 0;
+ if(!ReadUint32(ifile, n_anim)) return false;
+ skeleton.animations.resize(n_anim);
+ for(uint32 i = 0; i < n_anim; i++)
+    {
+     // read name and number of keyframed bones
+     MeshAnimation& animation = skeleton.animations[i];
+     std::string line;
+     uint32 n_keyframedbones = 0;
+     if(!ReadLine(ifile, line)) return false;
+     animation.name.assign(line.begin(), line.end());
+     animation.loop = true;
+     animation.minframe = 0xFFFFFFFFul;
+     animation.maxframe = 0x00000000ul;
+     if(!ReadUint32(ifile, n_keyframedbones) || !n_keyframedbones) return false;
+
+     // read keyframed bones (frame, translation, rotation, scale)
+     animation.bonelist.resize(n_keyframedbones);
+     for(uint32 j = 0; j < n_keyframedbones; j++) {
+         MeshAnimatedBoneKeys& keys = animation.bonelist[j];
+         if(!ReadLine(ifile, line)) return false;
+         auto iter = bonemap.find(line);
+         if(iter == bonemap.end()) return false;
+         keys.bone_index = iter->second;
+         uint32 n_keys = 0;
+         if(!ReadUint32(ifile, n_keys) || !n_keys) return false;
+         keys.keyframes.resize(n_keys);
+         for(uint32 k = 0; k < n_keys; k++) {
+             MeshKeyFrame& kf = keys.keyframes[k];
+             if(!ReadUint32(ifile, kf.frame)) return false;
+             if(!ReadReals(ifile, kf.translation, 3)) return false;
+             if(!ReadReals(ifile, kf.quaternion, 4)) return false;
+             if(!ReadReals(ifile, kf.scale, 3)) return false;
+             animation.keyset.insert(kf.frame);
+            }
+         keys.minframe = keys.keyframes[0].frame;
+         keys.maxframe = keys.keyframes[n_keys - 1].frame;
+         animation.minframe = std::min(animation.minframe, keys.minframe);
+         animation.maxframe = std::max(animation.maxframe, keys.maxframe);
+        }
+
+     // create keymap, set duration, and fill in missing keyframes
+     size_t index = 0;
+     for(auto iter = animation.keyset.begin(); iter != animation.keyset.end(); iter++) animation.keymap[*iter] = index++;
+     animation.duration = SECONDS_PER_FRAME*static_cast<real32>(animation.maxframe - animation.minframe + 1);
+     ConstructAnimationData(animation, skeleton.bones);
+    }
+
+ return true;
+}
+
+// skeletons of the models that have bones (models are found from the repository root or from
+// this folder, like in main.cpp)
+void LoadBenchSkeletons(const std::vector<BenchMesh>& meshes, std::vector<BenchSkeleton>& skeletons)
+{
+ skeletons.clear();
+ for(auto& mesh : meshes) {
+     BenchSkeleton skeleton;
+     if(LoadBenchSkeleton(mesh.name.c_str(), skeleton) || LoadBenchSkeleton(("../../" + mesh.name).c_str(), skeleton)) {
+        skeleton.name = mesh.name;
+        skeletons.push_back(std::move(skeleton));
+       }
+    }
+}
+
+/** MakeBenchAnimation
+ *  Generates an animation with n_keys keyframes (every other frame) for a skeleton. Every bone is
+ *  keyed at every keyframe with a small random rotation and translation.
+ */
+void MakeBenchAnimation(const BenchSkeleton& skeleton, uint32 n_keys, MeshAnimation& animation)
+{
+ BenchSeed(0x489ul);
+ animation.name = L"long";
+ animation.loop = true;
+ animation.minframe = 0;
+ animation.maxframe = 2*(n_keys - 1);
+ animation.bonelist.resize(skeleton.bones.size());
+ for(size_t bi = 0; bi < skeleton.bones.size(); bi++) {
+     MeshAnimatedBoneKeys& keys = animation.bonelist[bi];
+     keys.bone_index = static_cast<uint32>(bi);
+     keys.minframe = animation.minframe;
+     keys.maxframe = animation.maxframe;
+     keys.keyframes.resize(n_keys);
+     for(uint32 k = 0; k < n_keys; k++) {
+         MeshKeyFrame& kf = keys.keyframes[k];
+         kf.frame = 2*k;
+         real32 q[4] = { 1.0f, BenchRandom(-0.2f, 0.2f), BenchRandom(-0.2f, 0.2f), BenchRandom(-0.2f, 0.2f) };
+         qnormalize(q);
+         for(int i = 0; i < 4; i++) kf.quaternion[i] = q[i];
+         for(int i = 0; i < 3; i++) kf.translation[i] = BenchRandom(-0.01f, 0.01f);
+         for(int i = 0; i < 3; i++) kf.scale[i] = 1.0f;
+         animation.keyset.insert(kf.frame);
+        }
+    }
+ size_t index = 0;
+ for(auto iter = animation.keyset.begin(); iter != animation.keyset.end(); iter++) animation.keymap[*iter] = index++;
+ animation.duration = SECONDS_PER_FRAME*static_cast<real32>(animation.maxframe - animation.minframe + 1);
+ ConstructAnimationData(animation, skeleton.bones);
+}
+
+void BoundsBenchMesh(const BenchMesh& mesh, real32* a, real32* b)
+{
+ a[0] = a[1] = a[2] = std::numeric_limits<real32>::max();
+ b[0] = b[1] = b[2] = std::numeric_limits<real32>::lowest();
+ for(size_t i = 0; i < mesh.verts.size(); i++) {
+     for(int j = 0; j < 3; j++) {
+         if(mesh.verts[i][j] < a[j]) a[j] = mesh.verts[i][j];
+         if(b[j] < mesh.verts[i][j]) b[j] = mesh.verts[i][j];
+        }
+    }
+}
+
+#pragma endregion MESH_LOADING
+
+#pragma region TIMING
+
+double BenchTime(void)
+{
+ typedef std::chrono::high_resolution_clock clock;
+ static const clock::time_point start = clock::now();
+ return std::chrono::duration<double>(clock::now() - start).count();
+}
+
+#pragma endregion TIMING
+
+#pragma region RANDOM_NUMBERS
+
+static std::mt19937 generator(0x489ul);
+
+void BenchSeed(uint32 seed)
+{
+ generator.seed(seed);
+}
+
+real32 BenchRandom(void)
+{
+ return std::uniform_real_distribution<real32>(0.0f, 1.0f)(generator);
+}
+
+real32 BenchRandom(real32 a, real32 b)
+{
+ return std::uniform_real_distribution<real32>(a, b)(generator);
+}
+
+#pragma endregion RANDOM_NUMBERS
@@ -0,0 +1,62 @@
+#ifndef __CS489_BENCH_H
+#define __CS489_BENCH_H
+
+#include "../../vector3.h"
+#include "../../animation.h"
+
+// triangle soup used by the collision benchmarks
+struct BenchMesh {
+ std::string name;
+ std::vector<vector3D> verts;
+ std::vector<uint32> faces;
+};
+
+// skeleton and animations used by the animation benchmarks
+struct BenchSkeleton {
+ std::string name;
+ std::vector<MeshBone> bones;
+ std::vector<MeshAnimation> animations;
+};
+
+// mesh loading
+bool LoadBenchMesh(const char* filename, BenchMesh& mesh);
+bool LoadBenchSkeleton(const char* filename, BenchSkeleton& skeleton);
+void LoadBenchSkeletons(const std::vector<BenchMesh>& meshes, std::vector<BenchSkeleton>& skeletons);
+void MakeBenchAnimation(const BenchSkeleton& skeleton, uint32 n_keys, MeshAnimation& animation);
+void BoundsBenchMesh(const BenchMesh& mesh, real32* a, real32* b);
+
+// timing
+double BenchTime(void);
+
+// deterministic random numbers
+void BenchSeed(uint32 seed);
+real32 BenchRandom(void);
+real32 BenchRandom(real32 a, real32 b);
+
+// benchmarks
+bool SegmentBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool QBVHBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool SAHBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool SphereBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool RefitBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool PacketBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool CacheBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool CBVHBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool LBVHBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool ClosestBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool BlocksBenchmark(const BenchMesh& mesh, uint32 n_queries);
+bool BuildBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool SceneBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool SAPBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool OctreeBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool BatchBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool SuiteBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool MatrixBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool TransformBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool AnimationBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool BakeBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool CrowdBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool JobsBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+bool CompressBenchmark(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+
+#endif
@@ -0,0 +1,106 @@
+#include "../../stdafx.h"
+#include "bench.h"
+
+// meshes tested when none are given on the command line
+static const char* default_models[] = {
+ "models/room.txt",
+ "models/map.txt",
+ "models/boss.txt",
+ "models/door.txt",
+};
+
+// mesh benchmarks
+typedef bool (*MeshBenchmark)(const BenchMesh& mesh, uint32 n_queries);
+static const struct {
+ const char* name;
+ MeshBenchmark func;
+} benchmarks[] = {
+ { "segment", SegmentBenchmark },
+ { "qbvh", QBVHBenchmark },
+ { "sah", SAHBenchmark },
+ { "sphere", SphereBenchmark },
+ { "refit", RefitBenchmark },
+ { "packet", PacketBenchmark },
+ { "cache", CacheBenchmark },
+ { "cbvh", CBVHBenchmark },
+ { "lbvh", LBVHBenchmark },
+ { "closest", ClosestBenchmark },
+ { "blocks", BlocksBenchmark },
+};
+
+// benchmarks that use all models at once or generate their own data (only run when selected)
+typedef bool (*DataBenchmark)(const std::vector<BenchMesh>& meshes, uint32 n_queries);
+static const struct {
+ const char* name;
+ DataBenchmark func;
+} data_benchmarks[] = {
+ { "build", BuildBenchmark },
+ { "scene", SceneBenchmark },
+ { "sap", SAPBenchmark },
+ { "octree", OctreeBenchmark },
+ { "batch", BatchBenchmark },
+ { "suite", SuiteBenchmark },
+ { "matrix", MatrixBenchmark },
+ { "transform", TransformBenchmark },
+ { "animation", AnimationBenchmark },
+ { "bake", BakeBenchmark },
+ { "crowd", CrowdBenchmark },
+ { "jobs", JobsBenchmark },
+ { "compress", CompressBenchmark },
+};
+
+// models can be found from the repository root or from this folder
+static bool LoadModel(const char* filename, BenchMesh& mesh)
+{
+ if(LoadBenchMesh(filename, mesh)) return true;
+ std::string path = std::string("../../") + filename;
+ if(LoadBenchMesh(path.c_str(), mesh)) {
+    mesh.name = filename;
+    return true;
+   }
+ return false;
+}
+
+int main(int argc, char** argv)
+{
+ // command line
+ // Benchmark [-n queries] [-b benchmark] [model files]
+ uint32 n_queries = 1000000;
+ std::string selected;
+ std::vector<std::string> models;
+ for(int i = 1; i < argc; i++) {
+     std::string arg = argv[i];
+     if(arg == "-n" && (i + 1) < argc) n_queries = strtoul(argv[++i], nullptr, 10);
+     else if(arg == "-b" && (i + 1) < argc) selected = argv[++i];
+     else models.push_back(arg);
+    }
+ if(models.empty()) for(auto filename : default_models) models.push_back(filename);
+
+ // load models
+ int retval = 0;
+ std::vector<BenchMesh> meshes;
+ for(size_t i = 0; i < models.size(); i++) {
+     BenchMesh mesh;
+     if(!LoadModel(models[i].c_str(), mesh)) {
+        std::cout << "failed to load " << models[i] << std::endl;
+        retval = -1;
+        continue;
+       }
+     if(mesh.faces.size()) meshes.push_back(std::move(mesh));
+    }
+
+ // run benchmarks
+ for(auto& benchmark : data_benchmarks) {
+     if(selected != benchmark.name) continue;
+     if(!(*benchmark.func)(meshes, n_queries)) retval = -1;
+     return retval;
+    }
+ for(auto& mesh : meshes) {
+     for(auto& benchmark : benchmarks) {
+         if(selected.length() && selected != benchmark.name) continue;
+         if(!(*benchmark.func)(mesh, n_queries)) retval = -1;
+        }
+    }
+
+ return retval;
+}
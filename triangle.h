@@ -0,0 +1,222 @@
+#ifndef __CS489_TRIANGLE_H
+#define __CS489_TRIANGLE_H
+
+#include "math.h"
+#include "vector3.h"
+
+#pragma region TRIANGLE_FUNCTIONS
+
+/** \brief   Closest Point on Triangle.
+ *  \details Computes the point (X) on triangle (A, B, C) that is closest to point (P) by finding
+ *           which Voronoi region (vertex, edge, or face) of the triangle contains P. Returns the
+ *           squared distance from P to X.
+ */
+inline real32 triangle3D_closest_point(real32* X, const real32* P, const real32* A, const real32* B, const real32* C)
+{
+ real32 ab[3] = { B[0] - A[0], B[1] - A[1], B[2] - A[2] };
+ real32 ac[3] = { C[0] - A[0], C[1] - A[1], C[2] - A[2] };
+ real32 ap[3] = { P[0] - A[0], P[1] - A[1], P[2] - A[2] };
+ auto RESULT = [&](const real32* Q) {
+  X[0] = Q[0];
+  X[1] = Q[1];
+  X[2] = Q[2];
+  real32 d[3] = { P[0] - X[0], P[1] - X[1], P[2] - X[2] };
+  return vector3D_squared_norm(d);
+ };
+
+ // vertex region A
+ real32 d1 = vector3D_scalar_product(ab, ap);
+ real32 d2 = vector3D_scalar_product(ac, ap);
+ if(d1 <= 0.0f && d2 <= 0.0f) return RESULT(A);
+
+ // vertex region B
+ real32 bp[3] = { P[0] - B[0], P[1] - B[1], P[2] - B[2] };
+ real32 d3 = vector3D_scalar_product(ab, bp);
+ real32 d4 = vector3D_scalar_product(ac, bp);
+ if(d3 >= 0.0f && d4 <= d3) return RESULT(B);
+
+ // edge region AB
+ real32 vc = d1*d4 - d3*d2;
+ if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    real32 v = d1/(d1 - d3);
+    real32 Q[3] = { A[0] + v*ab[0], A[1] + v*ab[1], A[2] + v*ab[2] };
+    return RESULT(Q);
+   }
+
+ // vertex region C
+ real32 cp[3] = { P[0] - C[0], P[1] - C[1], P[2] - C[2] };
+ real32 d5 = vector3D_scalar_product(ab, cp);
+ real32 d6 = vector3D_scalar_product(ac, cp);
+ if(d6 >= 0.0f && d5 <= d6) return RESULT(C);
+
+ // edge region AC
+ real32 vb = d5*d2 - d1*d6;
+ if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    real32 w = d2/(d2 - d6);
+    real32 Q[3] = { A[0] + w*ac[0], A[1] + w*ac[1], A[2] + w*ac[2] };
+    return RESULT(Q);
+   }
+
+ // edge region BC
+ real32 va = d3*d6 - d5*d4;
+ if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+    real32 w = (d4 - d3)/((d4 - d3) + (d5 - d6));
+    real32 Q[3] = { B[0] + w*(C[0] - B[0]), B[1] + w*(C[1] - B[1]), B[2] + w*(C[2] - B[2]) };
+    return RESULT(Q);
+   }
+
+ // face region (degenerate triangles fall back to vertex A)
+ real32 denom = va + vb + vc;
+ if(std::abs(denom) < std::numeric_limits<real32>::min()) return RESULT(A);
+ denom = inv(denom);
+ real32 v = vb*denom;
+ real32 w = vc*denom;
+ real32 Q[3] = {
+  A[0] + ab[0]*v + ac[0]*w,
+  A[1] + ab[1]*v + ac[1]*w,
+  A[2] + ab[2]*v + ac[2]*w
+ };
+ return RESULT(Q);
+}
+
+// smallest root of a*t*t + b*t + c = 0 in [0, t_max]
+inline bool triangle3D_lowest_root(real32* t, real32 a, real32 b, real32 c, real32 t_max)
+{
+ if(std::abs(a) < std::numeric_limits<real32>::min()) return false;
+ real32 det = b*b - 4.0f*a*c;
+ if(det < 0.0f) return false;
+ real32 root = std::sqrt(det);
+ real32 r1 = (-b - root)/(2.0f*a);
+ real32 r2 = (-b + root)/(2.0f*a);
+ if(r2 < r1) std::swap(r1, r2);
+ if(r1 < 0.0f || t_max < r1) return false;
+ *t = r1;
+ return true;
+}
+
+/** \brief   Swept Sphere-Triangle Intersection.
+ *  \details Moves a sphere centered at point (O) with radius (r) along vector (V) and finds the
+ *           first time (t) it touches the two-sided triangle (A, B, C). On input, t is the
+ *           largest time accepted. On output, t is the time of impact and X is the contact point
+ *           on the triangle. The sphere first touches the face when it reaches the plane with its
+ *           center above the triangle; otherwise it touches one of the edges or vertices. A
+ *           sphere that already touches the triangle has a time of impact of zero.
+ */
+inline bool sphere3D_triangle_sweep(real32* t, real32* X, const real32* O, real32 r, const real32* V, const real32* A, const real32* B, const real32* C)
+{
+ const real32* P[3] = { A, B, C };
+ real32 t_max = *t;
+ real32 rr = r*r;
+
+ // triangle plane
+ real32 e1[3] = { B[0] - A[0], B[1] - A[1], B[2] - A[2] };
+ real32 e2[3] = { C[0] - A[0], C[1] - A[1], C[2] - A[2] };
+ real32 N[3];
+ vector3D_vector_product(N, e1, e2);
+ real32 N_length = vector3D_norm(N);
+
+ // face
+ if(N_length > std::numeric_limits<real32>::min())
+   {
+    N[0] /= N_length;
+    N[1] /= N_length;
+    N[2] /= N_length;
+
+    // interval of time where sphere touches plane
+    real32 s[3] = { O[0] - A[0], O[1] - A[1], O[2] - A[2] };
+    real32 distance = vector3D_scalar_product(N, s);
+    real32 NV = vector3D_scalar_product(N, V);
+    real32 t0 = 0.0f;
+    if(std::abs(NV) < epsilon()) {
+       // moving parallel to plane and never touching it (so edges and vertices can't be hit)
+       if(std::abs(distance) > r) return false;
+      }
+    else {
+       t0 = (r - distance)/NV;
+       real32 t1 = (-r - distance)/NV;
+       if(t1 < t0) std::swap(t0, t1);
+       if(t1 < 0.0f || t_max < t0) return false;
+       if(t0 < 0.0f) t0 = 0.0f;
+      }
+
+    // when the sphere first touches the plane, the center projected onto the plane must be
+    // inside the triangle for a face hit (and then no edge or vertex can be hit any earlier)
+    real32 Q[3] = { O[0] + t0*V[0], O[1] + t0*V[1], O[2] + t0*V[2] };
+    real32 q[3] = { Q[0] - A[0], Q[1] - A[1], Q[2] - A[2] };
+    real32 d = vector3D_scalar_product(N, q);
+    Q[0] -= d*N[0];
+    Q[1] -= d*N[1];
+    Q[2] -= d*N[2];
+    bool inside = true;
+    for(int i = 0; i < 3 && inside; i++) {
+        const real32* P1 = P[i];
+        const real32* P2 = P[(i + 1) % 3];
+        real32 edge[3] = { P2[0] - P1[0], P2[1] - P1[1], P2[2] - P1[2] };
+        real32 w[3] = { Q[0] - P1[0], Q[1] - P1[1], Q[2] - P1[2] };
+        real32 c[3];
+        vector3D_vector_product(c, edge, w);
+        if(vector3D_scalar_product(c, N) < 0.0f) inside = false;
+       }
+    if(inside) {
+       *t = t0;
+       X[0] = Q[0];
+       X[1] = Q[1];
+       X[2] = Q[2];
+       return true;
+      }
+   }
+
+ // vertices
+ bool hit = false;
+ real32 VV = vector3D_squared_norm(V);
+ for(int i = 0; i < 3; i++) {
+     real32 s[3] = { O[0] - P[i][0], O[1] - P[i][1], O[2] - P[i][2] };
+     real32 a = VV;
+     real32 b = 2.0f*vector3D_scalar_product(V, s);
+     real32 c = vector3D_squared_norm(s) - rr;
+     real32 root = 0.0f;
+     if(c <= 0.0f || triangle3D_lowest_root(&root, a, b, c, t_max)) {
+        t_max = root;
+        X[0] = P[i][0];
+        X[1] = P[i][1];
+        X[2] = P[i][2];
+        hit = true;
+       }
+    }
+
+ // edges
+ for(int i = 0; i < 3; i++)
+    {
+     const real32* P1 = P[i];
+     const real32* P2 = P[(i + 1) % 3];
+     real32 E[3] = { P2[0] - P1[0], P2[1] - P1[1], P2[2] - P1[2] };
+     real32 s[3] = { O[0] - P1[0], O[1] - P1[1], O[2] - P1[2] };
+     real32 EE = vector3D_squared_norm(E);
+     real32 EV = vector3D_scalar_product(E, V);
+     real32 Es = vector3D_scalar_product(E, s);
+     if(EE < std::numeric_limits<real32>::min()) continue;
+
+     // distance from center to infinite line through edge equals radius
+     real32 a = EE*VV - EV*EV;
+     real32 b = 2.0f*(EE*vector3D_scalar_product(V, s) - EV*Es);
+     real32 c = EE*(vector3D_squared_norm(s) - rr) - Es*Es;
+     real32 root = 0.0f;
+     if(!(c <= 0.0f) && !triangle3D_lowest_root(&root, a, b, c, t_max)) continue;
+
+     // hit point must be on the edge segment
+     real32 f = (Es + root*EV)/EE;
+     if(f < 0.0f || f > 1.0f) continue;
+     t_max = root;
+     X[0] = P1[0] + f*E[0];
+     X[1] = P1[1] + f*E[1];
+     X[2] = P1[2] + f*E[2];
+     hit = true;
+    }
+
+ if(hit) *t = t_max;
+ return hit;
+}
+
+#pragma endregion TRIANGLE_FUNCTIONS
+
+#endif